@@ -0,0 +1,127 @@
+"""
+Measures how the throughput scales if several SMUs are driven from several python threads of the same process.
+The bindings release the GIL while they wait for the instrument, so N threads driving N devices should reach N times
+the throughput of a single thread, as long as the instruments are the bottleneck.
+
+By default, the devices are simulated by a local server running in a separate process, which answers every print
+statement after a configurable latency. Pass the IP addresses of real SMUs with --ip to measure them instead.
+Each device must only be used by one thread at a time.
+
+Example:
+    python multithreading_benchmark.py --threads 1 2 4 8 --calls 200 --latency 5
+"""
+
+import argparse
+import asyncio
+import multiprocessing
+import threading
+import time
+
+from py_instrument_control_lib import *
+
+port = 5025
+timeout = 2000
+
+
+def simulate_smus(latency_ms, ready):
+    """
+    Runs a TCP server on the SMU port, which replies to every line containing a print statement after the given
+    latency. All connections are served concurrently, so every connection behaves like a separate instrument.
+    :param latency_ms: The time in milliseconds until a reply is sent.
+    :param ready: Event, which is set as soon as the server accepts connections.
+    """
+
+    async def handle(reader, writer):
+        while line := await reader.readline():
+            if b'print(' not in line:
+                continue
+            await asyncio.sleep(latency_ms / 1000)
+            # The error count is appended if the error queue is checked within the same reply.
+            writer.write(b'1.00000e-03\t0.00000e+00\n' if b'errorqueue.count' in line else b'1.00000e-03\n')
+            await writer.drain()
+        writer.close()
+
+    async def serve():
+        server = await asyncio.start_server(handle, '127.0.0.1', port)
+        ready.set()
+        async with server:
+            await server.serve_forever()
+
+    asyncio.run(serve())
+
+
+def drive_smu(smu, calls, barrier):
+    """
+    Performs the given number of measurements, which each require a round trip to the instrument.
+    :param smu: The connected smu object.
+    :param calls: The number of measurements.
+    :param barrier: Barrier, which lets all threads start at the same time.
+    """
+    barrier.wait()
+    for _ in range(calls):
+        smu.measure(SMU_UNIT.VOLTAGE, SMU_CHANNEL.CHANNEL_A, False)
+
+
+def run_benchmark(ips, calls):
+    """
+    Drives every device from its own thread and measures the total throughput.
+    :param ips: The IP addresses of the devices, one thread is started per device.
+    :param calls: The number of measurements per device.
+    :return: The number of measurements per second of all threads together.
+    """
+    smus = [KEI2600(ip, timeout, SEND_METHOD.DIRECT_SEND) for ip in ips]
+    for smu in smus:
+        if smu.connect() != ERROR_CODE.NO_ERROR:
+            raise RuntimeError('Could not connect to the SMU.')
+
+    barrier = threading.Barrier(len(smus) + 1)
+    threads = [threading.Thread(target=drive_smu, args=(smu, calls, barrier)) for smu in smus]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for thread in threads:
+        thread.join()
+    duration = time.perf_counter() - start
+
+    for smu in smus:
+        smu.disconnect()
+    return len(smus) * calls / duration
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--threads', type=int, nargs='+', default=[1, 2, 4, 8],
+                        help='numbers of threads to measure, each thread drives its own device')
+    parser.add_argument('--calls', type=int, default=200, help='measurements per thread')
+    parser.add_argument('--latency', type=float, default=5, help='latency of the simulated SMUs in milliseconds')
+    parser.add_argument('--ip', nargs='+', help='IP addresses of real SMUs, at least as many as threads')
+    args = parser.parse_args()
+
+    simulator = None
+    if not args.ip:
+        ready = multiprocessing.Event()
+        simulator = multiprocessing.Process(target=simulate_smus, args=(args.latency, ready), daemon=True)
+        simulator.start()
+        if not ready.wait(10):
+            raise RuntimeError('The simulated SMUs did not start.')
+
+    try:
+        baseline = None
+        print(f'{"threads":>8} {"calls/s":>12} {"speedup":>8} {"efficiency":>11}')
+        for thread_count in args.threads:
+            ips = args.ip[:thread_count] if args.ip else ['127.0.0.1'] * thread_count
+            if len(ips) < thread_count:
+                raise ValueError('Pass at least as many IP addresses as threads.')
+            throughput = run_benchmark(ips, args.calls)
+            if baseline is None:
+                baseline = throughput / thread_count
+            speedup = throughput / baseline
+            print(f'{thread_count:>8} {throughput:>12.1f} {speedup:>8.2f} {speedup / thread_count:>10.0%}')
+    finally:
+        if simulator:
+            simulator.terminate()
+
+
+if __name__ == "__main__":
+    main()
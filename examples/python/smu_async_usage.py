@@ -0,0 +1,64 @@
+"""
+Shows how to drive several instruments concurrently from a single asyncio event loop.
+Every *Async method returns an awaitable future. The call is executed on the I/O thread of the device, so the event
+loop is never blocked and the calls of different devices run in parallel. The calls of one device are executed in
+the order they were submitted. Do not use the synchronous methods of a device while its async calls are pending.
+"""
+
+import asyncio
+
+from py_instrument_control_lib import *
+
+smu_ips = ["132.231.14.168", "132.231.14.169"]
+timeout = 2000
+checkErrorBuffer = False
+
+
+def check_error_code(code):
+    """
+    Checks if an error occured. If so raises an Error to exit the program.
+    :param code: The error code returned by the last command.
+    """
+    if code != ERROR_CODE.NO_ERROR:
+        print('The last function returned an error code indicating something went wrong.')
+        raise RuntimeError()
+
+
+async def sweep_smu(smu, levels):
+    """
+    Applies every voltage level to CHANNEL_A and measures the resulting current.
+    :param smu: The connected smu object.
+    :param levels: The voltage levels to apply.
+    :return: The measured currents.
+    """
+    check_error_code(await smu.turnOn_async(SMU_CHANNEL.CHANNEL_A, checkErrorBuffer))
+    currents = []
+    try:
+        for level in levels:
+            ret, current, _ = await smu.setLevelAndMeasure_async(SMU_UNIT.VOLTAGE, SMU_CHANNEL.CHANNEL_A, level,
+                                                                 SMU_UNIT.CURRENT, checkErrorBuffer)
+            check_error_code(ret)
+            currents.append(current)
+    finally:
+        # Turning off is executed before all other waiting calls of the device.
+        check_error_code(await smu.turnOff_async(SMU_CHANNEL.CHANNEL_A, checkErrorBuffer))
+    return currents
+
+
+async def main():
+    smus = [KEI2600(ip, timeout, SEND_METHOD.DIRECT_SEND) for ip in smu_ips]
+    for smu in smus:
+        check_error_code(smu.connect())
+
+    levels = [i / 10 for i in range(10)]
+    results = await asyncio.gather(*(sweep_smu(smu, levels) for smu in smus))
+    for ip, currents in zip(smu_ips, results):
+        print(f'{ip}: {currents}')
+
+    for smu in smus:
+        smu.stopIOThread()
+        check_error_code(smu.disconnect())
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
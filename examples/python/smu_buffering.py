@@ -63,7 +63,7 @@ def use_smu(smu):
     time.sleep(5)  # Wait for script to finish running
 
     # If there are measurements when buffering, the values are saved in a channel buffer. They are saved in the order
-    # they are measured in a list. You have to manually make sense of these values (see below). These values can be
+    # they are measured in a numpy array. You have to manually make sense of these values (see below). These values can be
     # retrieved after executing the buffered script.
     values_channel_a = smu.getBuffer(smu.CHANNEL_A_BUFFER, False)
     print(f'Measured the following values when executing buffered Script: {values_channel_a}')
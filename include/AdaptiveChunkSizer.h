@@ -0,0 +1,49 @@
+/**
+ * @brief Helper to select the number of values requested per round trip, when large data sets are transferred
+ * from a device in multiple chunks.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_ADAPTIVE_CHUNK_SIZER_H
+#define INSTRUMENT_CONTROL_LIB_ADAPTIVE_CHUNK_SIZER_H
+
+#include <chrono> // std::chrono::duration
+#include <cstddef> // size_t
+
+/**
+ * @brief Calculates the chunk size of multi round trip transfers based on the observed round trip time and the
+ * observed throughput. The chunk size is chosen so that the transfer of a chunk takes significantly longer than
+ * the round trip time, which keeps the protocol overhead small without requesting unbounded replies.
+ */
+class AdaptiveChunkSizer
+{
+public:
+    explicit AdaptiveChunkSizer(size_t minChunkSize = 64, size_t maxChunkSize = 1 << 20,
+                                double rttFactor = 20.0);
+
+    void reset(std::chrono::duration<double> roundTripTime, double bytesPerValue, size_t initialChunkSize);
+    void update(size_t values, size_t bytes, std::chrono::duration<double> elapsed);
+
+    [[nodiscard]] size_t getChunkSize() const;
+    [[nodiscard]] double getRoundTripTime() const;
+    [[nodiscard]] double getThroughput() const;
+
+private:
+    /** Lower bound of the number of values per chunk. **/
+    size_t m_MinChunkSize;
+    /** Upper bound of the number of values per chunk. **/
+    size_t m_MaxChunkSize;
+    /** A chunk should take rttFactor times the round trip time to transfer. **/
+    double m_RTTFactor;
+
+    /** Round trip time in seconds. **/
+    double m_RoundTripTime = 0;
+    /** Average number of bytes which are required to transfer a single value. **/
+    double m_BytesPerValue = 1;
+    /** Observed throughput in bytes per second, 0 if not measured yet. **/
+    double m_Throughput = 0;
+    /** Currently selected number of values per chunk. **/
+    size_t m_ChunkSize;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_ADAPTIVE_CHUNK_SIZER_H
@@ -0,0 +1,57 @@
+/**
+ * @brief Streaming export of numeric columns as CSV file.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_CSV_WRITER_H
+#define INSTRUMENT_CONTROL_LIB_CSV_WRITER_H
+
+#include "ctlib/ErrorCodeDefines.h"
+
+#include <cstdio> // FILE
+#include <string> // std::string
+#include <vector> // std::vector
+
+/**
+ * @brief Writes columns of doubles as CSV without building the file in memory. Values are formatted with
+ * std::to_chars into buffers of fixed size, which are written with large write calls as soon as they are full.
+ * Large exports are split into blocks of rows, which are formatted by multiple threads and written in order.
+ * NaN values are written as empty fields, e.g. for holes of a waveform.
+ */
+class CSVWriter
+{
+public:
+    /**
+     * @brief Column to export. The values must stay valid until writeColumns returns.
+     */
+    struct Column {
+        std::string name;
+        const double *values;
+        /** Factor applied to every value, e.g. 1000 to export seconds as milliseconds. **/
+        double scale = 1;
+    };
+
+    explicit CSVWriter(unsigned threadCount = 0, size_t rowsPerBlock = 1 << 16);
+    ~CSVWriter();
+
+    CSVWriter(const CSVWriter &) = delete;
+    CSVWriter &operator=(const CSVWriter &) = delete;
+
+    PIL_ERROR_CODE open(const std::string &filePath);
+    PIL_ERROR_CODE writeColumns(const std::vector<Column> &columns, size_t rows, bool writeHeader = true);
+    PIL_ERROR_CODE close();
+
+    static PIL_ERROR_CODE writeFile(const std::string &filePath, const std::vector<Column> &columns, size_t rows);
+    static size_t formatRows(const std::vector<Column> &columns, size_t firstRow, size_t lastRow, std::string *buffer);
+
+private:
+    PIL_ERROR_CODE writeBuffer(const std::string &buffer);
+
+    std::FILE *m_File = nullptr;
+    unsigned m_ThreadCount;
+    size_t m_RowsPerBlock;
+    /** One formatting buffer per thread, reused for all blocks. **/
+    std::vector<std::string> m_Buffers;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_CSV_WRITER_H
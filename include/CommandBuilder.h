@@ -0,0 +1,54 @@
+/**
+ * @brief Builder to assemble commands in a reusable buffer without temporary strings.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_COMMAND_BUILDER_H
+#define INSTRUMENT_CONTROL_LIB_COMMAND_BUILDER_H
+
+#include <string> // std::string
+#include <string_view> // std::string_view
+#include <cstddef> // size_t
+
+/**
+ * @brief The CommandBuilder writes all parts of a command directly into one buffer, which keeps its capacity when
+ * it is cleared. Fixed parts are passed as string literals, whose length is known at compile time, numbers are
+ * formatted with std::to_chars. E.g. smua.source.levelv = 0.5 can be written as:
+ * @code{.cpp}
+ * builder.clear().Add("smu").Add('a').Add(".source.levelv = ").Add(0.5);
+ * @endcode
+ * After the first commands were built, no further allocations are required.
+ */
+class CommandBuilder
+{
+public:
+    explicit CommandBuilder(size_t initialCapacity = 256);
+
+    CommandBuilder &clear();
+
+    /**
+     * @brief Appends a string literal. The length is deduced at compile time, so no strlen is required.
+     * @param literal string literal to append.
+     * @return this object to allow a chain of calls.
+     */
+    template<size_t N>
+    CommandBuilder &Add(const char (&literal)[N]) {
+        m_Buffer.append(literal, N - 1);
+        return *this;
+    }
+
+    CommandBuilder &Add(std::string_view str);
+    CommandBuilder &Add(char c);
+    CommandBuilder &Add(int value);
+    CommandBuilder &Add(size_t value);
+    CommandBuilder &Add(double value);
+
+    [[nodiscard]] std::string &str();
+    [[nodiscard]] std::string_view view() const;
+    [[nodiscard]] bool empty() const;
+
+private:
+    std::string m_Buffer;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_COMMAND_BUILDER_H
@@ -0,0 +1,107 @@
+/**
+ * @brief Continuous acquisition of waveforms with a background thread.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_CONTINUOUS_ACQUISITION_H
+#define INSTRUMENT_CONTROL_LIB_CONTINUOUS_ACQUISITION_H
+
+#include "devices/KST3000.h"
+#include "SPSCRing.h"
+#include "WaveformConverter.h"
+
+#include <atomic> // std::atomic
+#include <chrono> // std::chrono::steady_clock
+#include <condition_variable> // std::condition_variable
+#include <cstdint> // uint8_t, uint64_t
+#include <functional> // std::function
+#include <mutex> // std::mutex
+#include <string> // std::string
+#include <thread> // std::thread
+#include <vector> // std::vector
+
+/**
+ * @brief Single acquisition of the waveform source. The buffers are allocated once and reused for every frame.
+ */
+struct WaveformFrame {
+    /** Number of the acquisition since start, frames dropped because all slots were in use are counted as well. **/
+    uint64_t sequence = 0;
+    /** Time at which the completed acquisition was detected. **/
+    std::chrono::steady_clock::time_point timestamp;
+    /** Raw BYTE or WORD samples as received from the device. **/
+    std::vector<uint8_t> samples;
+    /** Converted voltages, see WaveformConverter. **/
+    std::vector<float> voltages;
+    /** Validity bitmask of the voltages, see WaveformConverter::isValid. **/
+    std::vector<uint8_t> validMask;
+};
+
+/**
+ * @brief Captures waveforms of a KST3000 back to back. The acquisition thread arms the device with single, waits
+ * until the acquisition is complete, reads the raw samples into a free frame of a lock-free ring and re-arms the
+ * device before the frame is handed to the consumer. Converting and storing a frame therefore overlaps with waiting
+ * for the next trigger, and the dead time between two captures is reduced to the transfer of the raw samples.
+ * Frames are consumed either by a callback, which is called from a separate consumer thread, or by calling
+ * nextFrame and releaseFrame from a single thread. If all frames wait for the consumer, new acquisitions are not
+ * transferred and counted as dropped. Exceptions of the device or the callback end the acquisition, they are
+ * reported by getLastError and getLastErrorMessage.
+ * The preamble is read once at start, so the settings of the device must not change while the acquisition is
+ * running. The device must not be used by other threads until stop returns.
+ */
+class ContinuousAcquisition
+{
+public:
+    /** Called for every frame, the frame is only valid until the callback returns. **/
+    typedef std::function<void(const WaveformFrame &frame)> FrameCallback;
+
+    explicit ContinuousAcquisition(KST3000 *device, size_t frameCount = 8);
+    ~ContinuousAcquisition();
+
+    ContinuousAcquisition(const ContinuousAcquisition &) = delete;
+    ContinuousAcquisition &operator=(const ContinuousAcquisition &) = delete;
+
+    PIL_ERROR_CODE start(FrameCallback callback = nullptr);
+    PIL_ERROR_CODE stop();
+
+    const WaveformFrame *nextFrame(int timeoutInMs);
+    void releaseFrame();
+
+    [[nodiscard]] bool isRunning() const;
+    [[nodiscard]] uint64_t getAcquiredCount() const;
+    [[nodiscard]] uint64_t getDroppedCount() const;
+    [[nodiscard]] PIL_ERROR_CODE getLastError() const;
+    [[nodiscard]] std::string getLastErrorMessage() const;
+    [[nodiscard]] const WaveformPreamble &getPreamble() const;
+
+private:
+    void acquire();
+    void consume();
+    bool waitForFrame(int timeoutInMs);
+    void convert(WaveformFrame *frame) const;
+    void notifyConsumer();
+    void setError(PIL_ERROR_CODE errorCode, const char *message);
+
+    KST3000 *m_Device;
+    SPSCRing<WaveformFrame> m_Frames;
+    FrameCallback m_Callback;
+    WaveformPreamble m_Preamble;
+    WaveformConverter::SAMPLE_FORMAT m_SampleFormat = WaveformConverter::BYTE_SAMPLES;
+
+    std::atomic<bool> m_Running{false};
+    std::atomic<uint64_t> m_AcquiredCount{0};
+    std::atomic<uint64_t> m_DroppedCount{0};
+    std::atomic<PIL_ERROR_CODE> m_LastError{PIL_NO_ERROR};
+    /** Message of the exception, which ended the acquisition. **/
+    std::string m_LastErrorMessage;
+    mutable std::mutex m_ErrorMutex;
+
+    /** Set while the consumer waits for a frame, so the acquisition thread only locks the mutex if required. **/
+    std::atomic<bool> m_ConsumerSleeping{false};
+    std::mutex m_SleepMutex;
+    std::condition_variable m_FrameAvailable;
+
+    std::thread m_AcquisitionThread;
+    std::thread m_ConsumerThread;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_CONTINUOUS_ACQUISITION_H
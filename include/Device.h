@@ -9,12 +9,21 @@
 
 
 #include "ExecArgs.h"
+#include "CommandBuilder.h"
+#include "DeviceIOThread.h"
 #include "ctlib/Logging.hpp"
 #include "ctlib/Exception.h"
 
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <type_traits>
 
 namespace PIL
 {
@@ -22,6 +31,8 @@ namespace PIL
     class Logging;
 }
 
+class HTTPSession;
+
 /**
  * @class Device
  * @brief Basic device class
@@ -35,24 +46,49 @@ public:
         BUFFER_ENABLED = 1
     };
 
+    /** Lane of a task submitted to the I/O thread. **/
+    enum PRIORITY {
+        NORMAL_PRIORITY = 0,
+        HIGH_PRIORITY = 1
+    };
+
+    /** Identifies a command queued by ExecAsync, used to retrieve its result after Flush. **/
+    typedef uint64_t ExecTicket;
+
     explicit Device(std::string ipAddress, int timeoutInMs, SEND_METHOD mode = DIRECT_SEND, bool throwException = true);
     explicit Device(std::string ipAddress, int timeoutInMs, PIL::Logging *logger, SEND_METHOD mode = DIRECT_SEND,
                     bool throwException = true);
     explicit Device(std::string ipAddress, uint16_t srcPort, uint16_t destPort, int timeoutInMs, PIL::Logging *logger,
                     SEND_METHOD mode = DIRECT_SEND, bool throwException = true);
-    ~Device();
+    virtual ~Device();
 
     PIL_ERROR_CODE Connect();
     PIL_ERROR_CODE Disconnect();
     [[nodiscard]] bool isOpen() const;
     [[nodiscard]] bool isBuffered() const;
+    [[nodiscard]] const std::string &getIPAddress() const;
+    [[nodiscard]] int getPort() const;
+    [[nodiscard]] int getTimeout() const;
 
     std::string getDeviceIdentifier();
     PIL_ERROR_CODE Exec(const std::string& command, ExecArgs *args = nullptr, char *result = nullptr, bool br = true,
                         int size = 1024);
     PIL_ERROR_CODE Exec(const std::string &command, ExecArgs *args, std::string *result, bool br);
+    PIL_ERROR_CODE Exec(CommandBuilder &command, std::string *result = nullptr);
     PIL_ERROR_CODE ExecCommands(std::string &commands);
 
+    PIL_ERROR_CODE QueryBinaryBlock(const std::string &command, uint8_t *buffer, size_t capacity, size_t *length);
+    PIL_ERROR_CODE QueryBinaryBlock(const std::string &command, std::vector<uint8_t> *data);
+    PIL_ERROR_CODE QueryBinaryBlockToFile(const std::string &command, const std::string &filePath,
+                                          size_t *length = nullptr);
+    static bool parseBinaryBlockHeader(std::string_view header, size_t *length);
+
+    ExecTicket ExecAsync(const std::string &command, ExecArgs *args = nullptr, bool expectResult = true,
+                         bool br = true);
+    PIL_ERROR_CODE Flush();
+    PIL_ERROR_CODE GetResult(ExecTicket ticket, std::string *result);
+    [[nodiscard]] size_t getPendingCommandCount() const;
+
     std::string ReturnErrorMessage();
 
     std::string getBufferedScript();
@@ -61,16 +97,83 @@ public:
 
     PIL_ERROR_CODE delay(double delayTime);
 
+    void startIOThread();
+    void stopIOThread();
+    [[nodiscard]] bool isIOThreadRunning() const;
+
+    void setStateShadowEnabled(bool enable);
+    void invalidateState();
+
+    /**
+     * @brief Executes a function on the I/O thread of this device and returns its result as future. Exceptions are
+     * forwarded to the future. While the I/O thread is running, all calls to this device must be submitted, then
+     * several threads can share the connection. If the I/O thread is not running, or this function is called from
+     * the I/O thread, the function is executed immediately. While the I/O thread is stopped, this function waits
+     * until it was joined, so the function never runs concurrently with the remaining functions of the I/O thread.
+     * @param function function to execute, e.g. [&smu]() { return smu.turnOff(SMU::CHANNEL_A); }.
+     * @param priority HIGH_PRIORITY to execute the function before all waiting functions of normal priority, e.g.
+     * to turn off an output during a long buffer download.
+     * @return future containing the result of the function.
+     */
+    template<typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function, PRIORITY priority = NORMAL_PRIORITY) {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+        auto future = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(m_IOThreadMutex);
+            m_IOThreadStopped.wait(lock, [this]() {
+                return !m_IOThreadStopping || m_IOThread->isCurrentThread();
+            });
+            if (m_IOThread && !m_IOThread->isCurrentThread()) {
+                m_IOThread->submit([task]() { (*task)(); }, priority == HIGH_PRIORITY
+                                                            ? DeviceIOThread::HIGH_PRIORITY_LANE
+                                                            : DeviceIOThread::NORMAL_LANE);
+                return future;
+            }
+        }
+        // Executed without the lock, the function may submit further functions or stop the I/O thread.
+        (*task)();
+        return future;
+    }
+
 protected:
     PIL_ERROR_CODE handleErrorsAndLogging(PIL_ERROR_CODE errorCode, bool throwException, PIL::Level logLevel,
                                           const std::string& fileName, int line, std::string formatStr, ...);
 
+    CommandBuilder &newCommand();
+    PIL_ERROR_CODE sendAndReceive(std::string &message, std::string *result);
+    [[nodiscard]] std::string_view getLastMessage() const;
+
     static bool errorOccured(PIL_ERROR_CODE errorCode);
-    static PIL_ERROR_CODE postRequest(const std::string &url, std::string &payload);
+    std::string createMessage(const std::string &command, ExecArgs *args, bool br) const;
+    PIL_ERROR_CODE postRequest(const std::string &url, std::string &payload);
+    PIL_ERROR_CODE postRequests(const std::string &url, const std::vector<std::string> &payloads);
     static std::string vectorToStringNL(std::vector<std::string> vector);
     static std::string replaceAllSubstrings(std::string str, const std::string &from, const std::string &to);
     static std::vector<std::string> splitString(const std::string &toSplit, const std::string &delimiter);
 
+    void runPriorityTasks();
+    [[nodiscard]] bool hasPriorityTasks() const;
+
+    void invalidateSettings();
+    virtual void invalidateCachedState();
+    [[nodiscard]] virtual bool isReset(std::string_view message) const;
+    static bool containsCommand(std::string_view message, std::string_view command);
+
+    bool isStateUnchanged(std::string_view key, double value) const;
+    bool isStateUnchanged(std::string_view key, std::string_view value) const;
+    void updateState(std::string_view key, double value, PIL_ERROR_CODE result);
+    void updateState(std::string_view key, std::string_view value, PIL_ERROR_CODE result);
+    void invalidateState(std::string_view key);
+
+    PIL_ERROR_CODE receiveBytes(uint8_t *buffer, size_t length);
+    PIL_ERROR_CODE receiveLine(std::string *line);
+    PIL_ERROR_CODE sendBinaryBlockQuery(const std::string &command, size_t *length, bool *indefinite);
+    PIL_ERROR_CODE receiveBinaryBlockHeader(size_t *length, bool *indefinite);
+    PIL_ERROR_CODE receiveBinaryBlockEnd();
+    PIL_ERROR_CODE discardBinaryBlock(size_t length);
+    void closeDesynchronizedConnection(const char *reason);
+
     std::string m_IPAddr;
     PIL_ErrorHandle m_ErrorHandle;
     std::string m_DeviceName{};
@@ -81,6 +184,46 @@ protected:
     bool m_EnableExceptions;
     SEND_METHOD m_SendMode;
     std::vector<std::string> m_BufferedScript;
+    /** Bytes which were received from the socket, but not yet consumed by receiveLine or receiveBytes. **/
+    std::string m_ReceiveBuffer;
+
+private:
+    PIL_ERROR_CODE getHTTPSession(const std::string &url, HTTPSession **session, std::string *path);
+    void invalidateStateOnReset(std::string_view message);
+
+    int m_TimeoutInMs;
+    /** Keep-alive connection to the web interface of the device, created with the first post request. **/
+    std::unique_ptr<HTTPSession> m_HTTPSession;
+    std::string m_HTTPHost;
+    int m_HTTPPort = 0;
+    /** Thread executing submitted functions, only created by startIOThread. **/
+    std::unique_ptr<DeviceIOThread> m_IOThread;
+    /** Guards m_IOThread, so Submit can be called while another thread starts or stops the I/O thread. **/
+    mutable std::mutex m_IOThreadMutex;
+    /** Set while stopIOThread joins the I/O thread, which remains in m_IOThread until then. **/
+    bool m_IOThreadStopping = false;
+    /** Notified when stopIOThread cleared m_IOThreadStopping. **/
+    std::condition_variable m_IOThreadStopped;
+    /** Copy of the last message sent by sendAndReceive. **/
+    std::string m_LastMessage;
+    /** Reused to assemble commands passed as string and ExecArgs. **/
+    std::string m_MessageBuffer;
+    /** Reused to assemble commands of frequently called functions, see newCommand. **/
+    CommandBuilder m_CommandBuilder;
+    /** Last value written by a setter for every setting, e.g. "smua.source.limitv = " -> "0.1". **/
+    std::map<std::string, std::string, std::less<>> m_StateShadow;
+    bool m_StateShadowEnabled = true;
+
+    /** Command queued by ExecAsync, which is sent with the next Flush. **/
+    struct PendingCommand {
+        ExecTicket ticket;
+        std::string message;
+        bool expectsResult;
+    };
+
+    std::vector<PendingCommand> m_PendingCommands;
+    std::unordered_map<ExecTicket, std::string> m_PipelinedResults;
+    ExecTicket m_NextTicket = 1;
 };
 
 #endif //CE_DEVICE_DEVICE_H
@@ -0,0 +1,62 @@
+/**
+ * @brief Thread, which executes all operations of one device in submission order.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_DEVICE_IO_THREAD_H
+#define INSTRUMENT_CONTROL_LIB_DEVICE_IO_THREAD_H
+
+#include "MPSCQueue.h"
+
+#include <atomic> // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <functional> // std::function
+#include <mutex> // std::mutex
+#include <thread> // std::thread
+
+/**
+ * @brief Serves two lock-free submission queues from a dedicated thread. Tasks of the high priority lane are
+ * executed before any waiting task of the normal lane. A running task is not interrupted, but long running tasks
+ * can call runPriorityTasks between their steps. The mutex is only used to put the idle thread to sleep, submitting
+ * a task never waits for a running task.
+ */
+class DeviceIOThread
+{
+public:
+    /** Work item executed on the I/O thread. **/
+    typedef std::function<void()> Task;
+
+    enum LANE {
+        NORMAL_LANE = 0,
+        HIGH_PRIORITY_LANE = 1
+    };
+
+    DeviceIOThread();
+    ~DeviceIOThread();
+
+    DeviceIOThread(const DeviceIOThread &) = delete;
+    DeviceIOThread &operator=(const DeviceIOThread &) = delete;
+
+    void submit(Task task, LANE lane = NORMAL_LANE);
+    void runPriorityTasks();
+    [[nodiscard]] bool hasPriorityTasks() const;
+    void stop();
+
+    [[nodiscard]] bool isCurrentThread() const;
+
+private:
+    void run();
+    bool runNextTask();
+
+    MPSCQueue<Task> m_HighPriorityQueue;
+    MPSCQueue<Task> m_NormalQueue;
+
+    std::atomic<bool> m_Running{true};
+    /** Set while the thread waits for new tasks, so producers only lock the mutex if a wakeup is required. **/
+    std::atomic<bool> m_Sleeping{false};
+    std::mutex m_SleepMutex;
+    std::condition_variable m_WakeUp;
+    std::thread m_Thread;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_DEVICE_IO_THREAD_H
@@ -0,0 +1,77 @@
+/**
+ * @brief Minimal HTTP/1.1 client, which keeps a single connection to a device alive.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_HTTP_SESSION_H
+#define INSTRUMENT_CONTROL_LIB_HTTP_SESSION_H
+
+#include "ctlib/ErrorCodeDefines.h"
+
+#include <memory> // std::unique_ptr
+#include <string> // std::string
+#include <vector> // std::vector
+
+namespace PIL {
+    class Socket;
+    class Logging;
+}
+
+/**
+ * @brief The HTTPSession sends POST requests over one persistent connection. Multiple requests can be pipelined,
+ * i.e. all requests are written to the socket before the responses are read in order. If the server closes the
+ * connection, the session reconnects and resends the requests, which were not answered yet, as long as the server
+ * did not process them or the requests are idempotent.
+ */
+class HTTPSession
+{
+public:
+    /**
+     * @brief Status, body and latency of a single response.
+     */
+    struct Response {
+        /** HTTP status code, e.g. 200. **/
+        int statusCode = 0;
+        /** Body of the response. **/
+        std::string body;
+        /** Time from sending the request, or receiving the previous response, to receiving this response in ms. **/
+        double latencyInMs = 0;
+    };
+
+    HTTPSession(std::string host, int port, int timeoutInMs, PIL::Logging *logger = nullptr);
+    ~HTTPSession();
+
+    PIL_ERROR_CODE post(const std::string &path, const std::string &payload, Response *response = nullptr);
+    PIL_ERROR_CODE postPipelined(const std::string &path, const std::vector<std::string> &payloads,
+                                 std::vector<Response> *responses = nullptr, bool idempotent = false,
+                                 size_t *firstUnconfirmed = nullptr);
+    void close();
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] double getLastLatency() const;
+
+    static bool parseResponseHeader(const std::string &header, int *statusCode, size_t *contentLength,
+                                    bool *chunked, bool *keepAlive);
+
+private:
+    PIL_ERROR_CODE connect();
+    void appendRequest(const std::string &path, const std::string &payload, std::string *message) const;
+    PIL_ERROR_CODE receiveResponse(Response *response, bool *keepAlive);
+    PIL_ERROR_CODE receiveUntil(const std::string &delimiter, std::string *result);
+    PIL_ERROR_CODE receiveExactly(size_t length, std::string *result);
+    PIL_ERROR_CODE receiveChunkedBody(std::string *body);
+    PIL_ERROR_CODE fillReceiveBuffer();
+
+    std::string m_Host;
+    int m_Port;
+    int m_TimeoutInMs;
+    PIL::Logging *m_Logger;
+
+    std::unique_ptr<PIL::Socket> m_Socket;
+    bool m_Open = false;
+    /** Bytes received after the end of the last response, e.g. the beginning of the next pipelined response. **/
+    std::string m_ReceiveBuffer;
+    double m_LastLatency = 0;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_HTTP_SESSION_H
@@ -0,0 +1,182 @@
+/**
+ * @brief Single threaded event loop, which serves the socket connections of many devices.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_IO_REACTOR_H
+#define INSTRUMENT_CONTROL_LIB_IO_REACTOR_H
+
+#include "ctlib/ErrorCodeDefines.h"
+
+#include <chrono> // std::chrono::steady_clock
+#include <deque> // std::deque
+#include <functional> // std::function
+#include <memory> // std::unique_ptr
+#include <string> // std::string
+#include <unordered_map> // std::unordered_map
+#include <vector> // std::vector
+
+#if defined(__cpp_impl_coroutine)
+#include <atomic> // std::atomic
+#include <coroutine> // std::coroutine_handle
+#include <exception> // std::terminate
+#endif
+
+class Device;
+
+namespace PIL {
+    class Logging;
+}
+
+/**
+ * @brief The IOReactor owns non-blocking connections to multiple devices and multiplexes them with epoll, so a single
+ * thread can keep a whole rack of instruments busy. Commands follow the semantics of Device::ExecAsync: they are
+ * terminated with a line break and every command expecting a result is answered by exactly one line. Commands are
+ * written as soon as the socket is writable, so several commands to the same device are pipelined.
+ *
+ * While a device is attached, its own blocking socket is closed, because most instruments only serve one connection
+ * on their raw socket port. Operations fail with PIL_TIMEOUT if no reply is received within the timeout of the
+ * device, in this case the connection is closed and reopened with the next query.
+ *
+ * If compiled with C++20, queries can be awaited within coroutines:
+ * @code
+ * IOReactor::Task measure(IOReactor &reactor, Device *smu) {
+ *     auto reply = co_await reactor.asyncQuery(smu, "print(smua.measure.v())");
+ * }
+ * @endcode
+ */
+class IOReactor
+{
+public:
+    /**
+     * @brief Error code and reply of a single query.
+     */
+    struct QueryResult {
+        PIL_ERROR_CODE errorCode = PIL_NO_ERROR;
+        /** Reply without the line break, empty for commands without result. **/
+        std::string value;
+    };
+
+    /** Called from the reactor thread as soon as a query is completed. **/
+    typedef std::function<void(PIL_ERROR_CODE errorCode, const std::string &result)> Callback;
+
+    explicit IOReactor(PIL::Logging *logger = nullptr);
+    ~IOReactor();
+
+    IOReactor(const IOReactor &) = delete;
+    IOReactor &operator=(const IOReactor &) = delete;
+
+    PIL_ERROR_CODE attach(Device *device);
+    PIL_ERROR_CODE detach(Device *device);
+
+    PIL_ERROR_CODE query(Device *device, const std::string &command, Callback callback, bool expectResult = true);
+    PIL_ERROR_CODE runOnce(int maxWaitInMs);
+    PIL_ERROR_CODE run();
+    void stop();
+
+    [[nodiscard]] size_t getPendingCount() const;
+
+    static bool extractLine(std::string *buffer, std::string *line);
+
+#if defined(__cpp_impl_coroutine)
+    /**
+     * @brief Awaitable returned by asyncQuery, the coroutine is resumed from the reactor thread with the result.
+     */
+    class QueryAwaitable
+    {
+    public:
+        QueryAwaitable(IOReactor *reactor, Device *device, std::string command, bool expectResult)
+                : m_Reactor(reactor), m_Device(device), m_Command(std::move(command)), m_ExpectResult(expectResult) {}
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            // The callback can be called before query returns, e.g. if the command was written immediately or from
+            // another thread. Whoever finishes second resumes the coroutine, so it is resumed exactly once and
+            // this object is not accessed after the coroutine continued.
+            auto ret = m_Reactor->query(m_Device, m_Command, [this, handle](PIL_ERROR_CODE errorCode,
+                                                                           const std::string &result) {
+                m_Result.errorCode = errorCode;
+                m_Result.value = result;
+                if (m_State.exchange(COMPLETED, std::memory_order_acq_rel) == SUSPENDED)
+                    handle.resume();
+            }, m_ExpectResult);
+            // Resume immediately if the query could not be queued, the callback is not called in this case.
+            if (ret != PIL_NO_ERROR) {
+                m_Result.errorCode = ret;
+                return false;
+            }
+            return m_State.exchange(SUSPENDED, std::memory_order_acq_rel) == PENDING;
+        }
+
+        QueryResult await_resume() { return std::move(m_Result); }
+
+    private:
+        IOReactor *m_Reactor;
+        Device *m_Device;
+        std::string m_Command;
+        bool m_ExpectResult;
+        QueryResult m_Result;
+
+        enum State {
+            PENDING, SUSPENDED, COMPLETED
+        };
+        std::atomic<State> m_State{PENDING};
+    };
+
+    /**
+     * @brief Fire and forget coroutine. It starts immediately and is continued by run or runOnce.
+     */
+    struct Task {
+        struct promise_type {
+            Task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    QueryAwaitable asyncQuery(Device *device, std::string command, bool expectResult = true) {
+        return {this, device, std::move(command), expectResult};
+    }
+#endif // __cpp_impl_coroutine
+
+private:
+    /** Command waiting to be written or waiting for its reply. **/
+    struct Operation {
+        std::string message;
+        bool expectsResult;
+        Callback callback;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    /** Connection state of one attached device. **/
+    struct Connection {
+        Device *device;
+        int fd = -1;
+        bool connected = false;
+        /** Bytes of the front operation of writeQueue, which were already written. **/
+        size_t writeOffset = 0;
+        std::deque<Operation> writeQueue;
+        std::deque<Operation> replyQueue;
+        std::string readBuffer;
+    };
+
+    PIL_ERROR_CODE openConnection(Connection *connection);
+    void closeConnection(Connection *connection, PIL_ERROR_CODE reason);
+    void updateInterest(Connection *connection);
+    void handleWritable(Connection *connection);
+    void handleReadable(Connection *connection);
+    void handleTimeouts();
+    int getWaitTime(int maxWaitInMs) const;
+
+    int m_EpollFd = -1;
+    PIL::Logging *m_Logger;
+    bool m_Stopped = false;
+    std::unordered_map<Device *, std::unique_ptr<Connection>> m_Connections;
+    /** Detached connections are kept until the next iteration, because a callback may detach its own device. **/
+    std::vector<std::unique_ptr<Connection>> m_Retired;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_IO_REACTOR_H
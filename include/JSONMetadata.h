@@ -0,0 +1,41 @@
+/**
+ * @brief Metadata written next to exported measurement data.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_JSON_METADATA_H
+#define INSTRUMENT_CONTROL_LIB_JSON_METADATA_H
+
+#include "ctlib/ErrorCodeDefines.h"
+
+#include <string> // std::string
+#include <utility> // std::pair
+#include <vector> // std::vector
+
+/**
+ * @brief Flat JSON object whose values are strings, numbers or nested objects. The keys are written in the order
+ * they were added. It describes exported data, e.g. the preamble and the identifier of the instrument, and is
+ * stored as sidecar file with the same name as the data file and the extension .json.
+ */
+class JSONMetadata
+{
+public:
+    JSONMetadata &add(const std::string &key, const std::string &value);
+    JSONMetadata &add(const std::string &key, const char *value);
+    JSONMetadata &add(const std::string &key, double value);
+    JSONMetadata &add(const std::string &key, int value);
+    JSONMetadata &add(const std::string &key, bool value);
+    JSONMetadata &add(const std::string &key, const JSONMetadata &object);
+
+    [[nodiscard]] std::string toString() const;
+    PIL_ERROR_CODE writeFile(const std::string &filePath) const;
+
+    static std::string getSidecarPath(const std::string &dataPath);
+    static std::string escape(const std::string &value);
+
+private:
+    /** Pairs of key and value, the value is already encoded as JSON. **/
+    std::vector<std::pair<std::string, std::string>> m_Fields;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_JSON_METADATA_H
@@ -0,0 +1,83 @@
+/**
+ * @brief Lock-free queue with multiple producers and a single consumer.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_MPSC_QUEUE_H
+#define INSTRUMENT_CONTROL_LIB_MPSC_QUEUE_H
+
+#include <atomic> // std::atomic
+#include <utility> // std::move
+
+/**
+ * @brief Unbounded linked list queue after Dmitry Vyukov. push can be called from any thread and never blocks, it
+ * only exchanges the head pointer. pop and empty must only be called from the consumer thread.
+ * @tparam T type of the elements, must be default constructible.
+ */
+template<typename T>
+class MPSCQueue
+{
+public:
+    MPSCQueue() {
+        auto *stub = new Node();
+        m_Head.store(stub, std::memory_order_relaxed);
+        m_Tail = stub;
+    }
+
+    ~MPSCQueue() {
+        T value;
+        while (pop(&value)) {}
+        delete m_Tail;
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    /**
+     * @brief Appends an element, can be called concurrently from any thread.
+     * @param value element to append.
+     */
+    void push(T value) {
+        auto *node = new Node();
+        node->value = std::move(value);
+        Node *previous = m_Head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief Removes the oldest element. Must only be called from the consumer thread.
+     * @param value removed element.
+     * @return false if the queue is empty, or the only element is not completely linked yet.
+     */
+    bool pop(T *value) {
+        Node *next = m_Tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        *value = std::move(next->value);
+        next->value = T();
+        delete m_Tail;
+        m_Tail = next;
+        return true;
+    }
+
+    /**
+     * @brief Checks if an element is available. Must only be called from the consumer thread.
+     * @return true if pop would fail.
+     */
+    [[nodiscard]] bool empty() const {
+        return m_Tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    /** Most recently pushed node, shared by all producers. **/
+    std::atomic<Node *> m_Head;
+    /** Node before the oldest element, only accessed by the consumer. **/
+    Node *m_Tail;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_MPSC_QUEUE_H
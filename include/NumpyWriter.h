@@ -0,0 +1,68 @@
+/**
+ * @brief Binary export of numeric columns as numpy .npy and .npz files.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_NUMPY_WRITER_H
+#define INSTRUMENT_CONTROL_LIB_NUMPY_WRITER_H
+
+#include "ctlib/ErrorCodeDefines.h"
+
+#include <cstdint> // uint8_t, uint32_t
+#include <cstdio> // FILE
+#include <string> // std::string
+#include <vector> // std::vector
+
+/**
+ * @brief Writes one dimensional arrays in the numpy format (version 1.0), which numpy.load maps without parsing.
+ * A single array is written as .npy file with writeNpy. Multiple arrays are combined into an uncompressed .npz
+ * archive by opening a file, adding every array with addArray and closing it again.
+ * The values are written in the byte order of the host, which is stored in the header of every array.
+ */
+class NumpyWriter
+{
+public:
+    NumpyWriter() = default;
+    ~NumpyWriter();
+
+    NumpyWriter(const NumpyWriter &) = delete;
+    NumpyWriter &operator=(const NumpyWriter &) = delete;
+
+    static PIL_ERROR_CODE writeNpy(const std::string &filePath, const double *values, size_t count);
+    static PIL_ERROR_CODE writeNpy(const std::string &filePath, const float *values, size_t count);
+    static PIL_ERROR_CODE writeNpy(const std::string &filePath, const uint8_t *values, size_t count);
+
+    PIL_ERROR_CODE open(const std::string &filePath);
+    PIL_ERROR_CODE addArray(const std::string &name, const double *values, size_t count);
+    PIL_ERROR_CODE addArray(const std::string &name, const float *values, size_t count);
+    PIL_ERROR_CODE addArray(const std::string &name, const uint8_t *values, size_t count);
+    PIL_ERROR_CODE addBoolArray(const std::string &name, const uint8_t *values, size_t count);
+    PIL_ERROR_CODE close();
+
+    static std::string createHeader(const char *descr, size_t count);
+    static uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0);
+
+private:
+    /**
+     * @brief Entry of the central directory, written when the archive is closed.
+     */
+    struct Entry {
+        std::string name;
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;
+    };
+
+    static PIL_ERROR_CODE writeNpy(const std::string &filePath, const char *descr, const void *data, size_t count,
+                                   size_t bytesPerValue);
+    PIL_ERROR_CODE addEntry(const std::string &name, const char *descr, const void *data, size_t count,
+                            size_t bytesPerValue);
+    PIL_ERROR_CODE writeBuffer(const void *data, size_t length);
+
+    std::FILE *m_File = nullptr;
+    std::vector<Entry> m_Entries;
+    /** Offset of the next local file header. **/
+    uint64_t m_Offset = 0;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_NUMPY_WRITER_H
@@ -0,0 +1,95 @@
+/**
+ * @brief Lock-free ring of preallocated slots with a single producer and a single consumer.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_SPSC_RING_H
+#define INSTRUMENT_CONTROL_LIB_SPSC_RING_H
+
+#include <atomic> // std::atomic
+#include <cstddef> // size_t
+#include <vector> // std::vector
+
+/**
+ * @brief Bounded ring whose slots are allocated once and reused, e.g. frames with large sample buffers. Instead of
+ * copying elements, the producer fills the slot returned by beginWrite and publishes it with endWrite, the consumer
+ * reads the slot returned by beginRead and hands it back with endRead. The write functions must only be called from
+ * the producer thread, the read functions only from the consumer thread.
+ * @tparam T type of the slots, must be default constructible.
+ */
+template<typename T>
+class SPSCRing
+{
+public:
+    /**
+     * @brief Constructor allocates all slots.
+     * @param capacity number of slots, at least 1.
+     */
+    explicit SPSCRing(size_t capacity) : m_Slots(capacity > 0 ? capacity : 1) {}
+
+    SPSCRing(const SPSCRing &) = delete;
+    SPSCRing &operator=(const SPSCRing &) = delete;
+
+    /**
+     * @brief Returns the next free slot. Must only be called from the producer thread.
+     * @return the slot to fill or nullptr if all slots are waiting for the consumer.
+     */
+    T *beginWrite() {
+        size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head - m_Tail.load(std::memory_order_acquire) == m_Slots.size())
+            return nullptr;
+        return &m_Slots[head % m_Slots.size()];
+    }
+
+    /**
+     * @brief Publishes the slot returned by beginWrite to the consumer.
+     */
+    void endWrite() {
+        m_Head.store(m_Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Returns the oldest published slot. Must only be called from the consumer thread.
+     * @return the slot to read or nullptr if the ring is empty.
+     */
+    T *beginRead() {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail == m_Head.load(std::memory_order_acquire))
+            return nullptr;
+        return &m_Slots[tail % m_Slots.size()];
+    }
+
+    /**
+     * @brief Hands the slot returned by beginRead back to the producer.
+     */
+    void endRead() {
+        m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks if a published slot is waiting, can be called from both threads.
+     * @return true if no slot is waiting for the consumer.
+     */
+    [[nodiscard]] bool empty() const {
+        return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] size_t capacity() const { return m_Slots.size(); }
+
+    /**
+     * @brief Gives access to all slots, e.g. to preallocate their buffers. Must not be called while the producer or
+     * consumer are running.
+     * @param index index of the slot.
+     * @return the slot.
+     */
+    T &getSlot(size_t index) { return m_Slots[index]; }
+
+private:
+    std::vector<T> m_Slots;
+    /** Number of published slots, written by the producer. **/
+    alignas(64) std::atomic<size_t> m_Head{0};
+    /** Number of released slots, written by the consumer. **/
+    alignas(64) std::atomic<size_t> m_Tail{0};
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_SPSC_RING_H
@@ -0,0 +1,93 @@
+/**
+ * @brief Conversion of raw oscilloscope samples into voltages.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_WAVEFORM_CONVERTER_H
+#define INSTRUMENT_CONTROL_LIB_WAVEFORM_CONVERTER_H
+
+#include <cstddef> // size_t
+#include <cstdint> // uint8_t
+#include <string> // std::string
+
+/** Format field of the waveform preamble. **/
+#define PREAMBLE_FORMAT_BYTE 0
+#define PREAMBLE_FORMAT_WORD 1
+
+/**
+ * @brief Parsed reply of :WAVeform:PREamble?, which describes how raw samples are converted into time and voltage.
+ */
+struct WaveformPreamble {
+    /** 0 for BYTE, 1 for WORD and 4 for ASCII. **/
+    int format = 0;
+    /** 0 for NORMal, 1 for PEAK detect, 2 for AVERage and 3 for HRESolution. **/
+    int type = 0;
+    int points = 0;
+    int count = 0;
+    double xIncrement = 0;
+    double xOrigin = 0;
+    double xReference = 0;
+    double yIncrement = 0;
+    double yOrigin = 0;
+    double yReference = 0;
+
+    static bool parse(const std::string &preamble, WaveformPreamble *result);
+
+    /**
+     * @brief Returns the time of a sample.
+     * @param index index of the sample.
+     * @return time in seconds relative to the trigger.
+     */
+    [[nodiscard]] double getTime(size_t index) const {
+        return (static_cast<double>(index) - xReference) * xIncrement + xOrigin;
+    }
+};
+
+/**
+ * @brief Vectorized kernels converting BYTE and WORD samples into voltages with
+ * voltage = (raw - yReference) * yIncrement + yOrigin.
+ * Samples with the raw value 0 are holes, i.e. locations where no data was acquired yet. Instead of branching on
+ * them, a validity bitmask is written: bit (i % 8) of byte i / 8 is set if sample i is valid. The voltage of a hole is
+ * computed like any other sample and must be ignored.
+ * On x86-64 the AVX2 kernel is selected at runtime if supported, otherwise SSE2 is used. Other architectures use the
+ * scalar implementation.
+ */
+class WaveformConverter
+{
+public:
+    enum SAMPLE_FORMAT {
+        BYTE_SAMPLES,
+        WORD_BIG_ENDIAN_SAMPLES,
+        WORD_LITTLE_ENDIAN_SAMPLES
+    };
+
+    static void convert(const uint8_t *samples, size_t count, SAMPLE_FORMAT format, const WaveformPreamble &preamble,
+                        double *voltages, uint8_t *validMask);
+    static void convert(const uint8_t *samples, size_t count, SAMPLE_FORMAT format, const WaveformPreamble &preamble,
+                        float *voltages, uint8_t *validMask);
+
+    static void convertScalar(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                              const WaveformPreamble &preamble, double *voltages, uint8_t *validMask);
+    static void convertScalar(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                              const WaveformPreamble &preamble, float *voltages, uint8_t *validMask);
+
+    /**
+     * @brief Returns the number of bytes of a validity bitmask.
+     * @param count number of samples.
+     * @return size of the mask in bytes.
+     */
+    static size_t getMaskSize(size_t count) { return (count + 7) / 8; }
+
+    /**
+     * @brief Checks the validity bit of a sample.
+     * @param validMask mask written by convert.
+     * @param index index of the sample.
+     * @return true if the sample is not a hole.
+     */
+    static bool isValid(const uint8_t *validMask, size_t index) { return validMask[index / 8] & (1u << (index % 8)); }
+
+    static size_t getBytesPerSample(SAMPLE_FORMAT format);
+    static const char *getKernelName();
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_WAVEFORM_CONVERTER_H
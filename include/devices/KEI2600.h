@@ -6,8 +6,12 @@
 #pragma once
 
 #include "Device.h"
+#include "AdaptiveChunkSizer.h"
+#include "KEI2600Commands.h"
 #include "types/SMU.h"
 
+#include <functional> // std::function
+
 namespace PIL {
     class Logging;
 }
@@ -17,20 +21,172 @@ namespace PIL {
  */
 class KEI2600 : public SMU {
 public:
+    /**
+     * @brief Data format used by the SMU to transfer the content of reading buffers (format.data).
+     */
+    enum BUFFER_FORMAT {
+        /** Values are transferred as text and parsed on the host. **/
+        ASCII_FORMAT,
+        /** Values are transferred as IEEE-754 single precision binary block. **/
+        REAL32_FORMAT,
+        /** Values are transferred as IEEE-754 double precision binary block. **/
+        REAL64_FORMAT
+    };
+
+    /**
+     * @brief Decides when the error queue is checked for calls with checkErrorBuffer = true.
+     */
+    enum ERROR_CHECK_POLICY {
+        /** The error queue is requested after every call. **/
+        CHECK_EVERY_CALL,
+        /** The error queue is requested after a configurable number of calls. **/
+        CHECK_EVERY_N_CALLS,
+        /** The error queue is requested by checkErrors or at the end of an ErrorCheckScope. **/
+        CHECK_DEFERRED,
+        /** The error count is returned together with the reply of the next measurement. **/
+        CHECK_PIGGYBACK
+    };
+
+    /**
+     * @brief Command which added entries to the error queue of the SMU.
+     */
+    struct AttributedError {
+        /** Command as sent to the SMU, "unknown" if the error could not be attributed. **/
+        std::string command;
+        /** Number of errors added by the command. **/
+        int errorCount;
+    };
+
+    /**
+     * @brief Defers error checks until the end of a scope, e.g. of a batch of setters. The previous policy is
+     * restored afterwards. Call close to retrieve the result of the check, the destructor only logs errors.
+     * @code{.cpp}
+     * {
+     *     KEI2600::ErrorCheckScope scope(smu);
+     *     smu.setLevel(SMU::VOLTAGE, SMU::CHANNEL_A, 0.5, true);
+     *     smu.setLimit(SMU::CURRENT, SMU::CHANNEL_A, 0.1, true);
+     *     ret = scope.close();
+     * }
+     * @endcode
+     */
+    class ErrorCheckScope {
+    public:
+        explicit ErrorCheckScope(KEI2600 &smu);
+        ~ErrorCheckScope();
+        ErrorCheckScope(const ErrorCheckScope &) = delete;
+        ErrorCheckScope &operator=(const ErrorCheckScope &) = delete;
+
+        PIL_ERROR_CODE close();
+
+    private:
+        KEI2600 &m_SMU;
+        ERROR_CHECK_POLICY m_PreviousPolicy;
+        size_t m_PreviousInterval;
+        bool m_Closed = false;
+    };
+
+    /**
+     * @brief Transport used to upload scripts to the SMU.
+     */
+    enum SCRIPT_UPLOAD_METHOD {
+        /** loadscript ... endscript is streamed over the socket, completion is signaled by a printed sentinel. **/
+        SOCKET_UPLOAD,
+        /** The script is posted in batches to the web interface of the SMU. **/
+        HTTP_UPLOAD
+    };
+
+    /**
+     * @brief Shape of the source values of a sweep executed by the trigger model of the SMU.
+     */
+    enum SWEEP_MODE {
+        /** Equidistant steps from start to stop (smuX.trigger.source.linearY). **/
+        LINEAR_SWEEP,
+        /** Logarithmically spaced steps from start to stop (smuX.trigger.source.logY). **/
+        LOG_SWEEP,
+        /** Arbitrary source values (smuX.trigger.source.listY). **/
+        LIST_SWEEP
+    };
+
+    /**
+     * @brief Parameters of a sweep. Setting pulseWidth creates a pulsed sweep, which returns to the idle level
+     * (the current source level of the channel) after each point.
+     */
+    struct SweepConfig {
+        /** Linear, logarithmic or list sweep. **/
+        SWEEP_MODE mode = LINEAR_SWEEP;
+        /** Sourced unit, voltage or current. The other unit is measured. **/
+        UNIT sourceUnit = VOLTAGE;
+        /** First source value of linear and logarithmic sweeps. **/
+        double start = 0;
+        /** Last source value of linear and logarithmic sweeps. **/
+        double stop = 0;
+        /** Number of points of linear and logarithmic sweeps. List sweeps use the size of values. **/
+        int points = 1;
+        /** Source values of a list sweep. **/
+        std::vector<double> values;
+        /** Compliance limit of the measured unit. **/
+        double limit = 0.1;
+        /** Integration aperture of each measurement in power line cycles. **/
+        double nplc = 1;
+        /** Time between two points in seconds. 0 executes the sweep as fast as possible. If measure is set, the period
+         * must exceed the integration time of nplc power line cycles. **/
+        double period = 0;
+        /** Width of each pulse in seconds. 0 creates a DC sweep. Must be smaller than period. **/
+        double pulseWidth = 0;
+        /** Name of the reading buffer, which stores the measured values, e.g. to read them with readBuffer. **/
+        std::string bufferName = "ICL_SWEEP_BUFFER";
+        /** Whether a measurement is taken at every point. Otherwise only the source is stepped. **/
+        bool measure = true;
+    };
+
     explicit KEI2600(std::string ipAddress, int timeoutInMs, PIL::Logging *logger, SEND_METHOD mode = DIRECT_SEND);
     [[maybe_unused]] explicit KEI2600(std::string ipAddress, int timeoutInMs, SEND_METHOD mode);
 
-    virtual ~KEI2600() = default;
+    ~KEI2600() override;
 
     PIL_ERROR_CODE measure(UNIT unit, SMU_CHANNEL channel, double *value, bool checkErrorBuffer) override;
     double measurePy(UNIT unit, SMU_CHANNEL channel, bool checkErrorBuffer);
 
+    PIL_ERROR_CODE setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                      double *value, bool checkErrorBuffer) override;
+    PIL_ERROR_CODE setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                      double *value, bool *compliance, bool checkErrorBuffer);
+    PIL_ERROR_CODE measureIV(SMU_CHANNEL channel, double *current, double *voltage, bool checkErrorBuffer) override;
+    PIL_ERROR_CODE measureBothChannels(UNIT unit, double *valueA, double *valueB, bool checkErrorBuffer) override;
+    PIL_ERROR_CODE isInCompliance(SMU_CHANNEL channel, bool *compliance, bool checkErrorBuffer);
+
     PIL_ERROR_CODE turnOn(SMU_CHANNEL channel, bool checkErrorBuffer) override;
     PIL_ERROR_CODE turnOff(SMU_CHANNEL channel, bool checkErrorBuffer) override;
 
     PIL_ERROR_CODE setLevel(UNIT unit, SMU_CHANNEL channel, double level, bool checkErrorBuffer) override;
     PIL_ERROR_CODE setLimit(UNIT unit, SMU_CHANNEL channel, double limit, bool checkErrorBuffer) override;
 
+    /**
+     * @brief Sets the level of a channel, whose command is generated at compile time,
+     * e.g. setLevel<SMU::CHANNEL_A, SMU::VOLTAGE>(0.5, false). Invalid units are rejected by the compiler.
+     * @param level level to set. Encoded in amps or voltages.
+     * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+     * @return NO_ERROR if execution was successful otherwise return error code.
+     */
+    template<SMU_CHANNEL channel, UNIT unit>
+    PIL_ERROR_CODE setLevel(double level, bool checkErrorBuffer) {
+        return assignValue(KEI2600Commands::Command<channel, unit, KEI2600Commands::SOURCE_LEVEL>::view(), level,
+                           checkErrorBuffer);
+    }
+
+    /**
+     * @brief Sets the limit of a channel, whose command is generated at compile time,
+     * e.g. setLimit<SMU::CHANNEL_A, SMU::CURRENT>(0.1, false).
+     * @param limit limit value in amps, voltage or watts.
+     * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+     * @return NO_ERROR if execution was successful otherwise return error code.
+     */
+    template<SMU_CHANNEL channel, UNIT unit>
+    PIL_ERROR_CODE setLimit(double limit, bool checkErrorBuffer) {
+        return assignValue(KEI2600Commands::Command<channel, unit, KEI2600Commands::SOURCE_LIMIT>::view(), limit,
+                           checkErrorBuffer);
+    }
+
     PIL_ERROR_CODE enableMeasureAutoRange(UNIT unit, SMU_CHANNEL channel, bool checkErrorBuffer);
     PIL_ERROR_CODE disableMeasureAutoRange(UNIT unit, SMU_CHANNEL channel, bool checkErrorBuffer);
 
@@ -43,8 +199,44 @@ public:
     PIL_ERROR_CODE setMeasureRange(UNIT unit, SMU_CHANNEL channel, double range, bool checkErrorBuffer);
     PIL_ERROR_CODE setSourceRange(UNIT unit, SMU_CHANNEL channel, double range, bool checkErrorBuffer);
 
+    /**
+     * @brief Compile time variant of setMeasureRange(UNIT, SMU_CHANNEL, double, bool).
+     * @param range range value to set.
+     * @param checkErrorBuffer if true check the error buffer after execution.
+     * @return NO_ERROR if execution was successful otherwise return error code.
+     */
+    template<SMU_CHANNEL channel, UNIT unit>
+    PIL_ERROR_CODE setMeasureRange(double range, bool checkErrorBuffer) {
+        return assignValue(KEI2600Commands::Command<channel, unit, KEI2600Commands::MEASURE_RANGE>::view(), range,
+                           checkErrorBuffer);
+    }
+
+    /**
+     * @brief Compile time variant of setSourceRange(UNIT, SMU_CHANNEL, double, bool).
+     * @param range range value to set.
+     * @param checkErrorBuffer if true check the error buffer after execution.
+     * @return NO_ERROR if execution was successful otherwise return error code.
+     */
+    template<SMU_CHANNEL channel, UNIT unit>
+    PIL_ERROR_CODE setSourceRange(double range, bool checkErrorBuffer) {
+        return assignValue(KEI2600Commands::Command<channel, unit, KEI2600Commands::SOURCE_RANGE>::view(), range,
+                           checkErrorBuffer);
+    }
+
     PIL_ERROR_CODE setSenseMode(SMU_CHANNEL channel, SMU_SENSE senseArg, bool checkErrorBuffer);
     PIL_ERROR_CODE setMeasurePLC(SMU_CHANNEL channel, double value, bool checkErrorBuffer);
+
+    /**
+     * @brief Compile time variant of setMeasurePLC(SMU_CHANNEL, double, bool).
+     * @param value integration aperture in power line cycles (0.001 to 25).
+     * @param checkErrorBuffer if true check the error buffer after execution.
+     * @return NO_ERROR if execution was successful otherwise return error code.
+     */
+    template<SMU_CHANNEL channel>
+    PIL_ERROR_CODE setMeasurePLC(double value, bool checkErrorBuffer) {
+        return assignPLC(KEI2600Commands::Command<channel, VOLTAGE, KEI2600Commands::MEASURE_NPLC>::view(), value,
+                         checkErrorBuffer);
+    }
     PIL_ERROR_CODE setMeasureLowRange(UNIT unit, SMU_CHANNEL channel, double value, bool checkErrorBuffer);
     PIL_ERROR_CODE setMeasureAutoZero(SMU_CHANNEL channel, AUTOZERO autoZero, bool checkErrorBuffer);
     PIL_ERROR_CODE setMeasureCount(SMU_CHANNEL channel, int nrOfMeasurements, bool checkErrorBuffer);
@@ -62,9 +254,16 @@ public:
     std::string getLastError();
     PIL_ERROR_CODE clearErrorBuffer();
     PIL_ERROR_CODE getErrorBufferStatus();
+    PIL_ERROR_CODE checkErrors();
+    void setErrorCheckPolicy(ERROR_CHECK_POLICY policy, int interval = 1);
+    [[nodiscard]] ERROR_CHECK_POLICY getErrorCheckPolicy() const;
+    [[nodiscard]] const std::vector<AttributedError> &getAttributedErrors() const;
+    void clearAttributedErrors();
 
     PIL_ERROR_CODE performLinearVoltageSweep(SMU_CHANNEL channel, double startVoltage, double stopVoltage,
                                              int increaseRate, double current, bool checkErrorBuffer);
+    PIL_ERROR_CODE loadSweepEngine(bool reload, bool checkErrorBuffer);
+    PIL_ERROR_CODE performSweep(SMU_CHANNEL channel, const SweepConfig &config, bool checkErrorBuffer);
 
     PIL_ERROR_CODE sendScript(const std::string &scriptName, const std::string &script, bool checkErrorBuffer);
     PIL_ERROR_CODE sendVectorScript(const std::string &scriptName, const std::vector<std::string>& script,
@@ -76,17 +275,67 @@ public:
                                               bool checkErrorBuffer);
     PIL_ERROR_CODE executeBufferedScript(bool checkErrorBuffer);
 
+    void setScriptUploadMethod(SCRIPT_UPLOAD_METHOD method);
+    [[nodiscard]] SCRIPT_UPLOAD_METHOD getScriptUploadMethod() const;
+    void setScriptCacheEnabled(bool enable);
+    void setScriptCacheVerification(bool verify);
+    void clearScriptCache();
+
     PIL_ERROR_CODE readBuffer(const std::string &bufferName, std::vector<double> *result, bool checkErrorBuffer);
+    PIL_ERROR_CODE readBuffer(const std::string &bufferName, double *values, size_t capacity, size_t *count,
+                              bool checkErrorBuffer);
     std::vector<double> readBufferPy(const std::string &bufferName, bool checkErrorBuffer);
+    PIL_ERROR_CODE exportBufferToCSV(const std::string &bufferName, const std::string &filePath,
+                                     bool checkErrorBuffer);
+    PIL_ERROR_CODE exportBufferToNpz(const std::string &bufferName, const std::string &filePath,
+                                     bool includeTimestamps, bool includeSourceValues, bool checkErrorBuffer);
     PIL_ERROR_CODE getBufferSize(const std::string &bufferName, int *value, bool checkErrorBuffer);
     PIL_ERROR_CODE clearBuffer(const std::string &bufferName, bool checkErrorBuffer);
     void clearBufferedScript();
 
+    void setBufferFormat(BUFFER_FORMAT format);
+    [[nodiscard]] BUFFER_FORMAT getBufferFormat() const;
+    [[nodiscard]] size_t getReadChunkSize() const;
+
     std::string CHANNEL_A_BUFFER = "A_M_BUFFER";
     std::string CHANNEL_B_BUFFER = "B_M_BUFFER";
 
+protected:
+    void invalidateCachedState() override;
+    [[nodiscard]] bool isReset(std::string_view message) const override;
+
 private:
+    /**
+     * @brief Selects the binary data format while a buffer is transferred. The destructor selects ASCII again if the
+     * transfer is left early, e.g. by an exception, as all other queries expect text replies.
+     */
+    class BinaryFormatGuard
+    {
+    public:
+        explicit BinaryFormatGuard(KEI2600 *smu) : m_SMU(smu) {}
+        ~BinaryFormatGuard();
+
+        BinaryFormatGuard(const BinaryFormatGuard &) = delete;
+        BinaryFormatGuard &operator=(const BinaryFormatGuard &) = delete;
+
+        PIL_ERROR_CODE enable();
+        PIL_ERROR_CODE restore();
+
+    private:
+        KEI2600 *m_SMU;
+        bool m_Enabled = false;
+    };
+
     PIL_ERROR_CODE handleErrorCode(PIL_ERROR_CODE errorCode, bool checkErrorBuffer);
+    PIL_ERROR_CODE execQuery(CommandBuilder &command, bool checkErrorBuffer, double *values, size_t count);
+    void trackLastCommand(bool useMarker);
+    PIL_ERROR_CODE evaluateErrorCount(int errorCount);
+    void attributeErrors(int errorCount);
+    static int parseErrorCount(const std::string &reply);
+    PIL_ERROR_CODE setAttribute(KEI2600Commands::ATTRIBUTE attribute, UNIT unit, SMU_CHANNEL channel, double value,
+                                bool checkErrorBuffer);
+    PIL_ERROR_CODE assignValue(std::string_view prefix, double value, bool checkErrorBuffer);
+    PIL_ERROR_CODE assignPLC(std::string_view prefix, double value, bool checkErrorBuffer);
 
     PIL_ERROR_CODE toggleMeasureAnalogFilter(SMU_CHANNEL channel, bool enable);
     PIL_ERROR_CODE toggleMeasureAutoRange(SMU_CHANNEL channel, UNIT unit, bool enable);
@@ -96,16 +345,36 @@ private:
     PIL_ERROR_CODE toggleSourceSink(SMU_CHANNEL channel, bool enable);
 
     std::string getMeasurementStorage(SMU_CHANNEL channel);
-    PIL_ERROR_CODE readPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName, char *printBuffer,
-                                    std::vector<double> *result, bool checkErrorBuffer);
-    PIL_ERROR_CODE appendToBuffer(int startIdx, int endIdx, const std::string &bufferName, char *printBuffer,
-                                  std::vector<double> *result, bool checkErrorBuffer);
+    /** Returns the memory for the given number of values or nullptr if they do not fit. **/
+    typedef std::function<double *(size_t count)> BufferAllocator;
+    PIL_ERROR_CODE readBufferValues(const std::string &bufferName, const std::string &element,
+                                    std::vector<double> *result, bool clear, bool checkErrorBuffer);
+    PIL_ERROR_CODE readBufferValues(const std::string &bufferName, const std::string &element,
+                                    const BufferAllocator &allocate, size_t *count, bool clear,
+                                    bool checkErrorBuffer);
+    PIL_ERROR_CODE readTextPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName, double *values,
+                                        size_t *receivedBytes);
+    PIL_ERROR_CODE readBinaryPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName, double *values,
+                                          size_t *receivedBytes);
+    PIL_ERROR_CODE setBinaryDataFormat(bool enable);
+    PIL_ERROR_CODE validateSweepConfig(const SweepConfig &config);
+    PIL_ERROR_CODE uploadScript(const std::string &scriptName, const std::vector<std::string> &script,
+                                bool checkErrorBuffer);
+    PIL_ERROR_CODE uploadScriptOverSocket(const std::string &scriptName, const std::vector<std::string> &script,
+                                          bool checkErrorBuffer);
+    PIL_ERROR_CODE uploadScriptOverHTTP(const std::string &scriptName, const std::vector<std::string> &script,
+                                        bool checkErrorBuffer);
+    PIL_ERROR_CODE isScriptLoaded(const std::string &scriptName, bool *loaded);
+    static uint64_t hashScript(const std::vector<std::string> &script);
+    static double decodeBinaryValue(const uint8_t *data, BUFFER_FORMAT format);
+    static size_t getBytesPerValue(BUFFER_FORMAT format);
 
     static std::string createPayload(const std::string &value);
     static void createPayloadBatch(int offset, int numberOfLines, std::vector<std::string> values,
                                    std::vector<std::string> *result);
 
     static std::string getChannelStringFromEnum(SMU_CHANNEL channel);
+    static char getChannelLetterFromEnum(SMU_CHANNEL channel);
     static std::string getStringFromAutoZeroEnum(AUTOZERO autoZero);
     static std::string getStringFromSrcFuncEnum(SRC_FUNC srcFunc);
     static std::string getStringFromOffModeEnum(SRC_OFF_MODE offMode);
@@ -117,6 +386,24 @@ private:
 
     int m_BufferEntriesA = 1;
     int m_BufferEntriesB = 1;
+    BUFFER_FORMAT m_BufferFormat = ASCII_FORMAT;
+    AdaptiveChunkSizer m_ChunkSizer;
+    std::string m_TextReceiveBuffer;
+    std::vector<uint8_t> m_BinaryReceiveBuffer;
+    bool m_SweepEngineLoaded = false;
+    SCRIPT_UPLOAD_METHOD m_ScriptUploadMethod = SOCKET_UPLOAD;
+    ERROR_CHECK_POLICY m_ErrorCheckPolicy = CHECK_EVERY_CALL;
+    size_t m_ErrorCheckInterval = 1;
+    /** Number of entries in the error queue at the last check. **/
+    int m_KnownErrorCount = 0;
+    /** Commands executed since the last check, index i corresponds to the marker icl_ec[i + 1] on the SMU. **/
+    std::vector<std::string> m_UncheckedCommands;
+    std::vector<AttributedError> m_AttributedErrors;
+    /** Reused to receive the replies of execQuery. **/
+    std::string m_QueryReply;
+    bool m_ScriptCacheEnabled = true;
+    bool m_VerifyScriptCache = false;
+    std::unordered_map<std::string, uint64_t> m_ScriptCache;
     std::vector<std::string> defaultBufferedScript{CHANNEL_A_BUFFER + " = smua.makebuffer(%A_M_BUFFER_SIZE%)",
                                                    CHANNEL_B_BUFFER + " = smub.makebuffer(%B_M_BUFFER_SIZE%)",
                                                    CHANNEL_A_BUFFER + ".appendmode = 1",
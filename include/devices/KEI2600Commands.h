@@ -0,0 +1,185 @@
+/**
+ * @brief Compile-time generated TSP attribute paths of the Keithley 2600 series SMU's.
+ * @author Florian Frank
+ * @copyright University of Passau - Chair of computer engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_KEI2600_COMMANDS_H
+#define INSTRUMENT_CONTROL_LIB_KEI2600_COMMANDS_H
+
+#include "types/SMU.h"
+
+#include <array> // std::array
+#include <string_view> // std::string_view
+
+/**
+ * @brief Contains the constant part of all numeric KEI2600 setters, e.g. "smua.source.levelv = ".
+ * The prefixes are computed at compile time for every combination of channel, unit and attribute, so a setter only
+ * has to format the numeric value at runtime.
+ */
+namespace KEI2600Commands
+{
+    /**
+     * @brief Numeric attributes, which can be assigned on a specific channel.
+     */
+    enum ATTRIBUTE {
+        /** smuX.source.levelY **/
+        SOURCE_LEVEL,
+        /** smuX.source.limitY **/
+        SOURCE_LIMIT,
+        /** smuX.source.rangeY **/
+        SOURCE_RANGE,
+        /** smuX.measure.rangeY **/
+        MEASURE_RANGE,
+        /** smuX.measure.lowrangeY **/
+        MEASURE_LOW_RANGE,
+        /** smuX.measure.nplc, independent of the unit **/
+        MEASURE_NPLC,
+        ATTRIBUTE_COUNT
+    };
+
+    /** Number of entries per attribute in the lookup table: 2 channels times 4 units. **/
+    constexpr size_t TABLE_ROW_SIZE = 8;
+
+    /**
+     * @brief Pattern of each attribute. '#' is replaced by the channel letter, '@' by the unit letter.
+     */
+    template<ATTRIBUTE attribute>
+    struct AttributePattern;
+
+    template<> struct AttributePattern<SOURCE_LEVEL> { static constexpr char value[] = "smu#.source.level@ = "; };
+    template<> struct AttributePattern<SOURCE_LIMIT> { static constexpr char value[] = "smu#.source.limit@ = "; };
+    template<> struct AttributePattern<SOURCE_RANGE> { static constexpr char value[] = "smu#.source.range@ = "; };
+    template<> struct AttributePattern<MEASURE_RANGE> { static constexpr char value[] = "smu#.measure.range@ = "; };
+    template<> struct AttributePattern<MEASURE_LOW_RANGE> {
+        static constexpr char value[] = "smu#.measure.lowrange@ = ";
+    };
+    template<> struct AttributePattern<MEASURE_NPLC> { static constexpr char value[] = "smu#.measure.nplc = "; };
+
+    /**
+     * @brief Returns the letter of a unit used within attribute names.
+     * @param unit unit to convert.
+     * @return 'v', 'i', 'r' or 'p'.
+     */
+    constexpr char getUnitLetter(SMU::UNIT unit) {
+        switch (unit) {
+            case SMU::VOLTAGE:
+                return 'v';
+            case SMU::CURRENT:
+                return 'i';
+            case SMU::RESISTANCE:
+                return 'r';
+            case SMU::POWER:
+                return 'p';
+        }
+        return '\0';
+    }
+
+    /**
+     * @brief Checks if the SMU supports the attribute for the given unit, e.g. there is a power limit, but no power
+     * level.
+     * @param attribute attribute to check.
+     * @param unit unit to check.
+     * @return true if the combination is valid.
+     */
+    constexpr bool isValidCombination(ATTRIBUTE attribute, SMU::UNIT unit) {
+        switch (attribute) {
+            case SOURCE_LIMIT:
+                return unit == SMU::VOLTAGE || unit == SMU::CURRENT || unit == SMU::POWER;
+            case MEASURE_NPLC:
+                return true;
+            default:
+                return unit == SMU::VOLTAGE || unit == SMU::CURRENT;
+        }
+    }
+
+    /**
+     * @brief Replaces the placeholders of a pattern with channel and unit letter.
+     * @param pattern pattern containing '#' and '@' placeholders.
+     * @param channel channel letter.
+     * @param unit unit letter.
+     * @return array containing the command prefix without terminating null character.
+     */
+    template<size_t N>
+    constexpr std::array<char, N - 1> makeCommandPrefix(const char (&pattern)[N], char channel, char unit) {
+        std::array<char, N - 1> result{};
+        for (size_t i = 0; i < N - 1; i++) {
+            if (pattern[i] == '#')
+                result[i] = channel;
+            else if (pattern[i] == '@')
+                result[i] = unit;
+            else
+                result[i] = pattern[i];
+        }
+        return result;
+    }
+
+    /**
+     * @brief Command prefix for a specific channel, unit and attribute. Invalid combinations are rejected at
+     * compile time.
+     */
+    template<SMU::SMU_CHANNEL channel, SMU::UNIT unit, ATTRIBUTE attribute>
+    struct Command {
+        static_assert(channel == SMU::CHANNEL_A || channel == SMU::CHANNEL_B, "Invalid SMU channel");
+        static_assert(isValidCombination(attribute, unit), "Attribute is not supported for this unit");
+
+        static constexpr auto prefix = makeCommandPrefix(AttributePattern<attribute>::value,
+                                                         static_cast<char>(channel), getUnitLetter(unit));
+
+        static constexpr std::string_view view() {
+            return {prefix.data(), prefix.size()};
+        }
+    };
+
+    /**
+     * @brief Returns the prefix of a valid combination or an empty view.
+     */
+    template<ATTRIBUTE attribute, SMU::SMU_CHANNEL channel, SMU::UNIT unit>
+    constexpr std::string_view getPrefixOrEmpty() {
+        if constexpr (isValidCombination(attribute, unit))
+            return Command<channel, unit, attribute>::view();
+        else
+            return {};
+    }
+
+    /**
+     * @brief Creates the lookup table row of an attribute, indexed by channel * 4 + unit.
+     */
+    template<ATTRIBUTE attribute>
+    constexpr std::array<std::string_view, TABLE_ROW_SIZE> makeTableRow() {
+        return {getPrefixOrEmpty<attribute, SMU::CHANNEL_A, SMU::VOLTAGE>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_A, SMU::CURRENT>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_A, SMU::RESISTANCE>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_A, SMU::POWER>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_B, SMU::VOLTAGE>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_B, SMU::CURRENT>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_B, SMU::RESISTANCE>(),
+                getPrefixOrEmpty<attribute, SMU::CHANNEL_B, SMU::POWER>()};
+    }
+
+    /** Lookup table used by the runtime overloads, e.g. called from the python wrapper. **/
+    inline constexpr std::array<std::array<std::string_view, TABLE_ROW_SIZE>, ATTRIBUTE_COUNT> COMMAND_TABLE = {
+            makeTableRow<SOURCE_LEVEL>(),
+            makeTableRow<SOURCE_LIMIT>(),
+            makeTableRow<SOURCE_RANGE>(),
+            makeTableRow<MEASURE_RANGE>(),
+            makeTableRow<MEASURE_LOW_RANGE>(),
+            makeTableRow<MEASURE_NPLC>()};
+
+    /**
+     * @brief Runtime lookup of a command prefix.
+     * @param channel channel of the SMU.
+     * @param unit unit of the attribute.
+     * @param attribute attribute to set.
+     * @return prefix, or an empty view if the combination is invalid.
+     */
+    constexpr std::string_view getCommandPrefix(SMU::SMU_CHANNEL channel, SMU::UNIT unit, ATTRIBUTE attribute) {
+        if (attribute < 0 || attribute >= ATTRIBUTE_COUNT || unit < SMU::VOLTAGE || unit > SMU::POWER)
+            return {};
+        if (channel != SMU::CHANNEL_A && channel != SMU::CHANNEL_B)
+            return {};
+        size_t channelIdx = channel == SMU::CHANNEL_A ? 0 : 1;
+        return COMMAND_TABLE[attribute][channelIdx * 4 + static_cast<size_t>(unit)];
+    }
+}
+
+#endif //INSTRUMENT_CONTROL_LIB_KEI2600_COMMANDS_H
@@ -6,6 +6,9 @@
 #pragma once
 
 #include "types/Oscilloscope.h"
+#include "WaveformConverter.h"
+
+#include <vector> // std::vector
 
 namespace PIL {
     class Logging;
@@ -14,8 +17,57 @@ namespace PIL {
 //#define DEVICE_NAME "Mixed Single Oscilloscope" TODO
 
 #define MEASURE_RET_BUFF_SIZE 1024
+/** Bit of :OPERegister:CONDition?, which is set while the oscilloscope is running. **/
+#define OPERATION_STATUS_RUN_BIT 8
+/** Maximum number of segments whose queries are sent before the replies of the first one are read. **/
+#define SEGMENT_PIPELINE_DEPTH 4
+/** Interval between two queries of the Run bit while waiting for an acquisition. **/
+#define ACQUISITION_POLL_INTERVAL_MS 1
 
 
+/**
+ * @brief Waveforms of all segments of a segmented acquisition in one contiguous buffer. All segments share the
+ * preamble, so the buffer can be converted with a single call of WaveformConverter::convert.
+ */
+struct SegmentedWaveform {
+    WaveformPreamble preamble;
+    int segmentCount = 0;
+    /** Number of raw bytes of every segment. **/
+    size_t bytesPerSegment = 0;
+    /** Raw samples of all segments, segment i starts at i * bytesPerSegment. **/
+    std::vector<uint8_t> samples;
+    /** Trigger time of every segment in seconds relative to the trigger of the first segment. **/
+    std::vector<double> timeTags;
+
+    /**
+     * @brief Returns the raw samples of a segment.
+     * @param index index of the segment starting at 0.
+     * @return pointer to bytesPerSegment bytes.
+     */
+    [[nodiscard]] const uint8_t *getSegment(int index) const { return samples.data() + index * bytesPerSegment; }
+};
+
+/**
+ * @brief Time aligned waveforms of several channels captured by a single acquisition. All channels share the time
+ * axis, so the time of sample i is the same for every channel.
+ */
+struct MultiChannelFrame {
+    std::vector<Oscilloscope::OSC_CHANNEL> channels;
+    /** Preamble of every channel, the time fields are equal for all channels. **/
+    std::vector<WaveformPreamble> preambles;
+    /** Voltages of every channel, in the order of channels. **/
+    std::vector<std::vector<double>> voltages;
+    /** Validity bitmask of every channel, see WaveformConverter::isValid. **/
+    std::vector<std::vector<uint8_t>> validMasks;
+
+    /**
+     * @brief Returns the time of a sample.
+     * @param index index of the sample.
+     * @return time in seconds relative to the trigger.
+     */
+    [[nodiscard]] double getTime(size_t index) const { return preambles.empty() ? 0 : preambles[0].getTime(index); }
+};
+
 /**
  * @class KST3000
  * @brief Mixed Single Oscilloscope(Oscillator)
@@ -27,11 +79,13 @@ class KST3000 : public Oscilloscope
 public:
     explicit KST3000(const char *ip, int timeoutInMS);
     KST3000(const char *ip, int timeoutInMs, PIL::Logging *logger);
+    ~KST3000() override;
 
     PIL_ERROR_CODE run() override;
     PIL_ERROR_CODE stop() override;
     PIL_ERROR_CODE single() override;
     PIL_ERROR_CODE autoScale() override;
+    PIL_ERROR_CODE isAcquisitionRunning(bool *running);
 
     PIL_ERROR_CODE setTimeRange(double value) override;
     PIL_ERROR_CODE setChannelOffset(OSC_CHANNEL channel, double offset) override;
@@ -45,16 +99,35 @@ public:
 
     PIL_ERROR_CODE setWaveformSource(OSC_CHANNEL channel);
     PIL_ERROR_CODE getWaveformPreamble(std::string *result);
+    PIL_ERROR_CODE getWaveformPreamble(WaveformPreamble *preamble);
+    PIL_ERROR_CODE setWaveformByteOrder(bool bigEndian);
+    [[nodiscard]] bool isWaveformBigEndian() const;
     PIL_ERROR_CODE getWaveformPoints(int* nrWaveFormPoints);
     PIL_ERROR_CODE setWaveformPoints(int num_points);
     PIL_ERROR_CODE setWaveformPointsMode(std::string &mode);
     PIL_ERROR_CODE setWaveformFormat(FILE_FORMAT format);
     PIL_ERROR_CODE saveWaveformData(std::string &file_path); // TODO remove unnecessary default argument
+    PIL_ERROR_CODE saveWaveformNpz(const std::string &filePath, bool singlePrecision = false);
 
     PIL_ERROR_CODE getWaveformData(std::string *data);
+    PIL_ERROR_CODE getWaveformData(std::vector<uint8_t> *data);
+    PIL_ERROR_CODE getWaveformData(uint8_t *buffer, size_t capacity, size_t *length);
+    PIL_ERROR_CODE saveRawWaveformData(const std::string &filePath);
+    PIL_ERROR_CODE getVoltageData(std::vector<double> *voltages, std::vector<uint8_t> *validMask,
+                                  WaveformPreamble *preamble = nullptr);
+    PIL_ERROR_CODE getVoltageData(std::vector<float> *voltages, std::vector<uint8_t> *validMask,
+                                  WaveformPreamble *preamble = nullptr);
     PIL_ERROR_CODE getRealData(double **result);
-    std::vector<std::vector<double>> getRealDataPy();
     PIL_ERROR_CODE digitize(OSC_CHANNEL channel);
+    PIL_ERROR_CODE digitize(const std::vector<OSC_CHANNEL> &channels);
+    PIL_ERROR_CODE getMultiChannelData(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame);
+    PIL_ERROR_CODE digitizeAndFetch(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame);
+
+    PIL_ERROR_CODE setSegmentedAcquisition(int segmentCount);
+    PIL_ERROR_CODE disableSegmentedAcquisition();
+    PIL_ERROR_CODE getAcquiredSegmentCount(int *segmentCount);
+    PIL_ERROR_CODE captureSegments(int segmentCount, int timeoutInMs);
+    PIL_ERROR_CODE getSegmentedData(SegmentedWaveform *result);
 
     PIL_ERROR_CODE getSystemSetup(std::string *result);
     PIL_ERROR_CODE setDisplayMode(DISPLAY_MODES displayMode);
@@ -63,12 +136,59 @@ public:
 
     PIL_ERROR_CODE Exec2(const std::string &command, ExecArgs *args, std::string *result, bool br);
 
+    void setSettingsCacheEnabled(bool enable);
+    void invalidateSettingsCache();
+
+protected:
+    void invalidateCachedState() override;
+
 private:
+    /** Points mode selected with setWaveformPointsMode. **/
+    enum POINTS_MODE {
+        /** Not set since the cache was invalidated, e.g. changed on the front panel. Treated like RAW or MAXimum. **/
+        UNKNOWN_POINTS_MODE = 0,
+        NORMAL_POINTS_MODE = 1,
+        /** RAW or MAXimum, the number of points depends on the acquisition. **/
+        ACQUISITION_POINTS_MODE = 2
+    };
+
+    /**
+     * @brief Settings read from or written to the device, which are valid until a setter changes them.
+     */
+    struct SettingsCache {
+        bool pointsValid = false;
+        int points = 0;
+        bool preambleValid = false;
+        std::string preamble;
+        bool formatValid = false;
+        FILE_FORMAT format = BYTE;
+        POINTS_MODE pointsMode = UNKNOWN_POINTS_MODE;
+    };
+
+    void invalidateWaveformCache();
+    void invalidateAcquisitionDependentCache();
+
     // Helper-functions
     static std::string getTriggerEdgeStr(TRIGGER_EDGE edge) ;
     std::string getChannelFromEnum(OSC_CHANNEL channel) ;
     static std::string getDisplayModeFromEnum(DISPLAY_MODES displayMode);
     static std::string getFileFormatStrFromEnum(FILE_FORMAT format);
-    PIL_ERROR_CODE writeToFile(const char *data, const std::string &file_path);
+    std::string getDigitizeCommand(const std::vector<OSC_CHANNEL> &channels);
+    std::string getMultiChannelQueries(const std::vector<OSC_CHANNEL> &channels);
+    PIL_ERROR_CODE receiveMultiChannelData(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame);
+    PIL_ERROR_CODE receiveSegments(SegmentedWaveform *result);
+    PIL_ERROR_CODE receiveChannelWaveform(WaveformPreamble *preamble);
+    template<typename T>
+    PIL_ERROR_CODE getVoltageDataImpl(std::vector<T> *voltages, std::vector<uint8_t> *validMask,
+                                      WaveformPreamble *preamble);
+
+    /** Byte order of WORD samples, MSBFirst is the default of the device. **/
+    bool m_WaveformBigEndian = true;
+    /** Raw samples of the last waveform, reused so large captures are only allocated once. **/
+    std::vector<uint8_t> m_RawWaveform;
+    /** Validity mask written if the caller does not request it. **/
+    std::vector<uint8_t> m_ValidMask;
+    bool m_CacheEnabled = true;
+    SettingsCache m_Cache;
 
 };
@@ -16,6 +16,7 @@ class KST33500 : public FunctionGenerator {
 public:
     explicit KST33500(const char *ip, int timeoutInMS);
     explicit KST33500(const char *ip, int timeoutInMs, PIL::Logging *logger);
+    ~KST33500() override;
 
     PIL_ERROR_CODE turnOn() override;
     PIL_ERROR_CODE turnOff() override;
@@ -33,6 +34,7 @@ private:
     PIL_ERROR_CODE output(bool on);
     PIL_ERROR_CODE setPulseWidth(double value);
     std::string GetFunctionStr(FUNCTION_TYPE functionType);
+    void invalidateVoltageState();
 };
 
 #endif //CE_DEVICE_KST33500_H
@@ -19,6 +19,8 @@ public:
 
     explicit SPD1305(const char *ip, PIL::Logging *logger, int timeoutInMs);
 
+    ~SPD1305() override;
+
     PIL_ERROR_CODE turnOn(DC_CHANNEL channel) override;
     PIL_ERROR_CODE turnOff(DC_CHANNEL channel) override;
 
@@ -105,6 +105,11 @@ public:
 
     virtual PIL_ERROR_CODE setLimit(UNIT unit, SMU_CHANNEL channel, double limit, bool checkErrorBuffer) = 0;
     virtual PIL_ERROR_CODE setLevel(UNIT unit, SMU_CHANNEL channel, double level, bool checkErrorBuffer) = 0;
+
+    virtual PIL_ERROR_CODE setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                              double *value, bool checkErrorBuffer);
+    virtual PIL_ERROR_CODE measureIV(SMU_CHANNEL channel, double *current, double *voltage, bool checkErrorBuffer);
+    virtual PIL_ERROR_CODE measureBothChannels(UNIT unit, double *valueA, double *valueB, bool checkErrorBuffer);
 };
 
 
@@ -4,6 +4,7 @@
 #include "devices/KEI2600.h"
 #include "devices/KST3000.h"
 #include "devices/KST33500.h"
+#include "CSVWriter.h"
 #include "ctlib/Logging.hpp"
 #include <thread>
 
@@ -127,15 +128,17 @@ void oscTest() {
         std::string file_prefix =
                 "/home/alexander/Work/Data/memristor/test_data_1";
 
-        std::string data1 = file_prefix + "_1";
-        std::string data2 = file_prefix + "_2";
-
-        o.digitize(KST3000::CHANNEL_1);
-        o.setWaveformSource(KST3000::OSC_CHANNEL::CHANNEL_1);
-        o.saveWaveformData(data1);
-        o.digitize(KST3000::CHANNEL_2);
-        o.setWaveformSource(KST3000::OSC_CHANNEL::CHANNEL_2);
-        o.saveWaveformData(data2);
+        // Both channels are captured by the same trigger and fetched with a single round trip.
+        MultiChannelFrame frame;
+        if (o.digitizeAndFetch({KST3000::CHANNEL_1, KST3000::CHANNEL_2}, &frame) != PIL_NO_ERROR)
+            continue;
+
+        std::vector<double> times(frame.voltages[0].size());
+        for (size_t j = 0; j < times.size(); j++)
+            times[j] = frame.getTime(j);
+        CSVWriter::writeFile(file_prefix + ".csv", {{"time(ms)", times.data(), 1000},
+                                                    {"channel1(V)", frame.voltages[0].data()},
+                                                    {"channel2(V)", frame.voltages[1].data()}}, times.size());
         sleep(1);
     }
 }
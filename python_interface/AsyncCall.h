@@ -0,0 +1,200 @@
+/**
+ * @brief Awaitable device calls for the asyncio API of the python bindings.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_ASYNC_CALL_H
+#define INSTRUMENT_CONTROL_LIB_ASYNC_CALL_H
+
+#include "pybind11/pybind11.h"
+#include "Device.h"
+
+#include <exception> // std::exception
+#include <memory> // std::shared_ptr
+#include <optional> // std::optional
+#include <string> // std::string
+#include <utility> // std::move
+
+namespace AsyncCall {
+
+namespace py = pybind11;
+
+/**
+ * @brief Deletes a device without holding the GIL. Remaining async calls are executed before the device is
+ * destroyed, they need the GIL to complete their futures.
+ */
+struct DeviceDeleter {
+    template<typename DeviceType>
+    void operator()(DeviceType *device) const {
+        py::gil_scoped_release release;
+        // The I/O thread is stopped before the members of the derived device are destroyed.
+        device->stopIOThread();
+        delete device;
+    }
+};
+
+/** Holder of the device classes, which are bound to python. **/
+template<typename DeviceType>
+using DeviceHolder = std::unique_ptr<DeviceType, DeviceDeleter>;
+
+/**
+ * @brief Sets the result or exception of an asyncio future. Called on the event loop, so the future may have been
+ * cancelled in the meantime.
+ * @param future future to complete.
+ * @param result result of the device call.
+ * @param exception exception raised by the device call or None.
+ */
+inline void setFutureResult(py::object future, py::object result, py::object exception) {
+    if (future.attr("done")().cast<bool>())
+        return;
+    if (exception.is_none())
+        future.attr("set_result")(std::move(result));
+    else
+        future.attr("set_exception")(std::move(exception));
+}
+
+/**
+ * @brief Event loop and future of a submitted call. The references are only touched while holding the GIL.
+ */
+class PendingCall
+{
+public:
+    PendingCall(py::object loop, py::object future) : m_Loop(std::move(loop)), m_Future(std::move(future)) {}
+
+    ~PendingCall() {
+        if (m_Future) {
+            py::gil_scoped_acquire gil;
+            release();
+        }
+    }
+
+    PendingCall(const PendingCall &) = delete;
+    PendingCall &operator=(const PendingCall &) = delete;
+
+    /**
+     * @brief Schedules the completion of the future on its event loop. Must be called while holding the GIL.
+     * @param result result of the device call.
+     * @param exception exception raised by the device call or None.
+     */
+    void complete(py::object result, py::object exception) {
+        if (!m_Future)
+            return;
+        try {
+            m_Loop.attr("call_soon_threadsafe")(py::cpp_function(&setFutureResult), m_Future, std::move(result),
+                                                std::move(exception));
+        } catch (py::error_already_set &e) {
+            // The event loop was closed, nobody awaits the future anymore.
+            e.discard_as_unraisable("AsyncCall::PendingCall::complete");
+        }
+        release();
+    }
+
+private:
+    void release() {
+        m_Loop = py::object();
+        m_Future = py::object();
+    }
+
+    py::object m_Loop;
+    py::object m_Future;
+};
+
+/**
+ * @brief Executes a blocking device call on the I/O thread of the device and returns an asyncio future, which is
+ * completed on the running event loop with loop.call_soon_threadsafe. The event loop is never blocked and no python
+ * thread pool is required. Every device has its own I/O thread, which is started with the first async call, so the
+ * calls of one device are executed in submission order while different devices are served in parallel. Afterwards
+ * the synchronous bindings of the device are submitted as well, see AsyncCall::callSync.
+ * @param device device to submit the call to.
+ * @param call function executing the device call, called without holding the GIL.
+ * @param convert function converting the result of call into a python object, called while holding the GIL.
+ * @param priority HIGH_PRIORITY to execute the call before all waiting calls, e.g. to turn off an output.
+ * @return the future, which is completed with the converted result or a RuntimeError if the call threw.
+ */
+template<typename DeviceType, typename Call, typename Convert>
+py::object submitAndConvert(DeviceType &device, Call call, Convert convert,
+                            Device::PRIORITY priority = Device::NORMAL_PRIORITY) {
+    py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+    py::object future = loop.attr("create_future")();
+    auto pending = std::make_shared<PendingCall>(std::move(loop), future);
+
+    if (!device.isIOThreadRunning())
+        device.startIOThread();
+    device.Submit([pending, call = std::move(call), convert = std::move(convert)]() mutable {
+        std::optional<decltype(call())> result;
+        std::string error;
+        try {
+            result.emplace(call());
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+
+        py::gil_scoped_acquire gil;
+        try {
+            if (result)
+                pending->complete(convert(std::move(*result)), py::none());
+            else
+                pending->complete(py::none(), py::module_::import("builtins").attr("RuntimeError")(error));
+        } catch (py::error_already_set &e) {
+            pending->complete(py::none(), e.value());
+        } catch (const std::exception &e) {
+            pending->complete(py::none(), py::module_::import("builtins").attr("RuntimeError")(e.what()));
+        }
+    }, priority);
+    return future;
+}
+
+/**
+ * @brief Executes a blocking device call, whose result can be converted with py::cast.
+ * @see AsyncCall::submitAndConvert
+ */
+template<typename DeviceType, typename Call>
+py::object submit(DeviceType &device, Call call, Device::PRIORITY priority = Device::NORMAL_PRIORITY) {
+    return submitAndConvert(device, std::move(call), [](auto &&result) {
+        return py::cast(std::forward<decltype(result)>(result));
+    }, priority);
+}
+
+/**
+ * @brief Executes a device call of a synchronous binding. While the I/O thread of the device runs, the call is
+ * submitted and awaited, so it never races the pending async calls on the socket. Otherwise it is executed
+ * immediately. Must be called without holding the GIL, since the async calls need it to complete their futures.
+ * @param device device to execute the call on.
+ * @param call function executing the device call.
+ * @return the result of the call.
+ * @throw the exception thrown by the call.
+ */
+template<typename DeviceType, typename Call>
+auto callSync(DeviceType &device, Call call) {
+    return device.Submit(std::move(call)).get();
+}
+
+/**
+ * @brief Creates a synchronous binding of a device method, which releases the GIL and executes the method with
+ * callSync.
+ * @param method method of DeviceType or one of its base classes.
+ * @return function taking the device and the arguments of the method.
+ */
+template<typename DeviceType, typename Result, typename Class, typename... Args>
+auto sync(Result (Class::*method)(Args...)) {
+    return [method](DeviceType &device, Args... args) -> Result {
+        py::gil_scoped_release release;
+        return callSync(device, [&]() -> Result { return (device.*method)(std::forward<Args>(args)...); });
+    };
+}
+
+/**
+ * @brief Creates a synchronous binding of a const device method.
+ * @see AsyncCall::sync
+ */
+template<typename DeviceType, typename Result, typename Class, typename... Args>
+auto sync(Result (Class::*method)(Args...) const) {
+    return [method](DeviceType &device, Args... args) -> Result {
+        py::gil_scoped_release release;
+        return callSync(device, [&]() -> Result { return (device.*method)(std::forward<Args>(args)...); });
+    };
+}
+
+} // namespace AsyncCall
+
+#endif //INSTRUMENT_CONTROL_LIB_ASYNC_CALL_H
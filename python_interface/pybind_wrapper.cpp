@@ -1,5 +1,6 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
+#include "pybind11/numpy.h"
 #include "Device.h"
 #include "devices/types/DCPowerSupply.h"
 #include "devices/SPD1305.h"
@@ -7,11 +8,120 @@
 #include "devices/KEI2600.h"
 #include "devices/KST3000.h"
 #include "devices/KST33500.h"
+#include "AsyncCall.h"
+
+#include <limits> // std::numeric_limits
 
 using namespace pybind11;
 
 namespace py = pybind11;
 
+namespace {
+/**
+ * @brief Releases the GIL while a binding blocks on the socket or sleeps, so other python threads can drive their
+ * devices in parallel. A device must still only be used by one python thread at a time. Bindings of device methods
+ * use AsyncCall::sync, which releases the GIL itself, and bindings which create python objects release the GIL with a
+ * gil_scoped_release around AsyncCall::callSync instead.
+ */
+using ReleaseGIL = py::call_guard<py::gil_scoped_release>;
+
+/**
+ * @brief Moves a vector into a numpy array without copying the values. The array owns the vector through a capsule,
+ * which deletes it when the array is garbage collected.
+ * @param values values to move.
+ * @param shape shape of the array, the product must match the size of the vector. If empty, a 1D array is created.
+ * @return the array.
+ */
+template<typename T>
+py::array_t<T> toArray(std::vector<T> &&values, std::vector<py::ssize_t> shape = {}) {
+    auto *owner = new std::vector<T>(std::move(values));
+    py::capsule capsule(owner, [](void *vector) { delete static_cast<std::vector<T> *>(vector); });
+    if (shape.empty())
+        shape.push_back(static_cast<py::ssize_t>(owner->size()));
+    return py::array_t<T>(shape, owner->data(), capsule);
+}
+
+/**
+ * @brief Reads the valid samples of the waveform source, the times are followed by the voltages. Does not need the
+ * GIL.
+ * @param osc oscilloscope to read from.
+ * @return times and voltages in a single buffer, holes are removed.
+ * @throw PIL::Exception if the waveform could not be read.
+ */
+std::vector<double> readRealData(KST3000 &osc) {
+    std::vector<double> voltages;
+    std::vector<uint8_t> validMask;
+    WaveformPreamble preamble;
+    auto ret = osc.getVoltageData(&voltages, &validMask, &preamble);
+    if (ret != PIL_NO_ERROR)
+        throw PIL::Exception(ret, __FILENAME__, __LINE__, "Failed getting waveform data.");
+
+    size_t count = 0;
+    for (size_t i = 0; i < voltages.size(); i++)
+        count += WaveformConverter::isValid(validMask.data(), i);
+
+    // Both rows are written into a single buffer, which is handed to numpy without copying.
+    std::vector<double> result(2 * count);
+    for (size_t i = 0, j = 0; i < voltages.size(); i++) {
+        if (!WaveformConverter::isValid(validMask.data(), i))
+            continue;
+        result[j] = preamble.getTime(i);
+        result[count + j] = voltages[i];
+        j++;
+    }
+    return result;
+}
+
+/**
+ * @brief Converts the result of readRealData into a (2, n) array of times and voltages.
+ * @param realData times followed by voltages.
+ * @return the array.
+ */
+py::array_t<double> toRealDataArray(std::vector<double> &&realData) {
+    auto count = static_cast<py::ssize_t>(realData.size() / 2);
+    return toArray(std::move(realData), {2, count});
+}
+
+/**
+ * @brief Reads the valid samples of the waveform source into a (2, n) array of times and voltages.
+ * @param osc oscilloscope to read from.
+ * @return the array, holes are removed.
+ */
+py::array_t<double> getRealDataArray(KST3000 &osc) {
+    std::vector<double> realData;
+    {
+        py::gil_scoped_release release;
+        realData = AsyncCall::callSync(osc, [&]() { return readRealData(osc); });
+    }
+    return toRealDataArray(std::move(realData));
+}
+
+/**
+ * @brief Converts the result of digitizeAndFetch into a tuple of the error code, the shared time axis and a
+ * (channels, points) array of voltages. Holes are returned as NaN.
+ * @param ret error code of digitizeAndFetch.
+ * @param frame acquired channels.
+ * @return the tuple.
+ */
+py::tuple toFrameTuple(PIL_ERROR_CODE ret, MultiChannelFrame &frame) {
+    size_t points = frame.voltages.empty() ? 0 : frame.voltages[0].size();
+    std::vector<double> times(points);
+    for (size_t i = 0; i < times.size(); i++)
+        times[i] = frame.getTime(i);
+    // All channels have the same number of points, so they are stored as rows of a single array.
+    py::array_t<double> voltages({static_cast<py::ssize_t>(frame.voltages.size()),
+                                  static_cast<py::ssize_t>(points)});
+    auto rows = voltages.mutable_unchecked<2>();
+    for (size_t channel = 0; channel < frame.voltages.size(); channel++) {
+        for (size_t i = 0; i < points; i++) {
+            bool valid = WaveformConverter::isValid(frame.validMasks[channel].data(), i);
+            rows(channel, i) = valid ? frame.voltages[channel][i] : std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+    return py::make_tuple(ret, toArray(std::move(times)), voltages);
+}
+} // namespace
+
 PYBIND11_MODULE(py_instrument_control_lib, m) {
 
     enum_<PIL_ERROR_CODE>(m, "ERROR_CODE")
@@ -32,66 +142,288 @@ PYBIND11_MODULE(py_instrument_control_lib, m) {
         .value("PIL_ITEM_IN_ERROR_QUEUE", PIL_ERROR_CODE::PIL_ITEM_IN_ERROR_QUEUE);
 
     /** DC Powersupply **/
-    class_<SPD1305>(m, "SPD1305")
+    class_<SPD1305, AsyncCall::DeviceHolder<SPD1305>>(m, "SPD1305")
         .def(pybind11::init<char *, int>())
-        .def("turnOn", &SPD1305::turnOn)
-        .def("turnOff", &SPD1305::turnOff)
-        .def("setCurrent", &SPD1305::setCurrent)
-        .def("getCurrent", &SPD1305::getCurrent);
+        .def("turnOn", AsyncCall::sync<SPD1305>(&SPD1305::turnOn))
+        .def("turnOff", AsyncCall::sync<SPD1305>(&SPD1305::turnOff))
+        .def("setCurrent", AsyncCall::sync<SPD1305>(&SPD1305::setCurrent))
+        .def("getCurrent", AsyncCall::sync<SPD1305>(&SPD1305::getCurrent))
+        .def("setStateShadowEnabled", AsyncCall::sync<SPD1305>(&SPD1305::setStateShadowEnabled))
+        .def("invalidateState", AsyncCall::sync<SPD1305>(py::overload_cast<>(&SPD1305::invalidateState)))
+        .def("startIOThread", &SPD1305::startIOThread)
+        .def("stopIOThread", &SPD1305::stopIOThread, ReleaseGIL())
+        .def("isIOThreadRunning", &SPD1305::isIOThreadRunning)
+        .def("setCurrent_async", [](SPD1305 &psu, DCPowerSupply::DC_CHANNEL channel, double current) {
+            return AsyncCall::submit(psu, [&psu, channel, current]() { return psu.setCurrent(channel, current); });
+        })
+        .def("getCurrent_async", [](SPD1305 &psu, DCPowerSupply::DC_CHANNEL channel) {
+            return AsyncCall::submit(psu, [&psu, channel]() {
+                double current = 0;
+                auto ret = psu.getCurrent(channel, &current);
+                return std::make_tuple(ret, current);
+            });
+        })
+        .def("turnOff_async", [](SPD1305 &psu, DCPowerSupply::DC_CHANNEL channel) {
+            return AsyncCall::submit(psu, [&psu, channel]() { return psu.turnOff(channel); }, Device::HIGH_PRIORITY);
+        });
 
     enum_<DCPowerSupply::DC_CHANNEL>(m, "DC_CHANNEL")
         .value("CHANNEL_1", DCPowerSupply::DC_CHANNEL::CHANNEL_1)
         .value("CHANNEL_2", DCPowerSupply::DC_CHANNEL::CHANNEL_2);
 
     /** SMU **/
-    class_<KEI2600>(m, "KEI2600")
+    class_<KEI2600, AsyncCall::DeviceHolder<KEI2600>>(m, "KEI2600")
         .def(pybind11::init<char *, int, Device::SEND_METHOD>())
-        .def("enableBeep", &KEI2600::enableBeep)
-        .def("disableBeep", &KEI2600::disableBeep)
-        .def("beep", &KEI2600::beep)
-        .def("connect", &KEI2600::Connect)
-        .def("disconnect", &KEI2600::Disconnect)
-        .def("turnOn", &KEI2600::turnOn)
-        .def("turnOff", &KEI2600::turnOff)
-        .def("measure", &KEI2600::measurePy)
-        .def("setLevel", &KEI2600::setLevel)
-        .def("setLimit", &KEI2600::setLimit)
-
-        .def("enableMeasureAutoRange", &KEI2600::enableMeasureAutoRange)
-        .def("disableMeasureAutoRange", &KEI2600::disableMeasureAutoRange)
-        .def("enableSourceAutoRange", &KEI2600::enableSourceAutoRange)
-        .def("enableMeasureAnalogFilter", &KEI2600::enableMeasureAnalogFilter)
-        .def("disableMeasureAnalogFilter", &KEI2600::disableMeasureAnalogFilter)
-        .def("disableSourceAutoRange", &KEI2600::disableSourceAutoRange)
-        .def("setSourceRange", &KEI2600::setSourceRange)
-        .def("setSenseMode", &KEI2600::setSenseMode)
-        .def("getDeviceIdentifier", &KEI2600::getDeviceIdentifier)
-
-        .def("setMeasurePLC", &KEI2600::setMeasurePLC)
-        .def("setMeasureLowRange", &KEI2600::setMeasureLowRange)
-        .def("setMeasureAutoZero", &KEI2600::setMeasureAutoZero)
-        .def("setMeasureCount", &KEI2600::setMeasureCount)
-        .def("setSourceFunction", &KEI2600::setSourceFunction)
-        .def("setSourceOffMode", &KEI2600::setSourceOffMode)
-        .def("setSourceSettling", &KEI2600::setSourceSettling)
-        .def("enableSourceSink", &KEI2600::enableSourceSink)
-        .def("disableSourceSink", &KEI2600::disableSourceSink)
-        .def("displayMeasureFunction", &KEI2600::displayMeasureFunction)
-        .def("getLastError", &KEI2600::getLastError)
-        .def("clearErrorBuffer", &KEI2600::clearErrorBuffer)
-        .def("getErrorBufferStatus", &KEI2600::getErrorBufferStatus)
-
-        .def("sendScript", &KEI2600::sendScript)
-        .def("executeScript", &KEI2600::executeScript)
-        .def("sendAndExecuteScript", &KEI2600::sendAndExecuteScript)
-        .def("performLinearVoltageSweep", &KEI2600::performLinearVoltageSweep)
-        .def("executeBufferedScript", &KEI2600::executeBufferedScript)
-        .def("getBuffer", &KEI2600::readBufferPy)
-        .def("changeSendMode", &KEI2600::changeSendMode)
-        .def("delay", &KEI2600::delay)
+        .def("enableBeep", AsyncCall::sync<KEI2600>(&KEI2600::enableBeep))
+        .def("disableBeep", AsyncCall::sync<KEI2600>(&KEI2600::disableBeep))
+        .def("beep", AsyncCall::sync<KEI2600>(&KEI2600::beep))
+        .def("connect", AsyncCall::sync<KEI2600>(&KEI2600::Connect))
+        .def("disconnect", AsyncCall::sync<KEI2600>(&KEI2600::Disconnect))
+        .def("setStateShadowEnabled", AsyncCall::sync<KEI2600>(&KEI2600::setStateShadowEnabled))
+        .def("invalidateState", AsyncCall::sync<KEI2600>(py::overload_cast<>(&KEI2600::invalidateState)))
+        .def("startIOThread", &KEI2600::startIOThread)
+        .def("stopIOThread", &KEI2600::stopIOThread, ReleaseGIL())
+        .def("isIOThreadRunning", &KEI2600::isIOThreadRunning)
+        .def("turnOn_async", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, channel, checkErrorBuffer]() {
+                return smu.turnOn(channel, checkErrorBuffer);
+            });
+        })
+        .def("turnOff_async", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            // The output is turned off before all waiting calls.
+            return AsyncCall::submit(smu, [&smu, channel, checkErrorBuffer]() {
+                return smu.turnOff(channel, checkErrorBuffer);
+            }, Device::HIGH_PRIORITY);
+        })
+        .def("measure_async", [](KEI2600 &smu, SMU::UNIT unit, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, unit, channel, checkErrorBuffer]() {
+                return smu.measurePy(unit, channel, checkErrorBuffer);
+            });
+        })
+        .def("setLevelAndMeasure_async", [](KEI2600 &smu, SMU::UNIT sourceUnit, SMU::SMU_CHANNEL channel,
+                                            double level, SMU::UNIT measureUnit, bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, sourceUnit, channel, level, measureUnit, checkErrorBuffer]() {
+                double value = 0;
+                bool compliance = false;
+                auto ret = smu.setLevelAndMeasure(sourceUnit, channel, level, measureUnit, &value, &compliance,
+                                                  checkErrorBuffer);
+                return std::make_tuple(ret, value, compliance);
+            });
+        })
+        .def("measureIV_async", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, channel, checkErrorBuffer]() {
+                double current = 0, voltage = 0;
+                auto ret = smu.measureIV(channel, &current, &voltage, checkErrorBuffer);
+                return std::make_tuple(ret, current, voltage);
+            });
+        })
+        .def("setLevel_async", [](KEI2600 &smu, SMU::UNIT unit, SMU::SMU_CHANNEL channel, double level,
+                                  bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, unit, channel, level, checkErrorBuffer]() {
+                return smu.setLevel(unit, channel, level, checkErrorBuffer);
+            });
+        })
+        .def("setLimit_async", [](KEI2600 &smu, SMU::UNIT unit, SMU::SMU_CHANNEL channel, double limit,
+                                  bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, unit, channel, limit, checkErrorBuffer]() {
+                return smu.setLimit(unit, channel, limit, checkErrorBuffer);
+            });
+        })
+        .def("performSweep_async", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, const KEI2600::SweepConfig &config,
+                                      bool checkErrorBuffer) {
+            return AsyncCall::submit(smu, [&smu, channel, config, checkErrorBuffer]() {
+                return smu.performSweep(channel, config, checkErrorBuffer);
+            });
+        })
+        .def("getBuffer_async", [](KEI2600 &smu, const std::string &bufferName, bool checkErrorBuffer) {
+            return AsyncCall::submitAndConvert(smu, [&smu, bufferName, checkErrorBuffer]() {
+                return smu.readBufferPy(bufferName, checkErrorBuffer);
+            }, [](std::vector<double> &&values) { return toArray(std::move(values)); });
+        })
+        .def("turnOn", AsyncCall::sync<KEI2600>(&KEI2600::turnOn))
+        .def("turnOff", AsyncCall::sync<KEI2600>(&KEI2600::turnOff))
+        .def("measure", AsyncCall::sync<KEI2600>(&KEI2600::measurePy))
+        .def("setLevelAndMeasure", [](KEI2600 &smu, SMU::UNIT sourceUnit, SMU::SMU_CHANNEL channel, double level,
+                                      SMU::UNIT measureUnit, bool checkErrorBuffer) {
+            double value = 0;
+            bool compliance = false;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() {
+                    return smu.setLevelAndMeasure(sourceUnit, channel, level, measureUnit, &value, &compliance,
+                                                  checkErrorBuffer);
+                });
+            }
+            return py::make_tuple(ret, value, compliance);
+        })
+        .def("measureIV", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            double current = 0, voltage = 0;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() {
+                    return smu.measureIV(channel, &current, &voltage, checkErrorBuffer);
+                });
+            }
+            return py::make_tuple(ret, current, voltage);
+        })
+        .def("measureBothChannels", [](KEI2600 &smu, SMU::UNIT unit, bool checkErrorBuffer) {
+            double valueA = 0, valueB = 0;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() {
+                    return smu.measureBothChannels(unit, &valueA, &valueB, checkErrorBuffer);
+                });
+            }
+            return py::make_tuple(ret, valueA, valueB);
+        })
+        .def("isInCompliance", [](KEI2600 &smu, SMU::SMU_CHANNEL channel, bool checkErrorBuffer) {
+            bool compliance = false;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() {
+                    return smu.isInCompliance(channel, &compliance, checkErrorBuffer);
+                });
+            }
+            return py::make_tuple(ret, compliance);
+        })
+        .def("setLevel", AsyncCall::sync<KEI2600>(
+            py::overload_cast<SMU::UNIT, SMU::SMU_CHANNEL, double, bool>(&KEI2600::setLevel)))
+        .def("setLimit", AsyncCall::sync<KEI2600>(
+            py::overload_cast<SMU::UNIT, SMU::SMU_CHANNEL, double, bool>(&KEI2600::setLimit)))
+
+        .def("enableMeasureAutoRange", AsyncCall::sync<KEI2600>(&KEI2600::enableMeasureAutoRange))
+        .def("disableMeasureAutoRange", AsyncCall::sync<KEI2600>(&KEI2600::disableMeasureAutoRange))
+        .def("enableSourceAutoRange", AsyncCall::sync<KEI2600>(&KEI2600::enableSourceAutoRange))
+        .def("enableMeasureAnalogFilter", AsyncCall::sync<KEI2600>(&KEI2600::enableMeasureAnalogFilter))
+        .def("disableMeasureAnalogFilter", AsyncCall::sync<KEI2600>(&KEI2600::disableMeasureAnalogFilter))
+        .def("disableSourceAutoRange", AsyncCall::sync<KEI2600>(&KEI2600::disableSourceAutoRange))
+        .def("setSourceRange", AsyncCall::sync<KEI2600>(
+            py::overload_cast<SMU::UNIT, SMU::SMU_CHANNEL, double, bool>(&KEI2600::setSourceRange)))
+        .def("setSenseMode", AsyncCall::sync<KEI2600>(&KEI2600::setSenseMode))
+        .def("getDeviceIdentifier", AsyncCall::sync<KEI2600>(&KEI2600::getDeviceIdentifier))
+
+        .def("setMeasurePLC", AsyncCall::sync<KEI2600>(
+            py::overload_cast<SMU::SMU_CHANNEL, double, bool>(&KEI2600::setMeasurePLC)))
+        .def("setMeasureLowRange", AsyncCall::sync<KEI2600>(&KEI2600::setMeasureLowRange))
+        .def("setMeasureAutoZero", AsyncCall::sync<KEI2600>(&KEI2600::setMeasureAutoZero))
+        .def("setMeasureCount", AsyncCall::sync<KEI2600>(&KEI2600::setMeasureCount))
+        .def("setSourceFunction", AsyncCall::sync<KEI2600>(&KEI2600::setSourceFunction))
+        .def("setSourceOffMode", AsyncCall::sync<KEI2600>(&KEI2600::setSourceOffMode))
+        .def("setSourceSettling", AsyncCall::sync<KEI2600>(&KEI2600::setSourceSettling))
+        .def("enableSourceSink", AsyncCall::sync<KEI2600>(&KEI2600::enableSourceSink))
+        .def("disableSourceSink", AsyncCall::sync<KEI2600>(&KEI2600::disableSourceSink))
+        .def("displayMeasureFunction", AsyncCall::sync<KEI2600>(&KEI2600::displayMeasureFunction))
+        .def("getLastError", AsyncCall::sync<KEI2600>(&KEI2600::getLastError))
+        .def("clearErrorBuffer", AsyncCall::sync<KEI2600>(&KEI2600::clearErrorBuffer))
+        .def("getErrorBufferStatus", AsyncCall::sync<KEI2600>(&KEI2600::getErrorBufferStatus))
+        .def("checkErrors", AsyncCall::sync<KEI2600>(&KEI2600::checkErrors))
+        .def("setErrorCheckPolicy", AsyncCall::sync<KEI2600>(&KEI2600::setErrorCheckPolicy), py::arg("policy"),
+             py::arg("interval") = 1)
+        .def("getErrorCheckPolicy", AsyncCall::sync<KEI2600>(&KEI2600::getErrorCheckPolicy))
+        .def("getAttributedErrors", AsyncCall::sync<KEI2600>(&KEI2600::getAttributedErrors))
+        .def("clearAttributedErrors", AsyncCall::sync<KEI2600>(&KEI2600::clearAttributedErrors))
+
+        .def("sendScript", AsyncCall::sync<KEI2600>(&KEI2600::sendScript))
+        .def("executeScript", AsyncCall::sync<KEI2600>(&KEI2600::executeScript))
+        .def("sendAndExecuteScript", AsyncCall::sync<KEI2600>(&KEI2600::sendAndExecuteScript))
+        .def("setScriptUploadMethod", AsyncCall::sync<KEI2600>(&KEI2600::setScriptUploadMethod))
+        .def("getScriptUploadMethod", AsyncCall::sync<KEI2600>(&KEI2600::getScriptUploadMethod))
+        .def("setScriptCacheEnabled", AsyncCall::sync<KEI2600>(&KEI2600::setScriptCacheEnabled))
+        .def("setScriptCacheVerification", AsyncCall::sync<KEI2600>(&KEI2600::setScriptCacheVerification))
+        .def("clearScriptCache", AsyncCall::sync<KEI2600>(&KEI2600::clearScriptCache))
+        .def("performLinearVoltageSweep", AsyncCall::sync<KEI2600>(&KEI2600::performLinearVoltageSweep))
+        .def("loadSweepEngine", AsyncCall::sync<KEI2600>(&KEI2600::loadSweepEngine))
+        .def("performSweep", AsyncCall::sync<KEI2600>(&KEI2600::performSweep))
+        .def("executeBufferedScript", AsyncCall::sync<KEI2600>(&KEI2600::executeBufferedScript))
+        .def("getBuffer", [](KEI2600 &smu, const std::string &bufferName, bool checkErrorBuffer) {
+            std::vector<double> values;
+            {
+                py::gil_scoped_release release;
+                values = AsyncCall::callSync(smu, [&]() { return smu.readBufferPy(bufferName, checkErrorBuffer); });
+            }
+            return toArray(std::move(values));
+        })
+        .def("readBufferInto", [](KEI2600 &smu, const std::string &bufferName,
+                                  py::array_t<double, py::array::c_style> &values, bool checkErrorBuffer) {
+            // The array stays referenced by the arguments, so its memory is valid while the GIL is released.
+            double *data = values.mutable_data();
+            auto capacity = static_cast<size_t>(values.size());
+            size_t count = 0;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() {
+                    return smu.readBuffer(bufferName, data, capacity, &count, checkErrorBuffer);
+                });
+            }
+            return py::make_tuple(ret, count);
+        }, py::arg("bufferName"), py::arg("values").noconvert(), py::arg("checkErrorBuffer") = false)
+        .def("exportBufferToCSV", AsyncCall::sync<KEI2600>(&KEI2600::exportBufferToCSV))
+        .def("exportBufferToNpz", AsyncCall::sync<KEI2600>(&KEI2600::exportBufferToNpz))
+        .def("setBufferFormat", AsyncCall::sync<KEI2600>(&KEI2600::setBufferFormat))
+        .def("getBufferFormat", AsyncCall::sync<KEI2600>(&KEI2600::getBufferFormat))
+        .def("getReadChunkSize", AsyncCall::sync<KEI2600>(&KEI2600::getReadChunkSize))
+        .def("changeSendMode", AsyncCall::sync<KEI2600>(&KEI2600::changeSendMode))
+        .def("execAsync", [](KEI2600 &smu, const std::string &command, bool expectResult) {
+            return AsyncCall::callSync(smu, [&]() { return smu.ExecAsync(command, nullptr, expectResult); });
+        }, py::arg("command"), py::arg("expectResult") = true, ReleaseGIL())
+        .def("flush", AsyncCall::sync<KEI2600>(&KEI2600::Flush))
+        .def("getResult", [](KEI2600 &smu, Device::ExecTicket ticket) {
+            std::string result;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(smu, [&]() { return smu.GetResult(ticket, &result); });
+            }
+            return py::make_tuple(ret, result);
+        })
+        .def("delay", AsyncCall::sync<KEI2600>(&KEI2600::delay))
         .def_readonly("CHANNEL_A_BUFFER", &KEI2600::CHANNEL_A_BUFFER)
         .def_readonly("CHANNEL_B_BUFFER", &KEI2600::CHANNEL_B_BUFFER);
 
+    enum_<KEI2600::BUFFER_FORMAT>(m, "BUFFER_FORMAT")
+            .value("ASCII", KEI2600::ASCII_FORMAT)
+            .value("REAL32", KEI2600::REAL32_FORMAT)
+            .value("REAL64", KEI2600::REAL64_FORMAT);
+
+    enum_<KEI2600::ERROR_CHECK_POLICY>(m, "ERROR_CHECK_POLICY")
+            .value("CHECK_EVERY_CALL", KEI2600::CHECK_EVERY_CALL)
+            .value("CHECK_EVERY_N_CALLS", KEI2600::CHECK_EVERY_N_CALLS)
+            .value("CHECK_DEFERRED", KEI2600::CHECK_DEFERRED)
+            .value("CHECK_PIGGYBACK", KEI2600::CHECK_PIGGYBACK);
+
+    class_<KEI2600::AttributedError>(m, "AttributedError")
+            .def_readonly("command", &KEI2600::AttributedError::command)
+            .def_readonly("errorCount", &KEI2600::AttributedError::errorCount);
+
+    enum_<KEI2600::SCRIPT_UPLOAD_METHOD>(m, "SCRIPT_UPLOAD_METHOD")
+            .value("SOCKET_UPLOAD", KEI2600::SOCKET_UPLOAD)
+            .value("HTTP_UPLOAD", KEI2600::HTTP_UPLOAD);
+
+    enum_<KEI2600::SWEEP_MODE>(m, "SWEEP_MODE")
+            .value("LINEAR", KEI2600::LINEAR_SWEEP)
+            .value("LOG", KEI2600::LOG_SWEEP)
+            .value("LIST", KEI2600::LIST_SWEEP);
+
+    class_<KEI2600::SweepConfig>(m, "SweepConfig")
+            .def(pybind11::init<>())
+            .def_readwrite("mode", &KEI2600::SweepConfig::mode)
+            .def_readwrite("sourceUnit", &KEI2600::SweepConfig::sourceUnit)
+            .def_readwrite("start", &KEI2600::SweepConfig::start)
+            .def_readwrite("stop", &KEI2600::SweepConfig::stop)
+            .def_readwrite("points", &KEI2600::SweepConfig::points)
+            .def_readwrite("values", &KEI2600::SweepConfig::values)
+            .def_readwrite("limit", &KEI2600::SweepConfig::limit)
+            .def_readwrite("nplc", &KEI2600::SweepConfig::nplc)
+            .def_readwrite("period", &KEI2600::SweepConfig::period)
+            .def_readwrite("pulseWidth", &KEI2600::SweepConfig::pulseWidth)
+            .def_readwrite("bufferName", &KEI2600::SweepConfig::bufferName)
+            .def_readwrite("measure", &KEI2600::SweepConfig::measure);
+
     enum_<SMU::SEND_METHOD>(m, "SEND_METHOD")
             .value("DIRECT_SEND", SMU::DIRECT_SEND)
             .value("BUFFER_ENABLED", SMU::BUFFER_ENABLED);
@@ -140,34 +472,126 @@ PYBIND11_MODULE(py_instrument_control_lib, m) {
             .value("CALIBRATION", SMU::SMU_SENSE::CALIBRATION);
 
     /** Oscilloscope**/
-    class_<KST3000>(m, "KST3000")
+    class_<KST3000, AsyncCall::DeviceHolder<KST3000>>(m, "KST3000")
         .def(pybind11::init<char *, int>())
-        .def("connect", &KST3000::Connect)
-        .def("disconnect", &KST3000::Disconnect)
-        .def("run", &KST3000::run)
-        .def("stop", &KST3000::stop)
-        .def("single", &KST3000::single)
-        .def("autoScale", &KST3000::autoScale)
-        .def("setTimeRange", &KST3000::setTimeRange)
-        .def("setChannelOffset", &KST3000::setChannelOffset)
-        .def("setChannelScale", &KST3000::setChannelScale)
-        .def("setChannelRange", &KST3000::setChannelRange)
-        .def("setTriggerEdge", &KST3000::setTriggerEdge)
-        .def("setTriggerSource", &KST3000::setTriggerSource)
-        .def("setTimeDelay", &KST3000::setTimeDelay)
-        .def("setWaveformSource", &KST3000::setWaveformSource)
-        .def("getWaveformPreamble", &KST3000::getWaveformPreamble)
-        .def("getWaveformPoints", &KST3000::getWaveformPoints)
-        .def("setWaveformPoints", &KST3000::setWaveformPoints)
-        .def("setWaveformPointsMode", &KST3000::setWaveformPointsMode)
-        .def("setWaveformFormat", &KST3000::setWaveformFormat)
-        .def("saveWaveformData", &KST3000::saveWaveformData)
-        .def("getRealData", &KST3000::getRealDataPy)
-        .def("digitize", &KST3000::digitize)
-        .def("getSystemSetup", &KST3000::getSystemSetup)
-        .def("setDisplayMode", &KST3000::setDisplayMode)
-        .def("displayConnection", &KST3000::displayConnection)
-        .def("setChannelDisplay", &KST3000::setChannelDisplay);
+        .def("connect", AsyncCall::sync<KST3000>(&KST3000::Connect))
+        .def("disconnect", AsyncCall::sync<KST3000>(&KST3000::Disconnect))
+        .def("run", AsyncCall::sync<KST3000>(&KST3000::run))
+        .def("stop", AsyncCall::sync<KST3000>(&KST3000::stop))
+        .def("single", AsyncCall::sync<KST3000>(&KST3000::single))
+        .def("autoScale", AsyncCall::sync<KST3000>(&KST3000::autoScale))
+        .def("setTimeRange", AsyncCall::sync<KST3000>(&KST3000::setTimeRange))
+        .def("setChannelOffset", AsyncCall::sync<KST3000>(&KST3000::setChannelOffset))
+        .def("setChannelScale", AsyncCall::sync<KST3000>(&KST3000::setChannelScale))
+        .def("setChannelRange", AsyncCall::sync<KST3000>(&KST3000::setChannelRange))
+        .def("setTriggerEdge", AsyncCall::sync<KST3000>(&KST3000::setTriggerEdge))
+        .def("setTriggerSource", AsyncCall::sync<KST3000>(&KST3000::setTriggerSource))
+        .def("setTimeDelay", AsyncCall::sync<KST3000>(&KST3000::setTimeDelay))
+        .def("setWaveformSource", AsyncCall::sync<KST3000>(&KST3000::setWaveformSource))
+        .def("getWaveformPreamble", [](KST3000 &osc) {
+            std::string preamble;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.getWaveformPreamble(&preamble); });
+            }
+            return py::make_tuple(ret, preamble);
+        })
+        .def("getWaveformPoints", AsyncCall::sync<KST3000>(&KST3000::getWaveformPoints))
+        .def("setWaveformPoints", AsyncCall::sync<KST3000>(&KST3000::setWaveformPoints))
+        .def("setWaveformPointsMode", AsyncCall::sync<KST3000>(&KST3000::setWaveformPointsMode))
+        .def("setWaveformFormat", AsyncCall::sync<KST3000>(&KST3000::setWaveformFormat))
+        .def("setWaveformByteOrder", AsyncCall::sync<KST3000>(&KST3000::setWaveformByteOrder))
+        .def("setSettingsCacheEnabled", AsyncCall::sync<KST3000>(&KST3000::setSettingsCacheEnabled))
+        .def("invalidateSettingsCache", AsyncCall::sync<KST3000>(&KST3000::invalidateSettingsCache))
+        .def("startIOThread", &KST3000::startIOThread)
+        .def("stopIOThread", &KST3000::stopIOThread, ReleaseGIL())
+        .def("isIOThreadRunning", &KST3000::isIOThreadRunning)
+        .def("single_async", [](KST3000 &osc) {
+            return AsyncCall::submit(osc, [&osc]() { return osc.single(); });
+        })
+        .def("digitize_async", [](KST3000 &osc, const std::vector<Oscilloscope::OSC_CHANNEL> &channels) {
+            return AsyncCall::submit(osc, [&osc, channels]() { return osc.digitize(channels); });
+        })
+        .def("getRealData_async", [](KST3000 &osc) {
+            return AsyncCall::submitAndConvert(osc, [&osc]() { return readRealData(osc); }, &toRealDataArray);
+        })
+        .def("digitizeAndFetch_async", [](KST3000 &osc, const std::vector<Oscilloscope::OSC_CHANNEL> &channels) {
+            return AsyncCall::submitAndConvert(osc, [&osc, channels]() {
+                std::pair<PIL_ERROR_CODE, MultiChannelFrame> result;
+                result.first = osc.digitizeAndFetch(channels, &result.second);
+                return result;
+            }, [](std::pair<PIL_ERROR_CODE, MultiChannelFrame> &&result) {
+                return toFrameTuple(result.first, result.second);
+            });
+        })
+        .def("saveWaveformData", AsyncCall::sync<KST3000>(&KST3000::saveWaveformData))
+        .def("saveWaveformNpz", AsyncCall::sync<KST3000>(&KST3000::saveWaveformNpz))
+        .def("saveRawWaveformData", AsyncCall::sync<KST3000>(&KST3000::saveRawWaveformData))
+        .def("getRealData", &getRealDataArray)
+        .def("getWaveformDataInto", [](KST3000 &osc, py::array_t<uint8_t, py::array::c_style> &buffer) {
+            uint8_t *data = buffer.mutable_data();
+            auto capacity = static_cast<size_t>(buffer.size());
+            size_t length = 0;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.getWaveformData(data, capacity, &length); });
+            }
+            return py::make_tuple(ret, length);
+        }, py::arg("buffer").noconvert())
+        .def("digitize", AsyncCall::sync<KST3000>(py::overload_cast<Oscilloscope::OSC_CHANNEL>(&KST3000::digitize)))
+        .def("digitize", AsyncCall::sync<KST3000>(
+            py::overload_cast<const std::vector<Oscilloscope::OSC_CHANNEL> &>(&KST3000::digitize)))
+        .def("digitizeAndFetch", [](KST3000 &osc, const std::vector<Oscilloscope::OSC_CHANNEL> &channels) {
+            MultiChannelFrame frame;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.digitizeAndFetch(channels, &frame); });
+            }
+            return toFrameTuple(ret, frame);
+        })
+        .def("setSegmentedAcquisition", AsyncCall::sync<KST3000>(&KST3000::setSegmentedAcquisition))
+        .def("disableSegmentedAcquisition", AsyncCall::sync<KST3000>(&KST3000::disableSegmentedAcquisition))
+        .def("captureSegments", AsyncCall::sync<KST3000>(&KST3000::captureSegments))
+        .def("getAcquiredSegmentCount", [](KST3000 &osc) {
+            int segmentCount = 0;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.getAcquiredSegmentCount(&segmentCount); });
+            }
+            return py::make_tuple(ret, segmentCount);
+        })
+        .def("getSegmentedData", [](KST3000 &osc) {
+            SegmentedWaveform waveform;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.getSegmentedData(&waveform); });
+            }
+            return py::make_tuple(ret, toArray(std::move(waveform.timeTags)),
+                                  py::bytes(reinterpret_cast<const char *>(waveform.samples.data()),
+                                            waveform.samples.size()), waveform.bytesPerSegment);
+        })
+        .def("getSystemSetup", AsyncCall::sync<KST3000>(&KST3000::getSystemSetup))
+        .def("setDisplayMode", AsyncCall::sync<KST3000>(&KST3000::setDisplayMode))
+        .def("displayConnection", AsyncCall::sync<KST3000>(&KST3000::displayConnection))
+        .def("setChannelDisplay", AsyncCall::sync<KST3000>(&KST3000::setChannelDisplay))
+        .def("execAsync", [](KST3000 &osc, const std::string &command, bool expectResult) {
+            return AsyncCall::callSync(osc, [&]() { return osc.ExecAsync(command, nullptr, expectResult); });
+        }, py::arg("command"), py::arg("expectResult") = true, ReleaseGIL())
+        .def("flush", AsyncCall::sync<KST3000>(&KST3000::Flush))
+        .def("getResult", [](KST3000 &osc, Device::ExecTicket ticket) {
+            std::string result;
+            PIL_ERROR_CODE ret;
+            {
+                py::gil_scoped_release release;
+                ret = AsyncCall::callSync(osc, [&]() { return osc.GetResult(ticket, &result); });
+            }
+            return py::make_tuple(ret, result);
+        });
 
 
     enum_<Oscilloscope::OSC_CHANNEL>(m, "OSC_CHANNEL")
@@ -198,19 +622,44 @@ PYBIND11_MODULE(py_instrument_control_lib, m) {
         .value("MILLI_VOLT", Oscilloscope::MILLI_VOLT);
 
     /** Function Generator **/
-    class_<KST33500>(m, "KST33500")
+    class_<KST33500, AsyncCall::DeviceHolder<KST33500>>(m, "KST33500")
             .def(pybind11::init<char *, int>())
-            .def("connect", &KST33500::Connect)
-            .def("disconnect", &KST33500::Disconnect)
-            .def("turnOn", &KST33500::turnOn)
-            .def("turnOff", &KST33500::turnOff)
-            .def("setFrequency", &KST33500::setFrequency)
-            .def("setAmplitude", &KST33500::setAmplitude)
-            .def("setOffset", &KST33500::setOffset)
-            .def("setPhase", &KST33500::setPhase)
-            .def("setFunction", &KST33500::setFunction)
-            .def("display", &KST33500::display)
-            .def("display", &KST33500::displayConnection);
+            .def("connect", AsyncCall::sync<KST33500>(&KST33500::Connect))
+            .def("disconnect", AsyncCall::sync<KST33500>(&KST33500::Disconnect))
+            .def("setStateShadowEnabled", AsyncCall::sync<KST33500>(&KST33500::setStateShadowEnabled))
+            .def("invalidateState", AsyncCall::sync<KST33500>(py::overload_cast<>(&KST33500::invalidateState)))
+            .def("startIOThread", &KST33500::startIOThread)
+            .def("stopIOThread", &KST33500::stopIOThread, ReleaseGIL())
+            .def("isIOThreadRunning", &KST33500::isIOThreadRunning)
+            .def("turnOn_async", [](KST33500 &generator) {
+                return AsyncCall::submit(generator, [&generator]() { return generator.turnOn(); });
+            })
+            .def("turnOff_async", [](KST33500 &generator) {
+                return AsyncCall::submit(generator, [&generator]() { return generator.turnOff(); },
+                                         Device::HIGH_PRIORITY);
+            })
+            .def("setFrequency_async", [](KST33500 &generator, double value) {
+                return AsyncCall::submit(generator, [&generator, value]() { return generator.setFrequency(value); });
+            })
+            .def("setAmplitude_async", [](KST33500 &generator, double value, const std::string &constrain) {
+                return AsyncCall::submit(generator, [&generator, value, constrain]() {
+                    return generator.setAmplitude(value, constrain.c_str());
+                });
+            })
+            .def("setFunction_async", [](KST33500 &generator, FunctionGenerator::FUNCTION_TYPE functionType) {
+                return AsyncCall::submit(generator, [&generator, functionType]() {
+                    return generator.setFunction(functionType);
+                });
+            })
+            .def("turnOn", AsyncCall::sync<KST33500>(&KST33500::turnOn))
+            .def("turnOff", AsyncCall::sync<KST33500>(&KST33500::turnOff))
+            .def("setFrequency", AsyncCall::sync<KST33500>(&KST33500::setFrequency))
+            .def("setAmplitude", AsyncCall::sync<KST33500>(&KST33500::setAmplitude))
+            .def("setOffset", AsyncCall::sync<KST33500>(&KST33500::setOffset))
+            .def("setPhase", AsyncCall::sync<KST33500>(&KST33500::setPhase))
+            .def("setFunction", AsyncCall::sync<KST33500>(&KST33500::setFunction))
+            .def("display", AsyncCall::sync<KST33500>(&KST33500::display))
+            .def("display", AsyncCall::sync<KST33500>(&KST33500::displayConnection));
 
     enum_<FunctionGenerator::FUNCTION_TYPE>(m, "FUNCTION_TYPE")
         .value("SIN", FunctionGenerator::SIN)
@@ -0,0 +1,95 @@
+/**
+ * @brief Implementation of the chunk size selection used for multi round trip transfers.
+ * @authors Florian Frank
+ */
+#include "AdaptiveChunkSizer.h"
+
+#include <algorithm> // std::clamp, std::max
+
+/** The chunk size grows at most by this factor per update to avoid overshooting on a single fast sample. **/
+#define MAX_GROWTH_FACTOR 4
+/** Weight of the newest sample, when averaging throughput and bytes per value. **/
+#define SMOOTHING_FACTOR 0.5
+
+/**
+ * @brief Constructor sets the limits of the chunk size.
+ * @param minChunkSize lower bound of the number of values per chunk.
+ * @param maxChunkSize upper bound of the number of values per chunk, e.g. limited by the device.
+ * @param rttFactor transferring a chunk should take rttFactor times the round trip time.
+ * A factor of 20 limits the round trip overhead to about 5 %.
+ */
+AdaptiveChunkSizer::AdaptiveChunkSizer(size_t minChunkSize, size_t maxChunkSize, double rttFactor)
+        : m_MinChunkSize(minChunkSize), m_MaxChunkSize(std::max(minChunkSize, maxChunkSize)), m_RTTFactor(rttFactor),
+          m_ChunkSize(minChunkSize) {
+}
+
+/**
+ * @brief Starts a new transfer. The throughput is unknown, so the initial chunk size is used for the first chunk.
+ * @param roundTripTime round trip time measured with a short query right before the transfer.
+ * @param bytesPerValue expected number of bytes per value, e.g. 8 for double values.
+ * @param initialChunkSize number of values requested with the first chunk.
+ */
+void AdaptiveChunkSizer::reset(std::chrono::duration<double> roundTripTime, double bytesPerValue,
+                               size_t initialChunkSize) {
+    m_RoundTripTime = roundTripTime.count();
+    m_BytesPerValue = bytesPerValue > 0 ? bytesPerValue : 1;
+    m_Throughput = 0;
+    m_ChunkSize = std::clamp(initialChunkSize, m_MinChunkSize, m_MaxChunkSize);
+}
+
+/**
+ * @brief Updates throughput and bytes per value with the statistics of the last chunk and calculates the next
+ * chunk size.
+ * @param values number of values received with the last chunk.
+ * @param bytes number of bytes received with the last chunk.
+ * @param elapsed time between sending the request and receiving the last byte.
+ */
+void AdaptiveChunkSizer::update(size_t values, size_t bytes, std::chrono::duration<double> elapsed) {
+    if (values == 0 || bytes == 0)
+        return;
+
+    // The first round trip of each chunk is pure latency, only the remaining time is spent transferring data.
+    double transferTime = std::max(elapsed.count() - m_RoundTripTime, elapsed.count() * 0.1);
+    double throughput = transferTime > 0 ? static_cast<double>(bytes) / transferTime : 0;
+    double bytesPerValue = static_cast<double>(bytes) / static_cast<double>(values);
+
+    if (m_Throughput <= 0)
+        m_Throughput = throughput;
+    else
+        m_Throughput = SMOOTHING_FACTOR * throughput + (1 - SMOOTHING_FACTOR) * m_Throughput;
+    m_BytesPerValue = SMOOTHING_FACTOR * bytesPerValue + (1 - SMOOTHING_FACTOR) * m_BytesPerValue;
+
+    if (m_Throughput <= 0 || m_RoundTripTime <= 0) {
+        m_ChunkSize = std::min(m_ChunkSize * MAX_GROWTH_FACTOR, m_MaxChunkSize);
+        return;
+    }
+
+    double targetBytes = m_Throughput * m_RoundTripTime * m_RTTFactor;
+    auto targetValues = static_cast<size_t>(targetBytes / m_BytesPerValue);
+    targetValues = std::min(targetValues, m_ChunkSize * MAX_GROWTH_FACTOR);
+    m_ChunkSize = std::clamp(targetValues, m_MinChunkSize, m_MaxChunkSize);
+}
+
+/**
+ * @brief Returns the number of values, which should be requested with the next chunk.
+ * @return chunk size in values.
+ */
+size_t AdaptiveChunkSizer::getChunkSize() const {
+    return m_ChunkSize;
+}
+
+/**
+ * @brief Returns the round trip time passed to reset.
+ * @return round trip time in seconds.
+ */
+double AdaptiveChunkSizer::getRoundTripTime() const {
+    return m_RoundTripTime;
+}
+
+/**
+ * @brief Returns the averaged throughput of the current transfer.
+ * @return throughput in bytes per second. 0 if no chunk was received yet.
+ */
+double AdaptiveChunkSizer::getThroughput() const {
+    return m_Throughput;
+}
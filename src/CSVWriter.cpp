@@ -0,0 +1,169 @@
+/**
+ * @brief Implementation of the streaming CSV export.
+ * @authors Florian Frank
+ */
+#include "CSVWriter.h"
+
+#include <algorithm> // std::min
+#include <charconv> // std::to_chars
+#include <cmath> // std::isnan
+#include <thread> // std::thread
+
+/** Maximum number of characters of a formatted double including the separator. **/
+#define MAX_FIELD_LENGTH 32
+
+/**
+ * @brief Constructor only stores the configuration, the buffers are allocated with the first export.
+ * @param threadCount number of threads formatting rows, 0 to use the number of hardware threads.
+ * @param rowsPerBlock number of rows formatted into one buffer before it is written.
+ */
+CSVWriter::CSVWriter(unsigned threadCount, size_t rowsPerBlock)
+        : m_ThreadCount(threadCount), m_RowsPerBlock(std::max<size_t>(rowsPerBlock, 1)) {
+    if (m_ThreadCount == 0)
+        m_ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Destructor closes the file if it is still open.
+ */
+CSVWriter::~CSVWriter() {
+    close();
+}
+
+/**
+ * @brief Creates or overwrites the file to export to.
+ * @param filePath path of the file.
+ * @return PIL_NO_ERROR if the file was opened, PIL_NO_SUCH_FILE otherwise.
+ */
+PIL_ERROR_CODE CSVWriter::open(const std::string &filePath) {
+    close();
+    m_File = std::fopen(filePath.c_str(), "wb");
+    if (!m_File)
+        return PIL_NO_SUCH_FILE;
+    // Every write call passes a complete block, so the buffer of the FILE would only add a copy.
+    std::setvbuf(m_File, nullptr, _IONBF, 0);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Formats and writes the columns row by row. Blocks of rows are formatted in parallel, each block is written
+ * as soon as all previous blocks are written.
+ * @param columns columns to export, all columns must contain at least rows values.
+ * @param rows number of rows to write.
+ * @param writeHeader if true, a line with the names of the columns is written first.
+ * @return PIL_NO_ERROR if all rows were written, PIL_INTERFACE_CLOSED if the file is not open, PIL_ERRNO if a write
+ * failed.
+ */
+PIL_ERROR_CODE CSVWriter::writeColumns(const std::vector<Column> &columns, size_t rows, bool writeHeader) {
+    if (!m_File)
+        return PIL_INTERFACE_CLOSED;
+    if (columns.empty())
+        return PIL_INVALID_ARGUMENTS;
+
+    if (writeHeader) {
+        std::string header;
+        for (size_t i = 0; i < columns.size(); i++) {
+            header += columns[i].name;
+            header += i + 1 < columns.size() ? ',' : '\n';
+        }
+        auto ret = writeBuffer(header);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+
+    m_Buffers.resize(m_ThreadCount);
+    std::vector<size_t> lengths(m_ThreadCount);
+    std::vector<std::thread> workers;
+    for (size_t row = 0; row < rows;) {
+        size_t blockCount = std::min<size_t>(m_ThreadCount, (rows - row + m_RowsPerBlock - 1) / m_RowsPerBlock);
+
+        // The first block is formatted by the calling thread.
+        workers.clear();
+        for (size_t block = 1; block < blockCount; block++) {
+            size_t first = row + block * m_RowsPerBlock;
+            size_t last = std::min(rows, first + m_RowsPerBlock);
+            workers.emplace_back([&columns, &lengths, this, block, first, last]() {
+                lengths[block] = formatRows(columns, first, last, &m_Buffers[block]);
+            });
+        }
+        lengths[0] = formatRows(columns, row, std::min(rows, row + m_RowsPerBlock), &m_Buffers[0]);
+        for (auto &worker: workers)
+            worker.join();
+
+        for (size_t block = 0; block < blockCount; block++) {
+            if (std::fwrite(m_Buffers[block].data(), 1, lengths[block], m_File) != lengths[block])
+                return PIL_ERRNO;
+        }
+        row = std::min(rows, row + blockCount * m_RowsPerBlock);
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Closes the file.
+ * @return PIL_NO_ERROR if the file was closed or not open, PIL_ERRNO if pending data could not be written.
+ */
+PIL_ERROR_CODE CSVWriter::close() {
+    if (!m_File)
+        return PIL_NO_ERROR;
+    int ret = std::fclose(m_File);
+    m_File = nullptr;
+    return ret == 0 ? PIL_NO_ERROR : PIL_ERRNO;
+}
+
+/**
+ * @brief Exports columns with a header line to a file.
+ * @param filePath path of the file to create or overwrite.
+ * @param columns columns to export.
+ * @param rows number of rows to write.
+ * @return PIL_NO_ERROR if the file was written, otherwise return error code.
+ */
+/* static */ PIL_ERROR_CODE CSVWriter::writeFile(const std::string &filePath, const std::vector<Column> &columns,
+                                                 size_t rows) {
+    CSVWriter writer;
+    auto ret = writer.open(filePath);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    ret = writer.writeColumns(columns, rows);
+    auto closeRet = writer.close();
+    return ret != PIL_NO_ERROR ? ret : closeRet;
+}
+
+/**
+ * @brief Formats the rows from firstRow to lastRow (exclusive). The buffer only grows, so it is allocated once per
+ * block size and its length is returned separately.
+ * @param columns columns to format.
+ * @param firstRow index of the first row.
+ * @param lastRow index after the last row.
+ * @param buffer buffer to format to.
+ * @return number of characters written to the buffer.
+ */
+/* static */ size_t CSVWriter::formatRows(const std::vector<Column> &columns, size_t firstRow, size_t lastRow,
+                                          std::string *buffer) {
+    size_t required = (lastRow - firstRow) * columns.size() * MAX_FIELD_LENGTH;
+    if (buffer->size() < required)
+        buffer->resize(required);
+
+    char *position = buffer->data();
+    char *end = position + buffer->size();
+    for (size_t row = firstRow; row < lastRow; row++) {
+        for (size_t column = 0; column < columns.size(); column++) {
+            double value = columns[column].values[row];
+            if (!std::isnan(value))
+                position = std::to_chars(position, end, value * columns[column].scale).ptr;
+            *position++ = column + 1 < columns.size() ? ',' : '\n';
+        }
+    }
+    return position - buffer->data();
+}
+
+/**
+ * @brief Writes a buffer completely.
+ * @param buffer data to write.
+ * @return PIL_NO_ERROR if all bytes were written, PIL_ERRNO otherwise.
+ */
+PIL_ERROR_CODE CSVWriter::writeBuffer(const std::string &buffer) {
+    if (std::fwrite(buffer.data(), 1, buffer.size(), m_File) != buffer.size())
+        return PIL_ERRNO;
+    return PIL_NO_ERROR;
+}
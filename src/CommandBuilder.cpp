@@ -0,0 +1,108 @@
+/**
+ * @brief Implementation of the allocation free command builder.
+ * @authors Florian Frank
+ */
+#include "CommandBuilder.h"
+
+#include <charconv> // std::to_chars
+
+/** Maximum number of characters required to format a double in the shortest round trip representation. **/
+#define MAX_NUMBER_LENGTH 32
+
+/**
+ * @brief Constructor reserves the buffer, so that typical commands never cause an allocation.
+ * @param initialCapacity number of characters to reserve.
+ */
+CommandBuilder::CommandBuilder(size_t initialCapacity) {
+    m_Buffer.reserve(initialCapacity);
+}
+
+/**
+ * @brief Clears the content of the command. The capacity of the buffer is kept.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::clear() {
+    m_Buffer.clear();
+    return *this;
+}
+
+/**
+ * @brief Appends a string, e.g. a name which is only known at runtime.
+ * @param str string to append.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::Add(std::string_view str) {
+    m_Buffer.append(str.data(), str.size());
+    return *this;
+}
+
+/**
+ * @brief Appends a single character, e.g. the channel letter of an SMU.
+ * @param c character to append.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::Add(char c) {
+    m_Buffer.push_back(c);
+    return *this;
+}
+
+/**
+ * @brief Appends an integer formatted with std::to_chars.
+ * @param value integer to append.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::Add(int value) {
+    char buffer[MAX_NUMBER_LENGTH];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    m_Buffer.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+/**
+ * @brief Appends an unsigned integer formatted with std::to_chars.
+ * @param value integer to append.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::Add(size_t value) {
+    char buffer[MAX_NUMBER_LENGTH];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    m_Buffer.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+/**
+ * @brief Appends a floating point value in its shortest representation, which can be parsed without loss of
+ * precision, e.g. 0.5 or 1e-09. In contrast to std::to_string, small values are not rounded to 0.000000.
+ * @param value value to append.
+ * @return this object to allow a chain of calls.
+ */
+CommandBuilder &CommandBuilder::Add(double value) {
+    char buffer[MAX_NUMBER_LENGTH];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    m_Buffer.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+/**
+ * @brief Returns the underlying buffer, e.g. to pass it to the socket.
+ * @return reference to the buffer containing the command.
+ */
+std::string &CommandBuilder::str() {
+    return m_Buffer;
+}
+
+/**
+ * @brief Returns a view on the current command.
+ * @return view on the command.
+ */
+std::string_view CommandBuilder::view() const {
+    return m_Buffer;
+}
+
+/**
+ * @brief Checks if no content was added since the last clear.
+ * @return true if the command is empty.
+ */
+bool CommandBuilder::empty() const {
+    return m_Buffer.empty();
+}
@@ -0,0 +1,302 @@
+/**
+ * @brief Implementation of the continuous waveform acquisition.
+ * @authors Florian Frank
+ */
+#include "ContinuousAcquisition.h"
+
+#include <exception> // std::exception
+
+/** Waiting time of the consumer thread until it checks again if the acquisition was stopped. **/
+#define CONSUMER_WAIT_TIMEOUT_MS 100
+
+/**
+ * @brief Constructor allocates the frames, their buffers are sized with the first start.
+ * @param device oscilloscope to acquire from, must outlive this object.
+ * @param frameCount number of frames, which can wait for the consumer before acquisitions are dropped.
+ */
+ContinuousAcquisition::ContinuousAcquisition(KST3000 *device, size_t frameCount)
+        : m_Device(device), m_Frames(frameCount) {
+}
+
+/**
+ * @brief Destructor stops the acquisition.
+ */
+ContinuousAcquisition::~ContinuousAcquisition() {
+    stop();
+}
+
+/**
+ * @brief Reads the preamble, preallocates all frames and starts the acquisition thread. The waveform source, format
+ * and number of points must be configured before.
+ * @param callback called for every frame from a consumer thread. If empty, frames are read with nextFrame.
+ * @return PIL_NO_ERROR if the acquisition was started, PIL_INVALID_ARGUMENTS if the waveform format is neither BYTE
+ * nor WORD or the acquisition is already running, otherwise the error code of the device.
+ */
+PIL_ERROR_CODE ContinuousAcquisition::start(FrameCallback callback) {
+    if (!m_Device || m_Running.load())
+        return PIL_INVALID_ARGUMENTS;
+    // Joins the threads of an acquisition, which ended with an error.
+    stop();
+
+    auto ret = m_Device->getWaveformPreamble(&m_Preamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (m_Preamble.format == PREAMBLE_FORMAT_BYTE)
+        m_SampleFormat = WaveformConverter::BYTE_SAMPLES;
+    else if (m_Preamble.format == PREAMBLE_FORMAT_WORD)
+        m_SampleFormat = m_Device->isWaveformBigEndian() ? WaveformConverter::WORD_BIG_ENDIAN_SAMPLES
+                                                         : WaveformConverter::WORD_LITTLE_ENDIAN_SAMPLES;
+    else
+        return PIL_INVALID_ARGUMENTS;
+
+    size_t points = m_Preamble.points > 0 ? static_cast<size_t>(m_Preamble.points) : 0;
+    for (size_t i = 0; i < m_Frames.capacity(); i++) {
+        auto &frame = m_Frames.getSlot(i);
+        frame.samples.reserve(points * WaveformConverter::getBytesPerSample(m_SampleFormat));
+        frame.voltages.reserve(points);
+        frame.validMask.reserve(WaveformConverter::getMaskSize(points));
+    }
+
+    m_Callback = std::move(callback);
+    m_AcquiredCount.store(0);
+    m_DroppedCount.store(0);
+    m_LastError.store(PIL_NO_ERROR);
+    {
+        std::lock_guard<std::mutex> lock(m_ErrorMutex);
+        m_LastErrorMessage.clear();
+    }
+    m_Running.store(true);
+    m_AcquisitionThread = std::thread(&ContinuousAcquisition::acquire, this);
+    if (m_Callback)
+        m_ConsumerThread = std::thread(&ContinuousAcquisition::consume, this);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Stops the acquisition thread, waits until the callback returned for all transferred frames and stops the
+ * device. Frames returned by nextFrame are invalid afterwards.
+ * @return PIL_NO_ERROR if the acquisition ended without error, otherwise the error code which ended it.
+ */
+PIL_ERROR_CODE ContinuousAcquisition::stop() {
+    m_Running.store(false);
+    if (m_AcquisitionThread.joinable())
+        m_AcquisitionThread.join();
+
+    notifyConsumer();
+    if (m_ConsumerThread.joinable())
+        m_ConsumerThread.join();
+
+    // Frames not read with nextFrame are discarded, so the next start begins with an empty ring.
+    while (m_Frames.beginRead())
+        m_Frames.endRead();
+    m_Callback = nullptr;
+    return m_LastError.load();
+}
+
+/**
+ * @brief Waits for the next frame and converts it. Must not be used if a callback was passed to start.
+ * @param timeoutInMs maximum time to wait for a frame.
+ * @return the frame, which is valid until releaseFrame is called, or nullptr if no frame was acquired in time.
+ */
+const WaveformFrame *ContinuousAcquisition::nextFrame(int timeoutInMs) {
+    if (m_Callback || !waitForFrame(timeoutInMs))
+        return nullptr;
+
+    auto *frame = m_Frames.beginRead();
+    convert(frame);
+    return frame;
+}
+
+/**
+ * @brief Hands the frame returned by nextFrame back to the acquisition thread.
+ */
+void ContinuousAcquisition::releaseFrame() {
+    if (m_Frames.beginRead())
+        m_Frames.endRead();
+}
+
+bool ContinuousAcquisition::isRunning() const {
+    return m_Running.load();
+}
+
+/**
+ * @brief Returns the number of acquisitions since start, including dropped ones.
+ * @return number of completed acquisitions.
+ */
+uint64_t ContinuousAcquisition::getAcquiredCount() const {
+    return m_AcquiredCount.load();
+}
+
+/**
+ * @brief Returns the number of acquisitions, which were not transferred because all frames waited for the consumer.
+ * @return number of dropped acquisitions.
+ */
+uint64_t ContinuousAcquisition::getDroppedCount() const {
+    return m_DroppedCount.load();
+}
+
+/**
+ * @brief Returns the error, which ended the acquisition thread.
+ * @return PIL_NO_ERROR if no error occurred.
+ */
+PIL_ERROR_CODE ContinuousAcquisition::getLastError() const {
+    return m_LastError.load();
+}
+
+/**
+ * @brief Returns the message of the exception, which ended the acquisition.
+ * @return empty string if the acquisition was not ended by an exception.
+ */
+std::string ContinuousAcquisition::getLastErrorMessage() const {
+    std::lock_guard<std::mutex> lock(m_ErrorMutex);
+    return m_LastErrorMessage;
+}
+
+/**
+ * @brief Returns the preamble read at start, e.g. to calculate the time of a sample.
+ * @return preamble of all frames.
+ */
+const WaveformPreamble &ContinuousAcquisition::getPreamble() const {
+    return m_Preamble;
+}
+
+/**
+ * @brief Main loop of the acquisition thread. The device is re-armed directly after the samples were transferred
+ * and before the frame is published, so the next trigger can be captured while the frame is converted.
+ */
+void ContinuousAcquisition::acquire() {
+    PIL_ERROR_CODE ret = PIL_NO_ERROR;
+    try {
+        ret = m_Device->single();
+        while (ret == PIL_NO_ERROR && m_Running.load()) {
+            bool acquiring = true;
+            ret = m_Device->isAcquisitionRunning(&acquiring);
+            if (ret != PIL_NO_ERROR)
+                break;
+            if (acquiring) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACQUISITION_POLL_INTERVAL_MS));
+                continue;
+            }
+
+            auto timestamp = std::chrono::steady_clock::now();
+            uint64_t sequence = m_AcquiredCount.fetch_add(1);
+            WaveformFrame *frame = m_Frames.beginWrite();
+            if (frame)
+                ret = m_Device->getWaveformData(&frame->samples);
+            else
+                m_DroppedCount.fetch_add(1);
+
+            if (ret == PIL_NO_ERROR)
+                ret = m_Device->single();
+            if (ret == PIL_NO_ERROR && frame) {
+                frame->sequence = sequence;
+                frame->timestamp = timestamp;
+                m_Frames.endWrite();
+                notifyConsumer();
+            }
+        }
+    } catch (const PIL::Exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    } catch (const std::exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    }
+
+    if (ret != PIL_NO_ERROR)
+        setError(ret, "");
+    m_Running.store(false);
+    notifyConsumer();
+    // Disarms the trigger, the acquisition was either stopped or ended with an error.
+    try {
+        m_Device->stop();
+    } catch (const PIL::Exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    } catch (const std::exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    }
+}
+
+/**
+ * @brief Main loop of the consumer thread. Converts every frame and passes it to the callback until the
+ * acquisition stopped and all published frames were consumed. An exception of the callback stops the acquisition.
+ */
+void ContinuousAcquisition::consume() {
+    try {
+        while (true) {
+            if (!waitForFrame(CONSUMER_WAIT_TIMEOUT_MS)) {
+                if (!m_Running.load() && m_Frames.empty())
+                    return;
+                continue;
+            }
+
+            auto *frame = m_Frames.beginRead();
+            convert(frame);
+            m_Callback(*frame);
+            m_Frames.endRead();
+        }
+    } catch (const PIL::Exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    } catch (const std::exception &e) {
+        setError(PIL_UNKNOWN_ERROR, e.what());
+    }
+    // The remaining frames are discarded by stop.
+    m_Running.store(false);
+}
+
+/**
+ * @brief Waits until a frame was published or the acquisition stopped.
+ * @param timeoutInMs maximum time to wait.
+ * @return true if a frame is available.
+ */
+bool ContinuousAcquisition::waitForFrame(int timeoutInMs) {
+    if (!m_Frames.empty())
+        return true;
+
+    m_ConsumerSleeping.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in notifyConsumer, either the consumer sees the frame or the producer sees it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_FrameAvailable.wait_for(lock, std::chrono::milliseconds(timeoutInMs), [this]() {
+            return !m_Frames.empty() || !m_Running.load();
+        });
+    }
+    m_ConsumerSleeping.store(false, std::memory_order_relaxed);
+    return !m_Frames.empty();
+}
+
+/**
+ * @brief Converts the raw samples of a frame into voltages.
+ * @param frame frame to convert.
+ */
+void ContinuousAcquisition::convert(WaveformFrame *frame) const {
+    size_t count = frame->samples.size() / WaveformConverter::getBytesPerSample(m_SampleFormat);
+    frame->voltages.resize(count);
+    frame->validMask.resize(WaveformConverter::getMaskSize(count));
+    WaveformConverter::convert(frame->samples.data(), count, m_SampleFormat, m_Preamble, frame->voltages.data(),
+                               frame->validMask.data());
+}
+
+/**
+ * @brief Wakes the consumer up if it waits for a frame.
+ */
+void ContinuousAcquisition::notifyConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_ConsumerSleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_FrameAvailable.notify_one();
+    }
+}
+
+/**
+ * @brief Stores the error, which ended the acquisition. Only the first error is kept, e.g. the exception of the
+ * callback and not the resulting stop of the acquisition thread.
+ * @param errorCode error code to report by getLastError.
+ * @param message message of the exception, empty for error codes returned by the device.
+ */
+void ContinuousAcquisition::setError(PIL_ERROR_CODE errorCode, const char *message) {
+    std::lock_guard<std::mutex> lock(m_ErrorMutex);
+    if (m_LastError.load() != PIL_NO_ERROR)
+        return;
+    m_LastErrorMessage = message;
+    m_LastError.store(errorCode);
+}
@@ -5,13 +5,23 @@
  * @copyright University of Passau
  */
 #include "Device.h"
-#include "HTTPRequest.h"
+#include "HTTPSession.h"
 
 #include <regex> // std::regex_replace
 #include <iostream> // std::cout
 #include <utility>
 #include <thread>
 #include <chrono>
+#include <cstring> // memcpy
+#include <algorithm> // std::min
+#include <fstream> // std::ofstream
+#include <charconv> // std::to_chars
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap
+#include <unistd.h> // ftruncate, close
+#endif
 
 #include "ctlib/Socket.hpp"
 #include "ctlib/Logging.hpp"
@@ -20,6 +30,11 @@ extern "C" {
 #include "ctlib/ErrorHandler.h"
 }
 
+/** Maximum number of length digits of a definite length block, given by a single digit after '#'. **/
+#define MAX_BLOCK_LENGTH_DIGITS 9
+/** Size of the buffer used to discard blocks, which do not fit into the buffer of the caller. **/
+#define DISCARD_CHUNK_SIZE 4096
+
 #ifdef __APPLE__
 #include <sstream>
 #endif // __APPLE__
@@ -28,7 +43,7 @@ Device::Device(std::string ipAddress, uint16_t srcPort, uint16_t destPort, int t
                SEND_METHOD mode,
                bool throwException) : m_IPAddr(std::move(ipAddress)), m_ErrorHandle(), m_destPort(destPort),
                                       m_srcPort(srcPort),
-                                      m_EnableExceptions(throwException) {
+                                      m_EnableExceptions(throwException), m_TimeoutInMs(timeoutInMs) {
     m_SocketHandle = new PIL::Socket(TCP, IPv4, m_IPAddr, m_destPort, timeoutInMs);
     m_ErrorHandle.m_ErrorCode = PIL_NO_ERROR;
     m_Logger = logger;
@@ -56,7 +71,12 @@ Device::Device(std::string ipAddress, int timeoutInMs, SEND_METHOD mode, bool th
 Device::Device(std::string ipAddress, int timeoutInMs, PIL::Logging *logger, SEND_METHOD mode, bool throwException) :
         Device(std::move(ipAddress), 5025, 5025, timeoutInMs, logger, mode, throwException) {}
 
+/**
+ * @brief Destructor stops the I/O thread and closes the connection. Derived devices must stop the I/O thread in
+ * their own destructor, queued functions may call their overrides, which are already destroyed here.
+ */
 Device::~Device() {
+    stopIOThread();
     Disconnect();
     //delete m_SocketHandle;  // TODO: FIX!
 }
@@ -99,6 +119,10 @@ PIL_ERROR_CODE Device::handleErrorsAndLogging(PIL_ERROR_CODE errorCode, bool thr
  */
 PIL_ERROR_CODE Device::Connect() {
     m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "Device is connecting.");
+    // The settings may have been changed while no connection was established.
+    invalidateState();
+    // Replies of the previous connection must not be returned.
+    m_ReceiveBuffer.clear();
 
     auto ret = m_SocketHandle->Connect(m_IPAddr, m_destPort);
     if (ret != PIL_NO_ERROR)
@@ -121,6 +145,7 @@ PIL_ERROR_CODE Device::Disconnect() {
         return PIL_NO_ERROR;
     }
 
+    invalidateState();
     auto errCode = m_SocketHandle->Disconnect();
     if (errCode != PIL_NO_ERROR)
         return Device::handleErrorsAndLogging(errCode, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__, "");
@@ -145,6 +170,245 @@ bool Device::isBuffered() const {
     return m_SendMode == SEND_METHOD::BUFFER_ENABLED;
 }
 
+/**
+ * @brief Starts the I/O thread of this device. Afterwards all calls must be submitted with Submit, so only the I/O
+ * thread accesses socket, buffered script and send mode. Functions which were submitted before are already executed.
+ */
+void Device::startIOThread() {
+    std::unique_lock<std::mutex> lock(m_IOThreadMutex);
+    m_IOThreadStopped.wait(lock, [this]() { return !m_IOThreadStopping; });
+    if (!m_IOThread)
+        m_IOThread = std::make_unique<DeviceIOThread>();
+}
+
+/**
+ * @brief Executes all submitted functions and stops the I/O thread. Must be called before a derived device is
+ * destroyed, if functions of the derived class are still queued. Functions submitted by other threads meanwhile
+ * wait until the I/O thread was joined.
+ */
+void Device::stopIOThread() {
+    DeviceIOThread *ioThread;
+    {
+        std::lock_guard<std::mutex> lock(m_IOThreadMutex);
+        // The I/O thread can not join itself, a concurrent call already stops it.
+        if (!m_IOThread || m_IOThread->isCurrentThread() || m_IOThreadStopping)
+            return;
+        m_IOThreadStopping = true;
+        ioThread = m_IOThread.get();
+    }
+    // Joined without the lock, the remaining functions may call Submit, which executes them immediately on the I/O
+    // thread.
+    ioThread->stop();
+
+    std::unique_ptr<DeviceIOThread> stoppedThread;
+    {
+        std::lock_guard<std::mutex> lock(m_IOThreadMutex);
+        stoppedThread = std::move(m_IOThread);
+        m_IOThreadStopping = false;
+    }
+    m_IOThreadStopped.notify_all();
+}
+
+/**
+ * @brief Checks if submitted functions are executed by the I/O thread.
+ * @return true if the I/O thread is running.
+ */
+bool Device::isIOThreadRunning() const {
+    std::lock_guard<std::mutex> lock(m_IOThreadMutex);
+    return m_IOThread != nullptr;
+}
+
+/**
+ * @brief Executes waiting high priority functions. Long running operations call this function between their steps,
+ * so e.g. a turnOff is not delayed by a complete buffer download. Does nothing if not called from the I/O thread.
+ */
+void Device::runPriorityTasks() {
+    DeviceIOThread *ioThread;
+    {
+        std::lock_guard<std::mutex> lock(m_IOThreadMutex);
+        ioThread = m_IOThread.get();
+    }
+    // Only the I/O thread itself runs the tasks and stopIOThread waits for it, so the thread outlives this call.
+    if (ioThread)
+        ioThread->runPriorityTasks();
+}
+
+/**
+ * @brief Checks if high priority functions are waiting, e.g. to restore the data format before runPriorityTasks.
+ * @return true if called from the I/O thread and a high priority function is waiting.
+ */
+bool Device::hasPriorityTasks() const {
+    std::lock_guard<std::mutex> lock(m_IOThreadMutex);
+    return m_IOThread && m_IOThread->hasPriorityTasks();
+}
+
+namespace {
+/**
+ * @brief Formats a value of the state shadow. The shortest representation is unique, so equal strings mean equal
+ * values.
+ * @param value value to format.
+ * @return the formatted value.
+ */
+std::string formatStateValue(double value) {
+    char buffer[32];
+    return {buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr};
+}
+} // namespace
+
+/**
+ * @brief Enables or disables the state shadow. While enabled, setters skip commands which would write the value
+ * they wrote before. Disable it if the device is also configured from the front panel or by raw commands.
+ * @param enable true to skip redundant setter commands.
+ */
+void Device::setStateShadowEnabled(bool enable) {
+    m_StateShadowEnabled = enable;
+    invalidateState();
+}
+
+/**
+ * @brief Forgets all values written by setters, so the next call of every setter is sent to the device. Called on
+ * connect, disconnect and *RST. Must be called after commands changing settings outside of the setters, e.g. scripts
+ * or raw commands.
+ */
+void Device::invalidateState() {
+    invalidateSettings();
+    invalidateCachedState();
+}
+
+/**
+ * @brief Forgets only the values written by setters, but keeps the state of derived devices, e.g. after a function
+ * of an uploaded script changed settings of the device.
+ */
+void Device::invalidateSettings() {
+    m_StateShadow.clear();
+}
+
+/**
+ * @brief Called by invalidateState. Derived devices override it to forget what else they know about the state of
+ * the device, e.g. functions defined by an uploaded script.
+ */
+void Device::invalidateCachedState() {
+}
+
+/**
+ * @brief Checks if a setter can skip its command, because the setting already has the value.
+ * @param key unique name of the setting, e.g. the constant part of the command.
+ * @param value value the setter would write.
+ * @return true if the same value was written before and the state was not invalidated since.
+ */
+bool Device::isStateUnchanged(std::string_view key, double value) const {
+    return isStateUnchanged(key, formatStateValue(value));
+}
+
+/**
+ * @brief Checks if a setter can skip its command.
+ * @see Device::isStateUnchanged
+ */
+bool Device::isStateUnchanged(std::string_view key, std::string_view value) const {
+    // A buffered script may be executed after the settings were changed, so it must contain every command.
+    if (!m_StateShadowEnabled || isBuffered())
+        return false;
+    auto it = m_StateShadow.find(key);
+    return it != m_StateShadow.end() && it->second == value;
+}
+
+/**
+ * @brief Records the value written by a setter. In buffered mode the command is only executed with the script, so
+ * the setting is unknown until then and the entry is removed.
+ * @param key unique name of the setting.
+ * @param value written value.
+ * @param result result of the command, the entry is removed if it failed.
+ */
+void Device::updateState(std::string_view key, double value, PIL_ERROR_CODE result) {
+    updateState(key, formatStateValue(value), result);
+}
+
+/**
+ * @brief Records the value written by a setter.
+ * @see Device::updateState
+ */
+void Device::updateState(std::string_view key, std::string_view value, PIL_ERROR_CODE result) {
+    if (!m_StateShadowEnabled || result != PIL_NO_ERROR || isBuffered()) {
+        invalidateState(key);
+        return;
+    }
+    auto it = m_StateShadow.find(key);
+    if (it == m_StateShadow.end())
+        m_StateShadow.emplace(key, value);
+    else
+        it->second.assign(value);
+}
+
+/**
+ * @brief Forgets the value of a single setting, e.g. if a command changes it as side effect.
+ * @param key unique name of the setting.
+ */
+void Device::invalidateState(std::string_view key) {
+    auto it = m_StateShadow.find(key);
+    if (it != m_StateShadow.end())
+        m_StateShadow.erase(it);
+}
+
+/**
+ * @brief Invalidates the state if a message sent to the device contains a reset, which restores the default of every
+ * setting. Called for every message sent by sendAndReceive and Flush.
+ * @param message message sent to the device.
+ */
+void Device::invalidateStateOnReset(std::string_view message) {
+    if (isReset(message))
+        invalidateState();
+}
+
+/**
+ * @brief Checks if a message contains a reset command. Detects *RST anywhere in the message, e.g. "*CLS;*RST".
+ * Derived devices override it to detect their own reset commands.
+ * @param message message sent to the device.
+ * @return true if the message resets the device.
+ */
+bool Device::isReset(std::string_view message) const {
+    return containsCommand(message, "*RST") || containsCommand(message, "*rst");
+}
+
+/**
+ * @brief Checks if a message contains a command, which is separated from other commands by whitespace or ';'.
+ * @param message message which may contain several commands.
+ * @param command command to search for.
+ * @return true if the command was found.
+ */
+/* static */ bool Device::containsCommand(std::string_view message, std::string_view command) {
+    auto isSeparator = [](char c) { return c == ';' || c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    for (auto pos = message.find(command); pos != std::string_view::npos; pos = message.find(command, pos + 1)) {
+        auto end = pos + command.size();
+        if ((pos == 0 || isSeparator(message[pos - 1])) && (end == message.size() || isSeparator(message[end])))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the ip address passed to the constructor.
+ * @return ip address of the device.
+ */
+const std::string &Device::getIPAddress() const {
+    return m_IPAddr;
+}
+
+/**
+ * @brief Returns the destination port of the socket connection.
+ * @return port of the device, by default 5025.
+ */
+int Device::getPort() const {
+    return m_destPort;
+}
+
+/**
+ * @brief Returns the timeout of the socket passed to the constructor.
+ * @return timeout in milliseconds.
+ */
+int Device::getTimeout() const {
+    return m_TimeoutInMs;
+}
+
 /**
  * @brief Gets the name of the currently connected device.
  * @return The name of this device.
@@ -198,39 +462,405 @@ PIL_ERROR_CODE Device::Exec(const std::string &command, ExecArgs *args, char *re
 }
 
 PIL_ERROR_CODE Device::Exec(const std::string &command, ExecArgs *args, std::string *result, bool br) {
-    std::stringstream message;
-    message << command;
-    if (args)
-        message << args->GetArgumentsAsString();
     if (!isBuffered() && !m_SocketHandle->IsOpen())
         return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
                                               __LINE__, "Error interface is closed");
 
-    if (!isBuffered() && br)
-        message << std::endl;
+    // The message buffer keeps its capacity, so no allocation is required after the first commands.
+    m_MessageBuffer.assign(command);
+    if (args)
+        m_MessageBuffer += args->GetArgumentsAsString();
+    if (isBuffered()) {
+        m_BufferedScript.push_back(m_MessageBuffer);
+        return PIL_NO_ERROR;
+    }
+
+    if (br)
+        m_MessageBuffer += '\n';
+    return sendAndReceive(m_MessageBuffer, result);
+}
+
+/**
+ * @brief Executes a command assembled by a CommandBuilder. The command is sent directly from the buffer of the
+ * builder, so no temporary strings are created.
+ * @param command command to execute. A newline is appended to the command.
+ * @param result[out] if not null, the reply of the device is stored in result.
+ * @return PIL_NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE Device::Exec(CommandBuilder &command, std::string *result) {
+    if (!isBuffered() && !m_SocketHandle->IsOpen())
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Error interface is closed");
 
-    auto strToSend = message.str();
     if (isBuffered()) {
-        m_BufferedScript.push_back(strToSend);
+        m_BufferedScript.push_back(command.str());
         return PIL_NO_ERROR;
-    } else {
-        if (m_SocketHandle->Send(strToSend) != PIL_NO_ERROR)
+    }
+
+    command.Add('\n');
+    return sendAndReceive(command.str(), result);
+}
+
+/**
+ * @brief Clears the command builder owned by this device and returns it to assemble a new command.
+ * The builder is reused for every command, so its buffer only grows once.
+ * @return cleared command builder.
+ */
+CommandBuilder &Device::newCommand() {
+    return m_CommandBuilder.clear();
+}
+
+/**
+ * @brief Sends a message to the device and receives the reply if requested.
+ * @param message message including the terminating newline.
+ * @param result[out] if not null, the reply of the device is stored in result.
+ * @return PIL_NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE Device::sendAndReceive(std::string &message, std::string *result) {
+    // Replies of pipelined commands must be collected first, otherwise they would be returned as result.
+    if (!m_PendingCommands.empty()) {
+        auto flushRet = Flush();
+        if (flushRet != PIL_NO_ERROR)
+            return flushRet;
+    }
+
+    invalidateStateOnReset(message);
+    if (m_SocketHandle->Send(message) != PIL_NO_ERROR)
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__,
+                                              "Error while calling send");
+    // Copied into a buffer which keeps its capacity, e.g. to attribute errors of the device to this command.
+    m_LastMessage.assign(message);
+
+    if (m_Logger)
+        m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "Command %s successfully executed", message.c_str());
+
+    if (result) { // not all operation need a result
+        // Bytes of a previous reply may already be buffered by receiveLine or receiveBytes.
+        auto ret = receiveLine(result);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        // The reply is returned as sent by the device.
+        result->push_back('\n');
+        if (m_Logger)
+            m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "Receive result: %s", result->c_str());
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Returns the last message sent by Exec without the terminating newline.
+ * @return view on the last message, valid until the next command is sent.
+ */
+std::string_view Device::getLastMessage() const {
+    std::string_view message = m_LastMessage;
+    if (!message.empty() && message.back() == '\n')
+        message.remove_suffix(1);
+    return message;
+}
+
+/**
+ * @brief Receives exactly length bytes from the socket. Used for binary replies, where the message can not be
+ * terminated by a newline and may be split into multiple TCP segments.
+ * @param buffer buffer to write the received bytes to. Must be able to hold at least length bytes.
+ * @param length number of bytes to receive.
+ * @return PIL_NO_ERROR if all bytes were received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::receiveBytes(uint8_t *buffer, size_t length) {
+    if (!m_SocketHandle->IsOpen())
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Error interface is closed");
+
+    size_t received = std::min(length, m_ReceiveBuffer.size());
+    if (received > 0) {
+        memcpy(buffer, m_ReceiveBuffer.data(), received);
+        m_ReceiveBuffer.erase(0, received);
+    }
+
+    while (received < length) {
+        auto chunkLen = static_cast<uint32_t>(length - received);
+        auto ret = m_SocketHandle->Receive(buffer + received, &chunkLen);
+        if (ret != PIL_NO_ERROR)
+            return Device::handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                                  "Error while calling read");
+        if (chunkLen == 0)
             return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
-                                                  __LINE__,
-                                                  "Error while calling send");
-
-        m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "Command %s successfully executed", strToSend.c_str());
-
-        if (result) { // not all operation need a result
-            auto ret = m_SocketHandle->Receive(*result);
-            if (ret != PIL_NO_ERROR)
-                return Device::handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
-                                                      "Error while calling read");
-            if (m_Logger)
-                m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "Receive result: %s", result->c_str());
-        }
+                                                  __LINE__, "Connection closed after %zu of %zu bytes", received,
+                                                  length);
+        received += chunkLen;
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Receives a single reply terminated by a newline. In contrast to a single call of Receive, the reply may be
+ * of arbitrary length. Bytes following the newline are kept and returned by the next call.
+ * @param line the received line without the terminating newline.
+ * @return PIL_NO_ERROR if a complete line was received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::receiveLine(std::string *line) {
+    if (!m_SocketHandle->IsOpen())
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Error interface is closed");
+
+    size_t searchStart = 0;
+    size_t newlinePos;
+    uint8_t chunk[4096];
+    while ((newlinePos = m_ReceiveBuffer.find('\n', searchStart)) == std::string::npos) {
+        searchStart = m_ReceiveBuffer.size();
+        uint32_t chunkLen = sizeof(chunk);
+        auto ret = m_SocketHandle->Receive(chunk, &chunkLen);
+        if (ret != PIL_NO_ERROR)
+            return Device::handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                                  "Error while calling read");
+        if (chunkLen == 0)
+            return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                                  __LINE__, "Connection closed while waiting for newline");
+        m_ReceiveBuffer.append(reinterpret_cast<char *>(chunk), chunkLen);
+    }
+
+    line->assign(m_ReceiveBuffer, 0, newlinePos);
+    m_ReceiveBuffer.erase(0, newlinePos + 1);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Sends a query answered by an IEEE 488.2 binary block, e.g. :WAVeform:DATA?, and receives the data directly
+ * into the buffer of the caller. Definite length blocks (#<n><length>) are received completely, for indefinite length
+ * blocks (#0) the capacity of the buffer is the expected length.
+ * @param command query to send.
+ * @param buffer buffer to receive the data to.
+ * @param capacity size of the buffer in bytes.
+ * @param length number of received data bytes without header and terminating newline.
+ * @return PIL_NO_ERROR if the block was received, PIL_INSUFFICIENT_RESOURCES if the block does not fit into the
+ * buffer, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::QueryBinaryBlock(const std::string &command, uint8_t *buffer, size_t capacity,
+                                        size_t *length) {
+    if (!buffer || !length || isBuffered())
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Binary block query requires a buffer and direct send mode");
+
+    size_t blockLength;
+    bool indefinite;
+    auto ret = sendBinaryBlockQuery(command, &blockLength, &indefinite);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (indefinite)
+        blockLength = capacity;
+
+    if (blockLength > capacity) {
+        ret = discardBinaryBlock(blockLength);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        return Device::handleErrorsAndLogging(PIL_INSUFFICIENT_RESOURCES, m_EnableExceptions, PIL::ERROR,
+                                              __FILENAME__, __LINE__, "Binary block of %zu bytes exceeds buffer of "
+                                                                      "%zu bytes", blockLength, capacity);
+    }
+
+    ret = receiveBytes(buffer, blockLength);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    *length = blockLength;
+    return receiveBinaryBlockEnd();
+}
+
+/**
+ * @brief Sends a query answered by an IEEE 488.2 binary block and receives the data into a vector, which is resized
+ * exactly once to the length given in the header. For indefinite length blocks (#0) the current size of the vector
+ * is the expected length.
+ * @param command query to send.
+ * @param data vector to receive the data to.
+ * @return PIL_NO_ERROR if the block was received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::QueryBinaryBlock(const std::string &command, std::vector<uint8_t> *data) {
+    if (!data || isBuffered())
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Binary block query requires a buffer and direct send mode");
+
+    size_t blockLength;
+    bool indefinite;
+    auto ret = sendBinaryBlockQuery(command, &blockLength, &indefinite);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    if (!indefinite)
+        data->resize(blockLength);
+    ret = receiveBytes(data->data(), data->size());
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveBinaryBlockEnd();
+}
+
+/**
+ * @brief Sends a query answered by a definite length binary block and writes the data to a file. The file is
+ * resized to the length given in the header and memory mapped, so the data is received directly into the page cache
+ * without an intermediate buffer.
+ * @param command query to send.
+ * @param filePath path of the file to create or overwrite.
+ * @param length number of received data bytes. Can be nullptr.
+ * @return PIL_NO_ERROR if the block was written, PIL_NO_SUCH_FILE if the file could not be created, otherwise
+ * return error code.
+ */
+PIL_ERROR_CODE Device::QueryBinaryBlockToFile(const std::string &command, const std::string &filePath,
+                                              size_t *length) {
+    if (isBuffered())
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Binary block query requires direct send mode");
+
+    size_t blockLength;
+    bool indefinite;
+    auto ret = sendBinaryBlockQuery(command, &blockLength, &indefinite);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (indefinite) {
+        // The end of the block is unknown, so it can not be discarded.
+        closeDesynchronizedConnection("Indefinite length block received");
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Indefinite length blocks can not be written to a file");
+    }
+
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *mapping = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(blockLength)) == 0 && blockLength > 0)
+        mapping = mmap(nullptr, blockLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd < 0 || (blockLength > 0 && mapping == MAP_FAILED)) {
+        if (fd >= 0)
+            close(fd);
+        ret = discardBinaryBlock(blockLength);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        return Device::handleErrorsAndLogging(PIL_NO_SUCH_FILE, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Could not map file %s", filePath.c_str());
+    }
+
+    if (blockLength > 0) {
+        ret = receiveBytes(static_cast<uint8_t *>(mapping), blockLength);
+        munmap(mapping, blockLength);
+    }
+    close(fd);
+#else
+    std::ofstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        ret = discardBinaryBlock(blockLength);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        return Device::handleErrorsAndLogging(PIL_NO_SUCH_FILE, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Could not open file %s", filePath.c_str());
+    }
+    std::vector<uint8_t> data(blockLength);
+    ret = receiveBytes(data.data(), blockLength);
+    if (ret == PIL_NO_ERROR)
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(blockLength));
+#endif
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    if (length)
+        *length = blockLength;
+    return receiveBinaryBlockEnd();
+}
+
+/**
+ * @brief Parses a complete binary block header, e.g. #800001000.
+ * @param header header starting with '#'.
+ * @param length number of data bytes following the header, 0 for indefinite length blocks (#0).
+ * @return true if the header is valid and complete.
+ */
+/* static */ bool Device::parseBinaryBlockHeader(std::string_view header, size_t *length) {
+    if (header.size() < 2 || header[0] != '#' || header[1] < '0' || header[1] > '9')
+        return false;
+
+    size_t digitCount = header[1] - '0';
+    if (header.size() != digitCount + 2)
+        return false;
+
+    *length = 0;
+    for (size_t i = 2; i < header.size(); i++) {
+        if (header[i] < '0' || header[i] > '9')
+            return false;
+        *length = *length * 10 + (header[i] - '0');
+    }
+    return true;
+}
+
+/**
+ * @brief Sends a binary block query and receives the header of the reply.
+ * @param command query to send.
+ * @param length number of data bytes following the header.
+ * @param indefinite true if the header is #0, in this case the length is not known.
+ * @return PIL_NO_ERROR if a valid header was received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::sendBinaryBlockQuery(const std::string &command, size_t *length, bool *indefinite) {
+    auto ret = Exec(command);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveBinaryBlockHeader(length, indefinite);
+}
+
+/**
+ * @brief Receives the header of a binary block. Only the header bytes are read from the socket, so the data can be
+ * received directly into the destination buffer afterwards.
+ * @param length number of data bytes following the header.
+ * @param indefinite true if the header is #0, in this case the length is not known.
+ * @return PIL_NO_ERROR if a valid header was received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::receiveBinaryBlockHeader(size_t *length, bool *indefinite) {
+    char header[MAX_BLOCK_LENGTH_DIGITS + 2];
+    auto ret = receiveBytes(reinterpret_cast<uint8_t *>(header), 2);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    size_t digitCount = header[1] >= '0' && header[1] <= '9' ? header[1] - '0' : 0;
+    if (header[0] != '#' || (digitCount == 0 && header[1] != '0'))
+        return Device::handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Invalid binary block header");
+
+    *indefinite = digitCount == 0;
+    *length = 0;
+    if (*indefinite)
         return PIL_NO_ERROR;
+
+    ret = receiveBytes(reinterpret_cast<uint8_t *>(header + 2), digitCount);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (!parseBinaryBlockHeader(std::string_view(header, digitCount + 2), length))
+        return Device::handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Invalid binary block length");
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Consumes the newline terminating a binary block. Any other byte is kept for the next reply.
+ * @return PIL_NO_ERROR if the terminator was received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::receiveBinaryBlockEnd() {
+    uint8_t terminator;
+    auto ret = receiveBytes(&terminator, 1);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (terminator != '\n')
+        m_ReceiveBuffer.insert(m_ReceiveBuffer.begin(), static_cast<char>(terminator));
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Receives and drops the data of a definite length binary block and its terminator, e.g. if the block can not
+ * be stored. The next reply is then not mixed up with the remaining data of the block.
+ * @param length number of data bytes given in the header.
+ * @return PIL_NO_ERROR if the block was consumed, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::discardBinaryBlock(size_t length) {
+    uint8_t discard[DISCARD_CHUNK_SIZE];
+    for (size_t remaining = length; remaining > 0;) {
+        size_t chunk = std::min(remaining, sizeof(discard));
+        auto ret = receiveBytes(discard, chunk);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        remaining -= chunk;
     }
+    return receiveBinaryBlockEnd();
 }
 
 /***
@@ -252,6 +882,129 @@ PIL_ERROR_CODE Device::ExecCommands(std::string &commands) {
     return PIL_NO_ERROR;
 }
 
+/**
+ * @brief Queues a command without sending it. All queued commands are written back-to-back with a single send call
+ * by Flush and the replies are matched to the commands in order. This way N queries cost about one round trip
+ * instead of N. In buffered mode the command is appended to the buffered script and no result is available.
+ * @param command command to queue.
+ * @param args optional arguments which are appended to the command.
+ * @param expectResult true if the device answers the command (e.g. queries or print statements).
+ * @param br whether to add a '\\n' at the end of the command.
+ * @return ticket to retrieve the result with GetResult.
+ */
+Device::ExecTicket Device::ExecAsync(const std::string &command, ExecArgs *args, bool expectResult, bool br) {
+    auto ticket = m_NextTicket++;
+    if (isBuffered()) {
+        m_BufferedScript.push_back(createMessage(command, args, br));
+        return ticket;
+    }
+
+    m_PendingCommands.push_back({ticket, createMessage(command, args, br), expectResult});
+    return ticket;
+}
+
+/**
+ * @brief Sends all commands queued by ExecAsync at once and collects the replies of all commands expecting a result.
+ * If a reply can not be received, the connection is closed, since the following replies could not be matched to
+ * their commands anymore. Results received before remain available, Connect must be called to continue.
+ * @return PIL_NO_ERROR if all commands were sent and all replies were received, otherwise return error code.
+ */
+PIL_ERROR_CODE Device::Flush() {
+    if (m_PendingCommands.empty())
+        return PIL_NO_ERROR;
+
+    if (!m_SocketHandle->IsOpen())
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Error interface is closed");
+
+    // Move the queue, so the state stays consistent if an exception is thrown.
+    std::vector<PendingCommand> pendingCommands;
+    pendingCommands.swap(m_PendingCommands);
+
+    std::string batch;
+    for (const auto &pending: pendingCommands) {
+        invalidateStateOnReset(pending.message);
+        batch += pending.message;
+    }
+
+    if (m_SocketHandle->Send(batch) != PIL_NO_ERROR)
+        return Device::handleErrorsAndLogging(PIL_INTERFACE_CLOSED, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Error while calling send");
+
+    if (m_Logger)
+        m_Logger->LogMessage(PIL::INFO, __FILENAME__, __LINE__, "%zu pipelined commands sent",
+                             pendingCommands.size());
+
+    try {
+        for (const auto &pending: pendingCommands) {
+            if (!pending.expectsResult)
+                continue;
+
+            std::string reply;
+            auto ret = receiveLine(&reply);
+            if (ret != PIL_NO_ERROR) {
+                closeDesynchronizedConnection("Pipelined reply missing");
+                return ret;
+            }
+            m_PipelinedResults[pending.ticket] = std::move(reply);
+        }
+    } catch (const PIL::Exception &) {
+        closeDesynchronizedConnection("Pipelined reply missing");
+        throw;
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Closes the connection if the end of a reply is unknown, e.g. after a reply of a pipelined command was not
+ * received. The remaining reply would otherwise be returned as reply of the next query.
+ * @param reason reason which is logged.
+ */
+void Device::closeDesynchronizedConnection(const char *reason) {
+    if (m_Logger)
+        m_Logger->LogMessage(PIL::ERROR, __FILENAME__, __LINE__, "%s, closing the connection", reason);
+    invalidateState();
+    m_ReceiveBuffer.clear();
+    m_SocketHandle->Disconnect();
+}
+
+/**
+ * @brief Returns the reply of a command queued by ExecAsync. If the command was not sent yet, Flush is called.
+ * @param ticket ticket returned by ExecAsync.
+ * @param result reply of the command without the terminating newline.
+ * @return PIL_NO_ERROR if the result is available, PIL_INVALID_ARGUMENTS if the ticket is unknown, the result was
+ * already retrieved or the command does not expect a result.
+ */
+PIL_ERROR_CODE Device::GetResult(ExecTicket ticket, std::string *result) {
+    if (!result)
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "result must not be null");
+
+    if (m_PipelinedResults.find(ticket) == m_PipelinedResults.end()) {
+        auto ret = Flush();
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+
+    auto it = m_PipelinedResults.find(ticket);
+    if (it == m_PipelinedResults.end())
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "No result available for ticket %llu",
+                                              static_cast<unsigned long long>(ticket));
+
+    *result = std::move(it->second);
+    m_PipelinedResults.erase(it);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Returns the number of commands queued by ExecAsync, which were not sent yet.
+ * @return number of pending commands.
+ */
+size_t Device::getPendingCommandCount() const {
+    return m_PendingCommands.size();
+}
+
 std::string Device::ReturnErrorMessage() {
     return PIL_ReturnErrorMessageAsString(&m_ErrorHandle);
 }
@@ -292,6 +1045,22 @@ void Device::changeSendMode(SEND_METHOD mode) {
     m_SendMode = mode;
 }
 
+/**
+ * @brief Concatenates command and arguments to the message, which is sent to the device.
+ * @param command command to send.
+ * @param args optional arguments which are appended to the command.
+ * @param br whether to add a newline. Buffered scripts are joined by newlines later, so no newline is added.
+ * @return message to send.
+ */
+std::string Device::createMessage(const std::string &command, ExecArgs *args, bool br) const {
+    std::string message = command;
+    if (args)
+        message += args->GetArgumentsAsString();
+    if (!isBuffered() && br)
+        message += "\n";
+    return message;
+}
+
 /**
  * @brief Checks if a error occured given the error code.
  * @param errorCode The error code to check.
@@ -302,20 +1071,79 @@ void Device::changeSendMode(SEND_METHOD mode) {
 }
 
 /**
- * @brief Sends a post request to the given url with the given payload.
- * @param url The url to send the post request to.
+ * @brief Sends a post request to the given url with the given payload. All requests share one keep-alive
+ * connection to the web interface of the device. The latency of each request is logged at debug level.
+ * @param url The url to send the post request to, e.g. http://192.168.1.10/HttpCommand.
  * @param payload The payload to send.
+ * @return PIL_NO_ERROR if a response was received, otherwise the error of the connection.
  */
-/* static */ PIL_ERROR_CODE Device::postRequest(const std::string &url, std::string &payload) {
-    try {
-        http::Request request{url};
-        const auto response = request.send("POST", payload, {
-                {"Content-Type", "application/json"}
-        });
-        return PIL_NO_ERROR;
-    } catch (const std::exception &e) {
-        return PIL_UNKNOWN_ERROR;  // TODO: Add exception for http requests
+PIL_ERROR_CODE Device::postRequest(const std::string &url, std::string &payload) {
+    return postRequests(url, {payload});
+}
+
+/**
+ * @brief Sends multiple post requests pipelined over the keep-alive connection, i.e. all requests are sent before
+ * the responses are received in order.
+ * @param url The url to send the post requests to, e.g. http://192.168.1.10/HttpCommand.
+ * @param payloads The payloads to send in this order.
+ * @return PIL_NO_ERROR if all responses were received, otherwise the error of the connection.
+ */
+PIL_ERROR_CODE Device::postRequests(const std::string &url, const std::vector<std::string> &payloads) {
+    HTTPSession *session;
+    std::string path;
+    auto ret = getHTTPSession(url, &session, &path);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    // Commands posted to the web interface have side effects, so they are never sent twice.
+    std::vector<HTTPSession::Response> responses;
+    size_t firstUnconfirmed;
+    ret = session->postPipelined(path, payloads, &responses, false, &firstUnconfirmed);
+    if (ret != PIL_NO_ERROR)
+        return handleErrorsAndLogging(ret, false, PIL::WARNING, __FILENAME__, __LINE__,
+                                      "Error while sending post request %zu of %zu to %s", firstUnconfirmed + 1,
+                                      payloads.size(), url.c_str());
+
+    for (const auto &response: responses) {
+        if (response.statusCode < 200 || response.statusCode >= 300)
+            return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, false, PIL::WARNING, __FILENAME__, __LINE__,
+                                          "Post request to %s returned status %d", url.c_str(), response.statusCode);
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Returns the keep-alive session to the web interface and the path of the url. The session is created with
+ * the first request, a request to another host replaces the session.
+ * @param url url of the request, e.g. http://192.168.1.10/HttpCommand.
+ * @param session session to send the request.
+ * @param path path of the url, e.g. /HttpCommand.
+ * @return PIL_NO_ERROR if the url could be parsed otherwise PIL_INVALID_ARGUMENTS.
+ */
+PIL_ERROR_CODE Device::getHTTPSession(const std::string &url, HTTPSession **session, std::string *path) {
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0)
+        return PIL_INVALID_ARGUMENTS;
+
+    size_t pathStart = url.find('/', scheme.size());
+    std::string authority = url.substr(scheme.size(), pathStart == std::string::npos ? std::string::npos
+                                                                                       : pathStart - scheme.size());
+    *path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+    int port = 80;
+    size_t portStart = authority.find(':');
+    if (portStart != std::string::npos) {
+        port = std::stoi(authority.substr(portStart + 1));
+        authority.erase(portStart);
+    }
+
+    if (!m_HTTPSession || m_HTTPHost != authority || m_HTTPPort != port) {
+        m_HTTPSession = std::make_unique<HTTPSession>(authority, port, m_TimeoutInMs, m_Logger);
+        m_HTTPHost = authority;
+        m_HTTPPort = port;
     }
+    *session = m_HTTPSession.get();
+    return PIL_NO_ERROR;
 }
 
 /**
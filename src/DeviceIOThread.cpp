@@ -0,0 +1,115 @@
+/**
+ * @brief Implementation of the per device I/O thread.
+ * @authors Florian Frank
+ */
+#include "DeviceIOThread.h"
+
+/**
+ * @brief Constructor starts the thread, which waits for the first task.
+ */
+DeviceIOThread::DeviceIOThread() : m_Thread(&DeviceIOThread::run, this) {
+}
+
+/**
+ * @brief Destructor executes the remaining tasks and joins the thread.
+ */
+DeviceIOThread::~DeviceIOThread() {
+    stop();
+}
+
+/**
+ * @brief Queues a task. Can be called from any thread without blocking.
+ * @param task task to execute on the I/O thread.
+ * @param lane HIGH_PRIORITY_LANE to execute the task before all waiting tasks of the normal lane.
+ */
+void DeviceIOThread::submit(Task task, LANE lane) {
+    if (lane == HIGH_PRIORITY_LANE)
+        m_HighPriorityQueue.push(std::move(task));
+    else
+        m_NormalQueue.push(std::move(task));
+
+    // Pairs with the fence in run, either the thread sees the new task or this thread sees it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_Sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_WakeUp.notify_one();
+    }
+}
+
+/**
+ * @brief Executes all waiting high priority tasks. Called by long running tasks between their steps, e.g. between
+ * the chunks of a buffer download. Does nothing if not called from the I/O thread.
+ */
+void DeviceIOThread::runPriorityTasks() {
+    if (!isCurrentThread())
+        return;
+
+    Task task;
+    while (m_HighPriorityQueue.pop(&task))
+        task();
+}
+
+/**
+ * @brief Checks if high priority tasks are waiting, e.g. to prepare the device before runPriorityTasks is called.
+ * @return true if called from the I/O thread and a high priority task is waiting.
+ */
+bool DeviceIOThread::hasPriorityTasks() const {
+    return isCurrentThread() && !m_HighPriorityQueue.empty();
+}
+
+/**
+ * @brief Executes all waiting tasks and stops the thread. Tasks submitted afterwards are never executed.
+ */
+void DeviceIOThread::stop() {
+    m_Running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_WakeUp.notify_one();
+    }
+    if (m_Thread.joinable() && !isCurrentThread())
+        m_Thread.join();
+}
+
+/**
+ * @brief Checks if the caller is the I/O thread, e.g. to execute nested submissions directly.
+ * @return true if called from the I/O thread.
+ */
+bool DeviceIOThread::isCurrentThread() const {
+    return std::this_thread::get_id() == m_Thread.get_id();
+}
+
+/**
+ * @brief Main loop of the thread. Sleeps on the condition variable while both queues are empty.
+ */
+void DeviceIOThread::run() {
+    while (true) {
+        // Read before the queues are drained, so tasks submitted before stop are executed.
+        bool running = m_Running.load();
+        while (runNextTask()) {}
+
+        if (!running)
+            return;
+
+        m_Sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(m_SleepMutex);
+            m_WakeUp.wait(lock, [this]() {
+                return !m_HighPriorityQueue.empty() || !m_NormalQueue.empty() || !m_Running.load();
+            });
+        }
+        m_Sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Executes the next task, tasks of the high priority lane first.
+ * @return false if both queues are empty.
+ */
+bool DeviceIOThread::runNextTask() {
+    Task task;
+    if (!m_HighPriorityQueue.pop(&task) && !m_NormalQueue.pop(&task))
+        return false;
+    task();
+    return true;
+}
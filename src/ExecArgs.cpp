@@ -110,9 +110,11 @@ ExecArgs &ExecArgs::AddArgument(SubArg argument, SubArg &value, const std::strin
  */
 std::string ExecArgs::GetArgumentsAsString() {
     std::string retStr;
-    for (auto arg: m_ArgList) {
-        retStr += GetArgumentFromArgTuple(arg) +
-                  GetSeperatorFromArgTuple(arg) + GetValueFromArgTuple(arg) + "";
+    for (const auto &arg: m_ArgList) {
+        const auto &keyValuePair = std::get<2>(arg);
+        retStr += std::get<0>(keyValuePair);
+        retStr += std::get<1>(arg);
+        retStr += std::get<1>(keyValuePair);
     }
     return retStr;
 }
@@ -0,0 +1,345 @@
+/**
+ * @brief Implementation of the persistent HTTP/1.1 session.
+ * @authors Florian Frank
+ */
+#include "HTTPSession.h"
+
+#include "ctlib/Socket.hpp"
+#include "ctlib/Logging.hpp"
+#include "ctlib/Exception.h"
+
+#include <algorithm> // std::transform
+#include <cctype> // tolower
+#include <chrono> // std::chrono::steady_clock
+#include <cstdlib> // std::strtoul
+#include <utility> // std::move
+
+/** Size of the buffer used for a single call of receive. **/
+#define RECEIVE_CHUNK_SIZE 4096
+/** Maximum number of reconnects within one call of postPipelined, before the transfer is aborted. **/
+#define MAX_RECONNECTS 3
+
+/**
+ * @brief Constructor only stores the connection parameters. The connection is established with the first request.
+ * @param host ip address or host name of the device.
+ * @param port port of the web server, usually 80.
+ * @param timeoutInMs timeout of the socket in milliseconds.
+ * @param logger logger used to report the latency of the requests. If nullptr is passed, logging is disabled.
+ */
+HTTPSession::HTTPSession(std::string host, int port, int timeoutInMs, PIL::Logging *logger)
+        : m_Host(std::move(host)), m_Port(port), m_TimeoutInMs(timeoutInMs), m_Logger(logger) {
+}
+
+/**
+ * @brief Destructor closes the connection.
+ */
+HTTPSession::~HTTPSession() {
+    close();
+}
+
+/**
+ * @brief Sends a single POST request with a JSON payload and waits for the response.
+ * @param path path of the request, e.g. /HttpCommand.
+ * @param payload body of the request.
+ * @param response status, body and latency of the response. Can be nullptr.
+ * @return PIL_NO_ERROR if a response was received, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::post(const std::string &path, const std::string &payload, Response *response) {
+    std::vector<Response> responses;
+    auto ret = postPipelined(path, {payload}, &responses);
+    if (ret == PIL_NO_ERROR && response)
+        *response = std::move(responses.front());
+    return ret;
+}
+
+/**
+ * @brief Writes all POST requests to the connection before reading the responses, so the requests do not wait for
+ * each other. If the server announces that it closes the connection, the requests after the announcing response were
+ * not processed and are sent again over a new connection. If the connection is lost otherwise, the server may have
+ * processed the unanswered requests, so they are only sent again if they are idempotent.
+ * @param path path of all requests, e.g. /HttpCommand.
+ * @param payloads bodies of the requests, which are sent in this order.
+ * @param responses responses in the order of the payloads. Can be nullptr.
+ * @param idempotent true if sending a request twice has the same effect as sending it once, e.g. a status query.
+ * @param firstUnconfirmed index of the first request without response, payloads.size() if all were answered.
+ * Can be nullptr.
+ * @return PIL_NO_ERROR if all responses were received, PIL_INTERFACE_CLOSED if the connection was lost while
+ * non-idempotent requests were unanswered, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::postPipelined(const std::string &path, const std::vector<std::string> &payloads,
+                                          std::vector<Response> *responses, bool idempotent,
+                                          size_t *firstUnconfirmed) {
+    if (responses)
+        responses->clear();
+
+    size_t answered = 0;
+    int reconnects = 0;
+    PIL_ERROR_CODE ret = PIL_NO_ERROR;
+    while (answered < payloads.size() && ret == PIL_NO_ERROR) {
+        if (!m_Open) {
+            if (reconnects++ > MAX_RECONNECTS) {
+                ret = PIL_INTERFACE_CLOSED;
+                break;
+            }
+            ret = connect();
+            if (ret != PIL_NO_ERROR)
+                break;
+        }
+
+        std::string message;
+        for (size_t i = answered; i < payloads.size(); i++)
+            appendRequest(path, payloads[i], &message);
+
+        auto lastEvent = std::chrono::steady_clock::now();
+        ret = m_Socket->Send(message);
+        bool connectionLost = ret != PIL_NO_ERROR;
+        bool keepAlive = true;
+        while (ret == PIL_NO_ERROR && answered < payloads.size() && keepAlive) {
+            Response response;
+            ret = receiveResponse(&response, &keepAlive);
+            if (ret != PIL_NO_ERROR) {
+                // A connection closed by the server can be retried, timeouts are reported.
+                connectionLost = ret == PIL_INTERFACE_CLOSED;
+                break;
+            }
+            auto now = std::chrono::steady_clock::now();
+            response.latencyInMs = std::chrono::duration<double, std::milli>(now - lastEvent).count();
+            lastEvent = now;
+            m_LastLatency = response.latencyInMs;
+
+            if (m_Logger)
+                m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__, "POST %s returned %d after %.2f ms",
+                                     path.c_str(), response.statusCode, response.latencyInMs);
+            if (responses)
+                responses->push_back(std::move(response));
+            answered++;
+        }
+
+        if (ret != PIL_NO_ERROR || !keepAlive)
+            close();
+        if (connectionLost && idempotent)
+            ret = PIL_NO_ERROR;
+        else if (connectionLost)
+            ret = PIL_INTERFACE_CLOSED;
+    }
+
+    if (firstUnconfirmed)
+        *firstUnconfirmed = answered;
+    if (ret != PIL_NO_ERROR && m_Logger)
+        m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__,
+                             "POST %s: request %zu of %zu and the following ones were not confirmed", path.c_str(),
+                             answered + 1, payloads.size());
+    return ret;
+}
+
+/**
+ * @brief Closes the connection. The next request opens a new connection.
+ */
+void HTTPSession::close() {
+    if (m_Socket && m_Open)
+        m_Socket->Disconnect();
+    m_Open = false;
+    m_ReceiveBuffer.clear();
+}
+
+/**
+ * @brief Checks if the connection is currently open.
+ * @return true if a connection to the server exists.
+ */
+bool HTTPSession::isOpen() const {
+    return m_Open;
+}
+
+/**
+ * @brief Returns the latency of the last received response.
+ * @return latency in milliseconds.
+ */
+double HTTPSession::getLastLatency() const {
+    return m_LastLatency;
+}
+
+/**
+ * @brief Parses the status line and the headers required to find the end of the body.
+ * @param header status line and header fields including the terminating empty line.
+ * @param statusCode HTTP status code, e.g. 200.
+ * @param contentLength value of the Content-Length field, 0 if not available.
+ * @param chunked true if the body uses chunked transfer encoding.
+ * @param keepAlive false if the server closes the connection after this response.
+ * @return true if the status line could be parsed.
+ */
+/* static */ bool HTTPSession::parseResponseHeader(const std::string &header, int *statusCode, size_t *contentLength,
+                                                   bool *chunked, bool *keepAlive) {
+    *statusCode = 0;
+    *contentLength = 0;
+    *chunked = false;
+    *keepAlive = true;
+
+    if (header.compare(0, 5, "HTTP/") != 0)
+        return false;
+    if (header.compare(0, 8, "HTTP/1.0") == 0)
+        *keepAlive = false;
+
+    auto statusStart = header.find(' ');
+    if (statusStart == std::string::npos)
+        return false;
+    *statusCode = static_cast<int>(std::strtol(header.c_str() + statusStart + 1, nullptr, 10));
+
+    size_t lineStart = header.find("\r\n");
+    while (lineStart != std::string::npos) {
+        lineStart += 2;
+        size_t lineEnd = header.find("\r\n", lineStart);
+        if (lineEnd == std::string::npos || lineEnd == lineStart)
+            break;
+
+        size_t colon = header.find(':', lineStart);
+        if (colon != std::string::npos && colon < lineEnd) {
+            std::string name = header.substr(lineStart, colon - lineStart);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            size_t valueStart = header.find_first_not_of(' ', colon + 1);
+            std::string value = header.substr(valueStart, lineEnd - valueStart);
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+            if (name == "content-length")
+                *contentLength = std::strtoul(value.c_str(), nullptr, 10);
+            else if (name == "transfer-encoding")
+                *chunked = value.find("chunked") != std::string::npos;
+            else if (name == "connection")
+                *keepAlive = value.find("close") == std::string::npos;
+        }
+        lineStart = lineEnd;
+    }
+    return *statusCode > 0;
+}
+
+/**
+ * @brief Opens the connection to the web server of the device.
+ * @return PIL_NO_ERROR if the connection was established, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::connect() {
+    if (!m_Socket)
+        m_Socket = std::make_unique<PIL::Socket>(TCP, IPv4, m_Host, m_Port, m_TimeoutInMs);
+    m_ReceiveBuffer.clear();
+    auto ret = m_Socket->Connect(m_Host, m_Port);
+    m_Open = ret == PIL_NO_ERROR;
+    return ret;
+}
+
+/**
+ * @brief Appends a POST request with keep-alive header to a message.
+ * @param path path of the request.
+ * @param payload body of the request.
+ * @param message message to which the request is appended.
+ */
+void HTTPSession::appendRequest(const std::string &path, const std::string &payload, std::string *message) const {
+    message->append("POST ").append(path).append(" HTTP/1.1\r\nHost: ").append(m_Host)
+            .append("\r\nContent-Type: application/json\r\nContent-Length: ").append(std::to_string(payload.size()))
+            .append("\r\nConnection: keep-alive\r\n\r\n").append(payload);
+}
+
+/**
+ * @brief Receives header and body of the next response.
+ * @param response status and body of the response.
+ * @param keepAlive false if the server closes the connection after the response.
+ * @return PIL_NO_ERROR if the response was received, PIL_INTERFACE_CLOSED if the server closed the connection.
+ */
+PIL_ERROR_CODE HTTPSession::receiveResponse(Response *response, bool *keepAlive) {
+    std::string header;
+    auto ret = receiveUntil("\r\n\r\n", &header);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    size_t contentLength;
+    bool chunked;
+    if (!parseResponseHeader(header, &response->statusCode, &contentLength, &chunked, keepAlive))
+        return PIL_UNKNOWN_ERROR;
+
+    if (chunked)
+        return receiveChunkedBody(&response->body);
+    return receiveExactly(contentLength, &response->body);
+}
+
+/**
+ * @brief Receives data until the delimiter was received. Data after the delimiter is kept in the receive buffer.
+ * @param delimiter delimiter to search for.
+ * @param result received data including the delimiter.
+ * @return PIL_NO_ERROR if the delimiter was received, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::receiveUntil(const std::string &delimiter, std::string *result) {
+    size_t searchStart = 0;
+    size_t position;
+    while ((position = m_ReceiveBuffer.find(delimiter, searchStart)) == std::string::npos) {
+        searchStart = m_ReceiveBuffer.size() >= delimiter.size() ? m_ReceiveBuffer.size() - delimiter.size() + 1 : 0;
+        auto ret = fillReceiveBuffer();
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+    size_t end = position + delimiter.size();
+    result->assign(m_ReceiveBuffer, 0, end);
+    m_ReceiveBuffer.erase(0, end);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Receives exactly length bytes. Data after these bytes is kept in the receive buffer.
+ * @param length number of bytes to receive.
+ * @param result received data.
+ * @return PIL_NO_ERROR if all bytes were received, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::receiveExactly(size_t length, std::string *result) {
+    while (m_ReceiveBuffer.size() < length) {
+        auto ret = fillReceiveBuffer();
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+    result->assign(m_ReceiveBuffer, 0, length);
+    m_ReceiveBuffer.erase(0, length);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Receives a body with chunked transfer encoding. Trailer fields are discarded.
+ * @param body concatenated content of all chunks.
+ * @return PIL_NO_ERROR if the last chunk was received, otherwise the error of the socket.
+ */
+PIL_ERROR_CODE HTTPSession::receiveChunkedBody(std::string *body) {
+    body->clear();
+    std::string line;
+    std::string chunk;
+    while (true) {
+        auto ret = receiveUntil("\r\n", &line);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        size_t chunkSize = std::strtoul(line.c_str(), nullptr, 16);
+        if (chunkSize == 0)
+            break;
+
+        ret = receiveExactly(chunkSize + 2, &chunk);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        body->append(chunk, 0, chunkSize);
+    }
+
+    // Trailer fields are terminated by an empty line.
+    do {
+        auto ret = receiveUntil("\r\n", &line);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    } while (line != "\r\n");
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Appends the next received bytes to the receive buffer.
+ * @return PIL_NO_ERROR if bytes were received, PIL_INTERFACE_CLOSED if the server closed the connection.
+ */
+PIL_ERROR_CODE HTTPSession::fillReceiveBuffer() {
+    uint8_t chunk[RECEIVE_CHUNK_SIZE];
+    uint32_t chunkLen = sizeof(chunk);
+    auto ret = m_Socket->Receive(chunk, &chunkLen);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (chunkLen == 0)
+        return PIL_INTERFACE_CLOSED;
+    m_ReceiveBuffer.append(reinterpret_cast<char *>(chunk), chunkLen);
+    return PIL_NO_ERROR;
+}
@@ -0,0 +1,442 @@
+/**
+ * @brief Implementation of the epoll based event loop serving multiple devices.
+ * @authors Florian Frank
+ */
+#include "IOReactor.h"
+#include "Device.h"
+
+#include "ctlib/Logging.hpp"
+#include "ctlib/Exception.h"
+
+#include <algorithm> // std::min
+#include <cerrno> // errno
+#include <utility> // std::move
+
+#if defined(__linux__)
+#include <arpa/inet.h> // inet_pton
+#include <fcntl.h> // fcntl
+#include <netinet/in.h> // sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <sys/epoll.h> // epoll_create1
+#include <sys/socket.h> // socket
+#include <unistd.h> // close
+#endif // __linux__
+
+/** Maximum number of events processed within one call of epoll_wait. **/
+#define MAX_EPOLL_EVENTS 64
+/** Size of the buffer used for a single call of recv. **/
+#define REACTOR_RECEIVE_CHUNK_SIZE 4096
+
+/**
+ * @brief Constructor creates the epoll instance. Devices are attached afterwards.
+ * @param logger logger used to report connection errors. If nullptr is passed, logging is disabled.
+ */
+IOReactor::IOReactor(PIL::Logging *logger) : m_Logger(logger) {
+#if defined(__linux__)
+    m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+#endif // __linux__
+}
+
+/**
+ * @brief Destructor closes all connections. Pending operations are completed with PIL_INTERFACE_CLOSED.
+ */
+IOReactor::~IOReactor() {
+    for (auto &entry: m_Connections)
+        closeConnection(entry.second.get(), PIL_INTERFACE_CLOSED);
+#if defined(__linux__)
+    if (m_EpollFd >= 0)
+        ::close(m_EpollFd);
+#endif // __linux__
+}
+
+/**
+ * @brief Hands the connection of a device over to the reactor. If the device is connected, its blocking socket is
+ * closed. The reactor connects with the first query.
+ * @param device device to attach. Must outlive the reactor or be detached before.
+ * @return PIL_NO_ERROR if the device was attached, PIL_INVALID_ARGUMENTS if it is already attached or buffered.
+ */
+PIL_ERROR_CODE IOReactor::attach(Device *device) {
+    if (m_EpollFd < 0)
+        return PIL_INSUFFICIENT_RESOURCES;
+    if (!device || device->isBuffered() || m_Connections.find(device) != m_Connections.end())
+        return PIL_INVALID_ARGUMENTS;
+
+    if (device->isOpen())
+        device->Disconnect();
+
+    auto connection = std::make_unique<Connection>();
+    connection->device = device;
+    m_Connections.emplace(device, std::move(connection));
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Closes the connection of the reactor to a device. Pending operations are completed with
+ * PIL_INTERFACE_CLOSED. Afterwards the device can be connected again with Device::Connect.
+ * @param device device to detach.
+ * @return PIL_NO_ERROR if the device was detached, PIL_INVALID_ARGUMENTS if it was not attached.
+ */
+PIL_ERROR_CODE IOReactor::detach(Device *device) {
+    auto it = m_Connections.find(device);
+    if (it == m_Connections.end())
+        return PIL_INVALID_ARGUMENTS;
+
+    auto connection = std::move(it->second);
+    m_Connections.erase(it);
+    closeConnection(connection.get(), PIL_INTERFACE_CLOSED);
+    m_Retired.push_back(std::move(connection));
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Queues a command. The command is written as soon as the socket is writable, the callback is called from
+ * run or runOnce when the reply was received, or when the command was written if no result is expected.
+ * @param device attached device.
+ * @param command command to send, a line break is appended if missing.
+ * @param callback called with the error code and the reply without line break.
+ * @param expectResult false if the device does not answer this command.
+ * @return PIL_NO_ERROR if the command was queued, otherwise the error of the connection.
+ */
+PIL_ERROR_CODE IOReactor::query(Device *device, const std::string &command, Callback callback, bool expectResult) {
+    auto it = m_Connections.find(device);
+    if (it == m_Connections.end())
+        return PIL_INVALID_ARGUMENTS;
+
+    Connection *connection = it->second.get();
+    if (connection->fd < 0) {
+        auto ret = openConnection(connection);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+
+    Operation operation{command, expectResult, std::move(callback),
+                        std::chrono::steady_clock::now() + std::chrono::milliseconds(device->getTimeout())};
+    if (operation.message.empty() || operation.message.back() != '\n')
+        operation.message.push_back('\n');
+
+    connection->writeQueue.push_back(std::move(operation));
+    if (connection->connected && connection->writeQueue.size() == 1)
+        handleWritable(connection);
+    if (connection->fd >= 0)
+        updateInterest(connection);
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Waits for events on all connections and dispatches them. Callbacks are called from this function.
+ * @param maxWaitInMs maximum time to wait for an event, -1 to wait until the next timeout.
+ * @return PIL_NO_ERROR if the events were processed, PIL_ERRNO if epoll_wait failed.
+ */
+PIL_ERROR_CODE IOReactor::runOnce(int maxWaitInMs) {
+    m_Retired.clear();
+#if defined(__linux__)
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int count = epoll_wait(m_EpollFd, events, MAX_EPOLL_EVENTS, getWaitTime(maxWaitInMs));
+    if (count < 0 && errno != EINTR) {
+        if (m_Logger)
+            m_Logger->LogMessage(PIL::ERROR, __FILENAME__, __LINE__, "epoll_wait failed with errno %d", errno);
+        return PIL_ERRNO;
+    }
+
+    for (int i = 0; i < count; i++) {
+        auto *connection = static_cast<Connection *>(events[i].data.ptr);
+        // A callback of a previous event may have closed or detached the connection.
+        if (connection->fd < 0)
+            continue;
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+            closeConnection(connection, PIL_INTERFACE_CLOSED);
+            continue;
+        }
+        if (events[i].events & EPOLLIN)
+            handleReadable(connection);
+        if (connection->fd >= 0 && events[i].events & EPOLLOUT)
+            handleWritable(connection);
+        if (connection->fd >= 0)
+            updateInterest(connection);
+    }
+#else
+    (void) maxWaitInMs;
+#endif // __linux__
+    handleTimeouts();
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Processes events until all queued operations are completed or stop was called.
+ * @return PIL_NO_ERROR if all operations are completed, PIL_ERRNO if epoll_wait failed.
+ */
+PIL_ERROR_CODE IOReactor::run() {
+    m_Stopped = false;
+    while (!m_Stopped && getPendingCount() > 0) {
+        auto ret = runOnce(-1);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Lets run return after the current iteration. Must be called from the reactor thread, e.g. from a callback.
+ */
+void IOReactor::stop() {
+    m_Stopped = true;
+}
+
+/**
+ * @brief Returns the number of operations, which are not completed yet.
+ * @return number of queued and sent operations of all devices.
+ */
+size_t IOReactor::getPendingCount() const {
+    size_t count = 0;
+    for (const auto &entry: m_Connections)
+        count += entry.second->writeQueue.size() + entry.second->replyQueue.size();
+    return count;
+}
+
+/**
+ * @brief Removes the first line from a buffer.
+ * @param buffer received data, the line and its line break are removed.
+ * @param line line without line break and carriage return.
+ * @return true if the buffer contained a complete line.
+ */
+/* static */ bool IOReactor::extractLine(std::string *buffer, std::string *line) {
+    auto position = buffer->find('\n');
+    if (position == std::string::npos)
+        return false;
+
+    size_t length = position > 0 && (*buffer)[position - 1] == '\r' ? position - 1 : position;
+    line->assign(*buffer, 0, length);
+    buffer->erase(0, position + 1);
+    return true;
+}
+
+/**
+ * @brief Creates a non-blocking socket and starts connecting to the device. The connection is established as soon
+ * as the socket becomes writable.
+ * @param connection connection to open.
+ * @return PIL_NO_ERROR if the connect was started, otherwise PIL_ERRNO or PIL_INVALID_ARGUMENTS.
+ */
+PIL_ERROR_CODE IOReactor::openConnection(Connection *connection) {
+#if defined(__linux__)
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(connection->device->getPort()));
+    if (inet_pton(AF_INET, connection->device->getIPAddress().c_str(), &address.sin_addr) != 1)
+        return PIL_INVALID_ARGUMENTS;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return PIL_ERRNO;
+
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 && errno != EINPROGRESS) {
+        ::close(fd);
+        return PIL_ERRNO;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = connection;
+    if (epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        ::close(fd);
+        return PIL_ERRNO;
+    }
+
+    connection->fd = fd;
+    connection->connected = false;
+    connection->writeOffset = 0;
+    connection->readBuffer.clear();
+    return PIL_NO_ERROR;
+#else
+    (void) connection;
+    return PIL_UNKNOWN_ERROR;
+#endif // __linux__
+}
+
+/**
+ * @brief Closes the socket and completes all pending operations with an error.
+ * @param connection connection to close.
+ * @param reason error code passed to the callbacks.
+ */
+void IOReactor::closeConnection(Connection *connection, PIL_ERROR_CODE reason) {
+#if defined(__linux__)
+    if (connection->fd >= 0) {
+        epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        ::close(connection->fd);
+    }
+#endif // __linux__
+    connection->fd = -1;
+    connection->connected = false;
+    connection->writeOffset = 0;
+    connection->readBuffer.clear();
+
+    // Move the queues, so callbacks can queue new operations, which open a new connection.
+    std::deque<Operation> failed;
+    failed.swap(connection->replyQueue);
+    for (auto &operation: connection->writeQueue)
+        failed.push_back(std::move(operation));
+    connection->writeQueue.clear();
+
+    if (!failed.empty() && m_Logger)
+        m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "Connection to %s closed, %zu operations failed",
+                             connection->device->getIPAddress().c_str(), failed.size());
+    for (auto &operation: failed)
+        if (operation.callback)
+            operation.callback(reason, std::string());
+}
+
+/**
+ * @brief Only requests writable events while data is waiting to be written, to avoid busy waiting.
+ * @param connection connection to update.
+ */
+void IOReactor::updateInterest(Connection *connection) {
+#if defined(__linux__)
+    epoll_event event{};
+    event.events = EPOLLIN;
+    if (!connection->connected || !connection->writeQueue.empty())
+        event.events |= EPOLLOUT;
+    event.data.ptr = connection;
+    epoll_ctl(m_EpollFd, EPOLL_CTL_MOD, connection->fd, &event);
+#else
+    (void) connection;
+#endif // __linux__
+}
+
+/**
+ * @brief Finishes a pending connect and writes as many queued operations as the socket accepts.
+ * @param connection writable connection.
+ */
+void IOReactor::handleWritable(Connection *connection) {
+#if defined(__linux__)
+    if (!connection->connected) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            if (m_Logger)
+                m_Logger->LogMessage(PIL::ERROR, __FILENAME__, __LINE__, "Could not connect to %s, errno %d",
+                                     connection->device->getIPAddress().c_str(), error);
+            closeConnection(connection, PIL_ERRNO);
+            return;
+        }
+        connection->connected = true;
+    }
+
+    while (!connection->writeQueue.empty()) {
+        Operation &operation = connection->writeQueue.front();
+        ssize_t written = send(connection->fd, operation.message.data() + connection->writeOffset,
+                               operation.message.size() - connection->writeOffset, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            closeConnection(connection, PIL_INTERFACE_CLOSED);
+            return;
+        }
+
+        connection->writeOffset += static_cast<size_t>(written);
+        if (connection->writeOffset < operation.message.size())
+            return;
+
+        connection->writeOffset = 0;
+        Operation sent = std::move(operation);
+        connection->writeQueue.pop_front();
+        if (sent.expectsResult) {
+            connection->replyQueue.push_back(std::move(sent));
+        } else if (sent.callback) {
+            sent.callback(PIL_NO_ERROR, std::string());
+            if (connection->fd < 0)
+                return;
+        }
+    }
+#else
+    (void) connection;
+#endif // __linux__
+}
+
+/**
+ * @brief Reads all available data and completes one operation per received line.
+ * @param connection readable connection.
+ */
+void IOReactor::handleReadable(Connection *connection) {
+#if defined(__linux__)
+    char chunk[REACTOR_RECEIVE_CHUNK_SIZE];
+    while (true) {
+        ssize_t received = recv(connection->fd, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            connection->readBuffer.append(chunk, static_cast<size_t>(received));
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        // Closed by the device or receive error. Lines received before are still dispatched below.
+        std::string remaining = std::move(connection->readBuffer);
+        std::string line;
+        while (!connection->replyQueue.empty() && extractLine(&remaining, &line)) {
+            Operation completed = std::move(connection->replyQueue.front());
+            connection->replyQueue.pop_front();
+            if (completed.callback)
+                completed.callback(PIL_NO_ERROR, line);
+        }
+        closeConnection(connection, PIL_INTERFACE_CLOSED);
+        return;
+    }
+
+    std::string line;
+    while (!connection->replyQueue.empty() && extractLine(&connection->readBuffer, &line)) {
+        Operation completed = std::move(connection->replyQueue.front());
+        connection->replyQueue.pop_front();
+        if (completed.callback)
+            completed.callback(PIL_NO_ERROR, line);
+        if (connection->fd < 0)
+            return;
+    }
+#else
+    (void) connection;
+#endif // __linux__
+}
+
+/**
+ * @brief Closes connections with operations, which exceeded the timeout of their device. The remaining replies of
+ * such a connection can not be assigned anymore, so all of its operations fail.
+ */
+void IOReactor::handleTimeouts() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<Connection *> expired;
+    for (auto &entry: m_Connections) {
+        Connection *connection = entry.second.get();
+        bool replyExpired = !connection->replyQueue.empty() && connection->replyQueue.front().deadline <= now;
+        bool writeExpired = !connection->writeQueue.empty() && connection->writeQueue.front().deadline <= now;
+        if (replyExpired || writeExpired)
+            expired.push_back(connection);
+    }
+
+    for (auto *connection: expired) {
+        if (m_Logger)
+            m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "Timeout while waiting for %s",
+                                 connection->device->getIPAddress().c_str());
+        closeConnection(connection, PIL_TIMEOUT);
+    }
+}
+
+/**
+ * @brief Calculates how long epoll_wait may block without missing a timeout.
+ * @param maxWaitInMs maximum wait time requested by the caller, -1 for no limit.
+ * @return wait time in milliseconds, -1 if nothing is pending and no limit was requested.
+ */
+int IOReactor::getWaitTime(int maxWaitInMs) const {
+    auto now = std::chrono::steady_clock::now();
+    int waitTime = maxWaitInMs;
+    for (const auto &entry: m_Connections) {
+        for (const auto *queue: {&entry.second->writeQueue, &entry.second->replyQueue}) {
+            if (queue->empty())
+                continue;
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    queue->front().deadline - now).count();
+            int remainingInMs = remaining > 0 ? static_cast<int>(remaining) + 1 : 0;
+            waitTime = waitTime < 0 ? remainingInMs : std::min(waitTime, remainingInMs);
+        }
+    }
+    return waitTime;
+}
@@ -0,0 +1,156 @@
+/**
+ * @brief Implementation of the JSON metadata sidecar.
+ * @authors Florian Frank
+ */
+#include "JSONMetadata.h"
+
+#include <charconv> // std::to_chars
+#include <cmath> // std::isfinite
+#include <cstdio> // FILE
+
+/**
+ * @brief Adds a string value.
+ * @param key name of the field.
+ * @param value value, which is escaped.
+ * @return this object to chain calls.
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, const std::string &value) {
+    m_Fields.emplace_back(key, escape(value));
+    return *this;
+}
+
+/**
+ * @brief Adds a string value.
+ * @see JSONMetadata::add
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, const char *value) {
+    return add(key, std::string(value ? value : ""));
+}
+
+/**
+ * @brief Adds a number. The shortest representation that reads back to the same double is written, NaN and
+ * infinity are written as null.
+ * @see JSONMetadata::add
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, double value) {
+    if (!std::isfinite(value)) {
+        m_Fields.emplace_back(key, "null");
+        return *this;
+    }
+    char buffer[32];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    m_Fields.emplace_back(key, std::string(buffer, end));
+    return *this;
+}
+
+/**
+ * @brief Adds an integer.
+ * @see JSONMetadata::add
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, int value) {
+    m_Fields.emplace_back(key, std::to_string(value));
+    return *this;
+}
+
+/**
+ * @brief Adds a boolean.
+ * @see JSONMetadata::add
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, bool value) {
+    m_Fields.emplace_back(key, value ? "true" : "false");
+    return *this;
+}
+
+/**
+ * @brief Adds a nested object, e.g. the parsed preamble of a waveform.
+ * @see JSONMetadata::add
+ */
+JSONMetadata &JSONMetadata::add(const std::string &key, const JSONMetadata &object) {
+    m_Fields.emplace_back(key, object.toString());
+    return *this;
+}
+
+/**
+ * @brief Encodes all fields as JSON object.
+ * @return the JSON text without trailing newline.
+ */
+std::string JSONMetadata::toString() const {
+    std::string result = "{";
+    for (size_t i = 0; i < m_Fields.size(); i++) {
+        if (i > 0)
+            result += ", ";
+        result += escape(m_Fields[i].first);
+        result += ": ";
+        result += m_Fields[i].second;
+    }
+    result += "}";
+    return result;
+}
+
+/**
+ * @brief Writes the object to a file.
+ * @param filePath path of the file to create or overwrite.
+ * @return PIL_NO_ERROR if the file was written, PIL_NO_SUCH_FILE if it could not be created, PIL_ERRNO if a write
+ * failed.
+ */
+PIL_ERROR_CODE JSONMetadata::writeFile(const std::string &filePath) const {
+    std::FILE *file = std::fopen(filePath.c_str(), "wb");
+    if (!file)
+        return PIL_NO_SUCH_FILE;
+    std::string text = toString() + "\n";
+    bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (std::fclose(file) != 0)
+        written = false;
+    return written ? PIL_NO_ERROR : PIL_ERRNO;
+}
+
+/**
+ * @brief Returns the path of the sidecar file, e.g. capture.json for capture.npz.
+ * @param dataPath path of the exported data.
+ * @return the path with the extension replaced by .json.
+ */
+/* static */ std::string JSONMetadata::getSidecarPath(const std::string &dataPath) {
+    auto dot = dataPath.find_last_of('.');
+    auto slash = dataPath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return dataPath + ".json";
+    return dataPath.substr(0, dot) + ".json";
+}
+
+/**
+ * @brief Encodes a string as JSON string literal.
+ * @param value string to encode.
+ * @return the quoted and escaped string.
+ */
+/* static */ std::string JSONMetadata::escape(const std::string &value) {
+    std::string result = "\"";
+    for (char c: value) {
+        switch (c) {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            case '\n':
+                result += "\\n";
+                break;
+            case '\r':
+                result += "\\r";
+                break;
+            case '\t':
+                result += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result += buffer;
+                } else {
+                    result += c;
+                }
+        }
+    }
+    result += "\"";
+    return result;
+}
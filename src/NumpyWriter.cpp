@@ -0,0 +1,317 @@
+/**
+ * @brief Implementation of the numpy .npy and .npz export.
+ * @authors Florian Frank
+ */
+#include "NumpyWriter.h"
+
+#include <array> // std::array
+
+/** Magic string and version 1.0 at the beginning of every .npy file. **/
+#define NPY_MAGIC "\x93NUMPY\x01\x00"
+#define NPY_MAGIC_LENGTH 8
+/** numpy aligns the start of the data to 64 bytes, so the arrays can be mapped directly. **/
+#define NPY_ALIGNMENT 64
+
+#define ZIP_LOCAL_FILE_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_DIRECTORY_SIGNATURE 0x02014b50
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054b50
+/** Version 2.0 of the zip specification, the arrays are stored without compression. **/
+#define ZIP_VERSION 20
+/** Date field of the zip headers, 1980-01-01. **/
+#define ZIP_DATE 0x21
+/** Without the zip64 extension, sizes and offsets are limited to 32 bit. **/
+#define ZIP_MAX_SIZE 0xFFFFFFFFu
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NPY_DESCR_FLOAT64 "<f8"
+#define NPY_DESCR_FLOAT32 "<f4"
+#else
+#define NPY_DESCR_FLOAT64 ">f8"
+#define NPY_DESCR_FLOAT32 ">f4"
+#endif
+#define NPY_DESCR_UINT8 "|u1"
+#define NPY_DESCR_BOOL "|b1"
+
+namespace {
+/**
+ * @brief Appends an integer in little endian byte order, as required by the zip headers.
+ * @param value value to append.
+ * @param bytes number of bytes of the field.
+ * @param buffer buffer to append to.
+ */
+void appendLittleEndian(uint32_t value, int bytes, std::string *buffer) {
+    for (int i = 0; i < bytes; i++)
+        buffer->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+} // namespace
+
+/**
+ * @brief Destructor finishes the archive if it is still open.
+ */
+NumpyWriter::~NumpyWriter() {
+    close();
+}
+
+/**
+ * @brief Writes an array of doubles as .npy file.
+ * @param filePath path of the file to create or overwrite.
+ * @param values values to write.
+ * @param count number of values.
+ * @return PIL_NO_ERROR if the file was written, PIL_NO_SUCH_FILE if it could not be created, PIL_ERRNO if a write
+ * failed.
+ */
+/* static */ PIL_ERROR_CODE NumpyWriter::writeNpy(const std::string &filePath, const double *values, size_t count) {
+    return writeNpy(filePath, NPY_DESCR_FLOAT64, values, count, sizeof(double));
+}
+
+/**
+ * @brief Writes an array of floats as .npy file.
+ * @see NumpyWriter::writeNpy
+ */
+/* static */ PIL_ERROR_CODE NumpyWriter::writeNpy(const std::string &filePath, const float *values, size_t count) {
+    return writeNpy(filePath, NPY_DESCR_FLOAT32, values, count, sizeof(float));
+}
+
+/**
+ * @brief Writes an array of bytes as .npy file.
+ * @see NumpyWriter::writeNpy
+ */
+/* static */ PIL_ERROR_CODE NumpyWriter::writeNpy(const std::string &filePath, const uint8_t *values, size_t count) {
+    return writeNpy(filePath, NPY_DESCR_UINT8, values, count, sizeof(uint8_t));
+}
+
+/**
+ * @brief Creates or overwrites the .npz archive to add arrays to.
+ * @param filePath path of the archive.
+ * @return PIL_NO_ERROR if the file was opened, PIL_NO_SUCH_FILE otherwise.
+ */
+PIL_ERROR_CODE NumpyWriter::open(const std::string &filePath) {
+    close();
+    m_File = std::fopen(filePath.c_str(), "wb");
+    if (!m_File)
+        return PIL_NO_SUCH_FILE;
+    std::setvbuf(m_File, nullptr, _IONBF, 0);
+    m_Entries.clear();
+    m_Offset = 0;
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Adds an array of doubles to the archive, numpy.load returns it under the given name.
+ * @param name name of the array without the extension .npy.
+ * @param values values to write.
+ * @param count number of values.
+ * @return PIL_NO_ERROR if the array was written, PIL_INTERFACE_CLOSED if the archive is not open,
+ * PIL_INSUFFICIENT_RESOURCES if the archive would exceed 4 GiB, PIL_ERRNO if a write failed.
+ */
+PIL_ERROR_CODE NumpyWriter::addArray(const std::string &name, const double *values, size_t count) {
+    return addEntry(name, NPY_DESCR_FLOAT64, values, count, sizeof(double));
+}
+
+/**
+ * @brief Adds an array of floats to the archive.
+ * @see NumpyWriter::addArray
+ */
+PIL_ERROR_CODE NumpyWriter::addArray(const std::string &name, const float *values, size_t count) {
+    return addEntry(name, NPY_DESCR_FLOAT32, values, count, sizeof(float));
+}
+
+/**
+ * @brief Adds an array of bytes to the archive.
+ * @see NumpyWriter::addArray
+ */
+PIL_ERROR_CODE NumpyWriter::addArray(const std::string &name, const uint8_t *values, size_t count) {
+    return addEntry(name, NPY_DESCR_UINT8, values, count, sizeof(uint8_t));
+}
+
+/**
+ * @brief Adds an array of booleans to the archive. Every value must be 0 or 1, e.g. the unpacked validity mask of a
+ * waveform.
+ * @see NumpyWriter::addArray
+ */
+PIL_ERROR_CODE NumpyWriter::addBoolArray(const std::string &name, const uint8_t *values, size_t count) {
+    return addEntry(name, NPY_DESCR_BOOL, values, count, sizeof(uint8_t));
+}
+
+/**
+ * @brief Writes the central directory and closes the archive.
+ * @return PIL_NO_ERROR if the archive was closed or not open, PIL_ERRNO if a write failed.
+ */
+PIL_ERROR_CODE NumpyWriter::close() {
+    if (!m_File)
+        return PIL_NO_ERROR;
+
+    std::string directory;
+    for (auto &entry: m_Entries) {
+        appendLittleEndian(ZIP_CENTRAL_DIRECTORY_SIGNATURE, 4, &directory);
+        appendLittleEndian(ZIP_VERSION, 2, &directory); // version made by
+        appendLittleEndian(ZIP_VERSION, 2, &directory); // version needed to extract
+        appendLittleEndian(0, 2, &directory); // flags
+        appendLittleEndian(0, 2, &directory); // stored
+        appendLittleEndian(0, 2, &directory); // time
+        appendLittleEndian(ZIP_DATE, 2, &directory);
+        appendLittleEndian(entry.crc, 4, &directory);
+        appendLittleEndian(entry.size, 4, &directory); // compressed size
+        appendLittleEndian(entry.size, 4, &directory); // uncompressed size
+        appendLittleEndian(static_cast<uint32_t>(entry.name.size()), 2, &directory);
+        appendLittleEndian(0, 2, &directory); // extra field length
+        appendLittleEndian(0, 2, &directory); // comment length
+        appendLittleEndian(0, 2, &directory); // disk number
+        appendLittleEndian(0, 2, &directory); // internal attributes
+        appendLittleEndian(0, 4, &directory); // external attributes
+        appendLittleEndian(entry.offset, 4, &directory);
+        directory += entry.name;
+    }
+
+    auto directorySize = static_cast<uint32_t>(directory.size());
+    appendLittleEndian(ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE, 4, &directory);
+    appendLittleEndian(0, 2, &directory); // number of this disk
+    appendLittleEndian(0, 2, &directory); // disk of the central directory
+    appendLittleEndian(static_cast<uint32_t>(m_Entries.size()), 2, &directory);
+    appendLittleEndian(static_cast<uint32_t>(m_Entries.size()), 2, &directory);
+    appendLittleEndian(directorySize, 4, &directory);
+    appendLittleEndian(static_cast<uint32_t>(m_Offset), 4, &directory);
+    appendLittleEndian(0, 2, &directory); // comment length
+
+    auto ret = writeBuffer(directory.data(), directory.size());
+    if (std::fclose(m_File) != 0 && ret == PIL_NO_ERROR)
+        ret = PIL_ERRNO;
+    m_File = nullptr;
+    m_Entries.clear();
+    return ret;
+}
+
+/**
+ * @brief Creates the header of a one dimensional array including magic string and padding.
+ * @param descr type description of numpy, e.g. "<f8" for little endian doubles.
+ * @param count number of values.
+ * @return header, its length is a multiple of 64.
+ */
+/* static */ std::string NumpyWriter::createHeader(const char *descr, size_t count) {
+    std::string dict = "{'descr': '" + std::string(descr) + "', 'fortran_order': False, 'shape': (" +
+                       std::to_string(count) + ",), }";
+
+    // The dictionary is padded with spaces and terminated by a newline.
+    size_t length = NPY_MAGIC_LENGTH + 2 + dict.size() + 1;
+    dict.append((NPY_ALIGNMENT - length % NPY_ALIGNMENT) % NPY_ALIGNMENT, ' ');
+    dict += '\n';
+
+    std::string header(NPY_MAGIC, NPY_MAGIC_LENGTH);
+    appendLittleEndian(static_cast<uint32_t>(dict.size()), 2, &header);
+    return header + dict;
+}
+
+/**
+ * @brief Computes the CRC-32 checksum used by zip archives.
+ * @param data data to compute the checksum of.
+ * @param length number of bytes.
+ * @param crc checksum of the previous data to continue the computation, 0 for the first call.
+ * @return checksum of all data passed so far.
+ */
+/* static */ uint32_t NumpyWriter::crc32(const uint8_t *data, size_t length, uint32_t crc) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * @brief Writes the header and the values of an array as .npy file.
+ * @param filePath path of the file to create or overwrite.
+ * @param descr type description of numpy.
+ * @param data values to write.
+ * @param count number of values.
+ * @param bytesPerValue size of a single value.
+ * @return PIL_NO_ERROR if the file was written, otherwise the error code.
+ */
+/* static */ PIL_ERROR_CODE NumpyWriter::writeNpy(const std::string &filePath, const char *descr, const void *data,
+                                                  size_t count, size_t bytesPerValue) {
+    std::FILE *file = std::fopen(filePath.c_str(), "wb");
+    if (!file)
+        return PIL_NO_SUCH_FILE;
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    std::string header = createHeader(descr, count);
+    size_t length = count * bytesPerValue;
+    bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                   std::fwrite(data, 1, length, file) == length;
+    if (std::fclose(file) != 0)
+        written = false;
+    return written ? PIL_NO_ERROR : PIL_ERRNO;
+}
+
+/**
+ * @brief Writes the local file header, the npy header and the values of an array to the archive.
+ * @param name name of the array without extension.
+ * @param descr type description of numpy.
+ * @param data values to write.
+ * @param count number of values.
+ * @param bytesPerValue size of a single value.
+ * @return PIL_NO_ERROR if the array was written, otherwise the error code.
+ */
+PIL_ERROR_CODE NumpyWriter::addEntry(const std::string &name, const char *descr, const void *data, size_t count,
+                                     size_t bytesPerValue) {
+    if (!m_File)
+        return PIL_INTERFACE_CLOSED;
+    if (name.empty() || (!data && count > 0))
+        return PIL_INVALID_ARGUMENTS;
+
+    std::string header = createHeader(descr, count);
+    uint64_t size = header.size() + static_cast<uint64_t>(count) * bytesPerValue;
+    std::string fileName = name + ".npy";
+    if (m_Offset + size + 30 + fileName.size() > ZIP_MAX_SIZE)
+        return PIL_INSUFFICIENT_RESOURCES;
+
+    // The values are already in memory, so the checksum is computed before the local header is written and no data
+    // descriptor is required.
+    uint32_t crc = crc32(reinterpret_cast<const uint8_t *>(header.data()), header.size());
+    crc = crc32(static_cast<const uint8_t *>(data), count * bytesPerValue, crc);
+
+    std::string localHeader;
+    appendLittleEndian(ZIP_LOCAL_FILE_HEADER_SIGNATURE, 4, &localHeader);
+    appendLittleEndian(ZIP_VERSION, 2, &localHeader);
+    appendLittleEndian(0, 2, &localHeader); // flags
+    appendLittleEndian(0, 2, &localHeader); // stored
+    appendLittleEndian(0, 2, &localHeader); // time
+    appendLittleEndian(ZIP_DATE, 2, &localHeader);
+    appendLittleEndian(crc, 4, &localHeader);
+    appendLittleEndian(static_cast<uint32_t>(size), 4, &localHeader); // compressed size
+    appendLittleEndian(static_cast<uint32_t>(size), 4, &localHeader); // uncompressed size
+    appendLittleEndian(static_cast<uint32_t>(fileName.size()), 2, &localHeader);
+    appendLittleEndian(0, 2, &localHeader); // extra field length
+    localHeader += fileName;
+    localHeader += header;
+
+    auto ret = writeBuffer(localHeader.data(), localHeader.size());
+    if (ret == PIL_NO_ERROR)
+        ret = writeBuffer(data, count * bytesPerValue);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    m_Entries.push_back({fileName, crc, static_cast<uint32_t>(size), static_cast<uint32_t>(m_Offset)});
+    m_Offset += localHeader.size() - header.size() + size;
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Writes a buffer completely to the archive.
+ * @param data data to write.
+ * @param length number of bytes.
+ * @return PIL_NO_ERROR if all bytes were written, PIL_ERRNO otherwise.
+ */
+PIL_ERROR_CODE NumpyWriter::writeBuffer(const void *data, size_t length) {
+    if (length > 0 && std::fwrite(data, 1, length, m_File) != length)
+        return PIL_ERRNO;
+    return PIL_NO_ERROR;
+}
@@ -67,8 +67,10 @@ SubArg &SubArg::AddElem(double value, const std::string &prefix, const std::stri
 std::string SubArg::toString() {
     // TODO return local variable!
     std::string retStr;
-    for (auto elem: m_SubArgElem) {
-        retStr += std::get<0>(elem) + std::get<1>(elem) + std::get<2>(elem);
+    for (const auto &elem: m_SubArgElem) {
+        retStr += std::get<0>(elem);
+        retStr += std::get<1>(elem);
+        retStr += std::get<2>(elem);
     }
     return retStr;
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+/**
+ * @brief Implementation of the scalar, SSE2 and AVX2 waveform conversion kernels.
+ * @authors Florian Frank
+ */
+#include "WaveformConverter.h"
+
+#include <cstdlib> // std::strtod
+#include <type_traits> // std::is_same_v
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define WAVEFORM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/** Number of comma separated fields of the waveform preamble. **/
+#define PREAMBLE_FIELD_COUNT 10
+/** Number of samples converted per iteration of the vectorized kernels, one byte of the validity mask. **/
+#define SAMPLES_PER_BLOCK 8
+
+namespace
+{
+    /**
+     * @brief Reads a single unsigned sample.
+     */
+    inline uint32_t readSample(const uint8_t *samples, size_t index, WaveformConverter::SAMPLE_FORMAT format) {
+        switch (format) {
+            case WaveformConverter::BYTE_SAMPLES:
+                return samples[index];
+            case WaveformConverter::WORD_BIG_ENDIAN_SAMPLES:
+                return (static_cast<uint32_t>(samples[2 * index]) << 8) | samples[2 * index + 1];
+            case WaveformConverter::WORD_LITTLE_ENDIAN_SAMPLES:
+                return (static_cast<uint32_t>(samples[2 * index + 1]) << 8) | samples[2 * index];
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Converts the samples from begin to count. begin must be a multiple of 8, so the mask bytes are not
+     * shared with a vectorized kernel.
+     */
+    template<typename T>
+    void convertRange(const uint8_t *samples, size_t begin, size_t count, WaveformConverter::SAMPLE_FORMAT format,
+                      T scale, T offset, T *voltages, uint8_t *validMask) {
+        for (size_t i = begin; i < count; i++) {
+            uint32_t raw = readSample(samples, i, format);
+            voltages[i] = static_cast<T>(raw) * scale + offset;
+            if (i % SAMPLES_PER_BLOCK == 0)
+                validMask[i / SAMPLES_PER_BLOCK] = 0;
+            if (raw != 0)
+                validMask[i / SAMPLES_PER_BLOCK] |= static_cast<uint8_t>(1u << (i % SAMPLES_PER_BLOCK));
+        }
+    }
+
+#ifdef WAVEFORM_X86_KERNELS
+    /**
+     * @brief Loads 8 samples as two vectors of 4 int32 and returns the validity bits of the samples.
+     */
+    inline uint8_t loadBlockSSE2(const uint8_t *samples, WaveformConverter::SAMPLE_FORMAT format, __m128i *low,
+                                 __m128i *high) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i words;
+        int holes;
+        if (format == WaveformConverter::BYTE_SAMPLES) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(samples));
+            holes = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+            words = _mm_unpacklo_epi8(bytes, zero);
+        } else {
+            words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples));
+            if (format == WaveformConverter::WORD_BIG_ENDIAN_SAMPLES)
+                words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+            holes = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(words, zero), zero));
+        }
+        *low = _mm_unpacklo_epi16(words, zero);
+        *high = _mm_unpackhi_epi16(words, zero);
+        return static_cast<uint8_t>(~holes & 0xFF);
+    }
+
+    template<typename T>
+    size_t convertSSE2(const uint8_t *samples, size_t count, WaveformConverter::SAMPLE_FORMAT format, T scale,
+                       T offset, T *voltages, uint8_t *validMask) {
+        size_t bytesPerSample = WaveformConverter::getBytesPerSample(format);
+        size_t i = 0;
+        for (; i + SAMPLES_PER_BLOCK <= count; i += SAMPLES_PER_BLOCK) {
+            __m128i low, high;
+            validMask[i / SAMPLES_PER_BLOCK] = loadBlockSSE2(samples + i * bytesPerSample, format, &low, &high);
+
+            if constexpr (std::is_same_v<T, float>) {
+                const __m128 scaleVector = _mm_set1_ps(scale);
+                const __m128 offsetVector = _mm_set1_ps(offset);
+                _mm_storeu_ps(voltages + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(low), scaleVector), offsetVector));
+                _mm_storeu_ps(voltages + i + 4,
+                              _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(high), scaleVector), offsetVector));
+            } else {
+                const __m128d scaleVector = _mm_set1_pd(scale);
+                const __m128d offsetVector = _mm_set1_pd(offset);
+                __m128i parts[4] = {low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)),
+                                    high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2))};
+                for (int part = 0; part < 4; part++)
+                    _mm_storeu_pd(voltages + i + 2 * part,
+                                  _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(parts[part]), scaleVector), offsetVector));
+            }
+        }
+        return i;
+    }
+
+    template<typename T>
+    __attribute__((target("avx2")))
+    size_t convertAVX2(const uint8_t *samples, size_t count, WaveformConverter::SAMPLE_FORMAT format, T scale,
+                       T offset, T *voltages, uint8_t *validMask) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i swapBytes = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+        size_t bytesPerSample = WaveformConverter::getBytesPerSample(format);
+
+        size_t i = 0;
+        for (; i + SAMPLES_PER_BLOCK <= count; i += SAMPLES_PER_BLOCK) {
+            const uint8_t *block = samples + i * bytesPerSample;
+            __m256i values;
+            int holes;
+            if (format == WaveformConverter::BYTE_SAMPLES) {
+                __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(block));
+                holes = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+                values = _mm256_cvtepu8_epi32(bytes);
+            } else {
+                __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+                if (format == WaveformConverter::WORD_BIG_ENDIAN_SAMPLES)
+                    words = _mm_shuffle_epi8(words, swapBytes);
+                holes = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(words, zero), zero));
+                values = _mm256_cvtepu16_epi32(words);
+            }
+            validMask[i / SAMPLES_PER_BLOCK] = static_cast<uint8_t>(~holes & 0xFF);
+
+            if constexpr (std::is_same_v<T, float>) {
+                __m256 converted = _mm256_cvtepi32_ps(values);
+                _mm256_storeu_ps(voltages + i, _mm256_add_ps(_mm256_mul_ps(converted, _mm256_set1_ps(scale)),
+                                                             _mm256_set1_ps(offset)));
+            } else {
+                const __m256d scaleVector = _mm256_set1_pd(scale);
+                const __m256d offsetVector = _mm256_set1_pd(offset);
+                __m256d low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(values));
+                __m256d high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(values, 1));
+                _mm256_storeu_pd(voltages + i, _mm256_add_pd(_mm256_mul_pd(low, scaleVector), offsetVector));
+                _mm256_storeu_pd(voltages + i + 4, _mm256_add_pd(_mm256_mul_pd(high, scaleVector), offsetVector));
+            }
+        }
+        return i;
+    }
+
+    /**
+     * @brief Checks once if the CPU supports AVX2.
+     */
+    bool hasAVX2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif // WAVEFORM_X86_KERNELS
+
+    template<typename T>
+    void convertVectorized(const uint8_t *samples, size_t count, WaveformConverter::SAMPLE_FORMAT format,
+                           const WaveformPreamble &preamble, T *voltages, uint8_t *validMask) {
+        // voltage = (raw - yReference) * yIncrement + yOrigin = raw * scale + offset
+        T scale = static_cast<T>(preamble.yIncrement);
+        T offset = static_cast<T>(preamble.yOrigin - preamble.yReference * preamble.yIncrement);
+
+        size_t converted = 0;
+#ifdef WAVEFORM_X86_KERNELS
+        if (hasAVX2())
+            converted = convertAVX2(samples, count, format, scale, offset, voltages, validMask);
+        else
+            converted = convertSSE2(samples, count, format, scale, offset, voltages, validMask);
+#endif // WAVEFORM_X86_KERNELS
+        convertRange(samples, converted, count, format, scale, offset, voltages, validMask);
+    }
+}
+
+/**
+ * @brief Parses the reply of :WAVeform:PREamble?
+ * @param preamble comma separated reply, e.g. "0,0,1000,1,1e-6,-5e-4,0,0.01,0,128".
+ * @param result parsed preamble.
+ * @return false if the reply does not contain all fields.
+ */
+/* static */ bool WaveformPreamble::parse(const std::string &preamble, WaveformPreamble *result) {
+    double fields[PREAMBLE_FIELD_COUNT];
+    const char *position = preamble.c_str();
+    for (int i = 0; i < PREAMBLE_FIELD_COUNT; i++) {
+        char *end;
+        fields[i] = std::strtod(position, &end);
+        if (end == position)
+            return false;
+        position = *end == ',' ? end + 1 : end;
+    }
+
+    result->format = static_cast<int>(fields[0]);
+    result->type = static_cast<int>(fields[1]);
+    result->points = static_cast<int>(fields[2]);
+    result->count = static_cast<int>(fields[3]);
+    result->xIncrement = fields[4];
+    result->xOrigin = fields[5];
+    result->xReference = fields[6];
+    result->yIncrement = fields[7];
+    result->yOrigin = fields[8];
+    result->yReference = fields[9];
+    return true;
+}
+
+/**
+ * @brief Converts raw samples into voltages with the fastest kernel supported by the CPU.
+ * @param samples raw samples as received with :WAVeform:DATA?.
+ * @param count number of samples.
+ * @param format format of the samples.
+ * @param preamble preamble of the waveform.
+ * @param voltages converted voltages, must hold count values.
+ * @param validMask validity bitmask, must hold getMaskSize(count) bytes.
+ */
+/* static */ void WaveformConverter::convert(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                                             const WaveformPreamble &preamble, double *voltages,
+                                             uint8_t *validMask) {
+    convertVectorized(samples, count, format, preamble, voltages, validMask);
+}
+
+/**
+ * @brief Converts raw samples into single precision voltages with the fastest kernel supported by the CPU.
+ * @see WaveformConverter::convert
+ */
+/* static */ void WaveformConverter::convert(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                                             const WaveformPreamble &preamble, float *voltages, uint8_t *validMask) {
+    convertVectorized(samples, count, format, preamble, voltages, validMask);
+}
+
+/**
+ * @brief Reference implementation without vector instructions, e.g. to verify the vectorized kernels.
+ * @see WaveformConverter::convert
+ */
+/* static */ void WaveformConverter::convertScalar(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                                                   const WaveformPreamble &preamble, double *voltages,
+                                                   uint8_t *validMask) {
+    convertRange(samples, 0, count, format, preamble.yIncrement,
+                 preamble.yOrigin - preamble.yReference * preamble.yIncrement, voltages, validMask);
+}
+
+/**
+ * @brief Reference implementation without vector instructions for single precision voltages.
+ * @see WaveformConverter::convert
+ */
+/* static */ void WaveformConverter::convertScalar(const uint8_t *samples, size_t count, SAMPLE_FORMAT format,
+                                                   const WaveformPreamble &preamble, float *voltages,
+                                                   uint8_t *validMask) {
+    convertRange(samples, 0, count, format, static_cast<float>(preamble.yIncrement),
+                 static_cast<float>(preamble.yOrigin - preamble.yReference * preamble.yIncrement), voltages,
+                 validMask);
+}
+
+/**
+ * @brief Returns the size of a single raw sample.
+ * @param format format of the samples.
+ * @return 1 for BYTE samples, 2 for WORD samples.
+ */
+/* static */ size_t WaveformConverter::getBytesPerSample(SAMPLE_FORMAT format) {
+    return format == BYTE_SAMPLES ? 1 : 2;
+}
+
+/**
+ * @brief Returns the name of the kernel used by convert, e.g. to report it in benchmarks.
+ * @return "AVX2", "SSE2" or "scalar".
+ */
+/* static */ const char *WaveformConverter::getKernelName() {
+#ifdef WAVEFORM_X86_KERNELS
+    return hasAVX2() ? "AVX2" : "SSE2";
+#else
+    return "scalar";
+#endif // WAVEFORM_X86_KERNELS
+}
@@ -3,19 +3,113 @@
  * @copyright University of Passau - Chair of Computer Engineering
  */
 #include "devices/KEI2600.h"
+#include "CSVWriter.h"
+#include "JSONMetadata.h"
+#include "NumpyWriter.h"
 #include "ctlib/Logging.hpp"
 #include "ctlib/Exception.h"
-#include "HTTPRequest.h"
 
 #include <utility> // std::move
 #include <stdexcept> // std::invalid_argument
 #include <thread>
 #include <iostream>
+#include <cstring> // memcpy
+#include <algorithm> // std::min
+#include <chrono>
+#include <cstdlib> // std::strtod
+#include <cmath> // std::lround, std::abs
 
 extern "C" {
 #include "ctlib/ErrorHandler.h"
 }
 
+/** Number of values requested with the first printbuffer call, before the throughput is known. **/
+#define INITIAL_CHUNK_SIZE 256
+/** Upper bound of values requested with a single printbuffer call. **/
+#define MAX_CHUNK_SIZE 65536
+/** Estimated length of a value in ASCII format, e.g. "-1.23456789e-03, ". **/
+#define ASCII_VALUE_SIZE 15
+/** Length of the '#0' header which precedes each binary block of the 2600 series. **/
+#define BINARY_HEADER_SIZE 2
+/** Name of the script, which defines the icl_sweep function on the SMU. **/
+#define SWEEP_ENGINE_SCRIPT_NAME "ICLSweepEngine"
+/** Printed after a script was uploaded over the socket, followed by the name of the script. **/
+#define SCRIPT_UPLOAD_SENTINEL "ICL_UPLOAD_DONE_"
+/** Global variable on the SMU, which holds the number of errors in the error queue before a script upload. **/
+#define SCRIPT_UPLOAD_ERROR_COUNT "icl_upload_error_count"
+/** The error queue is checked at the latest after this number of unchecked commands, regardless of the policy. **/
+#define MAX_UNCHECKED_COMMANDS 1000
+/** Highest power line frequency, one power line cycle takes at least 1 / 60 s. **/
+#define MAX_LINE_FREQUENCY 60.0
+
+/**
+ * Defines icl_sweep(smu, sourceVoltage, mode, start, stop, points, values, limit, nplc, period, pulseWidth,
+ * bufferName). The sweep is executed by the trigger model: the source action steps through the configured values,
+ * timer 1 paces the points and timer 2 ends each pulse. The readings are stored in the global buffer bufferName.
+ * The script must not contain double quotes, since it is embedded into the JSON payload of the upload.
+ */
+static const std::vector<std::string> SWEEP_ENGINE_SCRIPT = {
+        "function icl_sweep(smu, sourceVoltage, mode, startValue, stopValue, points, values, limit, nplc, period, "
+        "pulseWidth, bufferName, measure)",
+        "    if sourceVoltage then",
+        "        smu.source.func = smu.OUTPUT_DCVOLTS",
+        "        smu.source.limiti = limit",
+        "        smu.trigger.source.limiti = limit",
+        "    else",
+        "        smu.source.func = smu.OUTPUT_DCAMPS",
+        "        smu.source.limitv = limit",
+        "        smu.trigger.source.limitv = limit",
+        "    end",
+        "    smu.measure.nplc = nplc",
+        "    local buffer = smu.makebuffer(measure and points or 1)",
+        "    buffer.collectsourcevalues = 1",
+        "    buffer.collecttimestamps = 1",
+        "    _G[bufferName] = buffer",
+        "    if mode == 0 and sourceVoltage then smu.trigger.source.linearv(startValue, stopValue, points)",
+        "    elseif mode == 0 then smu.trigger.source.lineari(startValue, stopValue, points)",
+        "    elseif mode == 1 and sourceVoltage then smu.trigger.source.logv(startValue, stopValue, points, 0)",
+        "    elseif mode == 1 then smu.trigger.source.logi(startValue, stopValue, points, 0)",
+        "    elseif sourceVoltage then smu.trigger.source.listv(values)",
+        "    else smu.trigger.source.listi(values) end",
+        "    smu.trigger.source.action = smu.ENABLE",
+        "    if measure then",
+        "        smu.trigger.measure.action = smu.ENABLE",
+        "        if sourceVoltage then smu.trigger.measure.i(buffer) else smu.trigger.measure.v(buffer) end",
+        "    else",
+        "        smu.trigger.measure.action = smu.DISABLE",
+        "    end",
+        "    smu.trigger.measure.stimulus = 0",
+        "    if period > 0 then",
+        "        trigger.timer[1].reset()",
+        "        trigger.timer[1].delay = period",
+        "        trigger.timer[1].count = points > 1 and points - 1 or 1",
+        "        trigger.timer[1].passthrough = true",
+        "        trigger.timer[1].stimulus = smu.trigger.ARMED_EVENT_ID",
+        "        smu.trigger.source.stimulus = trigger.timer[1].EVENT_ID",
+        "    else",
+        "        smu.trigger.source.stimulus = 0",
+        "    end",
+        "    if pulseWidth > 0 then",
+        "        trigger.timer[2].reset()",
+        "        trigger.timer[2].delay = pulseWidth",
+        "        trigger.timer[2].count = 1",
+        "        trigger.timer[2].passthrough = false",
+        "        trigger.timer[2].stimulus = smu.trigger.SOURCE_COMPLETE_EVENT_ID",
+        "        smu.trigger.endpulse.stimulus = trigger.timer[2].EVENT_ID",
+        "        smu.trigger.endpulse.action = smu.SOURCE_IDLE",
+        "    else",
+        "        smu.trigger.endpulse.stimulus = 0",
+        "        smu.trigger.endpulse.action = smu.SOURCE_HOLD",
+        "    end",
+        "    smu.trigger.endsweep.action = smu.SOURCE_IDLE",
+        "    smu.trigger.arm.count = 1",
+        "    smu.trigger.count = points",
+        "    smu.source.output = smu.OUTPUT_ON",
+        "    smu.trigger.initiate()",
+        "    waitcomplete()",
+        "    smu.source.output = smu.OUTPUT_OFF",
+        "end"};
+
 /**
  * @brief Constructor initializes the ip address and timeout. Disables the logger.
  * @param ip IP-address of the KEI2600-SMU.
@@ -23,7 +117,7 @@ extern "C" {
  * @param logger Logger-object to generate logging messages during the execution.
  */
 KEI2600::KEI2600(std::string ipAddress, int timeoutInMS, PIL::Logging *logger, SEND_METHOD mode)
-        : SMU(std::move(ipAddress), timeoutInMS, logger, mode) {
+        : SMU(std::move(ipAddress), timeoutInMS, logger, mode), m_ChunkSizer(INITIAL_CHUNK_SIZE / 4, MAX_CHUNK_SIZE) {
     m_BufferedScript = defaultBufferedScript;
 }
 
@@ -33,12 +127,19 @@ KEI2600::KEI2600(std::string ipAddress, int timeoutInMS, PIL::Logging *logger, S
  * @param timeoutInMS timeout in milliseconds of the socket.
  */
 [[maybe_unused]] KEI2600::KEI2600(std::string ipAddress, int timeoutInMS, SEND_METHOD mode)
-        : SMU(std::move(ipAddress), timeoutInMS, nullptr, mode) {
+        : SMU(std::move(ipAddress), timeoutInMS, nullptr, mode), m_ChunkSizer(INITIAL_CHUNK_SIZE / 4, MAX_CHUNK_SIZE) {
     m_BufferedScript = defaultBufferedScript;
     std::string logFile = "instrument_control.log";
     m_Logger = new PIL::Logging(PIL::INFO, &logFile);
 }
 
+/**
+ * @brief Destructor stops the I/O thread, so no queued function is executed on a partly destroyed device.
+ */
+KEI2600::~KEI2600() {
+    stopIOThread();
+}
+
 /**
  * @brief This function measures a certain unit on a specific channel. This function can be used to measure
  * voltage, current, power or resistance. It calls smuX.meausreUNIT().
@@ -57,36 +158,202 @@ PIL_ERROR_CODE KEI2600::measure(UNIT unit, SMU_CHANNEL channel, double *value, b
         return PIL_INVALID_ARGUMENTS;
     }
 
-    SubArg subArg("smu");
-    subArg.AddElem(getChannelStringFromEnum(channel))
-            .AddElem("measure", ".")
-            .AddElem(unitLetter + "(" + getMeasurementStorage(channel) + ")", ".");
+    auto &command = newCommand();
+    command.Add("reading = smu").Add(getChannelLetterFromEnum(channel))
+            .Add(".measure.").Add(unitLetter).Add('(').Add(getMeasurementStorage(channel)).Add(')');
 
-    ExecArgs args;
-    args.AddArgument(subArg, "");
+    if (isBuffered())
+        return Exec(command);
 
-    auto ret = Exec("reading = ", &args);
-    if (errorOccured(ret))
-        return ret;
+    // The measurement and the print statement are sent in one line, so only one round trip is required.
+    command.Add(" print(reading");
+    auto ret = execQuery(command, checkErrorBuffer, value, 1);
+    if (!errorOccured(ret) && m_Logger)
+        m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__, "measure" + unitLetter + " returned: %g", *value);
+    return ret;
+}
 
-    if (!isBuffered()) {
-        SubArg subArgPrint("");
-        subArgPrint.AddElem("reading", "(", ")");
+/**
+ * @brief Sets the level of a channel and measures in a single TSP line, so only one round trip is required.
+ * @param sourceUnit unit of the level, voltage or current.
+ * @param channel channel to set and measure.
+ * @param level level to set.
+ * @param measureUnit unit to measure. Allowed are voltage, current, power and resistance.
+ * @param value measured value.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated within the same reply.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                           double *value, bool checkErrorBuffer) {
+    return setLevelAndMeasure(sourceUnit, channel, level, measureUnit, value, nullptr, checkErrorBuffer);
+}
 
-        ExecArgs execArgs;
-        execArgs.AddArgument(subArgPrint, "");
+/**
+ * @brief Sets the level of a channel, measures and reads the compliance flag in a single TSP line.
+ * @param sourceUnit unit of the level, voltage or current.
+ * @param channel channel to set and measure.
+ * @param level level to set.
+ * @param measureUnit unit to measure. Allowed are voltage, current, power and resistance.
+ * @param value measured value.
+ * @param compliance set to true if the source is in compliance. Can be nullptr.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated within the same reply.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                           double *value, bool *compliance, bool checkErrorBuffer) {
+    std::string_view levelPrefix = KEI2600Commands::getCommandPrefix(channel, sourceUnit,
+                                                                     KEI2600Commands::SOURCE_LEVEL);
+    std::string measureLetter = getLetterFromUnit(measureUnit);
+    if (levelPrefix.empty() || measureLetter.empty() || (!isBuffered() && !value)) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
 
-        std::string result;
-        ret = Exec("print", &execArgs, &result, true);
-        if (errorOccured(ret))
-            return ret;
+    // The buffered script is executed at once, the default implementation appends both commands to it.
+    if (isBuffered())
+        return SMU::setLevelAndMeasure(sourceUnit, channel, level, measureUnit, value, checkErrorBuffer);
+
+    char channelLetter = getChannelLetterFromEnum(channel);
+    // The level is always sent, because the measurement is part of the same line.
+    auto &command = newCommand();
+    command.Add(levelPrefix).Add(level).Add(" reading = smu").Add(channelLetter).Add(".measure.").Add(measureLetter)
+            .Add("() print(reading");
+    if (compliance)
+        command.Add(", smu").Add(channelLetter).Add(".source.compliance and 1 or 0");
+
+    double values[2];
+    auto ret = execQuery(command, checkErrorBuffer, values, compliance ? 2 : 1);
+    updateState(levelPrefix, level, ret);
+    if (ret == PIL_NO_ERROR || ret == PIL_ITEM_IN_ERROR_QUEUE) {
+        *value = values[0];
+        if (compliance)
+            *compliance = values[1] != 0;
+    }
+    return ret;
+}
 
-        if (m_Logger)
-            m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__, "measure" + unitLetter + "V returned: %s",
-                                 result.c_str());
-        *value = std::stod(result);
+/**
+ * @brief Measures current and voltage simultaneously with smuX.measure.iv() in a single round trip.
+ * @param channel channel to measure.
+ * @param current measured current.
+ * @param voltage measured voltage.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated within the same reply.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::measureIV(SMU_CHANNEL channel, double *current, double *voltage, bool checkErrorBuffer) {
+    if (isBuffered())
+        return SMU::measureIV(channel, current, voltage, checkErrorBuffer);
+    if (!current || !voltage) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
+    auto &command = newCommand();
+    command.Add("icl_i, icl_v = smu").Add(getChannelLetterFromEnum(channel))
+            .Add(".measure.iv() print(icl_i, icl_v");
+
+    double values[2];
+    auto ret = execQuery(command, checkErrorBuffer, values, 2);
+    if (ret == PIL_NO_ERROR || ret == PIL_ITEM_IN_ERROR_QUEUE) {
+        *current = values[0];
+        *voltage = values[1];
+    }
+    return ret;
+}
+
+/**
+ * @brief Measures the same unit on channel A and channel B in a single round trip.
+ * @param unit unit to measure. Allowed are voltage, current, power and resistance.
+ * @param valueA measured value of channel A.
+ * @param valueB measured value of channel B.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated within the same reply.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::measureBothChannels(UNIT unit, double *valueA, double *valueB, bool checkErrorBuffer) {
+    if (isBuffered())
+        return SMU::measureBothChannels(unit, valueA, valueB, checkErrorBuffer);
+    std::string unitLetter = getLetterFromUnit(unit);
+    if (unitLetter.empty() || !valueA || !valueB) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
+    auto &command = newCommand();
+    command.Add("print(smua.measure.").Add(unitLetter).Add("(), smub.measure.").Add(unitLetter).Add("()");
+
+    double values[2];
+    auto ret = execQuery(command, checkErrorBuffer, values, 2);
+    if (ret == PIL_NO_ERROR || ret == PIL_ITEM_IN_ERROR_QUEUE) {
+        *valueA = values[0];
+        *valueB = values[1];
+    }
+    return ret;
+}
+
+/**
+ * @brief Reads the compliance flag of a channel (smuX.source.compliance).
+ * @param channel channel to check.
+ * @param compliance set to true if the source reached its limit.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated within the same reply.
+ * @return NO_ERROR if execution was successful, INVALID_ARGUMENTS in buffered mode, otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::isInCompliance(SMU_CHANNEL channel, bool *compliance, bool checkErrorBuffer) {
+    if (isBuffered() || !compliance) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
     }
 
+    auto &command = newCommand();
+    command.Add("print(smu").Add(getChannelLetterFromEnum(channel)).Add(".source.compliance and 1 or 0");
+
+    double value;
+    auto ret = execQuery(command, checkErrorBuffer, &value, 1);
+    if (ret == PIL_NO_ERROR || ret == PIL_ITEM_IN_ERROR_QUEUE)
+        *compliance = value != 0;
+    return ret;
+}
+
+/**
+ * @brief Executes a command ending with an open print statement, e.g. "print(reading", and parses the printed
+ * numbers. If the error queue has to be checked immediately, the error count is printed within the same reply,
+ * so the check does not cost an additional round trip.
+ * @param command command ending with an open print statement.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @param values parsed values.
+ * @param count number of values printed by the command.
+ * @return NO_ERROR if execution was successful, UNKNOWN_ERROR if the reply could not be parsed, otherwise return
+ * error code.
+ */
+PIL_ERROR_CODE KEI2600::execQuery(CommandBuilder &command, bool checkErrorBuffer, double *values, size_t count) {
+    bool fuseErrorCheck = checkErrorBuffer &&
+                          (m_ErrorCheckPolicy == CHECK_EVERY_CALL || m_ErrorCheckPolicy == CHECK_PIGGYBACK);
+    command.Add(fuseErrorCheck ? ", errorqueue.count)" : ")");
+
+    auto ret = Exec(command, &m_QueryReply);
+    if (errorOccured(ret))
+        return ret;
+
+    const char *position = m_QueryReply.c_str();
+    for (size_t i = 0; i <= count; i++) {
+        if (i == count && !fuseErrorCheck)
+            break;
+        char *end;
+        double value = std::strtod(position, &end);
+        if (end == position)
+            return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::WARNING, __FILENAME__, __LINE__,
+                                          "Invalid reply: %s", m_QueryReply.c_str());
+        if (i < count)
+            values[i] = value;
+        else {
+            trackLastCommand(false);
+            return evaluateErrorCount(static_cast<int>(value));
+        }
+        position = end;
+    }
     return handleErrorCode(ret, checkErrorBuffer);
 }
 
@@ -105,19 +372,14 @@ double KEI2600::measurePy(UNIT unit, SMU_CHANNEL channel, bool checkErrorBuffer)
         return 0;
     }
 
-    if (errorOccured(ret) && m_Logger) {
+    // The error queue was already evaluated by measure according to the error check policy.
+    if (errorOccured(ret)) {
+        std::string message = ret == PIL_ITEM_IN_ERROR_QUEUE ? getLastError() : PIL_ErrorCodeToString(ret);
         if (m_EnableExceptions)
-            throw PIL::Exception(ret, __FILENAME__, __LINE__, "");
-        m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__,
-                             "Error while executing measure: %s", PIL_ErrorCodeToString(ret));
-    }
-    if (checkErrorBuffer) {
-        auto returnValue = getErrorBufferStatus();
-        if (errorOccured(returnValue)) {
-            if (m_EnableExceptions)
-                throw PIL::Exception(returnValue, __FILENAME__, __LINE__, getLastError());
-            m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, getLastError());
-        }
+            throw PIL::Exception(ret, __FILENAME__, __LINE__, message);
+        if (m_Logger)
+            m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "Error while executing measure: %s",
+                                 message.c_str());
     }
     return value;
 }
@@ -149,22 +411,13 @@ PIL_ERROR_CODE KEI2600::turnOff(SMU_CHANNEL channel, bool checkErrorBuffer) {
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::toggleChannel(SMU_CHANNEL channel, bool enable) {
-    SubArg subArg("source", ".");
-    subArg.AddElem("output", ".");
-
-    std::string argString = "OUTPUT_";
-    argString += (enable ? "ON" : "OFF");
-    SubArg outputArg(argString, ".");
+    char channelLetter = getChannelLetterFromEnum(channel);
 
-    SubArg smuNumber("smu");
-    smuNumber.AddElem(getChannelStringFromEnum(channel));
+    auto &command = newCommand();
+    command.Add("smu").Add(channelLetter).Add(".source.output = smu").Add(channelLetter)
+            .Add(enable ? ".OUTPUT_ON" : ".OUTPUT_OFF");
 
-    ExecArgs execArgs;
-    execArgs.AddArgument("smu", getChannelStringFromEnum(channel))
-            .AddArgument(subArg, smuNumber, " = ")
-            .AddArgument(outputArg, "");
-
-    return Exec("", &execArgs);
+    return Exec(command);
 }
 
 /**
@@ -178,28 +431,7 @@ PIL_ERROR_CODE KEI2600::toggleChannel(SMU_CHANNEL channel, bool enable) {
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setLevel(UNIT unit, SMU_CHANNEL channel, double level, bool checkErrorBuffer) {
-    SubArg subArg("");
-    subArg.AddElem("source", ".");
-
-    ExecArgs args;
-
-    switch (unit) {
-        case CURRENT:
-            subArg.AddElem("leveli", ".");
-            break;
-        case VOLTAGE:
-            subArg.AddElem("levelv", ".");
-            break;
-        default:
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
-            return PIL_INVALID_ARGUMENTS;
-    }
-
-    args.AddArgument("smu", getChannelStringFromEnum(channel));
-    args.AddArgument(subArg, level, " = ");
-
-    return handleErrorCode(Exec("", &args), checkErrorBuffer);
+    return setAttribute(KEI2600Commands::SOURCE_LEVEL, unit, channel, level, checkErrorBuffer);
 }
 
 /**
@@ -213,31 +445,7 @@ PIL_ERROR_CODE KEI2600::setLevel(UNIT unit, SMU_CHANNEL channel, double level, b
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setLimit(UNIT unit, SMU_CHANNEL channel, double limit, bool checkErrorBuffer) {
-    SubArg subArg("");
-    subArg.AddElem("source", ".");
-
-    ExecArgs args;
-
-    switch (unit) {
-        case CURRENT:
-            subArg.AddElem("limiti", ".");
-            break;
-        case VOLTAGE:
-            subArg.AddElem("limitv", ".");
-            break;
-        case POWER:
-            subArg.AddElem("limitp", ".");
-            break;
-        default:
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
-            return PIL_INVALID_ARGUMENTS;
-    }
-
-    args.AddArgument("smu", getChannelStringFromEnum(channel));
-    args.AddArgument(subArg, limit, " = ");
-
-    return handleErrorCode(Exec("", &args), checkErrorBuffer);
+    return setAttribute(KEI2600Commands::SOURCE_LIMIT, unit, channel, limit, checkErrorBuffer);
 }
 
 /**
@@ -293,6 +501,8 @@ PIL_ERROR_CODE KEI2600::toggleMeasureAutoRange(SMU_CHANNEL channel, UNIT unit, b
     else
         args.AddArgument(subArg, "0", " = ");
 
+    // The instrument selects the range while autoranging, so the last assigned range is unknown.
+    invalidateState(KEI2600Commands::getCommandPrefix(channel, unit, KEI2600Commands::MEASURE_RANGE));
     return Exec("", &args);
 }
 
@@ -358,6 +568,8 @@ PIL_ERROR_CODE KEI2600::toggleSourceAutoRange(UNIT unit, SMU_CHANNEL channel, bo
             .AddArgument(subArg, smuArg, " = ")
             .AddArgument(subArgAutoRange, "");
 
+    // The instrument selects the range while autoranging, so the last assigned range is unknown.
+    invalidateState(KEI2600Commands::getCommandPrefix(channel, unit, KEI2600Commands::SOURCE_RANGE));
     return Exec("", &args);
 }
 
@@ -456,25 +668,7 @@ PIL_ERROR_CODE KEI2600::toggleSourceSink(SMU_CHANNEL channel, bool enable) {
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setMeasureRange(UNIT unit, SMU_CHANNEL channel, double rangeValue, bool checkErrorBuffer) {
-    SubArg subArg("measure", ".");
-    switch (unit) {
-        case CURRENT:
-            subArg.AddElem("rangei", ".");
-            break;
-        case VOLTAGE:
-            subArg.AddElem("rangev", ".");
-            break;
-        default:
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
-            return PIL_INVALID_ARGUMENTS;
-    }
-
-    ExecArgs args;
-    args.AddArgument("smu", getChannelStringFromEnum(channel))
-            .AddArgument(subArg, rangeValue, " = ");
-
-    return handleErrorCode(Exec("", &args), checkErrorBuffer);
+    return setAttribute(KEI2600Commands::MEASURE_RANGE, unit, channel, rangeValue, checkErrorBuffer);
 }
 
 /**
@@ -487,25 +681,7 @@ PIL_ERROR_CODE KEI2600::setMeasureRange(UNIT unit, SMU_CHANNEL channel, double r
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setSourceRange(UNIT unit, SMU_CHANNEL channel, double rangeValue, bool checkErrorBuffer) {
-    SubArg subArg("source", ".");
-    switch (unit) {
-        case CURRENT:
-            subArg.AddElem("rangei", ".");
-            break;
-        case VOLTAGE:
-            subArg.AddElem("rangev", ".");
-            break;
-        default:
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
-            return PIL_INVALID_ARGUMENTS;
-    }
-
-    ExecArgs args;
-    args.AddArgument("smu", getChannelStringFromEnum(channel))
-            .AddArgument(subArg, rangeValue, " = ");
-
-    return handleErrorCode(Exec("", &args), checkErrorBuffer);
+    return setAttribute(KEI2600Commands::SOURCE_RANGE, unit, channel, rangeValue, checkErrorBuffer);
 }
 
 /**
@@ -538,21 +714,13 @@ PIL_ERROR_CODE KEI2600::setSenseMode(SMU::SMU_CHANNEL channel, SMU::SMU_SENSE se
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setMeasurePLC(SMU_CHANNEL channel, double value, bool checkErrorBuffer) {
-    if (value < 0.001 || value > 25) {
+    std::string_view prefix = KEI2600Commands::getCommandPrefix(channel, VOLTAGE, KEI2600Commands::MEASURE_NPLC);
+    if (prefix.empty()) {
         if (m_EnableExceptions)
             throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
         return PIL_INVALID_ARGUMENTS;
     }
-
-    SubArg subArg("smu");
-    subArg.AddElem(getChannelStringFromEnum(channel))
-            .AddElem("measure", ".")
-            .AddElem("nplc", ".");
-
-    ExecArgs args;
-    args.AddArgument(subArg, value, " = ");
-
-    return handleErrorCode(Exec("", &args), checkErrorBuffer);
+    return assignPLC(prefix, value, checkErrorBuffer);
 }
 
 /**
@@ -564,30 +732,7 @@ PIL_ERROR_CODE KEI2600::setMeasurePLC(SMU_CHANNEL channel, double value, bool ch
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setMeasureLowRange(UNIT unit, SMU_CHANNEL channel, double value, bool checkErrorBuffer) {
-    SubArg subArg("smu");
-    subArg.AddElem(getChannelStringFromEnum(channel))
-            .AddElem("measure", ".")
-            .AddElem("lowrange");
-
-    switch (unit) {
-
-        case VOLTAGE:
-            subArg.AddElem("v");
-            break;
-        case CURRENT:
-            subArg.AddElem("i");
-            break;
-        default:
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
-            return PIL_INVALID_ARGUMENTS;
-    }
-
-    ExecArgs execArgs;
-    execArgs.AddArgument(subArg, value, " = ");
-
-    return handleErrorCode(Exec("", &execArgs), checkErrorBuffer);
-
+    return setAttribute(KEI2600Commands::MEASURE_LOW_RANGE, unit, channel, value, checkErrorBuffer);
 }
 
 /**
@@ -638,16 +783,24 @@ PIL_ERROR_CODE KEI2600::setMeasureCount(SMU_CHANNEL channel, int nrOfMeasurement
  * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::setSourceFunction(SMU_CHANNEL channel, SRC_FUNC srcFunc, bool checkErrorBuffer) {
+    std::string channelString = getChannelStringFromEnum(channel);
+    std::string key = "smu" + channelString + ".source.func";
+    std::string function = getStringFromSrcFuncEnum(srcFunc);
+    if (isStateUnchanged(key, function))
+        return PIL_NO_ERROR;
+
     SubArg subArg("smu");
-    subArg.AddElem(getChannelStringFromEnum(channel))
+    subArg.AddElem(channelString)
             .AddElem("source", ".")
             .AddElem("func", ".");
 
     ExecArgs arg;
     // TODO avoid concatination
-    arg.AddArgument(subArg, "smu" + getChannelStringFromEnum(channel) + "." + getStringFromSrcFuncEnum(srcFunc), " = ");
+    arg.AddArgument(subArg, "smu" + channelString + "." + function, " = ");
 
-    return handleErrorCode(Exec("", &arg), checkErrorBuffer);
+    auto ret = handleErrorCode(Exec("", &arg), checkErrorBuffer);
+    updateState(key, function, ret);
+    return ret;
 }
 
 /**
@@ -764,27 +917,21 @@ PIL_ERROR_CODE KEI2600::beep(float timeInSeconds, int frequency, bool checkError
 }
 
 /**
- * @brief Return last error in error-queue.
+ * @brief Return last error in error-queue. The error is removed from the queue.
  * @return Return last error from error-queue as string.
  */
 std::string KEI2600::getLastError() {
-    if (isBuffered()) {
+    if (isBuffered())
         return "Currently Buffering, only accumulating buffered script.";
-    } else {
-        ExecArgs argsErrorQueue;
-        argsErrorQueue.AddArgument("errorcode, message = errorqueue.next()", "");
-        auto ret = Exec("", &argsErrorQueue);
-        if (errorOccured(ret))
-            return "INTERNAL ERROR";
 
-        std::string errorBuffer;
-        ExecArgs argsPrintError;
-        argsPrintError.AddArgument("print(errorcode, message)", "");
-        ret = Exec("", &argsPrintError, &errorBuffer, true);
-        if (errorOccured(ret))
-            return "INTERNAL ERROR";
-        return errorBuffer.substr(0, errorBuffer.find('\n'));
-    }
+    std::string errorBuffer;
+    auto ret = Exec(newCommand().Add("errorcode, message = errorqueue.next() print(errorcode, message)"),
+                    &errorBuffer);
+    if (errorOccured(ret))
+        return "INTERNAL ERROR";
+    if (m_KnownErrorCount > 0)
+        m_KnownErrorCount--;
+    return errorBuffer.substr(0, errorBuffer.find('\n'));
 }
 
 /**
@@ -795,116 +942,535 @@ PIL_ERROR_CODE KEI2600::clearErrorBuffer() {
     ExecArgs args;
     args.AddArgument("errorqueue", "clear()", ".");
 
-    return Exec("", &args);
+    auto ret = Exec("", &args);
+    if (!errorOccured(ret))
+        m_KnownErrorCount = 0;
+    return ret;
+}
+
+/**
+ * @brief Switches the SMU to deferred error checks until the scope ends.
+ * @param smu SMU whose error checks are deferred.
+ */
+KEI2600::ErrorCheckScope::ErrorCheckScope(KEI2600 &smu)
+        : m_SMU(smu), m_PreviousPolicy(smu.m_ErrorCheckPolicy), m_PreviousInterval(smu.m_ErrorCheckInterval) {
+    m_SMU.m_ErrorCheckPolicy = CHECK_DEFERRED;
+}
+
+/**
+ * @brief Checks the error queue, if close was not called. Errors are only logged, since a destructor must not throw.
+ */
+KEI2600::ErrorCheckScope::~ErrorCheckScope() {
+    try {
+        close();
+    } catch (const PIL::Exception &e) {
+        if (m_SMU.m_Logger)
+            m_SMU.m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "Error queue not empty after scope");
+    }
+}
+
+/**
+ * @brief Checks the error queue for all commands executed within the scope and restores the previous policy.
+ * @return PIL_NO_ERROR if there is no item in the error queue. Otherwise return PIL_ITEM_IN_ERROR_QUEUE.
+ */
+PIL_ERROR_CODE KEI2600::ErrorCheckScope::close() {
+    if (m_Closed)
+        return PIL_NO_ERROR;
+    m_Closed = true;
+    m_SMU.m_ErrorCheckPolicy = m_PreviousPolicy;
+    m_SMU.m_ErrorCheckInterval = m_PreviousInterval;
+    if (m_SMU.m_UncheckedCommands.empty())
+        return PIL_NO_ERROR;
+    return m_SMU.checkErrors();
 }
 
 /**
- * @brief Request amount of elements in error queue. If queue is empty return PIL_NO_ERROR otherwise return
- * PIL_ITEM_IN_ERROR_QUEUE.
+ * @brief Request amount of elements in error queue with a single round trip. If queue is empty return PIL_NO_ERROR
+ * otherwise return PIL_ITEM_IN_ERROR_QUEUE. New errors are attributed to the commands executed since the last check.
  * @return PIL_NO_ERROR if there is no item in the error queue. Otherwise return PIL_ITEM_IN_ERROR_QUEUE.
  * If the queue could not be requested successfully. Return a specific error code.
  */
-PIL_ERROR_CODE KEI2600::getErrorBufferStatus() {  // TODO: Include in Buffering?
-    ExecArgs argsErrorQueue;
-    argsErrorQueue.AddArgument("count = errorqueue.count", "");
-    auto ret = Exec("", &argsErrorQueue);
-    if (errorOccured(ret))
-        return ret;
+PIL_ERROR_CODE KEI2600::getErrorBufferStatus() {
+    if (isBuffered())
+        return PIL_NO_ERROR;
 
-    std::string errorBufferRet;
-    ExecArgs argsPrintError;
-    argsPrintError.AddArgument("print(count)", "");
-    ret = Exec("", &argsPrintError, &errorBufferRet, true);
+    std::string result;
+    auto ret = Exec(newCommand().Add("print(errorqueue.count)"), &result);
     if (errorOccured(ret))
         return ret;
 
-    errorBufferRet = errorBufferRet.substr(0, errorBufferRet.find('\n'));
-    try {
-        if (std::stoi(errorBufferRet) > 0) {
-            if (m_EnableExceptions)
-                throw PIL::Exception(PIL_ITEM_IN_ERROR_QUEUE, __FILENAME__, __LINE__, "");
-            return PIL_ITEM_IN_ERROR_QUEUE;
-        }
-    } catch (const std::invalid_argument &e) {
-        throw PIL::Exception(PIL_INVALID_ARGUMENTS, e.what());
-    }
-    return PIL_NO_ERROR;
+    return evaluateErrorCount(parseErrorCount(result));
 }
 
 /**
- * @brief Perform a linear voltage sweep on the SMU. Increases the voltage at the given rate until the stop voltage is arrived.
- * @param checkErrorBuffer if true error buffer status is requested and evaluated.
- * @return NO_ERROR if execution was successful otherwise return error code.
+ * @brief Checks the error queue for all commands, which were not checked yet, e.g. at the end of a batch of
+ * commands executed with CHECK_DEFERRED.
+ * @return PIL_NO_ERROR if there is no item in the error queue. Otherwise return PIL_ITEM_IN_ERROR_QUEUE.
  */
-PIL_ERROR_CODE KEI2600::performLinearVoltageSweep(SMU_CHANNEL channel, double startVoltage, double stopVoltage,
-                                                  int increaseRate_mVpS, double current, bool checkErrorBuffer) {
-    std::string sweep = "start_voltage = " + std::to_string(startVoltage) + " * 1000\n"
-                                                                            "stop_voltage = " +
-                        std::to_string(stopVoltage) + " * 1000\n"
-                                                      "rate = " + std::to_string(increaseRate_mVpS) + "\n"
-                                                                                                      "current = " +
-                        std::to_string(current) + "\n"
-                                                  "channel = smu" + getChannelStringFromEnum(channel) + "\n"
-                                                                                                        "channel.source.func = channel.OUTPUT_DCVOLTS\n"
-                                                                                                        "channel.source.output = channel.OUTPUT_ON\n"
-                                                                                                        "channel.source.limitv = (stop_voltage / 1000) + 0.1\n"
-                                                                                                        "channel.source.limiti = current + 0.0001\n"
-                                                                                                        "channel.source.leveli = current\n"
-                                                                                                        "for v = start_voltage, stop_voltage do\n"
-                                                                                                        "    channel.source.levelv = v / 1000\n"
-                                                                                                        "    delay(1 / rate)\n"
-                                                                                                        "end\n"
-                                                                                                        "channel.source.output = channel.OUTPUT_OFF";
-    return sendAndExecuteScript("sweep", sweep, checkErrorBuffer);
+PIL_ERROR_CODE KEI2600::checkErrors() {
+    return getErrorBufferStatus();
 }
 
 /**
- * @brief Creates a payload of a post request for the smu. 
- * 
- * @param value The value of the payload.
- * @return The constructed payload.
+ * @brief Selects when the error queue is checked for calls with checkErrorBuffer = true.
+ * CHECK_EVERY_CALL checks after each call, CHECK_EVERY_N_CALLS after interval calls, CHECK_DEFERRED only when
+ * checkErrors is called or an ErrorCheckScope ends and CHECK_PIGGYBACK with the reply of the next measurement.
+ * Except for CHECK_EVERY_CALL, the error count is stored on the SMU after each command without waiting for a reply,
+ * so errors can be attributed to the commands which caused them.
+ * @param policy policy to use.
+ * @param interval number of calls between two checks, only used by CHECK_EVERY_N_CALLS.
  */
-std::string KEI2600::createPayload(const std::string &value) {
-    return R"({"command": "shellInput", "value": ")" + value + "\"}";
+void KEI2600::setErrorCheckPolicy(ERROR_CHECK_POLICY policy, int interval) {
+    m_ErrorCheckPolicy = policy;
+    m_ErrorCheckInterval = interval > 0 ? static_cast<size_t>(interval) : 1;
 }
 
 /**
- * @brief Create a payload provided a vector of values.
- * Works by splitting the values into batches and constructing a payload.
- * 
- * @param offset The value to start collecting values.
- * @param numberOfLines The total number of lines the batch is going to have at max.
- * @param values The values of the payload.
- * @param result The vector to insert the payload to.
+ * @brief Returns the policy, which decides when the error queue is checked.
+ * @return current error check policy.
  */
-void KEI2600::createPayloadBatch(int offset, int numberOfLines, std::vector<std::string> values,
-                                 std::vector<std::string> *result) {
-    std::string value;
-    for (int i = offset; i < offset + numberOfLines; ++i) {
-        value += values[i] + "\n";
-    }
-
-    result->push_back(createPayload(value));
+KEI2600::ERROR_CHECK_POLICY KEI2600::getErrorCheckPolicy() const {
+    return m_ErrorCheckPolicy;
 }
 
 /**
- * @brief Sends the given script to the SMU. The scripts does not get executed.
- * 
- * @param checkErrorBuffer if true error buffer status is requested and evaluated.
- * @return NO_ERROR if execution was successful otherwise return error code.
+ * @brief Returns the commands, which caused errors since the last call of clearAttributedErrors.
+ * @return commands and the number of errors they added to the error queue.
  */
-PIL_ERROR_CODE KEI2600::sendScript(const std::string &scriptName, const std::string &script, bool checkErrorBuffer) {
-    return sendVectorScript(scriptName, splitString(script, "\n"), checkErrorBuffer);
+const std::vector<KEI2600::AttributedError> &KEI2600::getAttributedErrors() const {
+    return m_AttributedErrors;
 }
 
 /**
- * @brief Sends the given script to the SMU. The scripts does not get executed.
- *
- * @param checkErrorBuffer if true error buffer status is requested and evaluated.
- * @return NO_ERROR if execution was successful otherwise return error code.
+ * @brief Removes all attributed errors.
+ */
+void KEI2600::clearAttributedErrors() {
+    m_AttributedErrors.clear();
+}
+
+/**
+ * @brief Remembers the last sent command for error attribution. If markers are enabled, the current error count is
+ * stored in the table icl_ec on the SMU. The marker is queued with ExecAsync and sent together with the next command,
+ * so it costs no additional round trip.
+ * @param useMarker if true a marker is stored on the SMU.
+ */
+void KEI2600::trackLastCommand(bool useMarker) {
+    m_UncheckedCommands.emplace_back(getLastMessage());
+    if (!useMarker)
+        return;
+
+    auto markerIdx = std::to_string(m_UncheckedCommands.size());
+    if (m_UncheckedCommands.size() == 1)
+        ExecAsync("icl_ec = {} icl_ec[1] = errorqueue.count", nullptr, false);
+    else
+        ExecAsync("icl_ec[" + markerIdx + "] = errorqueue.count", nullptr, false);
+}
+
+/**
+ * @brief Evaluates the error count of the SMU. If the count increased since the last check, the new errors are
+ * attributed to the commands executed in between.
+ * @param errorCount current number of entries in the error queue.
+ * @return PIL_NO_ERROR if the error queue is empty otherwise PIL_ITEM_IN_ERROR_QUEUE.
+ */
+PIL_ERROR_CODE KEI2600::evaluateErrorCount(int errorCount) {
+    if (errorCount > m_KnownErrorCount)
+        attributeErrors(errorCount);
+    m_KnownErrorCount = errorCount;
+    m_UncheckedCommands.clear();
+
+    if (errorCount > 0) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_ITEM_IN_ERROR_QUEUE, __FILENAME__, __LINE__, "");
+        return PIL_ITEM_IN_ERROR_QUEUE;
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Attributes new errors to the unchecked commands. With a single unchecked command no further request is
+ * required, otherwise the markers stored on the SMU are requested with one round trip.
+ * @param errorCount current number of entries in the error queue.
+ */
+void KEI2600::attributeErrors(int errorCount) {
+    size_t firstNew = m_AttributedErrors.size();
+    if (m_UncheckedCommands.size() == 1) {
+        m_AttributedErrors.push_back({m_UncheckedCommands.front(), errorCount - m_KnownErrorCount});
+    } else if (!m_UncheckedCommands.empty()) {
+        auto &command = newCommand();
+        command.Add("icl_s = '' for i = 1, ").Add(m_UncheckedCommands.size())
+                .Add(" do icl_s = icl_s .. tostring(icl_ec and icl_ec[i]) .. ',' end print(icl_s)");
+        std::string result;
+        if (errorOccured(Exec(command, &result)))
+            result.clear();
+
+        // Each marker holds the error count after the corresponding command, nil if it was not executed.
+        int previousCount = m_KnownErrorCount;
+        bool lastMarkerMissing = false;
+        const char *position = result.c_str();
+        for (const auto &uncheckedCommand: m_UncheckedCommands) {
+            char *end;
+            long markerCount = std::strtol(position, &end, 10);
+            lastMarkerMissing = end == position;
+            int count = lastMarkerMissing ? previousCount : static_cast<int>(markerCount);
+            if (count > previousCount)
+                m_AttributedErrors.push_back({uncheckedCommand, count - previousCount});
+            previousCount = std::max(previousCount, count);
+
+            const char *separator = std::strchr(position, ',');
+            position = separator ? separator + 1 : position + std::strlen(position);
+        }
+        // Commands checked within their own reply have no marker, the remaining errors belong to them.
+        if (errorCount > previousCount)
+            m_AttributedErrors.push_back({lastMarkerMissing ? m_UncheckedCommands.back() : "unknown",
+                                          errorCount - previousCount});
+    } else {
+        m_AttributedErrors.push_back({"unknown", errorCount - m_KnownErrorCount});
+    }
+
+    if (m_Logger) {
+        for (size_t i = firstNew; i < m_AttributedErrors.size(); i++)
+            m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "%d error(s) caused by: %s",
+                                 m_AttributedErrors[i].errorCount, m_AttributedErrors[i].command.c_str());
+    }
+}
+
+/**
+ * @brief Parses the error count printed by the SMU.
+ * @param reply reply of print(errorqueue.count), e.g. "0.00000e+00".
+ * @return number of entries in the error queue.
+ * @throw PIL::Exception if the reply is not a number.
+ */
+/* static */ int KEI2600::parseErrorCount(const std::string &reply) {
+    try {
+        return static_cast<int>(std::stod(reply));
+    } catch (const std::invalid_argument &e) {
+        throw PIL::Exception(PIL_INVALID_ARGUMENTS, e.what());
+    }
+}
+
+/**
+ * @brief Perform a linear voltage sweep on the SMU. Increases the voltage at the given rate until the stop voltage is arrived.
+ * The sweep is executed by performSweep in steps of 1 mV, one step every 1 / rate seconds. Like the previous Lua loop,
+ * no measurements are taken, so the timing does not depend on the integration time. Use performSweep to measure
+ * at every point. Unlike the previous Lua loop, the function blocks until the sweep is completed, so the timeout of
+ * the socket must exceed the duration of the sweep, and a start voltage above the stop voltage sweeps downwards
+ * instead of doing nothing. In buffered mode the sweep is appended to the buffered script.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::performLinearVoltageSweep(SMU_CHANNEL channel, double startVoltage, double stopVoltage,
+                                                  int increaseRate_mVpS, double current, bool checkErrorBuffer) {
+    if (increaseRate_mVpS <= 0) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
+    // The previous Lua loop stepped in 1 mV increments, which is kept to produce the same curve.
+    SweepConfig config;
+    config.mode = LINEAR_SWEEP;
+    config.sourceUnit = VOLTAGE;
+    config.start = startVoltage;
+    config.stop = stopVoltage;
+    config.points = static_cast<int>(std::lround(std::abs(stopVoltage - startVoltage) * 1000)) + 1;
+    config.limit = current + 0.0001;
+    config.period = 1.0 / increaseRate_mVpS;
+    config.measure = false;
+    return performSweep(channel, config, checkErrorBuffer);
+}
+
+/**
+ * @brief Uploads the script defining the sweep function. The script is only transferred once, subsequent sweeps
+ * call the already defined function with new parameters.
+ * @param reload if true the script is uploaded even if it was already loaded, e.g. after a reset of the SMU.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::loadSweepEngine(bool reload, bool checkErrorBuffer) {
+    if (m_SweepEngineLoaded && !reload)
+        return PIL_NO_ERROR;
+
+    // The engine is defined immediately, even in buffered mode, since it is only marked as loaded once.
+    SEND_METHOD prevSendMode = m_SendMode;
+    m_SendMode = SEND_METHOD::DIRECT_SEND;
+    auto ret = sendAndExecuteVectorScript(SWEEP_ENGINE_SCRIPT_NAME, SWEEP_ENGINE_SCRIPT, checkErrorBuffer);
+    m_SendMode = prevSendMode;
+    m_SweepEngineLoaded = !errorOccured(ret);
+    return ret;
+}
+
+/**
+ * @brief Marks the sweep engine as not loaded. Called with invalidateState, e.g. on connect and *RST, as the sweep
+ * function is not defined anymore after a power cycle of the SMU.
+ */
+void KEI2600::invalidateCachedState() {
+    m_SweepEngineLoaded = false;
+}
+
+/**
+ * @brief Detects the reset functions of the TSP interface in addition to *RST. Resetting a single channel also
+ * invalidates the whole state, which only causes the next setters to be sent again.
+ * @param message message sent to the device.
+ * @return true if the message resets the SMU or one of its channels.
+ */
+bool KEI2600::isReset(std::string_view message) const {
+    return Device::isReset(message) || containsCommand(message, "reset()") ||
+           containsCommand(message, "smua.reset()") || containsCommand(message, "smub.reset()");
+}
+
+/**
+ * @brief Executes a linear, logarithmic, list or pulsed sweep with the trigger model of the SMU. The timing of the
+ * points is controlled by the hardware timers of the SMU instead of the Lua interpreter. The function blocks until
+ * the sweep is completed, so the timeout of the socket must exceed the duration of the sweep. The measured values
+ * can be read afterwards with readBuffer(config.bufferName, ...). In buffered mode the sweep engine is uploaded
+ * immediately and the sweep is appended to the buffered script, so its result is only checked with the error queue.
+ * @param channel channel on which the sweep is executed.
+ * @param config parameters of the sweep.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful, INVALID_ARGUMENTS if the configuration is invalid, UNKNOWN_ERROR
+ * if the sweep function raised an error, otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::performSweep(SMU_CHANNEL channel, const SweepConfig &config, bool checkErrorBuffer) {
+    auto ret = validateSweepConfig(config);
+    if (errorOccured(ret))
+        return ret;
+
+    // The sweep function changes source, limit, range and integration settings of the channel, but the sweep engine
+    // stays defined.
+    invalidateSettings();
+    ret = loadSweepEngine(false, checkErrorBuffer);
+    if (errorOccured(ret))
+        return ret;
+
+    int points = config.mode == LIST_SWEEP ? static_cast<int>(config.values.size()) : config.points;
+    // A buffered script is executed later, so no reply can be awaited and the function is called directly.
+    bool buffered = isBuffered();
+
+    auto &command = newCommand();
+    command.Add(buffered ? "icl_sweep(smu" : "print(pcall(icl_sweep, smu").Add(getChannelLetterFromEnum(channel))
+            .Add(config.sourceUnit == VOLTAGE ? ", true, " : ", false, ").Add(static_cast<int>(config.mode))
+            .Add(", ").Add(config.start).Add(", ").Add(config.stop).Add(", ").Add(points).Add(", ");
+    if (config.mode == LIST_SWEEP) {
+        command.Add('{');
+        for (size_t i = 0; i < config.values.size(); i++) {
+            if (i > 0)
+                command.Add(", ");
+            command.Add(config.values[i]);
+        }
+        command.Add('}');
+    } else {
+        command.Add("nil");
+    }
+    command.Add(", ").Add(config.limit).Add(", ").Add(config.nplc).Add(", ").Add(config.period).Add(", ")
+            .Add(config.pulseWidth).Add(", '").Add(config.bufferName).Add("', ")
+            .Add(config.measure ? "true" : "false").Add(buffered ? ")" : "))");
+
+    if (buffered) {
+        ret = Exec(command);
+        return handleErrorCode(ret, checkErrorBuffer);
+    }
+
+    std::string result;
+    ret = Exec(command, &result);
+    if (errorOccured(ret))
+        return handleErrorCode(ret, checkErrorBuffer);
+
+    // pcall prints "true" on success, otherwise "false" followed by the error message.
+    if (result.rfind("true", 0) != 0) {
+        if (m_Logger)
+            m_Logger->LogMessage(PIL::WARNING, __FILENAME__, __LINE__, "Sweep failed: %s", result.c_str());
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_UNKNOWN_ERROR, __FILENAME__, __LINE__, "Sweep failed: " + result);
+        return PIL_UNKNOWN_ERROR;
+    }
+
+    return handleErrorCode(PIL_NO_ERROR, checkErrorBuffer);
+}
+
+/**
+ * @brief Checks if the sweep configuration can be executed by the trigger model.
+ * @param config configuration to check.
+ * @return NO_ERROR if the configuration is valid otherwise INVALID_ARGUMENTS.
+ */
+PIL_ERROR_CODE KEI2600::validateSweepConfig(const SweepConfig &config) {
+    bool valid = config.sourceUnit == VOLTAGE || config.sourceUnit == CURRENT;
+    if (config.mode == LIST_SWEEP)
+        valid &= !config.values.empty();
+    else
+        valid &= config.points > 0;
+    // Logarithmic sweeps require start and stop values of the same sign, different from zero.
+    if (config.mode == LOG_SWEEP)
+        valid &= config.start * config.stop > 0;
+    if (config.pulseWidth > 0)
+        valid &= config.period > config.pulseWidth;
+    // The trigger timer overruns if a point is started before the measurement of the previous one is completed.
+    if (config.measure && config.period > 0)
+        valid &= config.period > config.nplc / MAX_LINE_FREQUENCY;
+    valid &= config.period >= 0 && config.pulseWidth >= 0 && !config.bufferName.empty();
+    // The buffer name is embedded in a single quoted Lua string.
+    valid &= config.bufferName.find('\'') == std::string::npos;
+
+    if (!valid) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "Invalid sweep configuration");
+        return PIL_INVALID_ARGUMENTS;
+    }
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Creates a payload of a post request for the smu. 
+ * 
+ * @param value The value of the payload.
+ * @return The constructed payload.
+ */
+std::string KEI2600::createPayload(const std::string &value) {
+    return R"({"command": "shellInput", "value": ")" + value + "\"}";
+}
+
+/**
+ * @brief Create a payload provided a vector of values.
+ * Works by splitting the values into batches and constructing a payload.
+ * 
+ * @param offset The value to start collecting values.
+ * @param numberOfLines The total number of lines the batch is going to have at max.
+ * @param values The values of the payload.
+ * @param result The vector to insert the payload to.
+ */
+void KEI2600::createPayloadBatch(int offset, int numberOfLines, std::vector<std::string> values,
+                                 std::vector<std::string> *result) {
+    std::string value;
+    for (int i = offset; i < offset + numberOfLines; ++i) {
+        value += values[i] + "\n";
+    }
+
+    result->push_back(createPayload(value));
+}
+
+/**
+ * @brief Sends the given script to the SMU. The scripts does not get executed.
+ * 
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::sendScript(const std::string &scriptName, const std::string &script, bool checkErrorBuffer) {
+    return sendVectorScript(scriptName, splitString(script, "\n"), checkErrorBuffer);
+}
+
+/**
+ * @brief Sends the given script to the SMU. The scripts does not get executed.
+ * If a script with the same name and content was already uploaded by this object, the upload is skipped.
+ * When the verification of the cache is enabled, the script must also be listed in script.user.catalog().
+ * @param scriptName name of the script on the SMU.
+ * @param script lines of the script.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
  */
 PIL_ERROR_CODE KEI2600::sendVectorScript(const std::string &scriptName, const std::vector<std::string> &script,
                                          bool checkErrorBuffer) {
+    uint64_t hash = hashScript(script);
+    if (m_ScriptCacheEnabled) {
+        auto cachedScript = m_ScriptCache.find(scriptName);
+        if (cachedScript != m_ScriptCache.end() && cachedScript->second == hash) {
+            bool scriptLoaded = true;
+            if (m_VerifyScriptCache) {
+                auto ret = isScriptLoaded(scriptName, &scriptLoaded);
+                if (errorOccured(ret))
+                    return handleErrorCode(ret, checkErrorBuffer);
+            }
+            if (scriptLoaded) {
+                if (m_Logger)
+                    m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__,
+                                         "Script %s is unchanged, skip upload", scriptName.c_str());
+                return PIL_NO_ERROR;
+            }
+        }
+        m_ScriptCache.erase(scriptName);
+    }
+
+    auto ret = uploadScript(scriptName, script, checkErrorBuffer);
+    if (!errorOccured(ret) && m_ScriptCacheEnabled)
+        m_ScriptCache[scriptName] = hash;
+    return ret;
+}
+
+/**
+ * @brief Uploads a script with loadscript and endscript and saves it in the nonvolatile memory of the SMU.
+ * The script is either streamed over the already opened socket or posted to the web interface, depending on the
+ * selected upload method.
+ * @param scriptName name of the script on the SMU.
+ * @param script lines of the script.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::uploadScript(const std::string &scriptName, const std::vector<std::string> &script,
+                                     bool checkErrorBuffer) {
+    auto start = std::chrono::steady_clock::now();
+    auto ret = m_ScriptUploadMethod == SOCKET_UPLOAD ? uploadScriptOverSocket(scriptName, script, checkErrorBuffer)
+                                                     : uploadScriptOverHTTP(scriptName, script, checkErrorBuffer);
+    if (!errorOccured(ret) && m_Logger) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__, "Uploaded script %s with %zu lines in %lld ms",
+                             scriptName.c_str(), script.size(), static_cast<long long>(elapsed.count()));
+    }
+    return ret;
+}
+
+/**
+ * @brief Streams loadscript, the script and endscript in a single message over the socket. Instead of waiting a
+ * fixed time, a sentinel is printed after the script was saved, which is received as completion handshake. The
+ * sentinel carries the number of errors added by the upload, so a script which failed to load is detected within the
+ * same round trip. Errors left in the queue by previous commands do not fail the upload.
+ * @param scriptName name of the script on the SMU.
+ * @param script lines of the script.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful, ITEM_IN_ERROR_QUEUE if the error queue is not empty after the
+ * upload, otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::uploadScriptOverSocket(const std::string &scriptName, const std::vector<std::string> &script,
+                                               bool checkErrorBuffer) {
+    auto &command = newCommand();
+    command.Add(SCRIPT_UPLOAD_ERROR_COUNT " = errorqueue.count\n").Add("loadscript ").Add(scriptName).Add('\n');
+    for (const auto &line: script)
+        command.Add(line).Add('\n');
+    command.Add("endscript\n").Add(scriptName).Add(".save()\n")
+            .Add("print('").Add(SCRIPT_UPLOAD_SENTINEL).Add(scriptName)
+            .Add("', errorqueue.count - " SCRIPT_UPLOAD_ERROR_COUNT ")");
+
+    // The upload must not end up in the buffered script, since the handshake is received immediately.
+    SEND_METHOD prevSendMode = m_SendMode;
+    m_SendMode = SEND_METHOD::DIRECT_SEND;
+    auto ret = Exec(command);
+    m_SendMode = prevSendMode;
+    if (errorOccured(ret))
+        return handleErrorCode(ret, checkErrorBuffer);
+
+    // Lines printed by the script itself precede the sentinel and are discarded. print separates its arguments
+    // with a tab.
+    std::string expected = SCRIPT_UPLOAD_SENTINEL + scriptName + '\t';
+    std::string line;
+    do {
+        ret = receiveLine(&line);
+        if (errorOccured(ret))
+            return handleErrorCode(ret, checkErrorBuffer);
+    } while (line.compare(0, expected.size(), expected) != 0);
+
+    // A syntax error in the script is only reported in the error queue, so it is evaluated regardless of
+    // checkErrorBuffer.
+    trackLastCommand(false);
+    return evaluateErrorCount(parseErrorCount(line.substr(expected.size())));
+}
+
+/**
+ * @brief Posts the script in batches of 32 lines to the web interface of the SMU. The batches are pipelined over
+ * a single keep-alive connection instead of opening a connection per batch.
+ * @param scriptName name of the script on the SMU.
+ * @param script lines of the script.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::uploadScriptOverHTTP(const std::string &scriptName, const std::vector<std::string> &script,
+                                             bool checkErrorBuffer) {
     std::string url = "http://" + m_IPAddr + "/HttpCommand";
 
     std::vector<std::string> sendableScript = script;
@@ -938,12 +1504,10 @@ PIL_ERROR_CODE KEI2600::sendVectorScript(const std::string &scriptName, const st
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(300));
 
-    for (auto &payload: payloads) {
-        ret = postRequest(url, payload);
-        if (errorOccured(ret)) {
-            return handleErrorCode(ret, checkErrorBuffer);
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // All batches are pipelined over the keep-alive connection of the device.
+    ret = postRequests(url, payloads);
+    if (errorOccured(ret)) {
+        return handleErrorCode(ret, checkErrorBuffer);
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(300));
     ret = postRequest(url, exitPayload);
@@ -960,6 +1524,8 @@ PIL_ERROR_CODE KEI2600::executeScript(const std::string &scriptName, bool checkE
     std::string suffix = "()";
 
     std::string executeCommand = scriptName + suffix;
+    // Scripts can change any setting, but functions defined by uploaded scripts remain.
+    invalidateSettings();
     auto ret = Exec(executeCommand);
 
     if (errorOccured(ret) && m_Logger) {
@@ -970,6 +1536,84 @@ PIL_ERROR_CODE KEI2600::executeScript(const std::string &scriptName, bool checkE
     return handleErrorCode(ret, checkErrorBuffer);
 }
 
+/**
+ * @brief Checks if a script is listed in the user script catalog of the SMU.
+ * @param scriptName name of the script.
+ * @param loaded set to true if the script exists on the SMU.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::isScriptLoaded(const std::string &scriptName, bool *loaded) {
+    auto &command = newCommand();
+    command.Add("icl_found = false for name in script.user.catalog() do if name == '").Add(scriptName)
+            .Add("' then icl_found = true end end print(icl_found)");
+
+    std::string result;
+    auto ret = Exec(command, &result);
+    *loaded = !errorOccured(ret) && result.rfind("true", 0) == 0;
+    return ret;
+}
+
+/**
+ * @brief Selects how scripts are uploaded. SOCKET_UPLOAD uses the already opened connection on port 5025,
+ * HTTP_UPLOAD the web interface, which must be enabled on the SMU.
+ * @param method upload method used by sendScript and sendVectorScript.
+ */
+void KEI2600::setScriptUploadMethod(SCRIPT_UPLOAD_METHOD method) {
+    m_ScriptUploadMethod = method;
+}
+
+/**
+ * @brief Returns the method used to upload scripts.
+ * @return SOCKET_UPLOAD or HTTP_UPLOAD.
+ */
+KEI2600::SCRIPT_UPLOAD_METHOD KEI2600::getScriptUploadMethod() const {
+    return m_ScriptUploadMethod;
+}
+
+/**
+ * @brief Enables or disables the script cache. Disabling the cache also removes all cached entries.
+ * @param enable if true unchanged scripts are not uploaded again.
+ */
+void KEI2600::setScriptCacheEnabled(bool enable) {
+    m_ScriptCacheEnabled = enable;
+    if (!enable)
+        m_ScriptCache.clear();
+}
+
+/**
+ * @brief Enables the verification of cached scripts with script.user.catalog(). This costs one round trip per
+ * cached upload, but detects scripts which were deleted on the SMU, e.g. by another client.
+ * @param verify if true the existence of a cached script is verified before the upload is skipped.
+ */
+void KEI2600::setScriptCacheVerification(bool verify) {
+    m_VerifyScriptCache = verify;
+}
+
+/**
+ * @brief Removes all entries from the script cache, so all scripts are uploaded again, e.g. after a reset of the SMU.
+ */
+void KEI2600::clearScriptCache() {
+    m_ScriptCache.clear();
+}
+
+/**
+ * @brief Calculates the FNV-1a hash of all lines of a script, which is used to detect changed scripts.
+ * @param script lines of the script.
+ * @return 64 bit hash of the script.
+ */
+/* static */ uint64_t KEI2600::hashScript(const std::vector<std::string> &script) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto &line: script) {
+        for (char c: line) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ULL;
+        }
+        hash ^= static_cast<uint8_t>('\n');
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /**
  * @brief Sends and executes the given script.
  * @param checkErrorBuffer if true error buffer status is requested and evaluated.
@@ -1036,62 +1680,143 @@ PIL_ERROR_CODE KEI2600::clearBuffer(const std::string &bufferName, bool checkErr
 }
 
 /**
- * @brief Reads part of the buffer with the given name.
+ * @brief Reads the complete buffer with the given name. The values are requested in chunks, whose size is adapted
+ * to the measured round trip time and throughput of the connection (see AdaptiveChunkSizer). Depending on the
+ * selected buffer format, the values are transferred as text or as binary block.
+ * @param bufferName The name of the buffer.
+ * @param result The vector to write the received values to.
+ * @param checkErrorBuffer Whether to check the error buffer.
  * @return The received error code.
  */
-PIL_ERROR_CODE KEI2600::readPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName, char *printBuffer,
-                                         std::vector<double> *result, bool checkErrorBuffer) {
-    SubArg subArg("");
-    subArg.AddElem(std::to_string(startIdx) + ", " + std::to_string(endIdx) + ", " + bufferName, "(", ")");
-    ExecArgs execArgs;
-    execArgs.AddArgument(subArg, "");
-    auto ret = Exec("printbuffer", &execArgs, printBuffer);
-
-    if (errorOccured(ret)) {
-        return handleErrorCode(ret, checkErrorBuffer);
-    }
-
-    for (const std::string &value: splitString(std::string(printBuffer), ", ")) {
-        result->push_back(std::stod(value));
-    }
+PIL_ERROR_CODE KEI2600::readBuffer(const std::string &bufferName, std::vector<double> *result, bool checkErrorBuffer) {
+    return readBufferValues(bufferName, "", result, true, checkErrorBuffer);
+}
 
-    return handleErrorCode(ret, checkErrorBuffer);
+/**
+ * @brief Reads the complete buffer into preallocated memory, e.g. a numpy array passed from python. The values are
+ * received directly into the memory, so no intermediate vector is allocated.
+ * @see KEI2600::readBuffer
+ * @param bufferName The name of the buffer.
+ * @param values The memory to write the received values to.
+ * @param capacity The number of values, which fit into the memory.
+ * @param count The number of received values.
+ * @param checkErrorBuffer Whether to check the error buffer.
+ * @return PIL_INSUFFICIENT_RESOURCES if the buffer contains more than capacity values, otherwise the received error
+ * code.
+ */
+PIL_ERROR_CODE KEI2600::readBuffer(const std::string &bufferName, double *values, size_t capacity, size_t *count,
+                                   bool checkErrorBuffer) {
+    auto allocate = [values, capacity](size_t n) { return n <= capacity ? values : nullptr; };
+    return readBufferValues(bufferName, "", allocate, count, true, checkErrorBuffer);
 }
 
 /**
- * @brief Reads the complete buffer with the given name.
+ * @brief Reads the readings or another element of every entry of a buffer, e.g. the timestamps.
+ * @see KEI2600::readBuffer
  * @param bufferName The name of the buffer.
- * @param result The vector to write the received values to.
+ * @param element The element to read, e.g. "timestamps" or "sourcevalues". An empty string reads the readings.
+ * @param result The vector to append the received values to.
+ * @param clear Whether to clear the buffer after all values were read.
  * @param checkErrorBuffer Whether to check the error buffer.
  * @return The received error code.
  */
-PIL_ERROR_CODE KEI2600::readBuffer(const std::string &bufferName, std::vector<double> *result, bool checkErrorBuffer) {
+PIL_ERROR_CODE KEI2600::readBufferValues(const std::string &bufferName, const std::string &element,
+                                         std::vector<double> *result, bool clear, bool checkErrorBuffer) {
+    size_t offset = result->size();
+    size_t count = 0;
+    auto allocate = [result, offset](size_t n) {
+        result->resize(offset + n);
+        return result->data() + offset;
+    };
+    auto ret = readBufferValues(bufferName, element, allocate, &count, clear, checkErrorBuffer);
+    // Values of a failed chunk are not returned.
+    result->resize(offset + count);
+    return ret;
+}
+
+/**
+ * @brief Reads the readings or another element of every entry of a buffer into memory provided by the caller.
+ * @param bufferName The name of the buffer.
+ * @param element The element to read, e.g. "timestamps" or "sourcevalues". An empty string reads the readings.
+ * @param allocate Called once with the size of the buffer, returns the memory to write the values to.
+ * @param count The number of received values.
+ * @param clear Whether to clear the buffer after all values were read.
+ * @param checkErrorBuffer Whether to check the error buffer.
+ * @return PIL_INSUFFICIENT_RESOURCES if allocate returned nullptr, otherwise the received error code.
+ */
+PIL_ERROR_CODE KEI2600::readBufferValues(const std::string &bufferName, const std::string &element,
+                                         const BufferAllocator &allocate, size_t *count, bool clear,
+                                         bool checkErrorBuffer) {
+    *count = 0;
     SEND_METHOD prevSendMode = m_SendMode;
     m_SendMode = SEND_METHOD::DIRECT_SEND;
-    int n = 0;
-    getBufferSize(bufferName, &n, checkErrorBuffer);
-
-    int doubleSize = 15;
-    int batchSize = 1024 / doubleSize;
-    int batches = n / batchSize;
-    int remaining = n % batchSize;
 
-    char printBuffer[1024];
+    // The size query is a minimal request, so its duration is used as round trip time estimation.
+    int n = 0;
+    auto rttStart = std::chrono::steady_clock::now();
+    auto ret = getBufferSize(bufferName, &n, false);
+    auto roundTripTime = std::chrono::steady_clock::now() - rttStart;
+    if (errorOccured(ret)) {
+        m_SendMode = prevSendMode;
+        return handleErrorCode(ret, checkErrorBuffer);
+    }
 
-    result->reserve(n);
-    for (int i = 0; i < batches; ++i) {
-        int offset = i * batchSize;
-        appendToBuffer(1 + offset, offset + batchSize, bufferName, printBuffer, result, checkErrorBuffer);
+    // An empty buffer needs no memory, e.g. an empty vector returns nullptr.
+    double *values = allocate(static_cast<size_t>(std::max(n, 0)));
+    if (!values && n > 0) {
+        m_SendMode = prevSendMode;
+        return Device::handleErrorsAndLogging(PIL_INSUFFICIENT_RESOURCES, m_EnableExceptions, PIL::ERROR,
+                                              __FILENAME__, __LINE__, "No memory provided for %d values of %s", n,
+                                              bufferName.c_str());
     }
 
-    if (remaining > 0) {
-        int offset = batches * batchSize;
-        appendToBuffer(1 + offset, offset + remaining, bufferName, printBuffer, result, checkErrorBuffer);
+    bool binary = m_BufferFormat != ASCII_FORMAT;
+    BinaryFormatGuard binaryFormat(this);
+    if (binary)
+        ret = binaryFormat.enable();
+
+    double bytesPerValue = binary ? static_cast<double>(getBytesPerValue(m_BufferFormat)) : ASCII_VALUE_SIZE;
+    m_ChunkSizer.reset(roundTripTime, bytesPerValue, INITIAL_CHUNK_SIZE);
+
+    std::string source = element.empty() ? bufferName : bufferName + "." + element;
+    for (int offset = 0; offset < n && !errorOccured(ret);) {
+        int endIdx = static_cast<int>(std::min<size_t>(offset + m_ChunkSizer.getChunkSize(), n));
+        size_t receivedBytes = 0;
+        auto chunkStart = std::chrono::steady_clock::now();
+        if (binary)
+            ret = readBinaryPartOfBuffer(1 + offset, endIdx, source, values + offset, &receivedBytes);
+        else
+            ret = readTextPartOfBuffer(1 + offset, endIdx, source, values + offset, &receivedBytes);
+        m_ChunkSizer.update(endIdx - offset, receivedBytes, std::chrono::steady_clock::now() - chunkStart);
+        if (!errorOccured(ret))
+            *count = static_cast<size_t>(endIdx);
+        offset = endIdx;
+
+        // Safety commands like turnOff must not wait for the complete download. They expect text replies, so ASCII
+        // is selected while they are executed.
+        if (hasPriorityTasks()) {
+            auto formatRet = binaryFormat.restore();
+            runPriorityTasks();
+            if (binary && offset < n && !errorOccured(ret))
+                ret = errorOccured(formatRet) ? formatRet : binaryFormat.enable();
+        }
     }
 
-    auto ret = clearBuffer(bufferName, checkErrorBuffer);
+    if (m_Logger)
+        m_Logger->LogMessage(PIL::DEBUG, __FILENAME__, __LINE__,
+                             "readBuffer %s: %d values, rtt %.3f ms, selected chunk size %zu values",
+                             source.c_str(), n, m_ChunkSizer.getRoundTripTime() * 1000,
+                             m_ChunkSizer.getChunkSize());
+
+    auto formatRet = binaryFormat.restore();
+    if (!errorOccured(ret))
+        ret = formatRet;
+
+    if (clear && !errorOccured(ret))
+        ret = clearBuffer(bufferName, false);
+
     m_SendMode = prevSendMode;
-    return ret;
+    return handleErrorCode(ret, checkErrorBuffer);
 }
 
 /**
@@ -1108,30 +1833,296 @@ std::vector<double> KEI2600::readBufferPy(const std::string &bufferName, bool ch
 }
 
 /**
- * @brief Reads a part of the buffer (from startIdx to endIdx) and appends it to the result vector.
- * @param startIdx The start index of the values to append to the result buffer.
- * @param endIdx The end index of the values to append to the result buffer.
- * @param bufferName The name of the buffer to read from.
- * @param printBuffer The buffer to use for retrieving the values from the smu.
- * @param result The vector to append the retrived values to.
+ * @brief Reads the complete buffer with readBuffer and exports the readings as CSV file with a single column
+ * "reading". The file is written by CSVWriter, so no text representation of the buffer is kept in memory.
+ * @param bufferName The name of the buffer.
+ * @param filePath The file to create or overwrite.
  * @param checkErrorBuffer Whether to check the error buffer.
+ * @return PIL_NO_ERROR if the buffer was exported, PIL_NO_SUCH_FILE if the file could not be created, otherwise the
+ * error code of readBuffer.
+ */
+PIL_ERROR_CODE KEI2600::exportBufferToCSV(const std::string &bufferName, const std::string &filePath,
+                                          bool checkErrorBuffer) {
+    std::vector<double> readings;
+    auto ret = readBuffer(bufferName, &readings, checkErrorBuffer);
+    if (errorOccured(ret))
+        return ret;
+
+    ret = CSVWriter::writeFile(filePath, {{"reading", readings.data()}}, readings.size());
+    if (errorOccured(ret))
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not export buffer %s to %s", bufferName.c_str(), filePath.c_str());
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Reads the complete buffer and exports it as numpy archive with the array "reading" and optionally the
+ * arrays "timestamp" and "source". The name of the buffer, the number of values and the identifier of the device are
+ * written to a JSON file with the same name and the extension .json. The buffer is cleared afterwards, like by
+ * readBuffer.
+ * @param bufferName The name of the buffer.
+ * @param filePath The archive to create or overwrite, e.g. sweep.npz.
+ * @param includeTimestamps Whether to export the timestamps of the readings. The buffer must collect them, see
+ * collecttimestamps of the buffer.
+ * @param includeSourceValues Whether to export the source values of the readings. The buffer must collect them, see
+ * collectsourcevalues of the buffer.
+ * @param checkErrorBuffer Whether to check the error buffer.
+ * @return PIL_NO_ERROR if the buffer was exported, otherwise the error code.
+ */
+PIL_ERROR_CODE KEI2600::exportBufferToNpz(const std::string &bufferName, const std::string &filePath,
+                                          bool includeTimestamps, bool includeSourceValues, bool checkErrorBuffer) {
+    // The additional elements are read first, since reading the readings clears the buffer.
+    std::vector<double> timestamps;
+    std::vector<double> sourceValues;
+    std::vector<double> readings;
+    PIL_ERROR_CODE ret = PIL_NO_ERROR;
+    if (includeTimestamps)
+        ret = readBufferValues(bufferName, "timestamps", &timestamps, false, checkErrorBuffer);
+    if (!errorOccured(ret) && includeSourceValues)
+        ret = readBufferValues(bufferName, "sourcevalues", &sourceValues, false, checkErrorBuffer);
+    if (!errorOccured(ret))
+        ret = readBufferValues(bufferName, "", &readings, true, checkErrorBuffer);
+    if (errorOccured(ret))
+        return ret;
+
+    NumpyWriter writer;
+    ret = writer.open(filePath);
+    if (!errorOccured(ret))
+        ret = writer.addArray("reading", readings.data(), readings.size());
+    if (!errorOccured(ret) && includeTimestamps)
+        ret = writer.addArray("timestamp", timestamps.data(), timestamps.size());
+    if (!errorOccured(ret) && includeSourceValues)
+        ret = writer.addArray("source", sourceValues.data(), sourceValues.size());
+    auto closeRet = writer.close();
+    if (!errorOccured(ret))
+        ret = closeRet;
+    if (errorOccured(ret))
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not export buffer %s to %s", bufferName.c_str(), filePath.c_str());
+
+    // The identifier can not be queried while commands are buffered.
+    JSONMetadata metadata;
+    metadata.add("instrument", isBuffered() ? std::string() : getDeviceIdentifier()).add("buffer", bufferName)
+            .add("count", static_cast<int>(readings.size())).add("timestamps", includeTimestamps)
+            .add("sourceValues", includeSourceValues);
+    auto metadataPath = JSONMetadata::getSidecarPath(filePath);
+    ret = metadata.writeFile(metadataPath);
+    if (errorOccured(ret))
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not write metadata to %s", metadataPath.c_str());
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Requests the values from startIdx to endIdx as text and writes the parsed values to values.
+ * The reply is received into a buffer owned by the device, which grows with the chunk size.
+ * @param startIdx The start index of the values to read (starting at 1).
+ * @param endIdx The end index of the values to read (inclusive).
+ * @param bufferName The name of the buffer to read from.
+ * @param values The memory for endIdx - startIdx + 1 values.
+ * @param receivedBytes Number of bytes received for this chunk.
  * @return The received error code.
  */
-PIL_ERROR_CODE KEI2600::appendToBuffer(int startIdx, int endIdx, const std::string &bufferName, char *printBuffer,
-                                       std::vector<double> *result, bool checkErrorBuffer) {
-    std::vector<double> batchVector;
-    auto ret = readPartOfBuffer(startIdx, endIdx, bufferName, printBuffer, &batchVector, checkErrorBuffer);
-    if (errorOccured(ret)) {
-        return handleErrorCode(ret, checkErrorBuffer);
-    }
+PIL_ERROR_CODE KEI2600::readTextPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName,
+                                             double *values, size_t *receivedBytes) {
+    auto ret = Exec("printbuffer(" + std::to_string(startIdx) + ", " + std::to_string(endIdx) + ", " +
+                    bufferName + ")");
+    if (errorOccured(ret))
+        return ret;
 
-    for (double value: batchVector) {
-        result->push_back(value);
+    ret = receiveLine(&m_TextReceiveBuffer);
+    if (errorOccured(ret))
+        return ret;
+    *receivedBytes = m_TextReceiveBuffer.size() + 1;
+
+    const char *pos = m_TextReceiveBuffer.c_str();
+    for (int i = startIdx; i <= endIdx; i++) {
+        char *end;
+        double value = std::strtod(pos, &end);
+        if (end == pos)
+            return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR,
+                                                  __FILENAME__, __LINE__, "Could not parse value %d of %s", i,
+                                                  bufferName.c_str());
+        *values++ = value;
+        pos = end;
+        while (*pos == ',' || *pos == ' ')
+            pos++;
     }
 
     return PIL_NO_ERROR;
 }
 
+/**
+ * @brief Switches the data format of the SMU between binary (REAL32 or REAL64, little endian) and ASCII.
+ * The format must be switched back to ASCII after the transfer, as all other queries expect text replies.
+ * @param enable if true select the binary format according to m_BufferFormat, otherwise select ASCII.
+ * @return The received error code.
+ */
+PIL_ERROR_CODE KEI2600::setBinaryDataFormat(bool enable) {
+    if (!enable)
+        return Exec("format.data = format.ASCII");
+
+    auto ret = Exec(m_BufferFormat == REAL32_FORMAT ? "format.data = format.REAL32" : "format.data = format.REAL64");
+    if (errorOccured(ret))
+        return ret;
+
+    return Exec("format.byteorder = format.LITTLEENDIAN");
+}
+
+/**
+ * @brief Selects ASCII again if restore was not called, e.g. because readBuffer was left by an exception. Errors are
+ * ignored, the transfer already failed.
+ */
+KEI2600::BinaryFormatGuard::~BinaryFormatGuard() {
+    try {
+        restore();
+    } catch (const std::exception &) {
+        // An exception must not leave the destructor, it may be called while another one is propagated.
+    }
+}
+
+/**
+ * @brief Selects the binary format according to the buffer format of the SMU.
+ * @return The received error code.
+ */
+PIL_ERROR_CODE KEI2600::BinaryFormatGuard::enable() {
+    // Also set on error, the SMU may have executed a part of the commands.
+    m_Enabled = true;
+    return m_SMU->setBinaryDataFormat(true);
+}
+
+/**
+ * @brief Selects ASCII if the binary format was selected by enable.
+ * @return PIL_NO_ERROR if the binary format was not enabled, otherwise the received error code.
+ */
+PIL_ERROR_CODE KEI2600::BinaryFormatGuard::restore() {
+    if (!m_Enabled)
+        return PIL_NO_ERROR;
+    m_Enabled = false;
+    return m_SMU->setBinaryDataFormat(false);
+}
+
+/**
+ * @brief Requests the values from startIdx to endIdx as binary block and writes the decoded values to values.
+ * The 2600 series answers with '#0', followed by the raw values and a terminating newline. REAL64 values are
+ * received directly into values on little endian hosts, other formats are decoded from an intermediate buffer.
+ * @param startIdx The start index of the values to read (starting at 1).
+ * @param endIdx The end index of the values to read (inclusive).
+ * @param bufferName The name of the buffer to read from.
+ * @param values The memory for endIdx - startIdx + 1 values.
+ * @param receivedBytes Number of bytes received for this chunk.
+ * @return The received error code.
+ */
+PIL_ERROR_CODE KEI2600::readBinaryPartOfBuffer(int startIdx, int endIdx, const std::string &bufferName,
+                                               double *values, size_t *receivedBytes) {
+    size_t blockLength;
+    bool indefinite;
+    auto ret = sendBinaryBlockQuery("printbuffer(" + std::to_string(startIdx) + ", " + std::to_string(endIdx) +
+                                    ", " + bufferName + ")", &blockLength, &indefinite);
+    if (errorOccured(ret))
+        return ret;
+
+    size_t bytesPerValue = getBytesPerValue(m_BufferFormat);
+    size_t valueCount = endIdx - startIdx + 1;
+    size_t dataSize = valueCount * bytesPerValue;
+    if (!indefinite && blockLength != dataSize) {
+        ret = discardBinaryBlock(blockLength);
+        if (errorOccured(ret))
+            return ret;
+        return Device::handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__,
+                                              __LINE__, "Unexpected binary block length received from %s",
+                                              bufferName.c_str());
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (m_BufferFormat == REAL64_FORMAT) {
+        ret = receiveBytes(reinterpret_cast<uint8_t *>(values), dataSize);
+        if (errorOccured(ret))
+            return ret;
+        *receivedBytes = BINARY_HEADER_SIZE + dataSize + 1;
+        return receiveBinaryBlockEnd();
+    }
+#endif
+
+    if (m_BinaryReceiveBuffer.size() < dataSize)
+        m_BinaryReceiveBuffer.resize(dataSize);
+    ret = receiveBytes(m_BinaryReceiveBuffer.data(), dataSize);
+    if (errorOccured(ret))
+        return ret;
+    *receivedBytes = BINARY_HEADER_SIZE + dataSize + 1;
+
+    const uint8_t *data = m_BinaryReceiveBuffer.data();
+    for (size_t i = 0; i < valueCount; i++)
+        values[i] = decodeBinaryValue(data + i * bytesPerValue, m_BufferFormat);
+
+    return receiveBinaryBlockEnd();
+}
+
+/**
+ * @brief Decodes a single little endian IEEE-754 value, independent of the byte order of the host.
+ * @param data pointer to the first byte of the value.
+ * @param format REAL32_FORMAT or REAL64_FORMAT.
+ * @return decoded value.
+ */
+/*static*/ double KEI2600::decodeBinaryValue(const uint8_t *data, BUFFER_FORMAT format) {
+    if (format == REAL32_FORMAT) {
+        uint32_t raw = 0;
+        for (int i = 3; i >= 0; i--)
+            raw = (raw << 8) | data[i];
+        float value;
+        memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+
+    uint64_t raw = 0;
+    for (int i = 7; i >= 0; i--)
+        raw = (raw << 8) | data[i];
+    double value;
+    memcpy(&value, &raw, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Returns the number of bytes used to encode one value in the given format.
+ * @param format buffer format.
+ * @return 4 for REAL32, 8 for REAL64 and 0 for ASCII, as it has no fixed size.
+ */
+/*static*/ size_t KEI2600::getBytesPerValue(BUFFER_FORMAT format) {
+    switch (format) {
+        case REAL32_FORMAT:
+            return sizeof(float);
+        case REAL64_FORMAT:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Selects the format, which is used by readBuffer to transfer the reading buffers. Binary formats reduce
+ * the number of round trips and avoid parsing the values as text.
+ * @param format ASCII_FORMAT, REAL32_FORMAT or REAL64_FORMAT.
+ */
+void KEI2600::setBufferFormat(BUFFER_FORMAT format) {
+    m_BufferFormat = format;
+}
+
+/**
+ * @brief Returns the format used to transfer the reading buffers.
+ * @return currently selected buffer format.
+ */
+KEI2600::BUFFER_FORMAT KEI2600::getBufferFormat() const {
+    return m_BufferFormat;
+}
+
+/**
+ * @brief Returns the number of values per round trip, which was selected during the last call of readBuffer.
+ * @return chunk size in values.
+ */
+size_t KEI2600::getReadChunkSize() const {
+    return m_ChunkSizer.getChunkSize();
+}
+
 /**
  * @brief Retrieves the size of the buffer with the given name.
  * 
@@ -1163,7 +2154,8 @@ void KEI2600::clearBufferedScript() {
 }
 
 /**
- * @brief Checks the given error code and checks the error buffer if specified.
+ * @brief Checks the given error code and checks the error buffer if specified. When the error buffer is checked
+ * depends on the error check policy, see setErrorCheckPolicy.
  *
  * @param errorCode The error code to check.
  * @param checkErrorBuffer Whether to check the error buffer.
@@ -1172,7 +2164,17 @@ void KEI2600::clearBufferedScript() {
 PIL_ERROR_CODE KEI2600::handleErrorCode(PIL_ERROR_CODE errorCode, bool checkErrorBuffer) {
     if (errorOccured(errorCode))
         return errorCode;
-    if (!isBuffered() && checkErrorBuffer)
+    if (isBuffered() || !checkErrorBuffer)
+        return PIL_NO_ERROR;
+
+    if (m_ErrorCheckPolicy == CHECK_EVERY_CALL) {
+        trackLastCommand(false);
+        return getErrorBufferStatus();
+    }
+
+    trackLastCommand(true);
+    if (m_UncheckedCommands.size() >= MAX_UNCHECKED_COMMANDS ||
+        (m_ErrorCheckPolicy == CHECK_EVERY_N_CALLS && m_UncheckedCommands.size() >= m_ErrorCheckInterval))
         return getErrorBufferStatus();
     return PIL_NO_ERROR;
 }
@@ -1211,6 +2213,82 @@ std::string KEI2600::getMeasurementStorage(SMU_CHANNEL channel) {
     }
 }
 
+/**
+ * @brief Assigns a numeric value to a channel attribute, e.g. smua.source.levelv = 0.5. The constant part of the
+ * command is taken from the compile time generated command table.
+ * @param attribute attribute to set.
+ * @param unit unit of the attribute. Ignored for attributes without unit.
+ * @param channel selected channel either channel A or channel B.
+ * @param value value to assign.
+ * @param checkErrorBuffer if true check the error buffer after execution.
+ * @return NO_ERROR if execution was successful, INVALID_ARGUMENTS if the combination of unit and attribute is not
+ * supported, otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::setAttribute(KEI2600Commands::ATTRIBUTE attribute, UNIT unit, SMU_CHANNEL channel,
+                                     double value, bool checkErrorBuffer) {
+    std::string_view prefix = KEI2600Commands::getCommandPrefix(channel, unit, attribute);
+    if (prefix.empty()) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+    return assignValue(prefix, value, checkErrorBuffer);
+}
+
+/**
+ * @brief Appends the value to a command prefix and executes the command. The command is skipped if the same value
+ * was assigned before, see Device::isStateUnchanged.
+ * @param prefix constant part of the command, e.g. "smua.source.levelv = ".
+ * @param value value to assign.
+ * @param checkErrorBuffer if true check the error buffer after execution.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE KEI2600::assignValue(std::string_view prefix, double value, bool checkErrorBuffer) {
+    // The prefix identifies the attribute, so it is used as key of the state shadow.
+    if (isStateUnchanged(prefix, value))
+        return PIL_NO_ERROR;
+
+    auto &command = newCommand();
+    command.Add(prefix).Add(value);
+    auto ret = handleErrorCode(Exec(command), checkErrorBuffer);
+    updateState(prefix, value, ret);
+    return ret;
+}
+
+/**
+ * @brief Validates the integration aperture and assigns it to the nplc attribute of a channel.
+ * @param prefix constant part of the command, e.g. "smua.measure.nplc = ".
+ * @param value integration aperture in power line cycles. Allowed are values from 0.001 to 25.
+ * @param checkErrorBuffer if true check the error buffer after execution.
+ * @return NO_ERROR if execution was successful, INVALID_ARGUMENTS if the value is out of range, otherwise return
+ * error code.
+ */
+PIL_ERROR_CODE KEI2600::assignPLC(std::string_view prefix, double value, bool checkErrorBuffer) {
+    if (value < 0.001 || value > 25) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+    return assignValue(prefix, value, checkErrorBuffer);
+}
+
+/**
+ * @brief Helper function returning the channel letter, which is used to assemble commands with a CommandBuilder.
+ * @param channel channel enum to convert to a letter.
+ * @return 'a' or 'b'.
+ * @throw PIL::Exception if the channel is invalid.
+ */
+/* static */ char KEI2600::getChannelLetterFromEnum(SMU_CHANNEL channel) {
+    switch (channel) {
+        case SMU::CHANNEL_A:
+            return 'a';
+        case SMU::CHANNEL_B:
+            return 'b';
+        default:
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+    }
+}
+
 /**
  * @brief Helper function returning the auto zero enum as string which can be
  * used within the TCP command send to the SMU.
@@ -7,10 +7,21 @@
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <algorithm> // std::min
+#include <limits> // std::numeric_limits
+#include <cstdlib> // std::strtol, std::strtod
+#include <chrono> // std::chrono::steady_clock
+#include <thread> // std::this_thread::sleep_for
+#include <cctype> // toupper
 #include "devices/KST3000.h"
+#include "CSVWriter.h"
+#include "JSONMetadata.h"
+#include "NumpyWriter.h"
 #include <unistd.h>
 
 #define SLEEP_DISPLAY_CONNECTION 2 // seconds
+/** Query answered by the waveform data as IEEE 488.2 definite length block. **/
+#define WAVEFORM_DATA_QUERY ":WAVeform:DATA?"
 
 /**
  * @brief Constructor
@@ -29,14 +40,29 @@ KST3000::KST3000(const char *ip, int timeoutInMS, PIL::Logging *logger)
     //m_DeviceName = DEVICE_NAME;
 }
 
-PIL_ERROR_CODE KST3000::Exec2(const std::string &command, ExecArgs *args, std::string *result, bool br) {
-    auto ret = Exec(command, args);
+/**
+ * @brief Destructor stops the I/O thread, so no queued function is executed on a partly destroyed device.
+ */
+KST3000::~KST3000() {
+    stopIOThread();
+}
 
-    if (ret != PIL_NO_ERROR) {
+/**
+ * @brief Sends a query and receives the reply terminated by a newline, independent of the number of receive calls
+ * required for the reply.
+ * @param command command to send.
+ * @param args arguments appended to the command.
+ * @param result the reply without the terminating newline.
+ * @param br unused, the query is always terminated by a newline. Kept for compatibility.
+ * @return PIL_NO_ERROR if the reply was received, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::Exec2(const std::string &command, ExecArgs *args, std::string *result,
+                              [[maybe_unused]] bool br) {
+    auto ret = Exec(command, args);
+    if (ret != PIL_NO_ERROR || !result)
         return ret;
-    }
 
-    return Exec(" ", nullptr, result, br);
+    return receiveLine(result);
 }
 
 
@@ -80,6 +106,7 @@ PIL_ERROR_CODE KST3000::displayConnection() {
  * @brief Start to run. Equivalent to press the Run/Stop button when the device is not running.
  * */
 PIL_ERROR_CODE KST3000::run() {
+    invalidateAcquisitionDependentCache();
     return Exec("RUN");
 }
 
@@ -88,6 +115,7 @@ PIL_ERROR_CODE KST3000::run() {
  * @brief Stop to run. Equivalent to press the Run/Stop button when the device is not stopping.
  * */
 PIL_ERROR_CODE KST3000::stop() {
+    invalidateAcquisitionDependentCache();
     return Exec("STOP");
 }
 
@@ -96,14 +124,39 @@ PIL_ERROR_CODE KST3000::stop() {
  * @brief Equivalent to press the Single button.
  * */
 PIL_ERROR_CODE KST3000::single() {
+    invalidateAcquisitionDependentCache();
     return Exec("SINGLE");
 }
 
 
+/**
+ * @brief Checks if an acquisition is in progress by reading the Run bit of the operation status condition register.
+ * After single, the bit is cleared as soon as the triggered acquisition is complete and its data can be read.
+ * @param running true while the device is running or waiting for a trigger.
+ * @return PIL_NO_ERROR if the register was read, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::isAcquisitionRunning(bool *running) {
+    if (!running) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
+    std::string reply;
+    auto ret = Exec2(":OPERegister:CONDition?", nullptr, &reply, false);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    *running = std::strtol(reply.c_str(), nullptr, 10) & OPERATION_STATUS_RUN_BIT;
+    return PIL_NO_ERROR;
+}
+
+
 /**
  * @brief Equivalent to press the "Auto Scale" button.
  * */
 PIL_ERROR_CODE KST3000::autoScale() {
+    invalidateWaveformCache();
     return Exec("AUToscale");
 }
 
@@ -149,6 +202,7 @@ PIL_ERROR_CODE KST3000::setTimeRange(double range) {
     ExecArgs args;
     args.AddArgument(subArg, range, " ");
 
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -164,6 +218,7 @@ PIL_ERROR_CODE KST3000::setTimeDelay(double delay) {
     ExecArgs args;
     args.AddArgument(subArg, delay, " ");
 
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -182,6 +237,7 @@ PIL_ERROR_CODE KST3000::setChannelScale(OSC_CHANNEL channel, double value) {
     ExecArgs args;
     args.AddArgument(subArg, value, " ");
 
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -204,6 +260,7 @@ PIL_ERROR_CODE KST3000::setChannelRange(OSC_CHANNEL channel, double range, VOLTA
 
     if (voltageUnit == MILLI_VOLT)
         args.AddArgument("", "mV");
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -221,6 +278,7 @@ PIL_ERROR_CODE KST3000::setChannelOffset(OSC_CHANNEL channel, double offset) {
     ExecArgs args;
     args.AddArgument(subArg, offset, " ");
 
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -266,13 +324,23 @@ std::vector<std::string> split(const char *splitStr, std::string &delimiter) {
  *  Waveform Y increment, Waveform Y origin, Waveform Y reference]
  * */
 PIL_ERROR_CODE KST3000::getWaveformPreamble(std::string *result) {
+    if (m_CacheEnabled && m_Cache.preambleValid && result) {
+        *result = m_Cache.preamble;
+        return PIL_NO_ERROR;
+    }
+
     SubArg subArg("WAVeform");
     subArg.AddElem("PREamble", ":", "?");
 
     ExecArgs args;
     args.AddArgument(subArg, "");
 
-    return Exec2("", &args, result, false);
+    auto ret = Exec2("", &args, result, false);
+    if (ret == PIL_NO_ERROR && result && m_CacheEnabled) {
+        m_Cache.preamble = *result;
+        m_Cache.preambleValid = true;
+    }
+    return ret;
 }
 
 /**
@@ -286,6 +354,11 @@ PIL_ERROR_CODE KST3000::getWaveformPoints(int *nrWaveformPoints) {
         return PIL_INVALID_ARGUMENTS;
     }
 
+    if (m_CacheEnabled && m_Cache.pointsValid) {
+        *nrWaveformPoints = m_Cache.points;
+        return PIL_NO_ERROR;
+    }
+
     SubArg subArg("WAVeform");
     subArg.AddElem("POINts", ":", "?");
     // TODO sovle that
@@ -298,6 +371,10 @@ PIL_ERROR_CODE KST3000::getWaveformPoints(int *nrWaveformPoints) {
         return ret;
 
     *nrWaveformPoints = std::stoi(response);
+    if (m_CacheEnabled) {
+        m_Cache.points = *nrWaveformPoints;
+        m_Cache.pointsValid = true;
+    }
     return PIL_NO_ERROR;
 }
 
@@ -314,7 +391,17 @@ PIL_ERROR_CODE KST3000::setWaveformPointsMode(std::string &mode) {
             .AddElem("MODE", ":");
     ExecArgs args;
     args.AddArgument(subArg, mode, " ");
-    return Exec("", &args);
+    invalidateWaveformCache();
+    auto ret = Exec("", &args);
+    // In NORMal mode the number of points only depends on the settings, otherwise also on the acquisition. If the
+    // command failed, the device may or may not have applied it.
+    std::string prefix = mode.substr(0, 4);
+    std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::toupper);
+    if (ret != PIL_NO_ERROR)
+        m_Cache.pointsMode = UNKNOWN_POINTS_MODE;
+    else
+        m_Cache.pointsMode = prefix == "NORM" ? NORMAL_POINTS_MODE : ACQUISITION_POINTS_MODE;
+    return ret;
 }
 
 /**
@@ -326,6 +413,7 @@ PIL_ERROR_CODE KST3000::setWaveformPoints(int num_points) {
 
     ExecArgs args;
     args.AddArgument(subArg, num_points, " ");
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -333,29 +421,21 @@ PIL_ERROR_CODE KST3000::setWaveformPoints(int num_points) {
  * @brief set format of waveform data(default "BYTE")
  * */
 PIL_ERROR_CODE KST3000::setWaveformFormat(FILE_FORMAT format) {
+    // saveWaveformData sets the format before every export, which would otherwise invalidate the preamble.
+    if (m_CacheEnabled && m_Cache.formatValid && m_Cache.format == format)
+        return PIL_NO_ERROR;
+
     SubArg subArg("WAVeform");
     subArg.AddElem("FORMat", ":");
     ExecArgs args;
     args.AddArgument(subArg, getFileFormatStrFromEnum(format), " ");
-    return Exec("", &args);
-}
-
-/**
- * @brief write to file
- * */
-PIL_ERROR_CODE KST3000::writeToFile(const char *data, const std::string &file_path) {
-    std::string buffer(data);
-    std::ofstream file;
-    file.open(file_path); // TODO make more precise error checks
-    if (file.is_open()) {
-        file << buffer;
-        file.close();
-        return PIL_NO_ERROR;
+    invalidateWaveformCache();
+    auto ret = Exec("", &args);
+    if (ret == PIL_NO_ERROR) {
+        m_Cache.format = format;
+        m_Cache.formatValid = true;
     }
-
-    if (m_EnableExceptions)
-        throw PIL::Exception(PIL_INTERFACE_CLOSED, __FILENAME__, __LINE__, "");
-    return PIL_INTERFACE_CLOSED;
+    return ret;
 }
 
 /**
@@ -367,10 +447,8 @@ PIL_ERROR_CODE KST3000::writeToFile(const char *data, const std::string &file_pa
         <header><waveform_data><NL>\n
    Where:\n
    <header> = #800001000 (This is an example header)\n
-   The "#8" may be stripped off of the header and the remaining
-   numbers are the size, in bytes, of the waveform data block.
-   The size can vary depending on the number of points acquired for the waveform.(In the example, 1000 points)
-   You can then read that number of bytes from the oscilloscope and the terminating NL character.
+   The digit after '#' gives the number of the following digits, which are the size, in bytes, of the waveform data
+   block. The header is parsed by Device::QueryBinaryBlock and the data is received directly into the result.
  * */
 PIL_ERROR_CODE KST3000::getWaveformData(std::string *data) {
     if (!data) {
@@ -379,137 +457,233 @@ PIL_ERROR_CODE KST3000::getWaveformData(std::string *data) {
         return PIL_INVALID_ARGUMENTS;
     }
 
-    SubArg subArg("WAVeform");
-    subArg.AddElem("DATA", ":", "?");
+    size_t length;
+    bool indefinite;
+    auto ret = sendBinaryBlockQuery(WAVEFORM_DATA_QUERY, &length, &indefinite);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (indefinite)
+        return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Waveform data without length received");
 
-    ExecArgs args;
-    args.AddArgument(subArg, "");
+    data->resize(length);
+    ret = receiveBytes(reinterpret_cast<uint8_t *>(&(*data)[0]), length);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveBinaryBlockEnd();
+}
 
-    int num;
-    auto retGetWaveFormPoints = getWaveformPoints(&num);
-    if (retGetWaveFormPoints != PIL_NO_ERROR)
-        return retGetWaveFormPoints;
+/**
+ * @brief get the sampled data points into a vector, which is resized once to the size of the waveform.
+ * @param data raw BYTE or WORD samples as configured by setWaveformFormat.
+ * @return PIL_NO_ERROR if the data was received, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::getWaveformData(std::vector<uint8_t> *data) {
+    return QueryBinaryBlock(WAVEFORM_DATA_QUERY, data);
+}
 
-    auto execRet = Exec2("", &args, data, false);
-    if (execRet != PIL_NO_ERROR) {
-        return execRet;
+/**
+ * @brief get the sampled data points into a buffer of the caller, e.g. a preallocated numpy array.
+ * @param buffer buffer to receive the raw samples to.
+ * @param capacity size of the buffer in bytes.
+ * @param length number of received bytes.
+ * @return PIL_NO_ERROR if the data was received, PIL_INSUFFICIENT_RESOURCES if the buffer is too small.
+ */
+PIL_ERROR_CODE KST3000::getWaveformData(uint8_t *buffer, size_t capacity, size_t *length) {
+    return QueryBinaryBlock(WAVEFORM_DATA_QUERY, buffer, capacity, length);
+}
+
+/**
+ * @brief write the raw sampled data points to a memory mapped file, without buffering the waveform in memory.
+ * @param filePath file to create or overwrite.
+ * @return PIL_NO_ERROR if the data was written, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::saveRawWaveformData(const std::string &filePath) {
+    return QueryBinaryBlockToFile(WAVEFORM_DATA_QUERY, filePath);
+}
+
+/**
+ * @brief Query the preamble of waveform data and parse it.
+ * @param preamble parsed preamble.
+ * @return PIL_NO_ERROR if the preamble was received and parsed, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::getWaveformPreamble(WaveformPreamble *preamble) {
+    if (!preamble) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
     }
 
-    *data = data->substr(10, data->length());
+    std::string reply;
+    auto ret = getWaveformPreamble(&reply);
+    if (ret != PIL_NO_ERROR)
+        return ret;
 
+    if (!WaveformPreamble::parse(reply, preamble))
+        return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Invalid waveform preamble: %s", reply.c_str());
     return PIL_NO_ERROR;
 }
 
 /**
- * @brief convert a measurement data array to a 2d array: time array & voltage array
+ * @brief Set the byte order of WORD waveform data.
+ * @param bigEndian true for MSBFirst (default of the device), false for LSBFirst.
  * */
-PIL_ERROR_CODE KST3000::getRealData(double **result) {
-    if (!result) {
+PIL_ERROR_CODE KST3000::setWaveformByteOrder(bool bigEndian) {
+    auto ret = Exec(bigEndian ? ":WAVeform:BYTeorder MSBFirst" : ":WAVeform:BYTeorder LSBFirst");
+    if (ret == PIL_NO_ERROR)
+        m_WaveformBigEndian = bigEndian;
+    return ret;
+}
+
+/**
+ * @brief Enables or disables the settings cache. While enabled, the number of points, the preamble and the waveform
+ * format are only queried again after a setter changed a setting they depend on. Disable it if the settings are
+ * changed on the front panel or by raw commands while the device is controlled remotely.
+ * @param enable true to serve points and preamble from the cache.
+ */
+void KST3000::setSettingsCacheEnabled(bool enable) {
+    m_CacheEnabled = enable;
+    invalidateSettingsCache();
+}
+
+/**
+ * @brief Discards all cached settings, e.g. after the settings were changed on the front panel or with Exec.
+ */
+void KST3000::invalidateSettingsCache() {
+    m_Cache = SettingsCache();
+}
+
+/**
+ * @brief Discards all cached settings with the state of the device, e.g. on connect, disconnect and *RST.
+ */
+void KST3000::invalidateCachedState() {
+    invalidateSettingsCache();
+}
+
+/**
+ * @brief Discards the cached points and preamble, called by every setter changing the timebase, a channel or the
+ * waveform settings.
+ */
+void KST3000::invalidateWaveformCache() {
+    m_Cache.pointsValid = false;
+    m_Cache.preambleValid = false;
+}
+
+/**
+ * @brief Discards the cached points and preamble if they depend on the acquisition, i.e. if the points mode is RAW,
+ * MAXimum or unknown. Called by all commands starting or stopping an acquisition.
+ */
+void KST3000::invalidateAcquisitionDependentCache() {
+    if (m_Cache.pointsMode != NORMAL_POINTS_MODE)
+        invalidateWaveformCache();
+}
+
+/**
+ * @brief Returns the byte order of WORD waveform data set by setWaveformByteOrder.
+ * @return true for MSBFirst.
+ */
+bool KST3000::isWaveformBigEndian() const {
+    return m_WaveformBigEndian;
+}
+
+/**
+ * @brief Reads the waveform of the current source and converts it into voltages with the vectorized kernels of
+ * WaveformConverter. Holes are not removed, but marked in the validity bitmask.
+ * @param voltages converted voltages.
+ * @param validMask validity bitmask, see WaveformConverter::isValid. Can be nullptr.
+ * @param preamble preamble of the waveform, e.g. to calculate the time of a sample. Can be nullptr.
+ * @return PIL_NO_ERROR if the waveform was converted, INVALID_ARGUMENTS if the format is ASCII.
+ */
+PIL_ERROR_CODE KST3000::getVoltageData(std::vector<double> *voltages, std::vector<uint8_t> *validMask,
+                                       WaveformPreamble *preamble) {
+    return getVoltageDataImpl(voltages, validMask, preamble);
+}
+
+/**
+ * @brief Reads the waveform of the current source and converts it into single precision voltages.
+ * @see KST3000::getVoltageData
+ */
+PIL_ERROR_CODE KST3000::getVoltageData(std::vector<float> *voltages, std::vector<uint8_t> *validMask,
+                                       WaveformPreamble *preamble) {
+    return getVoltageDataImpl(voltages, validMask, preamble);
+}
+
+template<typename T>
+PIL_ERROR_CODE KST3000::getVoltageDataImpl(std::vector<T> *voltages, std::vector<uint8_t> *validMask,
+                                           WaveformPreamble *preamble) {
+    if (!voltages) {
         if (m_EnableExceptions)
             throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
         return PIL_INVALID_ARGUMENTS;
     }
 
-    int points;
-    auto getWaveFormPointsRet = getWaveformPoints(&points);
-    if (getWaveFormPointsRet != PIL_NO_ERROR)
-        return getWaveFormPointsRet;
+    WaveformPreamble waveformPreamble;
+    auto ret = getWaveformPreamble(&waveformPreamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (waveformPreamble.format != PREAMBLE_FORMAT_BYTE && waveformPreamble.format != PREAMBLE_FORMAT_WORD)
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Only BYTE and WORD waveforms can be converted");
 
-    std::string data;
-    auto getWaveFormDataRet = getWaveformData(&data);
-    if (getWaveFormDataRet != PIL_NO_ERROR)
-        return getWaveFormDataRet;
-
-    std::string preamble;
-    auto getWaveFormPreambleRet = getWaveformPreamble(&preamble);
-    if (getWaveFormPreambleRet != PIL_NO_ERROR)
-        return getWaveFormPreambleRet;
-
-    std::string delimiter = ",";
-    std::vector<std::string> v_preamble = splitString(preamble, delimiter);
-    double x_increment = std::stod(v_preamble[4]);          // TODO add define which makes the position more clear
-    double x_origin = std::stod(v_preamble[5]);             // TODO add define which makes the position more clear
-    double x_reference = std::stod(v_preamble[6]);          // TODO add define which makes the position more clear
-    double y_increment = std::stod(v_preamble[7]);          // TODO add define which makes the position more clear
-    double y_origin = std::stod(v_preamble[8]);             // TODO add define which makes the position more clear
-    double y_reference = std::stod(v_preamble[9]);          // TODO add define which makes the position more clear
-
-    std::vector<std::string> v_data = splitString(data, delimiter);
-
-    // TODO make the calculation more clear!
-    for (int i = 0; i < points; i++) {
-        double time = ((i - x_reference) * x_increment) + x_origin;
-        result[0][i] = time;
-
-        int voltage_data = (int) (unsigned char) data[i];
-        if (voltage_data == 0) {
-            // Hole. Holes are locations where data has not yet been acquired.
-            continue;
-        }
-        double voltage = ((voltage_data - y_reference) * y_increment) + y_origin;
-        result[1][i] = voltage;
-    }
+    ret = getWaveformData(&m_RawWaveform);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    WaveformConverter::SAMPLE_FORMAT format = WaveformConverter::BYTE_SAMPLES;
+    if (waveformPreamble.format == PREAMBLE_FORMAT_WORD)
+        format = m_WaveformBigEndian ? WaveformConverter::WORD_BIG_ENDIAN_SAMPLES
+                                     : WaveformConverter::WORD_LITTLE_ENDIAN_SAMPLES;
+
+    size_t count = m_RawWaveform.size() / WaveformConverter::getBytesPerSample(format);
+    voltages->resize(count);
+    // The mask is always written by the kernels, a member buffer is used if the caller does not need it.
+    std::vector<uint8_t> *mask = validMask ? validMask : &m_ValidMask;
+    mask->resize(WaveformConverter::getMaskSize(count));
+    WaveformConverter::convert(m_RawWaveform.data(), count, format, waveformPreamble, voltages->data(),
+                               mask->data());
+
+    if (preamble)
+        *preamble = waveformPreamble;
     return PIL_NO_ERROR;
 }
 
 /**
  * @brief convert a measurement data array to a 2d array: time array & voltage array
+ * Holes, i.e. locations where no data was acquired, are not written.
  * */
-std::vector<std::vector<double>> KST3000::getRealDataPy() {
+PIL_ERROR_CODE KST3000::getRealData(double **result) {
+    if (!result) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
     int points;
     auto getWaveFormPointsRet = getWaveformPoints(&points);
     if (getWaveFormPointsRet != PIL_NO_ERROR)
-        throw PIL::Exception(getWaveFormPointsRet, __FILENAME__, __LINE__, "Failed getting waveform points");
-
-    std::string data;
-    auto getWaveFormDataRet = getWaveformData(&data);
-    if (getWaveFormDataRet != PIL_NO_ERROR)
-        throw PIL::Exception(getWaveFormDataRet, __FILENAME__, __LINE__, "Failed getting waveform data.");
-
-    std::string preamble;
-    auto getWaveFormPreambleRet = getWaveformPreamble(&preamble);
-    if (getWaveFormPreambleRet != PIL_NO_ERROR)
-        throw PIL::Exception(getWaveFormPreambleRet, __FILENAME__, __LINE__, "Failed getting waveform preamble.");
-
-    std::string delimiter = ",";
-    std::vector<std::string> v_preamble = splitString(preamble, delimiter);
-    double x_increment = std::stod(v_preamble[4]);          // TODO add define which makes the position more clear
-    double x_origin = std::stod(v_preamble[5]);             // TODO add define which makes the position more clear
-    double x_reference = std::stod(v_preamble[6]);          // TODO add define which makes the position more clear
-    double y_increment = std::stod(v_preamble[7]);          // TODO add define which makes the position more clear
-    double y_origin = std::stod(v_preamble[8]);             // TODO add define which makes the position more clear
-    double y_reference = std::stod(v_preamble[9]);          // TODO add define which makes the position more clear
-
-    std::vector<std::string> v_data = splitString(data, delimiter);
-
-    std::vector<std::vector<double>> result;
-    std::vector<double> r1;
-    std::vector<double> r2;
-    result.push_back(r1);
-    result.push_back(r2);
-
-    // TODO make the calculation more clear!
-    for (int i = 0; i < points; i++) {
-        int voltage_data = (int) (unsigned char) data[i];
-        if (voltage_data == 0) {
-            // Hole. Holes are locations where data has not yet been acquired.
-            continue;
-        }
+        return getWaveFormPointsRet;
 
-        double time = ((i - x_reference) * x_increment) + x_origin;
-        result[0].push_back(time);
+    std::vector<double> voltages;
+    std::vector<uint8_t> validMask;
+    WaveformPreamble preamble;
+    auto ret = getVoltageData(&voltages, &validMask, &preamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
 
-        double voltage = ((voltage_data - y_reference) * y_increment) + y_origin;
-        result[1].push_back(voltage);
+    size_t count = std::min(voltages.size(), static_cast<size_t>(std::max(points, 0)));
+    for (size_t i = 0; i < count; i++) {
+        result[0][i] = preamble.getTime(i);
+        if (WaveformConverter::isValid(validMask.data(), i))
+            result[1][i] = voltages[i];
     }
-
-    return result;
+    return PIL_NO_ERROR;
 }
 
-
 /**
  * @brief save waveform data to the target file
- * @details The file can be plotted, for example using python.
+ * @details The file can be plotted, for example using python. Holes are written as empty fields.
+ * The values are streamed to the file by CSVWriter, so the export does not build the file content in memory.
  * @code{.py}
  * import pandas as pd
  * import matplotlib.pyplot as plt
@@ -519,32 +693,95 @@ std::vector<std::vector<double>> KST3000::getRealDataPy() {
  * plt.plot(data['time(ms)'], data['voltage(V)'])
  * @endcode
  * */
-// TODO refactor to csv handler class
 PIL_ERROR_CODE KST3000::saveWaveformData(std::string &file_path) {
-    setWaveformFormat(BYTE);
-    std::string preamble;
-    auto getWaveFormPreambleRet = getWaveformPreamble(&preamble);
-    if (getWaveFormPreambleRet != PIL_NO_ERROR)
-        return getWaveFormPreambleRet;
-
-    std::string delimiter = ",";
-    std::vector<std::string> v_preamble = splitString(preamble, delimiter);
-    int points;
-    auto getWaveformPointsRet = getWaveformPoints(&points);
-    if (getWaveformPointsRet != PIL_NO_ERROR)
-        return getWaveformPointsRet;
-
-    double *result[2];
-    result[0] = new double[points];
-    result[1] = new double[points];
-    getRealData(result);
-    std::stringstream stream;
-    stream << "time(ms)" << "," << "voltage(V)" << std::endl;
-    for (int i = 0; i < points; i++) {
-        stream << result[0][i] * 1000 << "," << result[1][i]
-               << std::endl; // TODO: ADD explanation, no static numeric values in the source code!
+    auto ret = setWaveformFormat(BYTE);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    std::vector<double> voltages;
+    std::vector<uint8_t> validMask;
+    WaveformPreamble preamble;
+    ret = getVoltageData(&voltages, &validMask, &preamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    std::vector<double> times(voltages.size());
+    for (size_t i = 0; i < voltages.size(); i++) {
+        times[i] = preamble.getTime(i);
+        if (!WaveformConverter::isValid(validMask.data(), i))
+            voltages[i] = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // Time is exported in milliseconds.
+    ret = CSVWriter::writeFile(file_path, {{"time(ms)", times.data(), 1000},
+                                           {"voltage(V)", voltages.data()}}, voltages.size());
+    if (ret != PIL_NO_ERROR)
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not write waveform to %s", file_path.c_str());
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Saves the waveform of the current source as numpy archive with the arrays "time" (seconds relative to the
+ * trigger), "voltage" and "valid" (false for holes). The preamble and the identifier of the device are written to a
+ * JSON file with the same name and the extension .json. Holes keep the voltage computed from the raw value.
+ * @code{.py}
+ * import numpy as np
+ * data = np.load("capture.npz")
+ * plt.plot(data['time'][data['valid']], data['voltage'][data['valid']])
+ * @endcode
+ * @param filePath path of the archive, e.g. capture.npz.
+ * @param singlePrecision if true, the voltages are stored as float32, which halves the size of the column.
+ * @return PIL_NO_ERROR if both files were written, otherwise the error code.
+ */
+PIL_ERROR_CODE KST3000::saveWaveformNpz(const std::string &filePath, bool singlePrecision) {
+    WaveformPreamble preamble;
+    std::vector<uint8_t> validMask;
+    std::vector<double> voltages;
+    std::vector<float> voltagesSingle;
+    auto ret = singlePrecision ? getVoltageData(&voltagesSingle, &validMask, &preamble)
+                               : getVoltageData(&voltages, &validMask, &preamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    size_t count = singlePrecision ? voltagesSingle.size() : voltages.size();
+    std::vector<double> times(count);
+    std::vector<uint8_t> valid(count);
+    for (size_t i = 0; i < count; i++) {
+        times[i] = preamble.getTime(i);
+        valid[i] = WaveformConverter::isValid(validMask.data(), i);
     }
-    writeToFile(stream.str().c_str(), file_path);
+
+    NumpyWriter writer;
+    ret = writer.open(filePath);
+    if (ret == PIL_NO_ERROR)
+        ret = writer.addArray("time", times.data(), count);
+    if (ret == PIL_NO_ERROR)
+        ret = singlePrecision ? writer.addArray("voltage", voltagesSingle.data(), count)
+                              : writer.addArray("voltage", voltages.data(), count);
+    if (ret == PIL_NO_ERROR)
+        ret = writer.addBoolArray("valid", valid.data(), count);
+    auto closeRet = writer.close();
+    if (ret == PIL_NO_ERROR)
+        ret = closeRet;
+    if (ret != PIL_NO_ERROR)
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not write waveform to %s", filePath.c_str());
+
+    JSONMetadata preambleMetadata;
+    preambleMetadata.add("format", preamble.format).add("type", preamble.type).add("points", preamble.points)
+            .add("count", preamble.count).add("xIncrement", preamble.xIncrement).add("xOrigin", preamble.xOrigin)
+            .add("xReference", preamble.xReference).add("yIncrement", preamble.yIncrement)
+            .add("yOrigin", preamble.yOrigin).add("yReference", preamble.yReference);
+
+    JSONMetadata metadata;
+    metadata.add("instrument", getDeviceIdentifier()).add("bigEndian", m_WaveformBigEndian)
+            .add("preamble", preambleMetadata);
+    auto metadataPath = JSONMetadata::getSidecarPath(filePath);
+    ret = metadata.writeFile(metadataPath);
+    if (ret != PIL_NO_ERROR)
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Could not write metadata to %s", metadataPath.c_str());
     return PIL_NO_ERROR;
 }
 
@@ -556,6 +793,7 @@ PIL_ERROR_CODE KST3000::saveWaveformData(std::string &file_path) {
 PIL_ERROR_CODE KST3000::setDisplayMode(DISPLAY_MODES mode) {
     ExecArgs args;
     args.AddArgument("TIMebase:MODE", getDisplayModeFromEnum(mode), " ");
+    invalidateWaveformCache();
     return Exec("", &args);
 }
 
@@ -563,21 +801,258 @@ PIL_ERROR_CODE KST3000::setDisplayMode(DISPLAY_MODES mode) {
  * @brief capture data
  * */
 PIL_ERROR_CODE KST3000::digitize(OSC_CHANNEL channel) {
+    invalidateAcquisitionDependentCache();
     ExecArgs args;
     return Exec("DIGitize CHAnnel" + getChannelFromEnum(channel), &args);
 }
 
+/**
+ * @brief Captures several channels with a single acquisition, e.g. :DIGitize CHANnel1,CHANnel2. In contrast to
+ * digitizing every channel separately, the waveforms of all channels belong to the same trigger.
+ * @param channels channels to capture.
+ * @return PIL_NO_ERROR if the command was sent, PIL_INVALID_ARGUMENTS if no channel is given.
+ */
+PIL_ERROR_CODE KST3000::digitize(const std::vector<OSC_CHANNEL> &channels) {
+    if (channels.empty())
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "No channel to digitize");
+    invalidateAcquisitionDependentCache();
+    return Exec(getDigitizeCommand(channels));
+}
+
+/**
+ * @brief Reads the waveforms of several channels of the last acquisition. The source, preamble and data queries of
+ * all channels are sent with a single message and the replies are read afterwards, so the channels cost one round
+ * trip instead of several per channel.
+ * @param channels channels to read.
+ * @param frame converted voltages and preambles of all channels. The buffers are reused if already allocated.
+ * @return PIL_NO_ERROR if all waveforms were received, PIL_INVALID_ARGUMENTS if the format is neither BYTE nor WORD,
+ * otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::getMultiChannelData(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame) {
+    if (channels.empty() || !frame || isBuffered())
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Multi channel fetch requires channels, a frame and direct send mode");
+
+    // The queries change the waveform source.
+    invalidateWaveformCache();
+    auto ret = Exec(getMultiChannelQueries(channels));
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveMultiChannelData(channels, frame);
+}
+
+/**
+ * @brief Captures several channels with a single acquisition and reads their waveforms. The digitize command and
+ * the queries of all channels are sent as one message. The device executes the queries after the acquisition is
+ * complete, so the timeout of the device must cover the time until the trigger.
+ * @param channels channels to capture and read.
+ * @param frame converted voltages and preambles of all channels.
+ * @return PIL_NO_ERROR if all waveforms were received, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::digitizeAndFetch(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame) {
+    if (channels.empty() || !frame || isBuffered())
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Multi channel capture requires channels, a frame and direct send mode");
+
+    invalidateWaveformCache();
+    auto ret = Exec(getDigitizeCommand(channels) + "\n" + getMultiChannelQueries(channels));
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveMultiChannelData(channels, frame);
+}
+
+/**
+ * @brief Enables the segmented memory. Every trigger of a single acquisition is captured into the next segment until
+ * all segments are filled, the device re-arms itself between the segments.
+ * @param segmentCount number of segments to capture with the next acquisition.
+ * @return PIL_NO_ERROR if the mode was set, PIL_INVALID_ARGUMENTS if the count is smaller than 1.
+ */
+PIL_ERROR_CODE KST3000::setSegmentedAcquisition(int segmentCount) {
+    if (segmentCount < 1)
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Invalid segment count %d", segmentCount);
+    invalidateWaveformCache();
+    return Exec(":ACQuire:MODE SEGMented;:ACQuire:SEGMented:COUNt " + std::to_string(segmentCount));
+}
+
+/**
+ * @brief Switches back to the default real time acquisition mode.
+ * @return PIL_NO_ERROR if the mode was set, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::disableSegmentedAcquisition() {
+    invalidateWaveformCache();
+    return Exec(":ACQuire:MODE RTIMe");
+}
+
+/**
+ * @brief Query the number of segments captured by the last segmented acquisition.
+ * @param segmentCount number of acquired segments.
+ * @return PIL_NO_ERROR if the count was received, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::getAcquiredSegmentCount(int *segmentCount) {
+    if (!segmentCount) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
+
+    std::string reply;
+    auto ret = Exec2(":WAVeform:SEGMented:COUNt?", nullptr, &reply, false);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    *segmentCount = static_cast<int>(std::strtol(reply.c_str(), nullptr, 10));
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Captures segmentCount triggers into the segmented memory with a single acquisition and waits until all
+ * segments are filled. The segments are read afterwards with getSegmentedData.
+ * @param segmentCount number of segments to capture.
+ * @param timeoutInMs maximum time to wait for all triggers. If it expires, the acquisition is stopped and the
+ * segments captured so far can still be read.
+ * @return PIL_NO_ERROR if all segments were captured, PIL_TIMEOUT if the timeout expired, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::captureSegments(int segmentCount, int timeoutInMs) {
+    auto ret = setSegmentedAcquisition(segmentCount);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    ret = single();
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutInMs);
+    while (true) {
+        bool running = true;
+        ret = isAcquisitionRunning(&running);
+        if (ret != PIL_NO_ERROR || !running)
+            return ret;
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            stop();
+            return handleErrorsAndLogging(PIL_TIMEOUT, m_EnableExceptions, PIL::WARNING, __FILENAME__, __LINE__,
+                                          "Segmented acquisition of %d segments timed out", segmentCount);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ACQUISITION_POLL_INTERVAL_MS));
+    }
+}
+
+/**
+ * @brief Downloads all acquired segments of the current waveform source with their time tags. The queries of the
+ * next segments are sent before the replies of the current segment are read, so the device selects the next
+ * segment while the samples of the current one are transferred. Every block is received directly into its position
+ * of the contiguous buffer. Waiting high priority tasks are executed as soon as all sent queries were answered.
+ * If a segment can not be received, the connection is closed, since the remaining replies could not be matched to
+ * their queries anymore. Connect must be called to continue.
+ * @param result preamble, time tags and samples of all segments. The buffers are reused if already allocated.
+ * @return PIL_NO_ERROR if all segments were received, PIL_INVALID_ARGUMENTS if the format is neither BYTE nor WORD,
+ * otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::getSegmentedData(SegmentedWaveform *result) {
+    if (!result || isBuffered())
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Segmented download requires a result and direct send mode");
+
+    auto ret = getWaveformPreamble(&result->preamble);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (result->preamble.format != PREAMBLE_FORMAT_BYTE && result->preamble.format != PREAMBLE_FORMAT_WORD)
+        return handleErrorsAndLogging(PIL_INVALID_ARGUMENTS, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Only BYTE and WORD waveforms can be downloaded as segments");
+
+    ret = getAcquiredSegmentCount(&result->segmentCount);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+
+    int count = result->segmentCount;
+    size_t bytesPerSample = result->preamble.format == PREAMBLE_FORMAT_WORD ? 2 : 1;
+    result->bytesPerSegment = static_cast<size_t>(std::max(result->preamble.points, 0)) * bytesPerSample;
+    result->samples.resize(count * result->bytesPerSegment);
+    result->timeTags.resize(count);
+
+    try {
+        ret = receiveSegments(result);
+    } catch (const PIL::Exception &) {
+        closeDesynchronizedConnection("Segmented waveform transfer failed");
+        throw;
+    }
+    // The replies of the current block and of the queries still in the pipeline can not be skipped reliably.
+    if (ret != PIL_NO_ERROR)
+        closeDesynchronizedConnection("Segmented waveform transfer failed");
+    return ret;
+}
+
+/**
+ * @brief Sends the pipelined queries of all segments and receives their time tags and samples.
+ * @param result preamble and buffers sized by getSegmentedData, which are filled with the segments.
+ * @return PIL_NO_ERROR if all segments were received, otherwise return error code. Replies may remain unread if an
+ * error occurred.
+ */
+PIL_ERROR_CODE KST3000::receiveSegments(SegmentedWaveform *result) {
+    int count = result->segmentCount;
+    int sent = 0;
+    for (int segment = 0; segment < count; segment++) {
+        // While high priority tasks wait, the pipeline is not refilled, so they run as soon as it is drained.
+        int depth = hasPriorityTasks() ? 1 : SEGMENT_PIPELINE_DEPTH;
+        for (; sent < count && sent < segment + depth; sent++) {
+            auto ret = Exec(":ACQuire:SEGMented:INDex " + std::to_string(sent + 1) + ";:WAVeform:SEGMented:TTAG?\n"
+                            WAVEFORM_DATA_QUERY);
+            if (ret != PIL_NO_ERROR)
+                return ret;
+        }
+
+        std::string timeTag;
+        auto ret = receiveLine(&timeTag);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        result->timeTags[segment] = std::strtod(timeTag.c_str(), nullptr);
+
+        size_t length;
+        bool indefinite;
+        ret = receiveBinaryBlockHeader(&length, &indefinite);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        // The preamble only announces the requested number of points, the first block determines the real size.
+        if (segment == 0 && !indefinite && length != result->bytesPerSegment) {
+            result->bytesPerSegment = length;
+            result->samples.resize(count * length);
+        }
+        if (indefinite || length != result->bytesPerSegment)
+            return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                          "Segment %d has %zu bytes instead of %zu", segment + 1, length,
+                                          result->bytesPerSegment);
+
+        ret = receiveBytes(result->samples.data() + segment * length, length);
+        if (ret != PIL_NO_ERROR)
+            return ret;
+        ret = receiveBinaryBlockEnd();
+        if (ret != PIL_NO_ERROR)
+            return ret;
+
+        // Priority tasks must not receive the replies of queries which are still in the pipeline.
+        if (sent == segment + 1)
+            runPriorityTasks();
+    }
+    return PIL_NO_ERROR;
+}
+
 /**
  * @brief get system setup
  * */
 PIL_ERROR_CODE KST3000::getSystemSetup(std::string *buffer) {
-    SubArg subArg("SYSTem");
-    subArg.AddElem("SETup", ":", "?");
-
-    ExecArgs args;
-    args.AddArgument(subArg, "");
+    if (!buffer) {
+        if (m_EnableExceptions)
+            throw PIL::Exception(PIL_INVALID_ARGUMENTS, __FILENAME__, __LINE__, "");
+        return PIL_INVALID_ARGUMENTS;
+    }
 
-    return Exec2("", &args, buffer, false);
+    // The setup is returned as binary block, which may contain newlines.
+    std::vector<uint8_t> setup;
+    auto ret = QueryBinaryBlock(":SYSTem:SETup?", &setup);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    buffer->assign(setup.begin(), setup.end());
+    return PIL_NO_ERROR;
 }
 
 /**
@@ -586,9 +1061,126 @@ PIL_ERROR_CODE KST3000::getSystemSetup(std::string *buffer) {
 PIL_ERROR_CODE KST3000::setWaveformSource(OSC_CHANNEL channel) {
     ExecArgs execArgs;
     execArgs.AddArgument("CHANnel", getChannelFromEnum(channel));
+    invalidateWaveformCache();
     return Exec("WAVeform:SOURce ", &execArgs);
 }
 
+/**
+ * @brief Creates the command capturing all channels, e.g. :DIGitize CHANnel1,CHANnel3.
+ * @param channels channels to capture.
+ * @return the command without newline.
+ */
+std::string KST3000::getDigitizeCommand(const std::vector<OSC_CHANNEL> &channels) {
+    std::string command = ":DIGitize ";
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (i > 0)
+            command += ',';
+        command += "CHANnel" + getChannelFromEnum(channels[i]);
+    }
+    return command;
+}
+
+/**
+ * @brief Creates the queries selecting every channel as source and requesting its preamble and data. Every channel
+ * is answered by the preamble line followed by the binary block of the samples.
+ * @param channels channels to read.
+ * @return the queries separated by newlines, without trailing newline.
+ */
+std::string KST3000::getMultiChannelQueries(const std::vector<OSC_CHANNEL> &channels) {
+    std::string queries;
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (i > 0)
+            queries += '\n';
+        queries += ":WAVeform:SOURce CHANnel" + getChannelFromEnum(channels[i]) + ";:WAVeform:PREamble?\n"
+                   WAVEFORM_DATA_QUERY;
+    }
+    return queries;
+}
+
+/**
+ * @brief Receives the replies of getMultiChannelQueries. Every block is converted before the next one is received,
+ * so only one raw waveform is buffered. If the reply of a channel can not be received, the connection is closed,
+ * since the remaining replies could not be matched to their queries anymore. Connect must be called to continue.
+ * @param channels channels in the order of the queries.
+ * @param frame converted voltages and preambles of all channels.
+ * @return PIL_NO_ERROR if all waveforms were received, otherwise return error code.
+ */
+PIL_ERROR_CODE KST3000::receiveMultiChannelData(const std::vector<OSC_CHANNEL> &channels, MultiChannelFrame *frame) {
+    frame->channels = channels;
+    frame->preambles.resize(channels.size());
+    frame->voltages.resize(channels.size());
+    frame->validMasks.resize(channels.size());
+
+    PIL_ERROR_CODE ret = PIL_NO_ERROR;
+    for (size_t i = 0; i < channels.size(); i++) {
+        auto &waveformPreamble = frame->preambles[i];
+        PIL_ERROR_CODE receiveRet;
+        try {
+            receiveRet = receiveChannelWaveform(&waveformPreamble);
+        } catch (const PIL::Exception &) {
+            closeDesynchronizedConnection("Multi channel transfer failed");
+            throw;
+        }
+        if (receiveRet != PIL_NO_ERROR) {
+            closeDesynchronizedConnection("Multi channel transfer failed");
+            return receiveRet;
+        }
+        size_t length = m_RawWaveform.size();
+
+        // The replies of all channels must be consumed, so an unsupported format is reported after the last one.
+        if (waveformPreamble.format != PREAMBLE_FORMAT_BYTE && waveformPreamble.format != PREAMBLE_FORMAT_WORD) {
+            ret = PIL_INVALID_ARGUMENTS;
+            continue;
+        }
+
+        WaveformConverter::SAMPLE_FORMAT format = WaveformConverter::BYTE_SAMPLES;
+        if (waveformPreamble.format == PREAMBLE_FORMAT_WORD)
+            format = m_WaveformBigEndian ? WaveformConverter::WORD_BIG_ENDIAN_SAMPLES
+                                         : WaveformConverter::WORD_LITTLE_ENDIAN_SAMPLES;
+        size_t count = length / WaveformConverter::getBytesPerSample(format);
+        frame->voltages[i].resize(count);
+        frame->validMasks[i].resize(WaveformConverter::getMaskSize(count));
+        WaveformConverter::convert(m_RawWaveform.data(), count, format, waveformPreamble, frame->voltages[i].data(),
+                                   frame->validMasks[i].data());
+    }
+
+    if (ret != PIL_NO_ERROR)
+        return handleErrorsAndLogging(ret, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Only BYTE and WORD waveforms can be converted");
+    return PIL_NO_ERROR;
+}
+
+/**
+ * @brief Receives the preamble line and the binary block of one channel replied to getMultiChannelQueries. The
+ * samples are stored in m_RawWaveform.
+ * @param preamble parsed preamble of the channel.
+ * @return PIL_NO_ERROR if the reply was received, otherwise return error code. The reply may remain partially unread
+ * if an error occurred.
+ */
+PIL_ERROR_CODE KST3000::receiveChannelWaveform(WaveformPreamble *preamble) {
+    std::string reply;
+    auto ret = receiveLine(&reply);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (!WaveformPreamble::parse(reply, preamble))
+        return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Invalid waveform preamble: %s", reply.c_str());
+
+    size_t length;
+    bool indefinite;
+    ret = receiveBinaryBlockHeader(&length, &indefinite);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    if (indefinite)
+        return handleErrorsAndLogging(PIL_UNKNOWN_ERROR, m_EnableExceptions, PIL::ERROR, __FILENAME__, __LINE__,
+                                      "Waveform data must be a definite length block");
+    m_RawWaveform.resize(length);
+    ret = receiveBytes(m_RawWaveform.data(), length);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return receiveBinaryBlockEnd();
+}
+
 /*static*/ std::string KST3000::getTriggerEdgeStr(Oscilloscope::TRIGGER_EDGE edge) {
     switch (edge) {
         case Oscilloscope::POS_EDGE:
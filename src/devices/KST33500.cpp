@@ -17,6 +17,10 @@ KST33500::KST33500(const char *ip, int timeoutInMs, PIL::Logging *logger) : Func
     this->m_DeviceName = "Keysight 33500B Waveform Generator";
 }
 
+KST33500::~KST33500() {
+    stopIOThread();
+}
+
 
 PIL_ERROR_CODE KST33500::display(std::string &text) {
     SubArg arg("DISP");
@@ -77,9 +81,14 @@ PIL_ERROR_CODE KST33500::turnOff() {
 }
 
 PIL_ERROR_CODE KST33500::setFrequency(double value) {
+    if (isStateUnchanged("FREQuency", value))
+        return PIL_NO_ERROR;
+
     ExecArgs args;
     args.AddArgument("", value);
-    return Exec("FREQuency ", &args);
+    auto execRet = Exec("FREQuency ", &args);
+    updateState("FREQuency", value, execRet);
+    return execRet;
 }
 
 // TODO unclear
@@ -88,8 +97,14 @@ PIL_ERROR_CODE KST33500::setAmplitude(double value, const char *constrain) {
     if (strlen(constrain) > 0) {
         msg += ":" + std::string(constrain) + " ";
     }
+    std::string key = strlen(constrain) > 0 ? "VOLTage:" + std::string(constrain) : msg;
+    if (isStateUnchanged(key, value))
+        return PIL_NO_ERROR;
+
     msg += " " + std::to_string(value);
     auto execRet = Exec(msg);
+    invalidateVoltageState();
+    updateState(key, value, execRet);
     if (execRet != PIL_NO_ERROR)
         return execRet;
 
@@ -105,12 +120,17 @@ PIL_ERROR_CODE KST33500::setAmplitude(double value, const char *constrain) {
  */
 PIL_ERROR_CODE KST33500::setFunction(FunctionGenerator::FUNCTION_TYPE functionType) {
     auto function = GetFunctionStr(functionType);
-
+    if (isStateUnchanged("FUNCtion", function))
+        return PIL_NO_ERROR;
 
     ExecArgs args;
     args.AddArgument("FUNCtion", function, " ");
 
     auto execRet = Exec("", &args);
+    // The generator limits frequency and voltage to the range of the new function.
+    invalidateState("FREQuency");
+    invalidateVoltageState();
+    updateState("FUNCtion", function, execRet);
     if (execRet != PIL_NO_ERROR)
         return execRet;
 
@@ -119,9 +139,14 @@ PIL_ERROR_CODE KST33500::setFunction(FunctionGenerator::FUNCTION_TYPE functionTy
 }
 
 PIL_ERROR_CODE KST33500::setPhase(double value) {
+    if (isStateUnchanged("PHASe", value))
+        return PIL_NO_ERROR;
+
     ExecArgs args;
     args.AddArgument("PHASe", value, " ");
-    return Exec("", &args);
+    auto execRet = Exec("", &args);
+    updateState("PHASe", value, execRet);
+    return execRet;
 }
 
 /**
@@ -129,12 +154,29 @@ PIL_ERROR_CODE KST33500::setPhase(double value) {
  * attention: offset would change voltage by double of your argument
  * */
 PIL_ERROR_CODE KST33500::setOffset(double offset) {
+    if (isStateUnchanged("VOLTage:OFFSet", offset))
+        return PIL_NO_ERROR;
+
     SubArg voltageOffset("VOLTage");
     voltageOffset.AddElem("OFFSet", ":");
 
     ExecArgs args;
     args.AddArgument(voltageOffset, offset, " ");
-    return Exec("", &args);
+    auto execRet = Exec("", &args);
+    invalidateVoltageState();
+    updateState("VOLTage:OFFSet", offset, execRet);
+    return execRet;
+}
+
+/**
+ * @brief Amplitude, offset, high and low level depend on each other, so setting one of them invalidates the values
+ * of the others in the state shadow.
+ */
+void KST33500::invalidateVoltageState() {
+    invalidateState("VOLTage");
+    invalidateState("VOLTage:OFFSet");
+    invalidateState("VOLTage:HIGH");
+    invalidateState("VOLTage:LOW");
 }
 
 std::string KST33500::GetFunctionStr(FUNCTION_TYPE functionType) {
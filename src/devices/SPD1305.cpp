@@ -13,13 +13,23 @@ SPD1305::SPD1305(const char *ip, PIL::Logging *logger, int timeoutInMs) : DCPowe
     this->m_DeviceName = "DC Power Supply";
 }
 
+SPD1305::~SPD1305() {
+    stopIOThread();
+}
+
 PIL_ERROR_CODE SPD1305::setCurrent(DC_CHANNEL channel, double current) {
+    std::string key = "CH" + getStrFromDCChannelEnum(channel) + ":CURRent";
+    if (isStateUnchanged(key, current))
+        return PIL_NO_ERROR;
+
     SubArg surrentArg("CURRent", ":");
     ExecArgs args;
     args.AddArgument("CH", getStrFromDCChannelEnum(channel))
             .AddArgument(surrentArg, current);
 
-    return Exec("OUTPut", &args);
+    auto execRet = Exec("OUTPut", &args);
+    updateState(key, current, execRet);
+    return execRet;
 }
 
 PIL_ERROR_CODE SPD1305::getCurrent(DC_CHANNEL channel, double *current) {
@@ -10,3 +10,52 @@ SMU::SMU(std::string ipAddress, int timeoutInMs, SEND_METHOD mode)
 SMU::SMU(std::string ipAddress, int timeoutInMs, PIL::Logging *logger, SEND_METHOD mode)
         : Device(std::move(ipAddress), timeoutInMs, logger, mode) {
 }
+
+/**
+ * @brief Sets the level of a channel and measures afterwards. Devices which support it, execute both in a single
+ * round trip. This default implementation calls setLevel and measure.
+ * @param sourceUnit unit of the level, voltage or current.
+ * @param channel channel to set and measure.
+ * @param level level to set.
+ * @param measureUnit unit to measure.
+ * @param value measured value.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE SMU::setLevelAndMeasure(UNIT sourceUnit, SMU_CHANNEL channel, double level, UNIT measureUnit,
+                                       double *value, bool checkErrorBuffer) {
+    auto ret = setLevel(sourceUnit, channel, level, checkErrorBuffer);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return measure(measureUnit, channel, value, checkErrorBuffer);
+}
+
+/**
+ * @brief Measures current and voltage of a channel. This default implementation calls measure twice.
+ * @param channel channel to measure.
+ * @param current measured current.
+ * @param voltage measured voltage.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE SMU::measureIV(SMU_CHANNEL channel, double *current, double *voltage, bool checkErrorBuffer) {
+    auto ret = measure(CURRENT, channel, current, checkErrorBuffer);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return measure(VOLTAGE, channel, voltage, checkErrorBuffer);
+}
+
+/**
+ * @brief Measures the same unit on channel A and channel B. This default implementation calls measure twice.
+ * @param unit unit to measure.
+ * @param valueA measured value of channel A.
+ * @param valueB measured value of channel B.
+ * @param checkErrorBuffer if true error buffer status is requested and evaluated.
+ * @return NO_ERROR if execution was successful otherwise return error code.
+ */
+PIL_ERROR_CODE SMU::measureBothChannels(UNIT unit, double *valueA, double *valueB, bool checkErrorBuffer) {
+    auto ret = measure(unit, CHANNEL_A, valueA, checkErrorBuffer);
+    if (ret != PIL_NO_ERROR)
+        return ret;
+    return measure(unit, CHANNEL_B, valueB, checkErrorBuffer);
+}
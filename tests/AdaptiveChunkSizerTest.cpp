@@ -0,0 +1,42 @@
+#include <gtest/gtest.h> // google test
+#include "AdaptiveChunkSizer.h"
+
+using namespace std::chrono_literals;
+
+TEST(AdaptiveChunkSizerTest, FirstChunkUsesInitialSize)
+{
+    AdaptiveChunkSizer sizer(64, 65536);
+    sizer.reset(1ms, 8, 256);
+    EXPECT_EQ(sizer.getChunkSize(), 256u);
+}
+
+TEST(AdaptiveChunkSizerTest, GrowsOnFastConnection)
+{
+    AdaptiveChunkSizer sizer(64, 65536);
+    sizer.reset(1ms, 8, 256);
+
+    // 2048 bytes transferred in 1.1 ms -> far below 20 round trip times, the chunk size must grow.
+    sizer.update(256, 2048, 1100us);
+    EXPECT_GT(sizer.getChunkSize(), 256u);
+    EXPECT_LE(sizer.getChunkSize(), 1024u); // growth is limited to factor 4 per update
+}
+
+TEST(AdaptiveChunkSizerTest, RespectsUpperBound)
+{
+    AdaptiveChunkSizer sizer(64, 4096);
+    sizer.reset(10ms, 8, 256);
+    for (int i = 0; i < 10; i++)
+        sizer.update(sizer.getChunkSize(), sizer.getChunkSize() * 8, 10100us);
+    EXPECT_EQ(sizer.getChunkSize(), 4096u);
+}
+
+TEST(AdaptiveChunkSizerTest, ShrinksOnSlowConnection)
+{
+    AdaptiveChunkSizer sizer(64, 65536);
+    sizer.reset(1ms, 8, 4096);
+
+    // 32 kB in 1 s -> ~32 kB/s, 20 round trips correspond to ~650 bytes = ~80 values.
+    sizer.update(4096, 32768, 1s);
+    EXPECT_GE(sizer.getChunkSize(), 80u);
+    EXPECT_LE(sizer.getChunkSize(), 85u);
+}
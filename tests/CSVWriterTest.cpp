@@ -0,0 +1,42 @@
+#include <gtest/gtest.h> // google test
+#include "CSVWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+TEST(CSVWriterTest, FormatRows)
+{
+    std::vector<double> time = {0, 0.001, 0.002};
+    std::vector<double> voltage = {1.5, NAN, -2e-9};
+    std::string buffer;
+    size_t length = CSVWriter::formatRows({{"t", time.data(), 1000}, {"v", voltage.data()}}, 0, 3, &buffer);
+    EXPECT_EQ(buffer.substr(0, length), "0,1.5\n1,\n2,-2e-09\n");
+}
+
+TEST(CSVWriterTest, ParallelBlocksAreWrittenInOrder)
+{
+    const size_t rows = 10007;
+    std::vector<double> values(rows);
+    for (size_t i = 0; i < rows; i++)
+        values[i] = static_cast<double>(i);
+
+    std::string path = testing::TempDir() + "csv_writer_test.csv";
+    CSVWriter writer(4, 100);
+    ASSERT_EQ(writer.open(path), PIL_NO_ERROR);
+    EXPECT_EQ(writer.writeColumns({{"index", values.data()}}, rows), PIL_NO_ERROR);
+    EXPECT_EQ(writer.close(), PIL_NO_ERROR);
+
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    EXPECT_EQ(line, "index");
+    for (size_t i = 0; i < rows; i++) {
+        ASSERT_TRUE(std::getline(file, line));
+        EXPECT_EQ(line, std::to_string(i));
+    }
+    EXPECT_FALSE(std::getline(file, line));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,29 @@
+#include <gtest/gtest.h> // google test
+#include "CommandBuilder.h"
+
+TEST(CommandBuilderTest, BuildsAttributeAssignment)
+{
+    CommandBuilder builder;
+    builder.Add("smu").Add('a').Add(".source.levelv = ").Add(0.5);
+    EXPECT_EQ(builder.view(), "smua.source.levelv = 0.5");
+}
+
+TEST(CommandBuilderTest, FormatsNumbersWithoutPrecisionLoss)
+{
+    CommandBuilder builder;
+    builder.Add(1e-9).Add(',').Add(-3).Add(',').Add(static_cast<size_t>(65536));
+    EXPECT_EQ(builder.view(), "1e-09,-3,65536");
+}
+
+TEST(CommandBuilderTest, ClearKeepsCapacity)
+{
+    CommandBuilder builder(16);
+    builder.Add("printbuffer(1, 100, A_M_BUFFER)");
+    auto capacity = builder.str().capacity();
+    builder.clear();
+    EXPECT_TRUE(builder.empty());
+    EXPECT_EQ(builder.str().capacity(), capacity);
+
+    builder.Add(std::string_view("print(reading)"));
+    EXPECT_EQ(builder.view(), "print(reading)");
+}
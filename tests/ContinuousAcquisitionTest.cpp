@@ -0,0 +1,122 @@
+#include <gtest/gtest.h> // google test
+#include "ContinuousAcquisition.h"
+#include "FakeInstrument.h"
+
+#include "ctlib/Logging.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Oscilloscope, which completes an acquisition of four BYTE samples immediately after every SINGLE.
+ */
+class FakeOscilloscope
+{
+public:
+    FakeOscilloscope() : m_Instrument([this](const std::string &line) { return answer(line); }) {}
+
+    /** Stops answering the state query, e.g. to simulate a device which was switched off. **/
+    void stopAnswering() { m_Answering.store(false); }
+
+    [[nodiscard]] bool waitForLine(const std::string &line) const { return m_Instrument.waitForLine(line); }
+
+private:
+    std::string answer(const std::string &line) {
+        if (line.find("PREamble?") != std::string::npos)
+            return "0,0,4,1,1e-6,0,0,0.5,0,0";
+        if (line == ":OPERegister:CONDition?")
+            return m_Answering.load() ? "0" : "";
+        if (line == ":WAVeform:DATA?")
+            return std::string("#14") + std::string("\x01\x02\x03\x04", 4);
+        return "";
+    }
+
+    std::atomic<bool> m_Answering{true};
+    FakeInstrument m_Instrument;
+};
+
+/**
+ * @brief Waits until the condition is true.
+ * @return false if the condition is still false after one second.
+ */
+template<typename Condition>
+static bool waitUntil(Condition condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(ContinuousAcquisitionTest, FramesAreDroppedWhileConsumerIsBusy)
+{
+    FakeOscilloscope oscilloscope;
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 device("127.0.0.1", 200, &logger);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    ContinuousAcquisition acquisition(&device, 2);
+    ASSERT_EQ(acquisition.start(), PIL_NO_ERROR);
+    // Nothing is consumed, so both frames are published and all further acquisitions are dropped.
+    ASSERT_TRUE(waitUntil([&]() { return acquisition.getDroppedCount() >= 3; }));
+
+    const WaveformFrame *frame = acquisition.nextFrame(100);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->sequence, 0);
+    ASSERT_EQ(frame->voltages.size(), 4);
+    EXPECT_FLOAT_EQ(frame->voltages[1], 1.0f);
+    acquisition.releaseFrame();
+    frame = acquisition.nextFrame(100);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->sequence, 1);
+    acquisition.releaseFrame();
+
+    EXPECT_EQ(acquisition.stop(), PIL_NO_ERROR);
+    EXPECT_FALSE(acquisition.isRunning());
+    EXPECT_GE(acquisition.getAcquiredCount(), acquisition.getDroppedCount() + 2);
+    EXPECT_TRUE(oscilloscope.waitForLine("STOP"));
+}
+
+TEST(ContinuousAcquisitionTest, CallbackExceptionStopsAcquisition)
+{
+    FakeOscilloscope oscilloscope;
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 device("127.0.0.1", 200, &logger);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    ContinuousAcquisition acquisition(&device, 2);
+    std::atomic<int> calls{0};
+    ASSERT_EQ(acquisition.start([&](const WaveformFrame &) {
+        calls++;
+        throw std::runtime_error("disk full");
+    }), PIL_NO_ERROR);
+
+    ASSERT_TRUE(waitUntil([&]() { return !acquisition.isRunning(); }));
+    EXPECT_NE(acquisition.stop(), PIL_NO_ERROR);
+    EXPECT_EQ(acquisition.getLastErrorMessage(), "disk full");
+    EXPECT_EQ(calls.load(), 1);
+    EXPECT_TRUE(oscilloscope.waitForLine("STOP"));
+}
+
+TEST(ContinuousAcquisitionTest, DeviceErrorStopsAcquisition)
+{
+    FakeOscilloscope oscilloscope;
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 device("127.0.0.1", 100, &logger);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    ContinuousAcquisition acquisition(&device, 2);
+    ASSERT_EQ(acquisition.start([](const WaveformFrame &) {}), PIL_NO_ERROR);
+    ASSERT_TRUE(waitUntil([&]() { return acquisition.getAcquiredCount() > 0; }));
+
+    // The state query times out, which ends the acquisition thread instead of terminating the process.
+    oscilloscope.stopAnswering();
+    ASSERT_TRUE(waitUntil([&]() { return !acquisition.isRunning(); }));
+    EXPECT_NE(acquisition.stop(), PIL_NO_ERROR);
+    EXPECT_NE(acquisition.getLastError(), PIL_NO_ERROR);
+}
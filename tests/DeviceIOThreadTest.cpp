@@ -0,0 +1,100 @@
+#include <gtest/gtest.h> // google test
+#include "DeviceIOThread.h"
+#include "MPSCQueue.h"
+#include "Device.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+TEST(DeviceIOThreadTest, QueueKeepsOrderOfEachProducer)
+{
+    MPSCQueue<int> queue;
+    const int producerCount = 4;
+    const int valuesPerProducer = 10000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < valuesPerProducer; i++)
+                queue.push(p * valuesPerProducer + i);
+        });
+    }
+
+    std::vector<int> lastValue(producerCount, -1);
+    int received = 0;
+    while (received < producerCount * valuesPerProducer) {
+        int value;
+        if (!queue.pop(&value))
+            continue;
+        int producer = value / valuesPerProducer;
+        EXPECT_GT(value, lastValue[producer]);
+        lastValue[producer] = value;
+        received++;
+    }
+    for (auto &producer: producers)
+        producer.join();
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(DeviceIOThreadTest, HighPriorityTasksRunFirst)
+{
+    DeviceIOThread ioThread;
+    std::promise<void> release;
+    auto blocker = release.get_future().share();
+    std::vector<int> order;
+
+    // Block the thread, so the following tasks are queued before any of them is executed.
+    ioThread.submit([blocker]() { blocker.wait(); });
+    ioThread.submit([&order]() { order.push_back(1); });
+    ioThread.submit([&order]() { order.push_back(2); });
+    ioThread.submit([&order]() { order.push_back(0); }, DeviceIOThread::HIGH_PRIORITY_LANE);
+    release.set_value();
+    ioThread.stop();
+
+    EXPECT_EQ(order, std::vector<int>({0, 1, 2}));
+}
+
+TEST(DeviceIOThreadTest, SubmitReturnsFuture)
+{
+    Device device("127.0.0.1", 1000, nullptr, Device::DIRECT_SEND, false);
+
+    // Without I/O thread the function is executed immediately.
+    EXPECT_EQ(device.Submit([]() { return 1; }).get(), 1);
+
+    device.startIOThread();
+    auto callerThread = std::this_thread::get_id();
+    auto future = device.Submit([callerThread]() { return std::this_thread::get_id() != callerThread; });
+    EXPECT_TRUE(future.get());
+
+    auto failing = device.Submit([]() -> int { throw std::runtime_error("failed"); });
+    EXPECT_THROW(failing.get(), std::runtime_error);
+    device.stopIOThread();
+    EXPECT_FALSE(device.isIOThreadRunning());
+}
+
+TEST(DeviceIOThreadTest, SubmitWaitsWhileIOThreadStops)
+{
+    Device device("127.0.0.1", 1000, nullptr, Device::DIRECT_SEND, false);
+    device.startIOThread();
+
+    std::atomic<bool> busy{false};
+    auto queued = device.Submit([&busy]() {
+        busy.store(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        busy.store(false);
+    });
+    while (!busy.load())
+        std::this_thread::yield();
+    std::thread stopper([&device]() { device.stopIOThread(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // The queued function still runs on the I/O thread, so this one must not be executed concurrently.
+    auto overlapping = device.Submit([&busy]() { return busy.load(); });
+    EXPECT_FALSE(overlapping.get());
+    stopper.join();
+    queued.get();
+    EXPECT_FALSE(device.isIOThreadRunning());
+}
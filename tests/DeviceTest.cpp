@@ -1,5 +1,6 @@
 #include <gtest/gtest.h> // google test
 #include "Device.h"
+#include "FakeInstrument.h"
 
 #include <ctlib/Exception.h>
 #include <thread>
@@ -82,6 +83,87 @@ TEST(DeviceTest, TestDisconnect)
     EXPECT_EQ(ret, PIL_NO_ERROR);
 }
 
+TEST(DeviceTest, ParseBinaryBlockHeader)
+{
+    size_t length;
+    EXPECT_TRUE(Device::parseBinaryBlockHeader("#800001000", &length));
+    EXPECT_EQ(length, 1000);
+    EXPECT_TRUE(Device::parseBinaryBlockHeader("#3512", &length));
+    EXPECT_EQ(length, 512);
+    EXPECT_TRUE(Device::parseBinaryBlockHeader("#0", &length));
+    EXPECT_EQ(length, 0);
+
+    EXPECT_FALSE(Device::parseBinaryBlockHeader("#35", &length));
+    EXPECT_FALSE(Device::parseBinaryBlockHeader("#2a1", &length));
+    EXPECT_FALSE(Device::parseBinaryBlockHeader("800001000", &length));
+}
+
+TEST(DeviceTest, RepliesAreReturnedInReceiveOrder)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        if (line == "print(1) print(2)")
+            return "1\n2";
+        if (line == "print(3)")
+            return "3";
+        return "";
+    }, 0);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    Device device("127.0.0.1", 0, instrument.getPort(), 1000, &logger, Device::DIRECT_SEND, false);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    // Both lines are received with a single read, the second one is kept in the receive buffer.
+    auto ticket = device.ExecAsync("print(1) print(2)");
+    std::string result;
+    EXPECT_EQ(device.GetResult(ticket, &result), PIL_NO_ERROR);
+    EXPECT_EQ(result, "1");
+
+    EXPECT_EQ(device.Exec("print(3)", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "2\n");
+    EXPECT_EQ(device.Exec("print(3)", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "3\n");
+}
+
+TEST(DeviceTest, UnwritableBinaryBlockIsDiscarded)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        if (line == ":WAV:DATA?")
+            return "#211binary\ndata";
+        if (line == "*IDN?")
+            return "ID";
+        return "";
+    }, 0);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    Device device("127.0.0.1", 0, instrument.getPort(), 1000, &logger, Device::DIRECT_SEND, false);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    EXPECT_EQ(device.QueryBinaryBlockToFile(":WAV:DATA?", "/nonexistent/directory/block.bin"), PIL_NO_SUCH_FILE);
+    // The block including its terminator was consumed, so the next reply is not mixed up with it.
+    std::string result;
+    EXPECT_EQ(device.Exec("*IDN?", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "ID\n");
+}
+
+TEST(DeviceTest, MissingPipelinedReplyClosesConnection)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        return line == "print(1)" ? "1" : "";
+    }, 0);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    Device device("127.0.0.1", 0, instrument.getPort(), 100, &logger, Device::DIRECT_SEND, false);
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    auto first = device.ExecAsync("print(1)");
+    device.ExecAsync("print(2)");
+    device.ExecAsync("print(1)");
+    EXPECT_NE(device.Flush(), PIL_NO_ERROR);
+    EXPECT_FALSE(device.isOpen());
+
+    std::string result;
+    EXPECT_EQ(device.GetResult(first, &result), PIL_NO_ERROR);
+    EXPECT_EQ(result, "1");
+    EXPECT_EQ(device.Exec("print(1)", nullptr, &result, true), PIL_INTERFACE_CLOSED);
+}
+
 /*TEST(DeviceTest, IdentificationTest)
 {
     std::string address = "127.0.0.1";
@@ -148,3 +230,86 @@ TEST(DeviceTest, TestSimpleExecution)
     EXPECT_EQ(returnCode, PIL_NO_ERROR);
     EXPECT_EQ("Ret\n", result);
 }*/
+
+/**
+ * @brief Exposes the state shadow, which is only used by the setters of the derived devices.
+ */
+class StateShadowDevice : public Device
+{
+public:
+    explicit StateShadowDevice(PIL::Logging *logger, int port = 0)
+            : Device("127.0.0.1", 0, port, 1000, logger, Device::DIRECT_SEND, false) {}
+    using Device::isStateUnchanged;
+    using Device::updateState;
+    using Device::newCommand;
+};
+
+TEST(DeviceTest, StateShadow)
+{
+    PIL::Logging logger(PIL::INFO, nullptr);
+    StateShadowDevice device(&logger);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    device.updateState("smua.source.func", "smua.OUTPUT_DCVOLTS", PIL_NO_ERROR);
+    EXPECT_TRUE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1 + 1e-12));
+    EXPECT_FALSE(device.isStateUnchanged("smub.source.limitv = ", 0.1));
+    EXPECT_TRUE(device.isStateUnchanged("smua.source.func", "smua.OUTPUT_DCVOLTS"));
+
+    // A failed command leaves the setting unknown.
+    device.updateState("smua.source.limitv = ", 0.2, PIL_ERRNO);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.2));
+
+    device.invalidateState();
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.func", "smua.OUTPUT_DCVOLTS"));
+
+    device.setStateShadowEnabled(false);
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+}
+
+TEST(DeviceTest, StateShadowIsNotUsedWhileBuffering)
+{
+    PIL::Logging logger(PIL::INFO, nullptr);
+    StateShadowDevice device(&logger);
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+
+    // The buffered script may be executed after the setting was changed, so it must contain the command.
+    device.changeSendMode(Device::BUFFER_ENABLED);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+    device.changeSendMode(Device::DIRECT_SEND);
+    EXPECT_TRUE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+}
+
+TEST(DeviceTest, ResetInvalidatesStateOnEverySendPath)
+{
+    FakeInstrument instrument([](const std::string &) -> std::string { return ""; }, 0);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    StateShadowDevice device(&logger, instrument.getPort());
+    ASSERT_EQ(device.Connect(), PIL_NO_ERROR);
+
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    EXPECT_EQ(device.Exec(device.newCommand().Add("*RST")), PIL_NO_ERROR);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    device.ExecAsync("*RST", nullptr, false);
+    EXPECT_EQ(device.Flush(), PIL_NO_ERROR);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+
+    std::string commands = "*CLS\n*RST";
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    EXPECT_EQ(device.ExecCommands(commands), PIL_NO_ERROR);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    EXPECT_EQ(device.Exec("*CLS;*RST"), PIL_NO_ERROR);
+    EXPECT_FALSE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+
+    // Only complete commands are detected.
+    device.updateState("smua.source.limitv = ", 0.1, PIL_NO_ERROR);
+    EXPECT_EQ(device.Exec("print('*RSTX')"), PIL_NO_ERROR);
+    EXPECT_TRUE(device.isStateUnchanged("smua.source.limitv = ", 0.1));
+}
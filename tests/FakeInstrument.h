@@ -0,0 +1,149 @@
+/**
+ * @brief Scripted instrument on the loopback interface, used to test the devices without hardware.
+ * @authors Florian Frank
+ * @copyright University of Passau - Chair of Computer Engineering
+ */
+#ifndef INSTRUMENT_CONTROL_LIB_FAKE_INSTRUMENT_H
+#define INSTRUMENT_CONTROL_LIB_FAKE_INSTRUMENT_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Port of the SCPI socket, the devices always connect to this port. **/
+#define FAKE_INSTRUMENT_PORT 5025
+
+/**
+ * @brief Accepts one connection after the other and passes every received line to a handler, whose reply is sent
+ * back. All received lines are recorded, so tests can check the commands sent by a device.
+ */
+class FakeInstrument
+{
+public:
+    /** Returns the reply to a received line without terminating newline. An empty reply is not sent. **/
+    typedef std::function<std::string(const std::string &line)> Handler;
+
+    explicit FakeInstrument(Handler handler, uint16_t port = FAKE_INSTRUMENT_PORT)
+            : m_Handler(std::move(handler)) {
+        m_ListenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int enable = 1;
+        setsockopt(m_ListenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        bind(m_ListenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        socklen_t length = sizeof(address);
+        getsockname(m_ListenFd, reinterpret_cast<sockaddr *>(&address), &length);
+        m_Port = ntohs(address.sin_port);
+        listen(m_ListenFd, 1);
+        m_Thread = std::thread(&FakeInstrument::serve, this);
+    }
+
+    ~FakeInstrument() {
+        m_Stopped.store(true);
+        shutdown(m_ListenFd, SHUT_RDWR);
+        close(m_ListenFd);
+        int clientFd = m_ClientFd.load();
+        if (clientFd >= 0)
+            shutdown(clientFd, SHUT_RDWR);
+        m_Thread.join();
+    }
+
+    FakeInstrument(const FakeInstrument &) = delete;
+    FakeInstrument &operator=(const FakeInstrument &) = delete;
+
+    [[nodiscard]] uint16_t getPort() const { return m_Port; }
+
+    /**
+     * @brief Returns all lines received so far.
+     * @return received lines without newline.
+     */
+    std::vector<std::string> getReceivedLines() const {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_ReceivedLines;
+    }
+
+    /**
+     * @brief Waits until a line equal to the given one was received, replies are handled asynchronously.
+     * @param line line to wait for.
+     * @param timeoutInMs maximum time to wait.
+     * @return true if the line was received.
+     */
+    bool waitForLine(const std::string &line, int timeoutInMs = 1000) const {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutInMs);
+        do {
+            for (const auto &received: getReceivedLines()) {
+                if (received == line)
+                    return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } while (std::chrono::steady_clock::now() < deadline);
+        return false;
+    }
+
+    /**
+     * @brief Closes the current connection, e.g. to simulate a device which is switched off.
+     */
+    void disconnect() {
+        int clientFd = m_ClientFd.load();
+        if (clientFd >= 0)
+            shutdown(clientFd, SHUT_RDWR);
+    }
+
+private:
+    void serve() {
+        while (!m_Stopped.load()) {
+            int fd = accept(m_ListenFd, nullptr, nullptr);
+            if (fd < 0)
+                return;
+            m_ClientFd.store(fd);
+            handleConnection(fd);
+            m_ClientFd.store(-1);
+            close(fd);
+        }
+    }
+
+    void handleConnection(int fd) {
+        std::string buffer;
+        char chunk[4096];
+        ssize_t received;
+        while ((received = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+            buffer.append(chunk, received);
+            size_t position;
+            while ((position = buffer.find('\n')) != std::string::npos) {
+                std::string line = buffer.substr(0, position);
+                buffer.erase(0, position + 1);
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    m_ReceivedLines.push_back(line);
+                }
+                std::string reply = m_Handler(line);
+                if (!reply.empty()) {
+                    reply += '\n';
+                    send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+                }
+            }
+        }
+    }
+
+    Handler m_Handler;
+    int m_ListenFd;
+    uint16_t m_Port;
+    std::atomic<int> m_ClientFd{-1};
+    std::atomic<bool> m_Stopped{false};
+    mutable std::mutex m_Mutex;
+    std::vector<std::string> m_ReceivedLines;
+    std::thread m_Thread;
+};
+
+#endif //INSTRUMENT_CONTROL_LIB_FAKE_INSTRUMENT_H
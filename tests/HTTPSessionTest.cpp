@@ -0,0 +1,101 @@
+#include <gtest/gtest.h> // google test
+#include "HTTPSession.h"
+#include "FakeInstrument.h"
+
+#include <algorithm>
+#include <atomic>
+
+TEST(HTTPSessionTest, ParsesContentLengthResponse)
+{
+    int statusCode;
+    size_t contentLength;
+    bool chunked, keepAlive;
+    std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 42\r\n\r\n";
+    ASSERT_TRUE(HTTPSession::parseResponseHeader(header, &statusCode, &contentLength, &chunked, &keepAlive));
+    EXPECT_EQ(statusCode, 200);
+    EXPECT_EQ(contentLength, 42u);
+    EXPECT_FALSE(chunked);
+    EXPECT_TRUE(keepAlive);
+}
+
+TEST(HTTPSessionTest, DetectsChunkedEncodingAndConnectionClose)
+{
+    int statusCode;
+    size_t contentLength;
+    bool chunked, keepAlive;
+    std::string header = "HTTP/1.1 404 Not Found\r\ntransfer-encoding: Chunked\r\nConnection: close\r\n\r\n";
+    ASSERT_TRUE(HTTPSession::parseResponseHeader(header, &statusCode, &contentLength, &chunked, &keepAlive));
+    EXPECT_EQ(statusCode, 404);
+    EXPECT_TRUE(chunked);
+    EXPECT_FALSE(keepAlive);
+}
+
+TEST(HTTPSessionTest, RejectsInvalidStatusLine)
+{
+    int statusCode;
+    size_t contentLength;
+    bool chunked, keepAlive;
+    EXPECT_FALSE(HTTPSession::parseResponseHeader("garbage\r\n\r\n", &statusCode, &contentLength, &chunked,
+                                                  &keepAlive));
+    // HTTP/1.0 closes the connection unless keep-alive is requested explicitly.
+    ASSERT_TRUE(HTTPSession::parseResponseHeader("HTTP/1.0 200 OK\r\n\r\n", &statusCode, &contentLength, &chunked,
+                                                 &keepAlive));
+    EXPECT_FALSE(keepAlive);
+}
+
+/**
+ * @brief Web server which answers every request, but closes the connection once when the body "req2" is received.
+ */
+class DroppingServer
+{
+public:
+    DroppingServer() : m_Instrument([this](const std::string &line) { return answer(line); }, 0) {}
+
+    [[nodiscard]] uint16_t getPort() const { return m_Instrument.getPort(); }
+
+    [[nodiscard]] long countRequests(const std::string &body) const {
+        auto lines = m_Instrument.getReceivedLines();
+        return std::count(lines.begin(), lines.end(), body);
+    }
+
+private:
+    std::string answer(const std::string &line) {
+        // Bodies are terminated by a newline, so they are received as separate line after the header.
+        if (line.compare(0, 3, "req") != 0)
+            return "";
+        if (line == "req2" && !m_Dropped.exchange(true)) {
+            m_Instrument.disconnect();
+            return "";
+        }
+        return "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r";
+    }
+
+    std::atomic<bool> m_Dropped{false};
+    FakeInstrument m_Instrument;
+};
+
+TEST(HTTPSessionTest, LostConnectionDoesNotResendRequests)
+{
+    DroppingServer server;
+    HTTPSession session("127.0.0.1", server.getPort(), 1000);
+    std::vector<HTTPSession::Response> responses;
+    size_t firstUnconfirmed;
+    EXPECT_EQ(session.postPipelined("/", {"req1\n", "req2\n", "req3\n"}, &responses, false, &firstUnconfirmed),
+              PIL_INTERFACE_CLOSED);
+    EXPECT_EQ(firstUnconfirmed, 1u);
+    EXPECT_EQ(responses.size(), 1u);
+    EXPECT_EQ(server.countRequests("req2"), 1);
+}
+
+TEST(HTTPSessionTest, LostConnectionResendsIdempotentRequests)
+{
+    DroppingServer server;
+    HTTPSession session("127.0.0.1", server.getPort(), 1000);
+    std::vector<HTTPSession::Response> responses;
+    size_t firstUnconfirmed;
+    EXPECT_EQ(session.postPipelined("/", {"req1\n", "req2\n", "req3\n"}, &responses, true, &firstUnconfirmed),
+              PIL_NO_ERROR);
+    EXPECT_EQ(firstUnconfirmed, 3u);
+    EXPECT_EQ(responses.size(), 3u);
+    EXPECT_EQ(server.countRequests("req2"), 2);
+}
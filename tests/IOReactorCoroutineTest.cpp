@@ -0,0 +1,62 @@
+#include <gtest/gtest.h> // google test
+#include "IOReactor.h"
+#include "Device.h"
+#include "FakeInstrument.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Answers every line starting with "print(" with the content between the parentheses.
+ */
+static std::string echoPrint(const std::string &line) {
+    if (line.compare(0, 6, "print(") == 0)
+        return line.substr(6, line.size() - 7);
+    return "";
+}
+
+static IOReactor::Task queryAll(IOReactor &reactor, Device *device, std::vector<std::string> *replies) {
+    auto reply = co_await reactor.asyncQuery(device, "print(1)");
+    EXPECT_EQ(reply.errorCode, PIL_NO_ERROR);
+    replies->push_back(reply.value);
+
+    reply = co_await reactor.asyncQuery(device, "print(2)");
+    EXPECT_EQ(reply.errorCode, PIL_NO_ERROR);
+    replies->push_back(reply.value);
+
+    // The connection is established now, so the command is written and completed within the call of query. The
+    // coroutine ends before query returns.
+    reply = co_await reactor.asyncQuery(device, "beeper.enable = 0", false);
+    EXPECT_EQ(reply.errorCode, PIL_NO_ERROR);
+    replies->emplace_back("sent");
+}
+
+TEST(IOReactorCoroutineTest, AwaitedQueriesResumeInOrder)
+{
+    FakeInstrument instrument(echoPrint, 0);
+    Device device("127.0.0.1", 0, instrument.getPort(), 1000, nullptr, Device::DIRECT_SEND, false);
+
+    IOReactor reactor;
+    ASSERT_EQ(reactor.attach(&device), PIL_NO_ERROR);
+
+    std::vector<std::string> replies;
+    queryAll(reactor, &device, &replies);
+    EXPECT_EQ(reactor.run(), PIL_NO_ERROR);
+    EXPECT_EQ(replies, std::vector<std::string>({"1", "2", "sent"}));
+    EXPECT_TRUE(instrument.waitForLine("beeper.enable = 0"));
+}
+
+static IOReactor::Task queryDetached(IOReactor &reactor, Device *device, PIL_ERROR_CODE *errorCode) {
+    auto reply = co_await reactor.asyncQuery(device, "print(1)");
+    *errorCode = reply.errorCode;
+}
+
+TEST(IOReactorCoroutineTest, FailedQueryResumesImmediately)
+{
+    Device device("127.0.0.1", 0, FAKE_INSTRUMENT_PORT, 1000, nullptr, Device::DIRECT_SEND, false);
+    IOReactor reactor;
+
+    PIL_ERROR_CODE errorCode = PIL_NO_ERROR;
+    queryDetached(reactor, &device, &errorCode);
+    EXPECT_EQ(errorCode, PIL_INVALID_ARGUMENTS);
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h> // google test
+#include "IOReactor.h"
+#include "Device.h"
+#include "FakeInstrument.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Answers every line starting with "print(" with the content between the parentheses.
+ */
+static std::string echoPrint(const std::string &line) {
+    if (line.compare(0, 6, "print(") == 0)
+        return line.substr(6, line.size() - 7);
+    return "";
+}
+
+TEST(IOReactorTest, ExtractLine)
+{
+    std::string buffer = "1.5\r\n2.5\n3";
+    std::string line;
+    EXPECT_TRUE(IOReactor::extractLine(&buffer, &line));
+    EXPECT_EQ(line, "1.5");
+    EXPECT_TRUE(IOReactor::extractLine(&buffer, &line));
+    EXPECT_EQ(line, "2.5");
+    EXPECT_FALSE(IOReactor::extractLine(&buffer, &line));
+    EXPECT_EQ(buffer, "3");
+}
+
+TEST(IOReactorTest, PipelinedQueriesCompleteInOrder)
+{
+    FakeInstrument instrument(echoPrint, 0);
+    Device device("127.0.0.1", 0, instrument.getPort(), 1000, nullptr, Device::DIRECT_SEND, false);
+
+    IOReactor reactor;
+    ASSERT_EQ(reactor.attach(&device), PIL_NO_ERROR);
+
+    std::vector<std::string> replies;
+    EXPECT_EQ(reactor.query(&device, "beeper.enable = 0", [&](PIL_ERROR_CODE errorCode, const std::string &) {
+        EXPECT_EQ(errorCode, PIL_NO_ERROR);
+        replies.emplace_back("sent");
+    }, false), PIL_NO_ERROR);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(reactor.query(&device, "print(" + std::to_string(i) + ")",
+                                [&](PIL_ERROR_CODE errorCode, const std::string &result) {
+                                    EXPECT_EQ(errorCode, PIL_NO_ERROR);
+                                    replies.push_back(result);
+                                }), PIL_NO_ERROR);
+    }
+    EXPECT_EQ(reactor.getPendingCount(), 4);
+
+    EXPECT_EQ(reactor.run(), PIL_NO_ERROR);
+    EXPECT_EQ(replies, std::vector<std::string>({"sent", "0", "1", "2"}));
+    EXPECT_EQ(reactor.detach(&device), PIL_NO_ERROR);
+}
+
+TEST(IOReactorTest, MissingReplyTimesOut)
+{
+    FakeInstrument instrument(echoPrint, 0);
+    Device device("127.0.0.1", 0, instrument.getPort(), 100, nullptr, Device::DIRECT_SEND, false);
+
+    IOReactor reactor;
+    ASSERT_EQ(reactor.attach(&device), PIL_NO_ERROR);
+
+    PIL_ERROR_CODE result = PIL_NO_ERROR;
+    reactor.query(&device, "smua.source.levelv = 1", [&](PIL_ERROR_CODE errorCode, const std::string &) {
+        result = errorCode;
+    });
+    EXPECT_EQ(reactor.run(), PIL_NO_ERROR);
+    EXPECT_EQ(result, PIL_TIMEOUT);
+}
@@ -0,0 +1,27 @@
+#include <gtest/gtest.h> // google test
+#include "devices/KEI2600Commands.h"
+
+using namespace KEI2600Commands;
+
+static_assert(Command<SMU::CHANNEL_A, SMU::VOLTAGE, SOURCE_LEVEL>::view() == "smua.source.levelv = ");
+static_assert(Command<SMU::CHANNEL_B, SMU::POWER, SOURCE_LIMIT>::view() == "smub.source.limitp = ");
+
+TEST(KEI2600CommandsTest, GeneratesPrefixesAtCompileTime)
+{
+    EXPECT_EQ((Command<SMU::CHANNEL_B, SMU::CURRENT, MEASURE_LOW_RANGE>::view()), "smub.measure.lowrangei = ");
+    EXPECT_EQ((Command<SMU::CHANNEL_A, SMU::VOLTAGE, MEASURE_NPLC>::view()), "smua.measure.nplc = ");
+}
+
+TEST(KEI2600CommandsTest, RuntimeLookupMatchesTemplates)
+{
+    EXPECT_EQ(getCommandPrefix(SMU::CHANNEL_A, SMU::CURRENT, SOURCE_RANGE),
+              (Command<SMU::CHANNEL_A, SMU::CURRENT, SOURCE_RANGE>::view()));
+    EXPECT_EQ(getCommandPrefix(SMU::CHANNEL_B, SMU::VOLTAGE, MEASURE_RANGE), "smub.measure.rangev = ");
+}
+
+TEST(KEI2600CommandsTest, RuntimeLookupRejectsInvalidCombinations)
+{
+    EXPECT_TRUE(getCommandPrefix(SMU::CHANNEL_A, SMU::POWER, SOURCE_LEVEL).empty());
+    EXPECT_TRUE(getCommandPrefix(SMU::CHANNEL_A, SMU::RESISTANCE, SOURCE_LIMIT).empty());
+    EXPECT_TRUE(getCommandPrefix(static_cast<SMU::SMU_CHANNEL>('c'), SMU::VOLTAGE, SOURCE_LEVEL).empty());
+}
@@ -0,0 +1,278 @@
+#include <gtest/gtest.h> // google test
+#include "devices/KEI2600.h"
+#include "FakeInstrument.h"
+
+#include <ctlib/Exception.h>
+#include "ctlib/Logging.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <vector>
+
+TEST(KEI2600Test, BinaryFormatIsRestoredAfterException)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        if (line == "print(A_M_BUFFER.n)")
+            return "4";
+        // Only a part of the four REAL64 values is sent, so the transfer times out.
+        if (line.compare(0, 12, "printbuffer(") == 0)
+            return std::string("#0") + std::string(8, '\0');
+        return "";
+    });
+
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 200, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+    smu.setBufferFormat(KEI2600::REAL64_FORMAT);
+
+    std::vector<double> values;
+    EXPECT_THROW(smu.readBuffer("A_M_BUFFER", &values, false), PIL::Exception);
+    EXPECT_TRUE(instrument.waitForLine("format.data = format.REAL64"));
+    EXPECT_TRUE(instrument.waitForLine("format.data = format.ASCII"));
+}
+
+TEST(KEI2600Test, BinaryBlockOfUnexpectedLengthIsDiscarded)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        if (line == "print(A_M_BUFFER.n)")
+            return "2";
+        // Only one of the two REAL64 values is sent.
+        if (line.compare(0, 12, "printbuffer(") == 0)
+            return std::string("#18") + std::string(8, '\n');
+        if (line == "print(1)")
+            return "1";
+        return "";
+    });
+
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+    smu.setBufferFormat(KEI2600::REAL64_FORMAT);
+
+    std::vector<double> values;
+    EXPECT_THROW(smu.readBuffer("A_M_BUFFER", &values, false), PIL::Exception);
+    std::string result;
+    EXPECT_EQ(smu.Exec("print(1)", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "1\n");
+}
+
+/**
+ * @brief Answers the upload handshake with an empty error queue and every sweep successfully.
+ */
+static std::string answerSweep(const std::string &line) {
+    if (line.compare(0, 23, "print('ICL_UPLOAD_DONE_") == 0)
+        return line.substr(7, line.find('\'', 7) - 7) + "\t0.00000e+00";
+    if (line.compare(0, 18, "print(pcall(icl_sw") == 0)
+        return "true";
+    return "";
+}
+
+static size_t countLines(const FakeInstrument &instrument, const std::string &line) {
+    size_t count = 0;
+    for (const auto &received: instrument.getReceivedLines())
+        count += received == line;
+    return count;
+}
+
+TEST(KEI2600Test, SweepEngineIsLoadedAgainAfterReset)
+{
+    FakeInstrument instrument(answerSweep);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    KEI2600::SweepConfig config;
+    config.stop = 1;
+    config.points = 11;
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLines(instrument, "ICLSweepEngine()"), 1);
+
+    // Running a script changes settings, but does not undefine the functions of the engine.
+    EXPECT_EQ(smu.executeScript("vectorScript", false), PIL_NO_ERROR);
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLines(instrument, "ICLSweepEngine()"), 1);
+
+    smu.Exec("*RST");
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLines(instrument, "ICLSweepEngine()"), 2);
+
+    smu.Disconnect();
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLines(instrument, "ICLSweepEngine()"), 3);
+}
+
+TEST(KEI2600Test, BufferedSweepIsAppendedToScript)
+{
+    FakeInstrument instrument(answerSweep);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    smu.changeSendMode(Device::BUFFER_ENABLED);
+    EXPECT_EQ(smu.performLinearVoltageSweep(SMU::CHANNEL_A, 0, 0.42, 18, 0.001, false), PIL_NO_ERROR);
+    smu.changeSendMode(Device::DIRECT_SEND);
+
+    // The engine is uploaded immediately, the sweep is only called when the buffered script is executed.
+    EXPECT_EQ(countLines(instrument, "ICLSweepEngine()"), 1);
+    auto script = smu.getBufferedScript();
+    EXPECT_NE(script.find("icl_sweep(smua, true, "), std::string::npos);
+    EXPECT_EQ(script.find("pcall"), std::string::npos);
+    for (const auto &line: instrument.getReceivedLines())
+        EXPECT_EQ(line.find("icl_sweep(smua"), std::string::npos);
+}
+
+TEST(KEI2600Test, TSPResetInvalidatesState)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string { return line == "print(1)" ? "1" : ""; });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    // Lines are handled in order, so all previous lines were received once the reply arrives.
+    auto countLimits = [&instrument, &smu]() {
+        std::string result;
+        EXPECT_EQ(smu.Exec("print(1)", nullptr, &result, true), PIL_NO_ERROR);
+        size_t count = 0;
+        for (const auto &line: instrument.getReceivedLines())
+            count += line.compare(0, 21, "smua.source.limitv = ") == 0;
+        return count;
+    };
+    EXPECT_EQ(smu.setLimit(SMU::VOLTAGE, SMU::CHANNEL_A, 1, false), PIL_NO_ERROR);
+    EXPECT_EQ(smu.setLimit(SMU::VOLTAGE, SMU::CHANNEL_A, 1, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLimits(), 1);
+
+    smu.Exec("smua.reset()");
+    EXPECT_EQ(smu.setLimit(SMU::VOLTAGE, SMU::CHANNEL_A, 1, false), PIL_NO_ERROR);
+    smu.Exec("reset()");
+    EXPECT_EQ(smu.setLimit(SMU::VOLTAGE, SMU::CHANNEL_A, 1, false), PIL_NO_ERROR);
+    smu.Exec("*CLS;*RST");
+    EXPECT_EQ(smu.setLimit(SMU::VOLTAGE, SMU::CHANNEL_A, 1, false), PIL_NO_ERROR);
+    EXPECT_EQ(countLimits(), 4);
+}
+
+TEST(KEI2600Test, SweepPeriodMustExceedIntegrationTime)
+{
+    FakeInstrument instrument(answerSweep);
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    KEI2600::SweepConfig config;
+    config.stop = 1;
+    config.points = 11;
+    config.nplc = 1;
+    config.period = 0.001;
+    EXPECT_THROW(smu.performSweep(SMU::CHANNEL_A, config, false), PIL::Exception);
+
+    // Without measurements only the source is stepped, so the period is independent of the integration time.
+    config.measure = false;
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+}
+
+TEST(KEI2600Test, ScriptUploadFailsOnLoadError)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        // The script itself prints a line, then loading it fails with a syntax error.
+        if (line.compare(0, 23, "print('ICL_UPLOAD_DONE_") == 0)
+            return "output of the script\nICL_UPLOAD_DONE_ICLSweepEngine\t1.00000e+00";
+        return "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    KEI2600::SweepConfig config;
+    config.stop = 1;
+    config.points = 11;
+    EXPECT_THROW(smu.performSweep(SMU::CHANNEL_A, config, false), PIL::Exception);
+    EXPECT_THROW(smu.performSweep(SMU::CHANNEL_A, config, false), PIL::Exception);
+    // The failed upload is neither cached nor marked as loaded, so it is retried.
+    size_t uploads = 0;
+    for (const auto &line: instrument.getReceivedLines())
+        uploads += line == "loadscript ICLSweepEngine";
+    EXPECT_EQ(uploads, 2);
+}
+
+TEST(KEI2600Test, ScriptUploadIgnoresPreviousErrors)
+{
+    // One error was left in the queue by a previous command, the upload itself does not add errors.
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        if (line.compare(0, 23, "print('ICL_UPLOAD_DONE_") == 0) {
+            bool relative = line.find("errorqueue.count - icl_upload_error_count") != std::string::npos;
+            return line.substr(7, line.find('\'', 7) - 7) + (relative ? "\t0.00000e+00" : "\t1.00000e+00");
+        }
+        if (line.compare(0, 18, "print(pcall(icl_sw") == 0)
+            return "true";
+        return "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+
+    KEI2600::SweepConfig config;
+    config.stop = 1;
+    config.points = 11;
+    EXPECT_EQ(smu.performSweep(SMU::CHANNEL_A, config, false), PIL_NO_ERROR);
+
+    // The error count is taken before the script is loaded.
+    auto lines = instrument.getReceivedLines();
+    auto load = std::find(lines.begin(), lines.end(), "loadscript ICLSweepEngine");
+    ASSERT_NE(load, lines.end());
+    ASSERT_NE(load, lines.begin());
+    EXPECT_EQ(*(load - 1), "icl_upload_error_count = errorqueue.count");
+}
+
+TEST(KEI2600Test, PriorityTasksDuringBinaryDownloadUseASCII)
+{
+    KEI2600 *device = nullptr;
+    std::future<PIL_ERROR_CODE> turnOff;
+    FakeInstrument instrument([&](const std::string &line) -> std::string {
+        if (line == "print(A_M_BUFFER.n)")
+            return "10000";
+        if (line.compare(0, 12, "printbuffer(") == 0) {
+            // Submitted while the first chunk is transferred, so it is executed between two chunks.
+            if (!turnOff.valid())
+                turnOff = device->Submit([device]() { return device->Exec("smua.source.output = 0"); },
+                                         Device::HIGH_PRIORITY);
+            int startIdx, endIdx;
+            sscanf(line.c_str(), "printbuffer(%d, %d", &startIdx, &endIdx);
+            return "#0" + std::string((endIdx - startIdx + 1) * sizeof(double), '\0');
+        }
+        if (line == "print(1)")
+            return "1";
+        return "";
+    });
+
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KEI2600 smu("127.0.0.1", 1000, &logger);
+    device = &smu;
+    ASSERT_EQ(smu.Connect(), PIL_NO_ERROR);
+    smu.setBufferFormat(KEI2600::REAL64_FORMAT);
+    smu.startIOThread();
+
+    std::vector<double> values;
+    auto download = smu.Submit([&]() { return smu.readBuffer("A_M_BUFFER", &values, false); });
+    EXPECT_EQ(download.get(), PIL_NO_ERROR);
+    EXPECT_EQ(values.size(), 10000);
+    ASSERT_TRUE(turnOff.valid());
+    EXPECT_EQ(turnOff.get(), PIL_NO_ERROR);
+    smu.stopIOThread();
+    // Lines are handled in order, so all previous lines were received once the reply arrives.
+    std::string result;
+    EXPECT_EQ(smu.Exec("print(1)", nullptr, &result, true), PIL_NO_ERROR);
+
+    auto lines = instrument.getReceivedLines();
+    auto turnOffLine = std::find(lines.begin(), lines.end(), "smua.source.output = 0");
+    ASSERT_NE(turnOffLine, lines.end());
+    EXPECT_EQ(*(turnOffLine - 1), "format.data = format.ASCII");
+    EXPECT_EQ(*(turnOffLine + 1), "format.data = format.REAL64");
+    auto lastFormat = std::find_if(lines.rbegin(), lines.rend(), [](const std::string &line) {
+        return line.compare(0, 11, "format.data") == 0;
+    });
+    ASSERT_NE(lastFormat, lines.rend());
+    EXPECT_EQ(*lastFormat, "format.data = format.ASCII");
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h> // google test
+#include "devices/KST3000.h"
+#include "FakeInstrument.h"
+
+#include <ctlib/Exception.h>
+#include "ctlib/Logging.h"
+
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Counts the queries of the number of waveform points received by the instrument.
+ */
+static size_t countPointsQueries(const FakeInstrument &instrument) {
+    size_t count = 0;
+    for (const auto &line: instrument.getReceivedLines())
+        count += line.find("POINts?") != std::string::npos;
+    return count;
+}
+
+TEST(KST3000Test, SettingsCacheIsClearedWithDeviceState)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        return line.find("POINts?") != std::string::npos ? "1000" : "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 scope("127.0.0.1", 200, &logger);
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+
+    int points = 0;
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(points, 1000);
+    EXPECT_EQ(countPointsQueries(instrument), 1);
+
+    scope.Exec("*RST");
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(countPointsQueries(instrument), 2);
+
+    scope.Disconnect();
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(countPointsQueries(instrument), 3);
+}
+
+TEST(KST3000Test, UnknownPointsModeDependsOnAcquisition)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        return line.find("POINts?") != std::string::npos ? "1000" : "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 scope("127.0.0.1", 200, &logger);
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+
+    // The points mode may have been changed on the front panel, so the points are queried after every acquisition.
+    int points = 0;
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    scope.single();
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(countPointsQueries(instrument), 2);
+
+    std::string mode = "NORMal";
+    EXPECT_EQ(scope.setWaveformPointsMode(mode), PIL_NO_ERROR);
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    scope.single();
+    EXPECT_EQ(scope.getWaveformPoints(&points), PIL_NO_ERROR);
+    EXPECT_EQ(countPointsQueries(instrument), 3);
+}
+
+TEST(KST3000Test, SegmentOfUnexpectedLengthClosesConnection)
+{
+    int index = 0;
+    FakeInstrument instrument([&index](const std::string &line) -> std::string {
+        if (line.find("PREamble?") != std::string::npos)
+            return "0,0,4,1,1e-6,0,0,0.5,0,0";
+        if (line == ":WAVeform:SEGMented:COUNt?")
+            return "3";
+        if (sscanf(line.c_str(), ":ACQuire:SEGMented:INDex %d;", &index) == 1)
+            return "0.1";
+        // The second segment is shorter than the first one.
+        if (line == ":WAVeform:DATA?")
+            return index == 2 ? "#13abc" : std::string("#14") + std::string("\x01\x02\x03\x04", 4);
+        if (line == "*IDN?")
+            return "ID";
+        return "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 scope("127.0.0.1", 200, &logger);
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+
+    SegmentedWaveform waveform;
+    EXPECT_THROW(scope.getSegmentedData(&waveform), PIL::Exception);
+    // The rest of the block and the pipelined replies can not be matched anymore, so they are not returned as reply.
+    EXPECT_FALSE(scope.isOpen());
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+    std::string result;
+    EXPECT_EQ(scope.Exec("*IDN?", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "ID\n");
+}
+
+TEST(KST3000Test, InvalidChannelPreambleClosesConnection)
+{
+    FakeInstrument instrument([](const std::string &line) -> std::string {
+        // The preamble of the first channel can not be parsed, the second channel is answered as usual.
+        if (line == ":WAVeform:SOURce CHANnel1;:WAVeform:PREamble?")
+            return "garbage";
+        if (line.find("PREamble?") != std::string::npos)
+            return "0,0,4,1,1e-6,0,0,0.5,0,0";
+        if (line == ":WAVeform:DATA?")
+            return std::string("#14") + std::string("\x01\x02\x03\x04", 4);
+        if (line == "*IDN?")
+            return "ID";
+        return "";
+    });
+    PIL::Logging logger(PIL::INFO, nullptr);
+    KST3000 scope("127.0.0.1", 200, &logger);
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+
+    MultiChannelFrame frame;
+    EXPECT_THROW(scope.getMultiChannelData({Oscilloscope::CHANNEL_1, Oscilloscope::CHANNEL_2}, &frame),
+                 PIL::Exception);
+    EXPECT_FALSE(scope.isOpen());
+    ASSERT_EQ(scope.Connect(), PIL_NO_ERROR);
+    std::string result;
+    EXPECT_EQ(scope.Exec("*IDN?", nullptr, &result, true), PIL_NO_ERROR);
+    EXPECT_EQ(result, "ID\n");
+}
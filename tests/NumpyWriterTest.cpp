@@ -0,0 +1,111 @@
+#include <gtest/gtest.h> // google test
+#include "NumpyWriter.h"
+#include "JSONMetadata.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static std::string readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static uint32_t readLittleEndian(const std::string &data, size_t offset, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i])) << (8 * i);
+    return value;
+}
+
+TEST(NumpyWriterTest, HeaderIsAligned)
+{
+    std::string header = NumpyWriter::createHeader("<f8", 1234);
+    EXPECT_EQ(header.size() % 64, 0u);
+    EXPECT_EQ(header.substr(0, 6), "\x93NUMPY");
+    EXPECT_EQ(readLittleEndian(header, 8, 2), header.size() - 10);
+    EXPECT_EQ(header.back(), '\n');
+    EXPECT_NE(header.find("'descr': '<f8', 'fortran_order': False, 'shape': (1234,), }"), std::string::npos);
+}
+
+TEST(NumpyWriterTest, CRC32)
+{
+    const char *check = "123456789";
+    auto data = reinterpret_cast<const uint8_t *>(check);
+    EXPECT_EQ(NumpyWriter::crc32(data, 9), 0xCBF43926u);
+    EXPECT_EQ(NumpyWriter::crc32(data + 4, 5, NumpyWriter::crc32(data, 4)), 0xCBF43926u);
+}
+
+TEST(NumpyWriterTest, WriteNpy)
+{
+    std::vector<double> values = {1.5, -2, 1e-12};
+    std::string path = testing::TempDir() + "numpy_writer_test.npy";
+    ASSERT_EQ(NumpyWriter::writeNpy(path, values.data(), values.size()), PIL_NO_ERROR);
+
+    std::string content = readFile(path);
+    std::string header = NumpyWriter::createHeader("<f8", values.size());
+    ASSERT_EQ(content.size(), header.size() + sizeof(double) * values.size());
+    EXPECT_EQ(content.substr(0, header.size()), header);
+    EXPECT_EQ(std::memcmp(content.data() + header.size(), values.data(), sizeof(double) * values.size()), 0);
+}
+
+TEST(NumpyWriterTest, WriteNpz)
+{
+    std::vector<double> time = {0, 1e-9, 2e-9};
+    std::vector<float> voltage = {0.5f, 0.25f, 0.125f};
+    std::vector<uint8_t> valid = {1, 0, 1};
+    std::string path = testing::TempDir() + "numpy_writer_test.npz";
+
+    NumpyWriter writer;
+    ASSERT_EQ(writer.open(path), PIL_NO_ERROR);
+    EXPECT_EQ(writer.addArray("time", time.data(), time.size()), PIL_NO_ERROR);
+    EXPECT_EQ(writer.addArray("voltage", voltage.data(), voltage.size()), PIL_NO_ERROR);
+    EXPECT_EQ(writer.addBoolArray("valid", valid.data(), valid.size()), PIL_NO_ERROR);
+    EXPECT_EQ(writer.close(), PIL_NO_ERROR);
+    EXPECT_EQ(writer.addArray("time", time.data(), time.size()), PIL_INTERFACE_CLOSED);
+
+    std::string content = readFile(path);
+    ASSERT_GE(content.size(), 22u);
+    size_t end = content.size() - 22;
+    ASSERT_EQ(readLittleEndian(content, end, 4), 0x06054b50u);
+    ASSERT_EQ(readLittleEndian(content, end + 10, 2), 3u);
+    size_t directory = readLittleEndian(content, end + 16, 4);
+    EXPECT_EQ(directory + readLittleEndian(content, end + 12, 4), end);
+
+    // Every central directory entry points to a local header, whose data matches size and checksum.
+    std::vector<std::string> names;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(readLittleEndian(content, directory, 4), 0x02014b50u);
+        uint32_t crc = readLittleEndian(content, directory + 16, 4);
+        uint32_t size = readLittleEndian(content, directory + 20, 4);
+        uint32_t nameLength = readLittleEndian(content, directory + 28, 2);
+        uint32_t offset = readLittleEndian(content, directory + 42, 4);
+        names.push_back(content.substr(directory + 46, nameLength));
+
+        ASSERT_EQ(readLittleEndian(content, offset, 4), 0x04034b50u);
+        size_t data = offset + 30 + nameLength;
+        EXPECT_EQ(NumpyWriter::crc32(reinterpret_cast<const uint8_t *>(content.data() + data), size), crc);
+        directory += 46 + nameLength;
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"time.npy", "voltage.npy", "valid.npy"}));
+}
+
+TEST(JSONMetadataTest, ToString)
+{
+    JSONMetadata preamble;
+    preamble.add("points", 1000).add("xIncrement", 1e-9).add("yOrigin", NAN);
+
+    JSONMetadata metadata;
+    metadata.add("instrument", "KEYSIGHT,\"DSOX\"\t1").add("bigEndian", true).add("preamble", preamble);
+    EXPECT_EQ(metadata.toString(), "{\"instrument\": \"KEYSIGHT,\\\"DSOX\\\"\\t1\", \"bigEndian\": true, "
+                                   "\"preamble\": {\"points\": 1000, \"xIncrement\": 1e-09, \"yOrigin\": null}}");
+}
+
+TEST(JSONMetadataTest, SidecarPath)
+{
+    EXPECT_EQ(JSONMetadata::getSidecarPath("capture.npz"), "capture.json");
+    EXPECT_EQ(JSONMetadata::getSidecarPath("/data/run.1/capture"), "/data/run.1/capture.json");
+    EXPECT_EQ(JSONMetadata::getSidecarPath("/data/capture.v2.npz"), "/data/capture.v2.json");
+}
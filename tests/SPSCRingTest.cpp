@@ -0,0 +1,73 @@
+#include <gtest/gtest.h> // google test
+#include "SPSCRing.h"
+
+#include <thread>
+#include <vector>
+
+TEST(SPSCRingTest, FullAndEmpty)
+{
+    SPSCRing<int> ring(2);
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(ring.beginRead(), nullptr);
+
+    *ring.beginWrite() = 1;
+    ring.endWrite();
+    *ring.beginWrite() = 2;
+    ring.endWrite();
+    EXPECT_EQ(ring.beginWrite(), nullptr);
+
+    ASSERT_NE(ring.beginRead(), nullptr);
+    EXPECT_EQ(*ring.beginRead(), 1);
+    ring.endRead();
+    EXPECT_NE(ring.beginWrite(), nullptr);
+    EXPECT_EQ(*ring.beginRead(), 2);
+    ring.endRead();
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(SPSCRingTest, SlotsAreReused)
+{
+    SPSCRing<std::vector<int>> ring(4);
+    for (size_t i = 0; i < ring.capacity(); i++)
+        ring.getSlot(i).reserve(16);
+
+    for (int i = 0; i < 10; i++) {
+        auto *slot = ring.beginWrite();
+        ASSERT_NE(slot, nullptr);
+        EXPECT_GE(slot->capacity(), 16u);
+        slot->assign(3, i);
+        ring.endWrite();
+        EXPECT_EQ(ring.beginRead(), slot);
+        ring.endRead();
+    }
+}
+
+TEST(SPSCRingTest, ProducerAndConsumerThread)
+{
+    const int count = 100000;
+    SPSCRing<int> ring(8);
+
+    std::thread producer([&ring]() {
+        for (int i = 0; i < count;) {
+            int *slot = ring.beginWrite();
+            if (!slot) {
+                std::this_thread::yield();
+                continue;
+            }
+            *slot = i++;
+            ring.endWrite();
+        }
+    });
+
+    for (int expected = 0; expected < count;) {
+        int *slot = ring.beginRead();
+        if (!slot) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(*slot, expected++);
+        ring.endRead();
+    }
+    producer.join();
+    EXPECT_TRUE(ring.empty());
+}
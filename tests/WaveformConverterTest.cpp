@@ -0,0 +1,71 @@
+#include <gtest/gtest.h> // google test
+#include "WaveformConverter.h"
+
+#include <random>
+#include <vector>
+
+TEST(WaveformConverterTest, ParsePreamble)
+{
+    WaveformPreamble preamble;
+    ASSERT_TRUE(WaveformPreamble::parse("+0,+0,+1000,+1,+1.0e-06,-5.0e-04,+0,+1.0e-02,+1.5e-01,+128\n", &preamble));
+    EXPECT_EQ(preamble.format, 0);
+    EXPECT_EQ(preamble.points, 1000);
+    EXPECT_DOUBLE_EQ(preamble.xIncrement, 1e-6);
+    EXPECT_DOUBLE_EQ(preamble.yOrigin, 0.15);
+    EXPECT_DOUBLE_EQ(preamble.yReference, 128);
+    EXPECT_DOUBLE_EQ(preamble.getTime(500), 0);
+
+    EXPECT_FALSE(WaveformPreamble::parse("0,0,1000", &preamble));
+}
+
+TEST(WaveformConverterTest, VectorizedMatchesScalar)
+{
+    WaveformPreamble preamble;
+    preamble.yIncrement = 0.01;
+    preamble.yOrigin = 0.5;
+    preamble.yReference = 128;
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    // An odd number of samples also covers the scalar tail of the vectorized kernels.
+    const size_t count = 1003;
+    std::vector<uint8_t> samples(2 * count);
+    for (auto &sample: samples)
+        sample = distribution(generator) < 16 ? 0 : static_cast<uint8_t>(distribution(generator));
+
+    for (auto format: {WaveformConverter::BYTE_SAMPLES, WaveformConverter::WORD_BIG_ENDIAN_SAMPLES,
+                       WaveformConverter::WORD_LITTLE_ENDIAN_SAMPLES}) {
+        std::vector<double> expected(count), actual(count);
+        std::vector<float> actualFloat(count);
+        std::vector<uint8_t> expectedMask(WaveformConverter::getMaskSize(count));
+        std::vector<uint8_t> actualMask(expectedMask.size()), actualFloatMask(expectedMask.size());
+
+        WaveformConverter::convertScalar(samples.data(), count, format, preamble, expected.data(),
+                                         expectedMask.data());
+        WaveformConverter::convert(samples.data(), count, format, preamble, actual.data(), actualMask.data());
+        WaveformConverter::convert(samples.data(), count, format, preamble, actualFloat.data(),
+                                   actualFloatMask.data());
+
+        EXPECT_EQ(expectedMask, actualMask);
+        EXPECT_EQ(expectedMask, actualFloatMask);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_NEAR(expected[i], actual[i], 1e-9);
+            EXPECT_NEAR(expected[i], actualFloat[i], 1e-2);
+        }
+    }
+}
+
+TEST(WaveformConverterTest, HolesAreMarkedInvalid)
+{
+    WaveformPreamble preamble;
+    preamble.yIncrement = 1;
+    std::vector<uint8_t> samples = {0, 1, 2, 0, 4, 5, 6, 7, 0, 9};
+    std::vector<double> voltages(samples.size());
+    std::vector<uint8_t> mask(WaveformConverter::getMaskSize(samples.size()));
+
+    WaveformConverter::convert(samples.data(), samples.size(), WaveformConverter::BYTE_SAMPLES, preamble,
+                               voltages.data(), mask.data());
+    for (size_t i = 0; i < samples.size(); i++)
+        EXPECT_EQ(WaveformConverter::isValid(mask.data(), i), samples[i] != 0);
+    EXPECT_DOUBLE_EQ(voltages[9], 9);
+}